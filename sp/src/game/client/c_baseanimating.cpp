@@ -47,6 +47,7 @@
 #include "jigglebones.h"
 #include "toolframework_client.h"
 #include "vstdlib/jobthread.h"
+#include "tier1/taskpool.h"
 #include "bonetoworldarray.h"
 #include "posedebugger.h"
 #include "tier0/icommandline.h"
@@ -2736,7 +2737,7 @@ void C_BaseAnimating::ThreadedBoneSetup()
 		{
 			g_bInThreadedBoneSetup = true;
 
-			ParallelProcess( "C_BaseAnimating::ThreadedBoneSetup", g_PreviousBoneSetups.Base(), nCount, &SetupBonesOnBaseAnimating, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
+			g_TaskPool.ParallelProcess( g_PreviousBoneSetups.Base(), nCount, &SetupBonesOnBaseAnimating, &PreThreadedBoneSetup, &PostThreadedBoneSetup );
 
 			g_bInThreadedBoneSetup = false;
 		}
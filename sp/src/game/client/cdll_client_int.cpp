@@ -971,6 +971,9 @@ int CHLClient::Init( CreateInterfaceFn appSystemFactory, CreateInterfaceFn physi
 		}
 	}
 
+	// Pre-parsed copies of script files, see KeyValues::LoadFromFile()
+	KeyValues::SetBinaryCacheEnabled( !CommandLine()->CheckParm( "-nokvcache" ) );
+
 #ifdef WORKSHOP_IMPORT_ENABLED
 	if ( !ConnectDataModel( appSystemFactory ) )
 		return false;
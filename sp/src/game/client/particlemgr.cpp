@@ -23,6 +23,7 @@
 #include "tier1/utlintrusivelist.h"
 #include "particles_new.h"
 #include "vstdlib/jobthread.h"
+#include "tier1/taskpool.h"
 #include "filesystem.h"
 #include "particle_parse.h"
 #include "model_types.h"
@@ -1853,7 +1854,7 @@ void CParticleMgr::UpdateNewEffects( float flTimeDelta )
 			int nAltCore = IsX360() && particle_sim_alt_cores.GetInt();
 			if ( !m_pThreadPool[1] || nAltCore == 0 )
 			{
-				ParallelProcess( "CParticleMgr::UpdateNewEffects", particlesToSimulate.Base(), nCount, ProcessPSystem );
+				g_TaskPool.ParallelProcess( particlesToSimulate.Base(), nCount, ProcessPSystem );
 			}
 			else
 			{
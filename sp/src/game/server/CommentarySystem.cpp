@@ -597,7 +597,7 @@ public:
 
 		// Spawn the commentary semaphore entity
 		CBaseEntity *pSemaphore = CreateEntityByName( "info_target" );
-		pSemaphore->SetName( MAKE_STRING(COMMENTARY_SPAWNED_SEMAPHORE) );
+		pSemaphore->SetName( AllocPooledString(COMMENTARY_SPAWNED_SEMAPHORE) );
 
 		bool oldLock = engine->LockNetworkStringTables( false );
 
@@ -3605,28 +3605,10 @@ void CAI_BaseNPC::UpdateEfficiency(bool bInPVS)
 
 	if (GetSoundInterests() & SOUND_DANGER)
 	{
-		int	iSound = CSoundEnt::ActiveList();
+		CSoundEnt::SoundList_t sounds;
+		CSoundEnt::GetSoundsInRange(SOUND_DANGER, EarPosition(), HearingSensitivity(), &sounds);
 
-		while (iSound != SOUNDLIST_EMPTY)
-		{
-			CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex(iSound);
-
-			float hearingSensitivity = HearingSensitivity();
-			Vector vEarPosition = EarPosition();
-
-			if (pCurrentSound && (SOUND_DANGER & pCurrentSound->SoundType()))
-			{
-				float flHearDistanceSq = pCurrentSound->Volume() * hearingSensitivity;
-				flHearDistanceSq *= flHearDistanceSq;
-				if (pCurrentSound->GetSoundOrigin().DistToSqr(vEarPosition) <= flHearDistanceSq)
-				{
-					bPotentialDanger = true;
-					break;
-				}
-			}
-
-			iSound = pCurrentSound->NextSound();
-		}
+		bPotentialDanger = (sounds.Count() > 0);
 	}
 
 	if (bPotentialDanger)
@@ -4322,6 +4304,9 @@ void CAI_BaseNPC::NPCThink(void)
 
 	//---------------------------------
 
+	// Routes built and torn down during this think recycle this NPC's waypoints
+	CAI_WaypointCacheScope waypointCacheScope(GetNavigator() ? GetNavigator()->GetPath()->GetWaypointCache() : NULL);
+
 	bool bInPVS = CheckPVSCondition();
 
 	//---------------------------------
@@ -949,6 +949,7 @@ public:
 	void				SetMoveEfficiency( AI_MoveEfficiency_t efficiency )	{ m_MoveEfficiency = efficiency; }
 	virtual void		UpdateEfficiency( bool bInPVS );
 	void				ForceDecisionThink()						{ m_flNextDecisionTime = 0; SetEfficiency( AIE_NORMAL ); }
+	float				GetNextDecisionTime() const					{ return m_flNextDecisionTime; }
 
 	bool				IsFlaggedEfficient() const					{ return HasSpawnFlags( SF_NPC_START_EFFICIENT ); }
 
@@ -1432,6 +1433,8 @@ public:
 	
 	// NPCs can override this to tweak with how costly particular movements are
 	virtual	bool		MovementCost( int moveType, const Vector &vecStart, const Vector &vecEnd, float *pCost );
+	// Return true if MovementCost() is overridden, such NPCs can't share routes with others
+	virtual bool		HasCustomMovementCost() const	{ return false; }
 
 	// Turns a directional vector into a yaw value that points down that vector.
 	float				VecToYaw( const Vector &vecDir );
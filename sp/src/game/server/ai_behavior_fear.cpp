@@ -306,7 +306,8 @@ bool CAI_FearBehavior::CanSelectSchedule()
 	}
 #endif
 
-	if( !pEnemy->ClassMatches("npc_hunter") )
+	static CHashedPooledString s_Hunter( "npc_hunter" );
+	if( !pEnemy->ClassMatches( s_Hunter ) )
 		return false;
 
 	return true;
@@ -15,6 +15,7 @@
 #include "ai_link.h"
 #include "ai_network.h"
 #include "ai_networkmanager.h"
+#include "ai_flowfield.h"
 #ifdef MAPBASE
 #include "ai_hint.h"
 #include "ai_basenpc.h"
@@ -632,6 +633,9 @@ void CAI_DynamicLink::SetLinkState(void)
 		return;
 	}
 
+	// Shared route fields were built around the old link state
+	g_AIFlowFieldManager.Invalidate();
+
 	// ------------------------------------------------------------------
 	// Now update the node links...
 	//  Nodes share links so we only have to find the node from the src 
@@ -0,0 +1,278 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Shared node routes toward common goals.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "ai_flowfield.h"
+#include "ai_network.h"
+#include "ai_node.h"
+#include "ai_link.h"
+#include "utlpriorityqueue.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar ai_flowfield( "ai_flowfield", "1", 0, "Share node routes between NPCs heading to the same goal node" );
+ConVar ai_flowfield_min_requests( "ai_flowfield_min_requests", "3", 0, "Number of route requests for a goal within 2 seconds before a shared field is built for it" );
+ConVar ai_flowfield_lifetime( "ai_flowfield_lifetime", "5", 0, "Seconds a shared field is kept before it is rebuilt" );
+
+#define AI_MAX_FLOW_FIELDS		16
+#define AI_FLOW_REQUEST_WINDOW	2.0f
+
+CAI_FlowFieldManager g_AIFlowFieldManager;
+
+//-----------------------------------------------------------------------------
+
+struct FlowFieldOpen_t
+{
+	int		iNode;
+	float	flCost;
+};
+
+static bool FlowFieldOpenLess( const FlowFieldOpen_t &lhs, const FlowFieldOpen_t &rhs )
+{
+	// Cheapest at the head of the queue
+	return ( lhs.flCost > rhs.flCost );
+}
+
+//-----------------------------------------------------------------------------
+
+CAI_FlowFieldManager::CAI_FlowFieldManager()
+ :	CAutoGameSystem( "CAI_FlowFieldManager" )
+{
+	m_iGeneration = 0;
+	m_nLookups = m_nBuilt = m_nNodesVisited = m_nRoutes = m_nFallbacks = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_FlowFieldManager::LevelShutdownPostEntity()
+{
+	Purge();
+}
+
+void CAI_FlowFieldManager::Purge()
+{
+	m_Fields.PurgeAndDeleteElements();
+	m_iGeneration++;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds or tracks a field toward iGoalNode. Fields are only worth
+//			building when several NPCs want the same goal, so the first few
+//			requests just count toward that.
+//-----------------------------------------------------------------------------
+const AI_FlowField_t *CAI_FlowFieldManager::GetField( CAI_Network *pNetwork, int iGoalNode, Hull_t hull, int moveCaps )
+{
+	if ( !ai_flowfield.GetBool() || !pNetwork || iGoalNode < 0 || iGoalNode >= pNetwork->NumNodes() )
+		return NULL;
+
+	m_nLookups++;
+
+	AI_FlowField_t *pField = NULL;
+	int iOldest = -1;
+
+	for ( int i = 0; i < m_Fields.Count(); i++ )
+	{
+		AI_FlowField_t *pCandidate = m_Fields[i];
+		if ( pCandidate->pNetwork == pNetwork && pCandidate->iGoalNode == iGoalNode && pCandidate->hull == hull && pCandidate->moveCaps == moveCaps )
+		{
+			pField = pCandidate;
+			break;
+		}
+
+		if ( iOldest == -1 || pCandidate->flLastUsed < m_Fields[iOldest]->flLastUsed )
+			iOldest = i;
+	}
+
+	if ( !pField )
+	{
+		if ( m_Fields.Count() < AI_MAX_FLOW_FIELDS )
+		{
+			pField = new AI_FlowField_t;
+			m_Fields.AddToTail( pField );
+		}
+		else
+		{
+			pField = m_Fields[iOldest];
+		}
+
+		pField->pNetwork = pNetwork;
+		pField->iGoalNode = iGoalNode;
+		pField->hull = hull;
+		pField->moveCaps = moveCaps;
+		pField->bBuilt = false;
+		pField->nRequests = 0;
+		pField->flFirstRequest = gpGlobals->curtime;
+	}
+
+	pField->flLastUsed = gpGlobals->curtime;
+
+	if ( pField->bBuilt )
+	{
+		if ( pField->iGeneration != m_iGeneration ||
+			 pField->nextNode.Count() != pNetwork->NumNodes() ||
+			 gpGlobals->curtime < pField->flBuildTime ||
+			 gpGlobals->curtime - pField->flBuildTime > ai_flowfield_lifetime.GetFloat() )
+		{
+			pField->bBuilt = false;
+			pField->nRequests = 0;
+			pField->flFirstRequest = gpGlobals->curtime;
+		}
+	}
+
+	if ( !pField->bBuilt )
+	{
+		if ( gpGlobals->curtime - pField->flFirstRequest > AI_FLOW_REQUEST_WINDOW || gpGlobals->curtime < pField->flFirstRequest )
+		{
+			pField->nRequests = 0;
+			pField->flFirstRequest = gpGlobals->curtime;
+		}
+
+		if ( ++pField->nRequests < ai_flowfield_min_requests.GetInt() )
+			return NULL;
+
+		Build( pField );
+	}
+
+	return pField;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reverse Dijkstra from the goal. Only links any NPC with these
+//			capabilities could use are followed, and costs match the default
+//			CAI_Navigator::MovementCost(). Per-NPC restrictions are checked
+//			as each NPC follows the field. Off links are skipped, but the ones
+//			a dynamic link might open to some NPCs are listed so those NPCs
+//			can search for themselves.
+//-----------------------------------------------------------------------------
+void CAI_FlowFieldManager::Build( AI_FlowField_t *pField )
+{
+	CAI_Network *pNetwork = pField->pNetwork;
+	int nNodes = pNetwork->NumNodes();
+	CAI_Node **pAInode = pNetwork->AccessNodes();
+	Hull_t hull = pField->hull;
+
+	pField->nextNode.SetCount( nNodes );
+	pField->cost.SetCount( nNodes );
+	pField->dynamicLinks.RemoveAll();
+
+	for ( int i = 0; i < nNodes; i++ )
+	{
+		pField->nextNode[i] = NO_NODE;
+		pField->cost[i] = FLT_MAX;
+	}
+
+	CUtlPriorityQueue<FlowFieldOpen_t> openList( 0, 64, FlowFieldOpenLess );
+
+	FlowFieldOpen_t start = { pField->iGoalNode, 0 };
+	pField->cost[pField->iGoalNode] = 0;
+	openList.Insert( start );
+
+	while ( openList.Count() )
+	{
+		FlowFieldOpen_t current = openList.ElementAtHead();
+		openList.RemoveAtHead();
+
+		// Stale entry, a cheaper route to this node was already expanded
+		if ( current.flCost > pField->cost[current.iNode] )
+			continue;
+
+		m_nNodesVisited++;
+
+		CAI_Node *pNode = pAInode[current.iNode];
+		const Vector &vecNode = pNode->GetPosition( hull );
+
+		for ( int link = 0; link < pNode->NumLinks(); link++ )
+		{
+			CAI_Link *pLink = pNode->GetLinkByIndex( link );
+
+			int moveType = pLink->m_iAcceptedMoveTypes[hull] & pField->moveCaps;
+			if ( !moveType )
+				continue;
+
+			if ( pLink->m_LinkInfo & bits_LINK_OFF )
+			{
+				if ( pLink->m_pDynamicLink )
+				{
+					AddDynamicLink( pField, pLink );
+				}
+				continue;
+			}
+
+			int iFrom = pLink->DestNodeID( current.iNode );
+
+			float flCost = ( pAInode[iFrom]->GetPosition( hull ) - vecNode ).Length();
+			if ( moveType == bits_CAP_MOVE_JUMP || moveType == bits_CAP_MOVE_CLIMB )
+			{
+				flCost *= 2.0;
+			}
+
+			flCost += current.flCost;
+			if ( flCost < pField->cost[iFrom] )
+			{
+				pField->cost[iFrom] = flCost;
+				pField->nextNode[iFrom] = current.iNode;
+
+				FlowFieldOpen_t open = { iFrom, flCost };
+				openList.Insert( open );
+			}
+		}
+	}
+
+	pField->bBuilt = true;
+	pField->iGeneration = m_iGeneration;
+	pField->flBuildTime = gpGlobals->curtime;
+	m_nBuilt++;
+}
+
+//-----------------------------------------------------------------------------
+// Both ends of a link are expanded, so it can come up twice
+//-----------------------------------------------------------------------------
+void CAI_FlowFieldManager::AddDynamicLink( AI_FlowField_t *pField, CAI_Link *pLink )
+{
+	for ( int i = 0; i < pField->dynamicLinks.Count(); i += 2 )
+	{
+		if ( pField->dynamicLinks[i] == pLink->m_iSrcID && pField->dynamicLinks[i + 1] == pLink->m_iDestID )
+			return;
+	}
+
+	pField->dynamicLinks.AddToTail( pLink->m_iSrcID );
+	pField->dynamicLinks.AddToTail( pLink->m_iDestID );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_FlowFieldManager::NoteFieldRoute( bool bSucceeded )
+{
+	if ( bSucceeded )
+		m_nRoutes++;
+	else
+		m_nFallbacks++;
+}
+
+void CAI_FlowFieldManager::ReportStats()
+{
+	int nBuilt = 0;
+	for ( int i = 0; i < m_Fields.Count(); i++ )
+	{
+		if ( m_Fields[i]->bBuilt )
+			nBuilt++;
+	}
+
+	Msg( "Flow fields: %d tracked, %d built\n", m_Fields.Count(), nBuilt );
+	Msg( "Lookups: %d, fields built: %d (%d nodes visited), routes from fields: %d, fell back to A*: %d\n",
+		m_nLookups, m_nBuilt, m_nNodesVisited, m_nRoutes, m_nFallbacks );
+
+	m_nLookups = m_nBuilt = m_nNodesVisited = m_nRoutes = m_nFallbacks = 0;
+}
+
+CON_COMMAND( ai_flowfield_stats, "Reports shared route field usage since the last report" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_AIFlowFieldManager.ReportStats();
+}
@@ -0,0 +1,85 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Shared node routes toward common goals. When several NPCs path
+//			to the same node, one reverse search from that node gives every
+//			one of them the next hop home instead of each running its own A*.
+//
+//=============================================================================//
+
+#ifndef AI_FLOWFIELD_H
+#define AI_FLOWFIELD_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "ai_hull.h"
+#include "utlvector.h"
+
+class CAI_Network;
+class CAI_Link;
+
+//-----------------------------------------------------------------------------
+// Next hop and remaining cost from every node to one goal node, for one hull
+// and set of movement capabilities.
+//-----------------------------------------------------------------------------
+struct AI_FlowField_t
+{
+	CAI_Network *		pNetwork;
+	int					iGoalNode;
+	Hull_t				hull;
+	int					moveCaps;
+
+	CUtlVector<int>		nextNode;			// NO_NODE if the goal can't be reached
+	CUtlVector<float>	cost;
+
+	// Links that were off but have a dynamic link, which may still let some
+	// NPCs through. As node pairs: source, then destination.
+	CUtlVector<int>		dynamicLinks;
+
+	bool				bBuilt;
+	unsigned			iGeneration;
+	float				flBuildTime;
+	float				flLastUsed;
+
+	// Demand tracking, fields are only built for goals several NPCs want
+	int					nRequests;
+	float				flFirstRequest;
+};
+
+//-----------------------------------------------------------------------------
+
+class CAI_FlowFieldManager : public CAutoGameSystem
+{
+public:
+	CAI_FlowFieldManager();
+
+	// Returns a field toward iGoalNode once enough NPCs have asked for one, otherwise NULL
+	const AI_FlowField_t *	GetField( CAI_Network *pNetwork, int iGoalNode, Hull_t hull, int moveCaps );
+
+	// Call when links change state, fields no longer hold
+	void					Invalidate()	{ m_iGeneration++; }
+
+	void					NoteFieldRoute( bool bSucceeded );
+	void					ReportStats();
+
+	virtual void			LevelShutdownPostEntity();
+
+private:
+	void					Build( AI_FlowField_t *pField );
+	void					AddDynamicLink( AI_FlowField_t *pField, CAI_Link *pLink );
+	void					Purge();
+
+	CUtlVector<AI_FlowField_t *> m_Fields;
+	unsigned				m_iGeneration;
+
+	int						m_nLookups;
+	int						m_nBuilt;
+	int						m_nNodesVisited;
+	int						m_nRoutes;
+	int						m_nFallbacks;
+};
+
+extern CAI_FlowFieldManager g_AIFlowFieldManager;
+
+#endif // AI_FLOWFIELD_H
@@ -16,6 +16,7 @@
 #include "ai_routedist.h"
 #include "props.h"
 #include "vphysics/object_hash.h"
+#include "tier1/generichash.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -64,10 +65,185 @@ CON_COMMAND( ai_set_move_height_epsilon, "Set how high AI bumps up ground walker
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Move probe result cache
+//
+// Route building, triangulation, stale route checks and local avoidance probe
+// the same short segments many times per think. MoveLimit() results are kept
+// per hull for a short time:
+//
+// Results are only reused by the NPC that stored them, since the nav trace
+// filter depends on the NPC (ignored brushes, collision pairs, per-class
+// collision rules):
+//
+// - Probes whose mask includes NPCs are only reused within the same tick,
+//   since NPCs move every tick.
+// - Brush-only probes are reused for a short time, unless their traces came
+//   across any entity other than the world. Brush-only masks still hit
+//   physics props and brush movers, and those don't invalidate the cache.
+//-----------------------------------------------------------------------------
+
+ConVar	ai_moveprobe_cache( "ai_moveprobe_cache", "1", 0, "Reuse recent move probe results" );
+ConVar	ai_moveprobe_cache_time( "ai_moveprobe_cache_time", "0.2", 0, "How long brush-only move probe results are reused, in seconds" );
+
+#define MOVEPROBE_CACHE_SIZE		256		// entries per hull, must be a power of two
+#define MOVEPROBE_CACHE_QUANTIZE	8.0f	// positions match to 1/8 unit
+
+struct MoveProbeCacheKey_t
+{
+	int			start[3];
+	int			end[3];
+	int			navType;
+	unsigned	collisionMask;
+	unsigned	flags;
+	int			pctToCheckStandPositions;
+	int			hTarget;
+	int			collisionGroup;
+	int			hProber;
+};
+
+struct MoveProbeCacheEntry_t
+{
+	MoveProbeCacheKey_t	key;
+	AIMoveTrace_t		result;
+	EHANDLE				hObstruction;
+	float				flStoreTime;
+	int					iTick;			// tick the result is limited to, or -1
+	unsigned			iGeneration;
+	bool				bValid;
+};
+
+class CAI_MoveProbeCache
+{
+public:
+	CAI_MoveProbeCache()
+	{
+		memset( m_pEntries, 0, sizeof(m_pEntries) );
+		m_iGeneration = 0;
+		ResetStats();
+	}
+
+	~CAI_MoveProbeCache()
+	{
+		for ( int i = 0; i < NUM_HULLS; i++ )
+		{
+			delete [] m_pEntries[i];
+		}
+	}
+
+	MoveProbeCacheEntry_t *GetSlot( Hull_t hull, const MoveProbeCacheKey_t &key )
+	{
+		if ( hull < 0 || hull >= NUM_HULLS )
+			return NULL;
+
+		if ( !m_pEntries[hull] )
+		{
+			m_pEntries[hull] = new MoveProbeCacheEntry_t[MOVEPROBE_CACHE_SIZE];
+			for ( int i = 0; i < MOVEPROBE_CACHE_SIZE; i++ )
+			{
+				m_pEntries[hull][i].bValid = false;
+			}
+		}
+
+		return &m_pEntries[hull][ HashBlock( &key, sizeof(key) ) & ( MOVEPROBE_CACHE_SIZE - 1 ) ];
+	}
+
+	bool Lookup( MoveProbeCacheEntry_t *pEntry, const MoveProbeCacheKey_t &key, AIMoveTrace_t *pResult )
+	{
+		if ( !pEntry->bValid || memcmp( &pEntry->key, &key, sizeof(key) ) != 0 || pEntry->iGeneration != m_iGeneration )
+		{
+			m_nMisses++;
+			return false;
+		}
+
+		if ( pEntry->iTick != -1 )
+		{
+			if ( pEntry->iTick != gpGlobals->tickcount )
+			{
+				m_nMisses++;
+				return false;
+			}
+		}
+		else if ( gpGlobals->curtime < pEntry->flStoreTime || gpGlobals->curtime >= pEntry->flStoreTime + ai_moveprobe_cache_time.GetFloat() )
+		{
+			m_nMisses++;
+			return false;
+		}
+
+		// The obstruction may have gone away since
+		if ( pEntry->result.pObstruction && pEntry->hObstruction.Get() != pEntry->result.pObstruction )
+		{
+			pEntry->bValid = false;
+			m_nMisses++;
+			return false;
+		}
+
+		*pResult = pEntry->result;
+		m_nHits++;
+		return true;
+	}
+
+	void Store( MoveProbeCacheEntry_t *pEntry, const MoveProbeCacheKey_t &key, const AIMoveTrace_t &result, bool bTickOnly )
+	{
+		pEntry->key = key;
+		pEntry->result = result;
+		pEntry->hObstruction = result.pObstruction;
+		pEntry->flStoreTime = gpGlobals->curtime;
+		pEntry->iTick = ( bTickOnly ) ? gpGlobals->tickcount : -1;
+		pEntry->iGeneration = m_iGeneration;
+		pEntry->bValid = true;
+		m_nStores++;
+	}
+
+	void Invalidate()
+	{
+		m_iGeneration++;
+		m_nInvalidations++;
+	}
+
+	void ReportStats()
+	{
+		int nLookups = m_nHits + m_nMisses;
+		Msg( "Move probe cache: %d lookups, %d hits (%.1f%%), %d misses, %d stored, %d invalidations\n",
+			nLookups, m_nHits, ( nLookups ) ? 100.0f * m_nHits / nLookups : 0.0f, m_nMisses, m_nStores, m_nInvalidations );
+		ResetStats();
+	}
+
+private:
+	void ResetStats()
+	{
+		m_nHits = m_nMisses = m_nStores = m_nInvalidations = 0;
+	}
+
+	MoveProbeCacheEntry_t *m_pEntries[NUM_HULLS];
+	unsigned	m_iGeneration;
+
+	int			m_nHits;
+	int			m_nMisses;
+	int			m_nStores;
+	int			m_nInvalidations;
+};
+
+static CAI_MoveProbeCache g_MoveProbeCache;
+
+void CAI_MoveProbe::InvalidateCache()
+{
+	g_MoveProbeCache.Invalidate();
+}
+
+CON_COMMAND( ai_moveprobe_cache_stats, "Reports move probe cache hits and misses since the last report" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_MoveProbeCache.ReportStats();
+}
+
 //-----------------------------------------------------------------------------
 
 BEGIN_SIMPLE_DATADESC(CAI_MoveProbe)
 	//					m_pTraceListData (not saved, a cached item)
+	//					m_bTracedEntity (not saved, only used during a probe)
 	DEFINE_FIELD( m_bIgnoreTransientEntities,		FIELD_BOOLEAN ),
 	DEFINE_FIELD( m_hLastBlockingEnt,				FIELD_EHANDLE ),
 
@@ -113,6 +289,35 @@ bool CAI_MoveProbe::ShouldBrushBeIgnored( CBaseEntity *pEntity )
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Nav filter that notes whether a probe's traces came across any
+//			entity, hit or not, so the result isn't reused after it moves.
+//-----------------------------------------------------------------------------
+class CTraceFilterMoveProbe : public CTraceFilterNav
+{
+public:
+	CTraceFilterMoveProbe( const CAI_MoveProbe *pProbe, int collisionGroup ) :
+		CTraceFilterNav( const_cast<CAI_BaseNPC *>( pProbe->GetOuter() ), pProbe->m_bIgnoreTransientEntities, pProbe->GetOuter(), collisionGroup ),
+		m_pProbe( pProbe )
+	{
+	}
+
+	bool ShouldHitEntity( IHandleEntity *pHandleEntity, int contentsMask )
+	{
+		// Static props don't have an entity and can't move
+		CBaseEntity *pEntity = EntityFromEntityHandle( pHandleEntity );
+		if ( pEntity && !pEntity->IsWorld() )
+		{
+			m_pProbe->m_bTracedEntity = true;
+		}
+
+		return CTraceFilterNav::ShouldHitEntity( pHandleEntity, contentsMask );
+	}
+
+private:
+	const CAI_MoveProbe *m_pProbe;
+};
+
 //-----------------------------------------------------------------------------
 
 void CAI_MoveProbe::TraceLine( const Vector &vecStart, const Vector &vecEnd, unsigned int mask, 
@@ -122,7 +327,7 @@ void CAI_MoveProbe::TraceLine( const Vector &vecStart, const Vector &vecEnd, uns
 							GetCollisionGroup() : 
 							COLLISION_GROUP_NONE;
 
-	CTraceFilterNav traceFilter( const_cast<CAI_BaseNPC *>(GetOuter()), m_bIgnoreTransientEntities, GetOuter(), collisionGroup );
+	CTraceFilterMoveProbe traceFilter( this, collisionGroup );
 
 	AI_TraceLine( vecStart, vecEnd, mask, &traceFilter, pResult );
 
@@ -140,6 +345,7 @@ void CAI_MoveProbe::TraceLine( const Vector &vecStart, const Vector &vecEnd, uns
 CAI_MoveProbe::CAI_MoveProbe(CAI_BaseNPC *pOuter)
  : 	CAI_Component( pOuter ),
 	m_bIgnoreTransientEntities( false ),
+	m_bTracedEntity( false ),
 	m_pTraceListData( NULL )
 {
 }
@@ -159,7 +365,7 @@ void CAI_MoveProbe::TraceHull(
 {
 	AI_PROFILE_SCOPE( CAI_MoveProbe_TraceHull );
 
-	CTraceFilterNav traceFilter( const_cast<CAI_BaseNPC *>(GetOuter()), m_bIgnoreTransientEntities, GetOuter(), GetCollisionGroup() );
+	CTraceFilterMoveProbe traceFilter( this, GetCollisionGroup() );
 
 	Ray_t ray;
 	ray.Init( vecStart, vecEnd, hullMin, hullMax );
@@ -1018,6 +1224,43 @@ bool CAI_MoveProbe::MoveLimit( Navigation_t navType, const Vector &vecStart,
 	if ( !pTrace )
 		pTrace = &ignoredTrace;
 
+	// Jumps and climbs depend on more of the NPC than the key holds, and
+	// quick rejects trace from the eyes
+	MoveProbeCacheEntry_t *pCacheEntry = NULL;
+	MoveProbeCacheKey_t cacheKey;
+	bool bTickOnly = ( ( collisionMask & CONTENTS_MONSTER ) != 0 );
+
+	if ( ai_moveprobe_cache.GetBool() && 
+		 ( navType == NAV_GROUND || navType == NAV_FLY ) && 
+		 !( flags & ( AIMLF_DRAW_RESULTS | AIMLF_QUICK_REJECT ) ) &&
+		 !( ai_moveprobe_debug.GetBool() && (GetOuter()->m_debugOverlays & OVERLAY_NPC_SELECTED_BIT) ) )
+	{
+		memset( &cacheKey, 0, sizeof(cacheKey) );
+		for ( int i = 0; i < 3; i++ )
+		{
+			cacheKey.start[i] = RoundFloatToInt( vecStart[i] * MOVEPROBE_CACHE_QUANTIZE );
+			cacheKey.end[i] = RoundFloatToInt( vecEnd[i] * MOVEPROBE_CACHE_QUANTIZE );
+		}
+		cacheKey.navType = navType;
+		cacheKey.collisionMask = collisionMask;
+		cacheKey.flags = flags;
+		cacheKey.pctToCheckStandPositions = RoundFloatToInt( pctToCheckStandPositions );
+		cacheKey.hTarget = ( pTarget ) ? pTarget->GetRefEHandle().ToInt() : 0;
+		cacheKey.collisionGroup = GetOuter()->GetCollisionGroup();
+		cacheKey.hProber = GetOuter()->GetRefEHandle().ToInt();
+
+		pCacheEntry = g_MoveProbeCache.GetSlot( GetOuter()->GetHullType(), cacheKey );
+		if ( pCacheEntry && g_MoveProbeCache.Lookup( pCacheEntry, cacheKey, pTrace ) )
+		{
+			if (IsMoveBlocked(pTrace->fStatus) && pTrace->pObstruction && !pTrace->pObstruction->IsWorld())
+			{
+				m_hLastBlockingEnt = pTrace->pObstruction;
+			}
+
+			return !IsMoveBlocked(pTrace->fStatus);
+		}
+	}
+
 	// Set a reasonable default set of values
 	pTrace->flTotalDist = ComputePathDistance( navType, vecStart, vecEnd );
 	pTrace->flDistObstructed = 0.0f;
@@ -1026,6 +1269,8 @@ bool CAI_MoveProbe::MoveLimit( Navigation_t navType, const Vector &vecStart,
 	pTrace->fStatus = AIMR_OK;
 	pTrace->vEndPosition = vecStart;
 
+	m_bTracedEntity = false;
+
 	switch (navType)
 	{
 	case NAV_GROUND:	
@@ -1087,6 +1332,11 @@ bool CAI_MoveProbe::MoveLimit( Navigation_t navType, const Vector &vecStart,
 	{
 		m_hLastBlockingEnt = pTrace->pObstruction;
 	}
+
+	if ( pCacheEntry && ( bTickOnly || !m_bTracedEntity ) )
+	{
+		g_MoveProbeCache.Store( pCacheEntry, cacheKey, *pTrace, bTickOnly );
+	}
 	
 	return !IsMoveBlocked(pTrace->fStatus);
 }
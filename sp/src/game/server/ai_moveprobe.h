@@ -82,6 +82,9 @@ public:
 	void				ClearBlockingEntity()	{ m_hLastBlockingEnt = NULL; }
 	CBaseEntity *		GetBlockingEntity()	{ return m_hLastBlockingEnt; }
 
+	// Call when a door or other blocker moves, cached MoveLimit() results may no longer hold
+	static void			InvalidateCache();
+
 private:
 	struct CheckStepArgs_t
 	{
@@ -129,11 +132,14 @@ private:
 	bool				CanStandOn( CBaseEntity *pSurface ) const;
 
 	bool				m_bIgnoreTransientEntities;
+	mutable bool		m_bTracedEntity;		// a probe trace considered something other than the world
 
 	CTraceListData *	m_pTraceListData;
 
 	EHANDLE				m_hLastBlockingEnt;
 
+	friend class CTraceFilterMoveProbe;
+
 	DECLARE_SIMPLE_DATADESC();
 };
 
@@ -24,6 +24,7 @@
 
 //@todo: bad dependency!
 #include "ai_navigator.h"
+#include "ai_flowfield.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -287,6 +288,19 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 	m_nPerfStatPB++;
 #endif
 
+	// NPCs heading to the same node share one search from that node
+	if ( !GetOuter()->HasCustomMovementCost() )
+	{
+		const AI_FlowField_t *pField = g_AIFlowFieldManager.GetField( GetNetwork(), endID, GetHullType(), CapabilitiesGet() & AI_MOVE_TYPE_BITS );
+		if ( pField )
+		{
+			AI_Waypoint_t *pRoute = FollowFlowField( pField, startID, endID );
+			g_AIFlowFieldManager.NoteFieldRoute( pRoute != NULL );
+			if ( pRoute )
+				return pRoute;
+		}
+	}
+
 	int nNodes = GetNetwork()->NumNodes();
 	CAI_Node **pAInode = GetNetwork()->AccessNodes();
 
@@ -369,6 +383,52 @@ AI_Waypoint_t *CAI_Pathfinder::FindBestPath(int startID, int endID)
 	return NULL;   
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Build a path between two nodes by following a shared field toward
+//			endID. Fails if any step isn't usable by this NPC, or if a link
+//			the field went around is open to it, in which case the caller runs
+//			its own search.
+//-----------------------------------------------------------------------------
+
+AI_Waypoint_t *CAI_Pathfinder::FollowFlowField( const AI_FlowField_t *pField, int startID, int endID )
+{
+	int nNodes = GetNetwork()->NumNodes();
+	CAI_Node **pAInode = GetNetwork()->AccessNodes();
+
+	if ( GetOuter()->IsUnusableNode( startID, pAInode[startID]->GetHint() ) )
+		return NULL;
+
+	for ( int i = 0; i < pField->dynamicLinks.Count(); i += 2 )
+	{
+		int iSrcID = pField->dynamicLinks[i];
+		int iDestID = pField->dynamicLinks[i + 1];
+
+		CAI_Link *pLink = pAInode[iSrcID]->GetLink( iDestID );
+		if ( pLink && ( IsLinkUsable( pLink, iSrcID ) || IsLinkUsable( pLink, iDestID ) ) )
+			return NULL;
+	}
+
+	int *nodeP = (int *)stackalloc( nNodes * sizeof(int) );		// Node parent
+	nodeP[startID] = NO_NODE;
+
+	int currentID = startID;
+	for ( int nSteps = 0; currentID != endID; nSteps++ )
+	{
+		int nextID = pField->nextNode[currentID];
+		if ( nextID == NO_NODE || nSteps >= nNodes )
+			return NULL;
+
+		CAI_Link *pLink = pAInode[currentID]->GetLink( nextID );
+		if ( !pLink || !IsLinkUsable( pLink, currentID ) )
+			return NULL;
+
+		nodeP[nextID] = currentID;
+		currentID = nextID;
+	}
+
+	return MakeRouteFromParents( nodeP, endID );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Find a short random path of at least pathLength distance.  If
 //			vDirection is given random path will expand in the given direction,
@@ -18,6 +18,7 @@
 struct AIMoveTrace_t;
 struct OverlayLine_t;
 struct AI_Waypoint_t;
+struct AI_FlowField_t;
 class CAI_Link;
 class CAI_Network;
 class CAI_Node;
@@ -117,6 +118,7 @@ private:
 	//---------------------------------
 	
 	AI_Waypoint_t*	MakeRouteFromParents(int *parentArray, int endID);
+	AI_Waypoint_t*	FollowFlowField( const AI_FlowField_t *pField, int startID, int endID );
 	AI_Waypoint_t*	CreateNodeWaypoint( Hull_t hullType, int nodeID, int nodeFlags = 0 );
 	
 	AI_Waypoint_t*	BuildRouteThroughPoints( Vector *vecPoints, int nNumPoints, int nDirection, int nStartIndex, int nEndIndex, Navigation_t navType, CBaseEntity *pTarget );
@@ -18,6 +18,7 @@
 
 BEGIN_SIMPLE_DATADESC(CAI_Path)
 	//					m_Waypoints	(reconsititute on load)
+	//					m_WaypointCache	(not saved)
 	DEFINE_FIELD( m_goalTolerance,	FIELD_FLOAT ),
 	DEFINE_CUSTOM_FIELD( m_activity,	ActivityDataOps() ),
 	DEFINE_FIELD( m_target,			FIELD_EHANDLE ),
@@ -137,6 +137,8 @@ public:
 		m_iLastNodeReached = NO_NODE;
 	}
 
+	CAI_WaypointCache *GetWaypointCache() { return &m_WaypointCache; }
+
 private:
 
 	// Computes the goal distance for each waypoint along the route
@@ -144,6 +146,7 @@ private:
 
 	//---------------------------------
 	CAI_WaypointList m_Waypoints;
+	CAI_WaypointCache m_WaypointCache;		// waypoints recycled between this NPC's routes
 
 	//---------------------------------
 	float		m_goalTolerance;			// How close do we need to get to the goal
@@ -12,7 +12,11 @@
 #include "soundent.h"
 #include "team.h"
 #include "ai_basenpc.h"
+#include "ai_network.h"
+#include "ai_networkmanager.h"
 #include "saverestore_utlvector.h"
+#include "datacache/imdlcache.h"
+#include "tier1/taskpool.h"
 
 #ifdef PORTAL
 	#include "portal_util_shared.h"
@@ -35,6 +39,8 @@ const float AI_EFFICIENT_NPC_SEARCH_TIME = .35;
 const float AI_HIGH_PRIORITY_SEARCH_TIME = 0.15;
 const float AI_MISC_SEARCH_TIME  = 0.45;
 
+ConVar ai_parallel_sensing( "ai_parallel_sensing", "0", 0, "Issue the sight traces of all NPCs due to think this frame in parallel, before entity think" );
+
 //-----------------------------------------------------------------------------
 
 CAI_SensedObjectsManager g_AI_SensedObjectsManager;
@@ -71,6 +77,8 @@ BEGIN_SIMPLE_DATADESC( CAI_Senses )
 	DEFINE_UTLVECTOR(m_SeenNPCs, 		FIELD_EHANDLE ),
 	DEFINE_UTLVECTOR(m_SeenMisc, 		FIELD_EHANDLE ),
 	//								m_SeenArrays		(not saved, rebuilt)
+	//								m_SightPrepass		(not saved, rebuilt every frame)
+	//								m_nSightPrepassTick	(not saved, rebuilt every frame)
 
 	// Could fold these three and above timer into one concept, but would invalidate savegames
 	DEFINE_FIELD( m_TimeLastLookHighPriority, 	FIELD_TIME	),
@@ -120,20 +128,21 @@ void CAI_Senses::Listen( void )
 	
 	if ( iSoundMask != SOUND_NONE && !(GetOuter()->HasSpawnFlags(SF_NPC_WAIT_TILL_SEEN)) )
 	{
-		int	iSound = CSoundEnt::ActiveList();
-		
-		while ( iSound != SOUNDLIST_EMPTY )
+		// Only sounds of interest within earshot come back, in active list order
+		CSoundEnt::SoundList_t sounds;
+		CSoundEnt::GetSoundsInRange( iSoundMask, GetOuter()->EarPosition(), GetOuter()->HearingSensitivity(), &sounds );
+
+		for ( int i = 0; i < sounds.Count(); i++ )
 		{
+			int iSound = sounds[i];
 			CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex( iSound );
 
-			if ( pCurrentSound	&& (iSoundMask & pCurrentSound->SoundType()) && CanHearSound( pCurrentSound ) )
+			if ( pCurrentSound && CanHearSound( pCurrentSound ) )
 			{
 	 			// the npc cares about this sound, and it's close enough to hear.
 				pCurrentSound->m_iNextAudible = m_iAudibleList;
 				m_iAudibleList = iSound;
 			}
-
-			iSound = pCurrentSound->NextSound();
 		}
 	}
 	
@@ -663,6 +672,258 @@ void CAI_Senses::PerformSensing( void )
 		Listen();
 }
 
+//-----------------------------------------------------------------------------
+// Two-phase AI frame
+//
+// With ai_parallel_sensing, the sight traces Look() is about to issue are
+// gathered for every NPC due to think this frame and traced in parallel before
+// any entity thinks. Everything with side effects (QuerySeeEntity, script hooks,
+// seen lists, conditions, schedules) still runs serially in NPCThink.
+//
+// The parallel traces only test world geometry, since entity trace filters
+// aren't thread safe and entities move during think. FVisible picks up a
+// precomputed trace only when the world blocked it with no entity or static
+// prop along the way, and looker, target, eye positions and mask all match.
+// Anything else is traced again in full on the main thread. Results are only
+// valid for the tick they were issued in.
+//-----------------------------------------------------------------------------
+
+bool CAI_Senses::BuildSightPrepass()
+{
+	m_SightPrepass.RemoveAll();
+	m_nSightPrepassTick = gpGlobals->tickcount;
+
+	if ( HasSensingFlags(SENSING_FLAGS_DONT_LOOK) )
+		return false;
+
+	int iDistance = m_LookDist;
+
+	// Look() won't search again this frame
+	if ( m_TimeLastLook == gpGlobals->curtime && m_LastLookDist == iDistance )
+		return false;
+
+	float distSq = ( iDistance * iDistance );
+	const Vector &origin = GetAbsOrigin();
+	Vector vecEyes = GetOuter()->EyePosition();
+
+	// Mirrors the search timers in LookForHighPriorityEntities(), LookForNPCs() and LookForObjects()
+	if ( gpGlobals->curtime - m_TimeLastLookHighPriority > AI_HIGH_PRIORITY_SEARCH_TIME )
+	{
+		for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+		{
+			CBaseEntity *pPlayer = UTIL_PlayerByIndex( i );
+
+			if ( pPlayer && origin.DistToSqr(pPlayer->GetAbsOrigin()) < distSq )
+			{
+				AddSightPrepass( pPlayer, vecEyes );
+			}
+		}
+	}
+
+	AI_Efficiency_t efficiency = GetOuter()->GetEfficiency();
+	float timeNPCs = ( efficiency < AIE_VERY_EFFICIENT ) ? AI_STANDARD_NPC_SEARCH_TIME : AI_EFFICIENT_NPC_SEARCH_TIME;
+	if ( gpGlobals->curtime - m_TimeLastLookNPCs > timeNPCs )
+	{
+		if ( efficiency < AIE_SUPER_EFFICIENT )
+		{
+			CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+
+			for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+			{
+				if ( ppAIs[i] != GetOuter() && ( ppAIs[i]->ShouldNotDistanceCull() || origin.DistToSqr(ppAIs[i]->GetAbsOrigin()) < distSq ) )
+				{
+					AddSightPrepass( ppAIs[i], vecEyes );
+				}
+			}
+		}
+		else
+		{
+			// Super efficient NPCs only recheck who they already see
+			for ( int i = 0; i < m_SeenNPCs.Count(); i++ )
+			{
+				if ( m_SeenNPCs[i].Get() != NULL )
+				{
+					AddSightPrepass( m_SeenNPCs[i], vecEyes );
+				}
+			}
+		}
+	}
+
+	if ( gpGlobals->curtime - m_TimeLastLookMisc > AI_MISC_SEARCH_TIME )
+	{
+		int iter;
+		CBaseEntity *pEnt = g_AI_SensedObjectsManager.GetFirst( &iter );
+		while ( pEnt )
+		{
+			if ( ( pEnt->GetFlags() & FL_OBJECT ) && origin.DistToSqr(pEnt->GetAbsOrigin()) < distSq )
+			{
+				AddSightPrepass( pEnt, vecEyes );
+			}
+			pEnt = g_AI_SensedObjectsManager.GetNext( &iter );
+		}
+	}
+
+	return ( m_SightPrepass.Count() != 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_Senses::AddSightPrepass( CBaseEntity *pSightEnt, const Vector &vecStart )
+{
+	// Only the cheap rejections happen here. Anything which can run script or
+	// change state is left to Look() in the think phase.
+	if ( pSightEnt == GetOuter() || !pSightEnt->IsAlive() || ( pSightEnt->GetFlags() & FL_NOTARGET ) )
+		return;
+
+	if ( !GetOuter()->FInViewCone( pSightEnt ) )
+		return;
+
+	int i = m_SightPrepass.AddToTail();
+	m_SightPrepass[i].hTarget = pSightEnt;
+	m_SightPrepass[i].vecStart = vecStart;
+	m_SightPrepass[i].vecEnd = pSightEnt->EyePosition();
+	m_SightPrepass[i].nMask = GetOuter()->GetLineOfSightMask( MASK_BLOCKLOS );
+	m_SightPrepass[i].flFraction = 1.0f;
+	m_SightPrepass[i].bStartSolid = false;
+	m_SightPrepass[i].bWorldBlocked = false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Skips every entity and static prop without calling into it, and
+//			notes whether the ray came across any besides the looker.
+//-----------------------------------------------------------------------------
+class CTraceFilterSightPrepass : public CTraceFilter
+{
+public:
+	CTraceFilterSightPrepass( const IHandleEntity *pLooker ) : m_pLooker( pLooker ), m_bTouchedEntity( false ) {}
+
+	virtual bool ShouldHitEntity( IHandleEntity *pHandleEntity, int contentsMask )
+	{
+		if ( pHandleEntity != m_pLooker )
+		{
+			m_bTouchedEntity = true;
+		}
+		return false;
+	}
+
+	const IHandleEntity *m_pLooker;
+	bool m_bTouchedEntity;
+};
+
+//-----------------------------------------------------------------------------
+// Runs on a worker thread. Only the engine trace and this NPC's prepass
+// records are touched, and all positions were resolved when the records were
+// built.
+//-----------------------------------------------------------------------------
+
+void CAI_Senses::RunSightPrepass()
+{
+	const IHandleEntity *pLooker = GetOuter();
+
+	for ( int i = 0; i < m_SightPrepass.Count(); i++ )
+	{
+		SightPrepass_t &sight = m_SightPrepass[i];
+
+		Ray_t ray;
+		ray.Init( sight.vecStart, sight.vecEnd );
+
+		CTraceFilterSightPrepass traceFilter( pLooker );
+		trace_t tr;
+		enginetrace->TraceRay( ray, sight.nMask, &traceFilter, &tr );
+
+		sight.flFraction = tr.fraction;
+		sight.bStartSolid = tr.startsolid;
+		sight.bWorldBlocked = ( tr.fraction != 1.0f || tr.startsolid ) && !traceFilter.m_bTouchedEntity;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+bool CAI_Senses::GetPrepassSightTrace( CBaseEntity *pTarget, const Vector &vecStart, const Vector &vecEnd, int traceMask, trace_t *ptr ) const
+{
+	if ( m_nSightPrepassTick != gpGlobals->tickcount || traceMask != MASK_BLOCKLOS )
+		return false;
+
+	for ( int i = 0; i < m_SightPrepass.Count(); i++ )
+	{
+		const SightPrepass_t &sight = m_SightPrepass[i];
+		if ( sight.hTarget == pTarget && sight.vecStart == vecStart && sight.vecEnd == vecEnd )
+		{
+			// A clear ray may have been crossed by something that moved since
+			if ( !sight.bWorldBlocked )
+				return false;
+
+			ptr->fraction = sight.flFraction;
+			ptr->startsolid = sight.bStartSolid;
+			ptr->m_pEnt = GetContainingEntity( INDEXENT(0) );
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+
+static void ProcessSightPrepass( CAI_Senses *&pSenses )
+{
+	pSenses->RunSightPrepass();
+}
+
+static void PreSightPrepass()
+{
+	mdlcache->BeginLock();
+}
+
+static void PostSightPrepass()
+{
+	mdlcache->EndLock();
+}
+
+void AI_UpdateSensingPrepass( void )
+{
+	if ( !ai_parallel_sensing.GetBool() || !g_pAINetworkManager || !g_pAINetworkManager->IsInitialized() )
+		return;
+
+	VPROF_BUDGET( "AI_UpdateSensingPrepass", VPROF_BUDGETGROUP_NPCS );
+
+	static CUtlVector<CAI_Senses *> workList;
+	workList.RemoveAll();
+
+	CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+	for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
+	{
+		CAI_BaseNPC *pNPC = ppAIs[i];
+		CAI_Senses *pSenses = pNPC->GetSenses();
+		if ( !pSenses )
+			continue;
+
+		// Same gating NPCThink() and GatherConditions() apply before sensing
+		int nextThinkTick = pNPC->GetNextThinkTick();
+		if ( nextThinkTick == TICK_NEVER_THINK || nextThinkTick > gpGlobals->tickcount )
+			continue;
+
+		if ( pNPC->GetEfficiency() >= AIE_DORMANT || pNPC->GetSleepState() != AISS_AWAKE || pNPC->IsFlaggedEfficient() )
+			continue;
+
+		if ( pNPC->GetNextDecisionTime() > gpGlobals->curtime )
+			continue;
+
+		if ( pNPC->m_NPCState == NPC_STATE_NONE || pNPC->m_NPCState == NPC_STATE_DEAD )
+			continue;
+
+		if ( !pNPC->HasCondition( COND_IN_PVS ) && !pNPC->ShouldAlwaysThink() && pNPC->m_NPCState != NPC_STATE_COMBAT )
+			continue;
+
+		if ( pSenses->BuildSightPrepass() )
+		{
+			workList.AddToTail( pSenses );
+		}
+	}
+
+	g_TaskPool.ParallelProcess( workList.Base(), workList.Count(), &ProcessSightPrepass, &PreSightPrepass, &PostSightPrepass );
+}
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
@@ -62,6 +62,7 @@ public:
 		m_SeenArrays[1] = &m_SeenNPCs;
 		m_SeenArrays[2] = &m_SeenMisc;
 		m_iSensingFlags = SENSING_FLAGS_NONE;
+		m_nSightPrepassTick = -1;
 	}
 	
 	float			GetDistLook() const				{ return m_LookDist; }
@@ -99,6 +100,13 @@ public:
 	void			RemoveSensingFlags( int iFlags )	{ m_iSensingFlags &= ~iFlags; }
 	bool			HasSensingFlags( int iFlags )		{ return (m_iSensingFlags & iFlags) == iFlags; }
 
+	//---------------------------------
+	// Two-phase AI frame (see AI_UpdateSensingPrepass)
+
+	bool			BuildSightPrepass();
+	void			RunSightPrepass();
+	bool			GetPrepassSightTrace( CBaseEntity *pTarget, const Vector &vecStart, const Vector &vecEnd, int traceMask, trace_t *ptr ) const;
+
 	DECLARE_SIMPLE_DATADESC();
 
 private:
@@ -138,6 +146,22 @@ private:
 	float			m_TimeLastLookMisc;
 
 	int				m_iSensingFlags;
+
+	struct SightPrepass_t
+	{
+		EHANDLE		hTarget;
+		Vector		vecStart;
+		Vector		vecEnd;
+		int			nMask;
+		float		flFraction;
+		bool		bStartSolid;
+		bool		bWorldBlocked;		// by world geometry, with no entity or static prop along the way
+	};
+
+	void			AddSightPrepass( CBaseEntity *pSightEnt, const Vector &vecStart );
+
+	CUtlVector<SightPrepass_t> m_SightPrepass;
+	int				m_nSightPrepassTick;
 };
 
 //-----------------------------------------------------------------------------
@@ -164,6 +188,12 @@ extern CAI_SensedObjectsManager g_AI_SensedObjectsManager;
 
 //-----------------------------------------------------------------------------
 
+// call during main loop, before entity think, to issue the sight traces of
+// all NPCs due to think this frame in parallel (ai_parallel_sensing)
+void AI_UpdateSensingPrepass( void );
+
+//-----------------------------------------------------------------------------
+
 
 
 #endif // AI_SENSES_H
@@ -15,12 +15,29 @@
 #include "tier0/memdbgon.h"
 
 #define	WAYPOINT_POOL_SIZE 512
+#define	WAYPOINT_CACHE_SIZE 64		// most waypoints a single NPC keeps for reuse
 
 //-----------------------------------------------------------------------------
 // Init static variables
 //-----------------------------------------------------------------------------
 
-DEFINE_FIXEDSIZE_ALLOCATOR( AI_Waypoint_t, WAYPOINT_POOL_SIZE, CUtlMemoryPool::GROW_FAST );
+CUtlMemoryPool AI_Waypoint_t::s_Allocator( sizeof(AI_Waypoint_t), WAYPOINT_POOL_SIZE, CUtlMemoryPool::GROW_FAST, "AI_Waypoint_t pool" );
+
+CAI_WaypointCache *CAI_WaypointCache::sm_pActive;
+
+//-------------------------------------
+
+struct AI_WaypointStats_t
+{
+	int nPoolAllocs;		// allocations served by the shared pool
+	int nCacheAllocs;		// allocations served by an NPC's cache
+	int nPoolFrees;
+	int nCacheFrees;
+	int nLive;
+	int nPeakLive;
+};
+
+static AI_WaypointStats_t g_WaypointStats;
 
 //-------------------------------------
 
@@ -41,6 +58,130 @@ END_DATADESC()
 
 //-------------------------------------
 
+void *AI_Waypoint_t::operator new( size_t size )
+{
+	Assert( size == sizeof(AI_Waypoint_t) );
+
+	CAI_WaypointCache *pCache = CAI_WaypointCache::GetActive();
+	void *p = ( pCache ) ? pCache->Alloc() : NULL;
+	if ( p )
+	{
+		g_WaypointStats.nCacheAllocs++;
+	}
+	else
+	{
+		MEM_ALLOC_CREDIT_( "AI_Waypoint_t pool" );
+		p = s_Allocator.Alloc( size );
+		g_WaypointStats.nPoolAllocs++;
+	}
+
+	if ( ++g_WaypointStats.nLive > g_WaypointStats.nPeakLive )
+		g_WaypointStats.nPeakLive = g_WaypointStats.nLive;
+
+	return p;
+}
+
+void *AI_Waypoint_t::operator new( size_t size, int nBlockUse, const char *pFileName, int nLine )
+{
+	return AI_Waypoint_t::operator new( size );
+}
+
+void AI_Waypoint_t::operator delete( void *p )
+{
+	if ( !p )
+		return;
+
+	g_WaypointStats.nLive--;
+
+	CAI_WaypointCache *pCache = CAI_WaypointCache::GetActive();
+	if ( pCache && pCache->Free( p ) )
+	{
+		g_WaypointStats.nCacheFrees++;
+	}
+	else
+	{
+		s_Allocator.Free( p );
+		g_WaypointStats.nPoolFrees++;
+	}
+}
+
+void AI_Waypoint_t::operator delete( void *p, int nBlockUse, const char *pFileName, int nLine )
+{
+	AI_Waypoint_t::operator delete( p );
+}
+
+//-------------------------------------
+
+CAI_WaypointCache::~CAI_WaypointCache()
+{
+	if ( sm_pActive == this )
+	{
+		Assert( 0 );
+		sm_pActive = NULL;
+	}
+
+	Purge();
+}
+
+void *CAI_WaypointCache::Alloc()
+{
+	if ( !m_pFree )
+		return NULL;
+
+	FreeWaypoint_t *pWaypoint = m_pFree;
+	m_pFree = pWaypoint->pNext;
+	m_nFree--;
+	return pWaypoint;
+}
+
+bool CAI_WaypointCache::Free( void *p )
+{
+	if ( m_nFree >= WAYPOINT_CACHE_SIZE )
+		return false;
+
+	FreeWaypoint_t *pWaypoint = (FreeWaypoint_t *)p;
+	pWaypoint->pNext = m_pFree;
+	m_pFree = pWaypoint;
+	m_nFree++;
+	return true;
+}
+
+//-------------------------------------
+// Returns everything to the shared pool
+
+void CAI_WaypointCache::Purge()
+{
+	while ( m_pFree )
+	{
+		FreeWaypoint_t *pWaypoint = m_pFree;
+		m_pFree = pWaypoint->pNext;
+		AI_Waypoint_t::s_Allocator.Free( pWaypoint );
+	}
+
+	m_nFree = 0;
+}
+
+//-------------------------------------
+
+CON_COMMAND( ai_show_waypoint_stats, "Reports waypoint allocations since the last report, and how many were served by NPC waypoint caches." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	AI_WaypointStats_t &stats = g_WaypointStats;
+	int nAllocs = stats.nPoolAllocs + stats.nCacheAllocs;
+
+	Msg( "Waypoints: %d live (peak %d)\n", stats.nLive, stats.nPeakLive );
+	Msg( "Allocs: %d (%d from NPC caches, %.1f%%), frees: %d pool, %d cached\n",
+		nAllocs, stats.nCacheAllocs, ( nAllocs ) ? 100.0f * stats.nCacheAllocs / nAllocs : 0.0f,
+		stats.nPoolFrees, stats.nCacheFrees );
+
+	stats.nPoolAllocs = stats.nCacheAllocs = stats.nPoolFrees = stats.nCacheFrees = 0;
+	stats.nPeakLive = stats.nLive;
+}
+
+//-------------------------------------
+
 AI_Waypoint_t::AI_Waypoint_t()
 {
 	memset( this, 0, sizeof(*this) );
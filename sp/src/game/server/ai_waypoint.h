@@ -144,7 +144,18 @@ private:
 	AI_Waypoint_t *pNext;
 	AI_Waypoint_t *pPrev;
 
-	DECLARE_FIXEDSIZE_ALLOCATOR(AI_Waypoint_t);
+	// Allocated from the active NPC's waypoint cache when there is one,
+	// otherwise from the shared pool. See CAI_WaypointCache.
+public:
+	void* operator new( size_t size );
+	void* operator new( size_t size, int nBlockUse, const char *pFileName, int nLine );
+	void  operator delete( void* p );
+	void  operator delete( void* p, int nBlockUse, const char *pFileName, int nLine );
+
+private:
+	static CUtlMemoryPool s_Allocator;
+
+	friend class CAI_WaypointCache;
 
 public:
 	DECLARE_SIMPLE_DATADESC();
@@ -191,6 +202,67 @@ inline void AI_Waypoint_t::SetNext( AI_Waypoint_t *p )
 }
 
 
+// ----------------------------------------------------------------------------
+// Purpose: Per-NPC free list of waypoint memory. Routes are rebuilt every few
+//			hundred ms, so while an NPC thinks its freed waypoints are kept
+//			here and handed back to its next route instead of going through
+//			the shared pool. All memory comes from the shared pool, so a
+//			waypoint may be freed into any cache.
+
+class CAI_WaypointCache
+{
+public:
+	CAI_WaypointCache()
+	 :	m_pFree( NULL ),
+		m_nFree( 0 )
+	{
+	}
+
+	~CAI_WaypointCache();
+
+	void *			Alloc();
+	bool			Free( void *p );
+	void			Purge();
+
+	int				Count() const				{ return m_nFree; }
+
+	static CAI_WaypointCache *GetActive()		{ return sm_pActive; }
+
+private:
+	friend class CAI_WaypointCacheScope;
+
+	struct FreeWaypoint_t
+	{
+		FreeWaypoint_t *pNext;
+	};
+
+	FreeWaypoint_t *m_pFree;
+	int				m_nFree;
+
+	static CAI_WaypointCache *sm_pActive;
+};
+
+// ------------------------------------
+// Makes a waypoint cache active for the lifetime of the scope
+
+class CAI_WaypointCacheScope
+{
+public:
+	CAI_WaypointCacheScope( CAI_WaypointCache *pCache )
+	 :	m_pPrevious( CAI_WaypointCache::sm_pActive )
+	{
+		CAI_WaypointCache::sm_pActive = pCache;
+	}
+
+	~CAI_WaypointCacheScope()
+	{
+		CAI_WaypointCache::sm_pActive = m_pPrevious;
+	}
+
+private:
+	CAI_WaypointCache *m_pPrevious;
+};
+
 // ----------------------------------------------------------------------------
 // Purpose: Holds an maintains a chain of waypoints
 
@@ -46,6 +46,7 @@
 #include "game.h"
 #include "tier0/vprof.h"
 #include "ai_basenpc.h"
+#include "ai_senses.h"
 #include "iservervehicle.h"
 #include "eventlist.h"
 #include "scriptevent.h"
@@ -62,6 +63,7 @@
 #include "env_debughistory.h"
 #include "tier1/utlstring.h"
 #include "utlhashtable.h"
+#include "datamap_index.h"
 #ifdef MAPBASE
 #include "mapbase/matchers.h"
 #include "mapbase/datadesc_mod.h"
@@ -638,8 +640,25 @@ HSCRIPT CBaseEntity::ScriptGetFollowedEntity()
 void CBaseEntity::SetClassname( const char *className )
 {
 	m_iClassname = AllocPooledString( className );
+	gEntList.ReportEntityNamesChanged( this );
 }
 
+void CBaseEntity::SetName( string_t newName )
+{
+	// Must be pooled for CHashedPooledString compares
+	AssertIsValidString( newName );
+	m_iName = newName;
+	gEntList.ReportEntityNamesChanged( this );
+}
+
+#ifdef MAPBASE_VSCRIPT
+void CBaseEntity::SetNameAsCStr( const char *newName )
+{
+	m_iName = AllocPooledString(newName);
+	gEntList.ReportEntityNamesChanged( this );
+}
+#endif
+
 void CBaseEntity::SetModelIndex( int index )
 {
 	if ( IsDynamicModelIndex( index ) && !(GetBaseAnimating() && m_bDynamicModelAllowed) )
@@ -3344,27 +3363,10 @@ bool CBaseEntity::FVisible( CBaseEntity *pEntity, int traceMask, CBaseEntity **p
 	Vector vecTargetOrigin = pEntity->EyePosition();
 
 	trace_t tr;
-	if ( !IsXbox() && ai_LOS_mode.GetBool() )
+	CAI_BaseNPC *pNPC = MyNPCPointer();
+	if ( ppBlocker || !pNPC || !pNPC->GetSenses() || !pNPC->GetSenses()->GetPrepassSightTrace( pEntity, vecLookerOrigin, vecTargetOrigin, traceMask, &tr ) )
 	{
-		UTIL_TraceLine(vecLookerOrigin, vecTargetOrigin, traceMask, this, COLLISION_GROUP_NONE, &tr);
-	}
-	else
-	{
-		// If we're doing an LOS search, include NPCs.
-		if ( traceMask == MASK_BLOCKLOS )
-		{
-			traceMask = MASK_BLOCKLOS_AND_NPCS;
-		}
-
-		// Player sees through nodraw
-		if ( IsPlayer() )
-		{
-			traceMask &= ~CONTENTS_BLOCKLOS;
-		}
-
-		// Use the custom LOS trace filter
-		CTraceFilterLOS traceFilter( this, COLLISION_GROUP_NONE, pEntity );
-		UTIL_TraceLine( vecLookerOrigin, vecTargetOrigin, traceMask, &traceFilter, &tr );
+		TraceLineOfSight( vecLookerOrigin, pEntity, vecTargetOrigin, traceMask, &tr );
 	}
 	
 	if (tr.fraction != 1.0 || tr.startsolid )
@@ -3392,6 +3394,46 @@ bool CBaseEntity::FVisible( CBaseEntity *pEntity, int traceMask, CBaseEntity **p
 	return true;// line of sight is valid.
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: The sight trace behind FVisible, and the mask it traces with.
+//			Split out so the AI sensing prepass traces the world the same way.
+//-----------------------------------------------------------------------------
+int CBaseEntity::GetLineOfSightMask( int traceMask ) const
+{
+	if ( !IsXbox() && ai_LOS_mode.GetBool() )
+		return traceMask;
+
+	// If we're doing an LOS search, include NPCs.
+	if ( traceMask == MASK_BLOCKLOS )
+	{
+		traceMask = MASK_BLOCKLOS_AND_NPCS;
+	}
+
+	// Player sees through nodraw
+	if ( IsPlayer() )
+	{
+		traceMask &= ~CONTENTS_BLOCKLOS;
+	}
+
+	return traceMask;
+}
+
+void CBaseEntity::TraceLineOfSight( const Vector &vecLookerOrigin, CBaseEntity *pEntity, const Vector &vecTargetOrigin, int traceMask, trace_t *ptr )
+{
+	if ( !IsXbox() && ai_LOS_mode.GetBool() )
+	{
+		UTIL_TraceLine(vecLookerOrigin, vecTargetOrigin, traceMask, this, COLLISION_GROUP_NONE, ptr);
+	}
+	else
+	{
+		traceMask = GetLineOfSightMask( traceMask );
+
+		// Use the custom LOS trace filter
+		CTraceFilterLOS traceFilter( this, COLLISION_GROUP_NONE, pEntity );
+		UTIL_TraceLine( vecLookerOrigin, vecTargetOrigin, traceMask, &traceFilter, ptr );
+	}
+}
+
 //=========================================================
 // FVisible - returns true if a line can be traced from
 // the caller's eyes to the wished position.
@@ -3805,6 +3847,7 @@ int CBaseEntity::Restore( IRestore &restore )
 
 	// loops through the data description list, restoring each data desc block in order
 	int status = RestoreDataDescBlock( restore, GetDataDescMap() );
+	gEntList.ReportEntityNamesChanged( this );
 
 	// ---------------------------------------------------------------
 	// HACKHACK: We don't know the space of these vectors until now
@@ -4496,6 +4539,9 @@ ConVar ent_messages_draw( "ent_messages_draw", "0", FCVAR_CHEAT, "Visualizes all
 //-----------------------------------------------------------------------------
 bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator, CBaseEntity *pCaller, variant_t Value, int outputID )
 {
+	// Set if the event queue is delivering this input, lets its targets share value conversions
+	EventQueuePrioritizedEvent_t *pEvent = g_EventQueue.ClaimDeliveringEvent();
+
 	if ( ent_messages_draw.GetBool() )
 	{
 		if ( pCaller != NULL )
@@ -4508,134 +4554,126 @@ bool CBaseEntity::AcceptInput( const char *szInputName, CBaseEntity *pActivator,
 		NDebugOverlay::Box( GetAbsOrigin(), Vector(-4, -4, -4), Vector(4, 4, 4), 0, 255, 0, 0, 3 );
 	}
 
-	// loop through the data description list, restoring each data desc block
-	for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
+	// find the input in this class's datamap
+	typedescription_t *pInput = DataMap_FindField( GetDataDescMap(), DATADESC_LOOKUP_INPUT, szInputName );
+	if ( pInput )
 	{
-		// search through all the actions in the data description, looking for a match
-		for ( int i = 0; i < dmap->dataNumFields; i++ )
+		// mapper debug message, Value.String() formats the value so only build it when it'll be shown
+		if ( developer.GetInt() >= 2 )
 		{
-			if ( dmap->dataDesc[i].flags & FTYPEDESC_INPUT )
-			{
-				if ( !Q_stricmp(dmap->dataDesc[i].externalName, szInputName) )
-				{
-					// found a match
-
-					// mapper debug message
 #ifdef MAPBASE
-					CGMsg( 2, CON_GROUP_IO_SYSTEM, "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, pCaller ? STRING(pCaller->m_iName.Get()) : "<NULL>", GetDebugName(), szInputName, Value.String() );
+			CGMsg( 2, CON_GROUP_IO_SYSTEM, "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, pCaller ? STRING(pCaller->m_iName.Get()) : "<NULL>", GetDebugName(), szInputName, Value.String() );
 #else
-					DevMsg( 2, "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, pCaller ? STRING(pCaller->m_iName.Get()) : "<NULL>", GetDebugName(), szInputName, Value.String() );
+			DevMsg( 2, "(%0.2f) input %s: %s.%s(%s)\n", gpGlobals->curtime, pCaller ? STRING(pCaller->m_iName.Get()) : "<NULL>", GetDebugName(), szInputName, Value.String() );
 #endif
-					ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+		}
+		ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
 
-					if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
-					{
-						DrawInputOverlay(szInputName,pCaller,Value);
-					}
+		if (m_debugOverlays & OVERLAY_MESSAGE_BIT)
+		{
+			DrawInputOverlay(szInputName,pCaller,Value);
+		}
 
-					// convert the value if necessary
-					if ( Value.FieldType() != dmap->dataDesc[i].fieldType )
-					{
-						if ( !(Value.FieldType() == FIELD_VOID && dmap->dataDesc[i].fieldType == FIELD_STRING) ) // allow empty strings
-						{
+		// convert the value if necessary
+		if ( Value.FieldType() != pInput->fieldType )
+		{
+			if ( !(Value.FieldType() == FIELD_VOID && pInput->fieldType == FIELD_STRING) ) // allow empty strings
+			{
 #ifdef MAPBASE
-							// Activator, etc. support for EHANDLE convert
-							if ( !Value.Convert( (fieldtype_t)dmap->dataDesc[i].fieldType, this, pActivator, pCaller ) )
-							{
-								bool bBadConversion = true;
-
-								// Attempt to convert to string and back.
-								// Almost all field types support being converted to a string, and many support being parsed from a string too.
-								fieldtype_t originalfield = Value.FieldType();
-								if (Value.Convert(FIELD_STRING))
-								{
-									bBadConversion = !(Value.Convert((fieldtype_t)dmap->dataDesc[i].fieldType, this, pActivator, pCaller));
-									if (!bBadConversion)
-									{
-										// Actual support should be added for each field, but if it works, it works.
-										// Warning against it only matters if you're a programmer and want to add support for each field.
-										// Only send a warning in dev mode.
-										DevWarning("!! Had to convert to string and back\n"
-													"!! Source Field Type: %i, Target Field Type: %i\n",
-												originalfield, dmap->dataDesc[i].fieldType);
-									}
-								}
+				// Activator, etc. support for EHANDLE convert
+				if ( !g_EventQueue.ConvertInputValue( pEvent, Value, (fieldtype_t)pInput->fieldType, this, pActivator, pCaller ) )
+				{
+					bool bBadConversion = true;
 
-								if (bBadConversion)
-								{
-									Warning( "!! ERROR: bad input/output link:\n!! Unable to convert value \"%s\" from %s (%s) to field type %i\n!! Target Entity: %s (%s), Input: %s\n", 
-										Value.GetDebug(),
-										( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
-										( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>",
-										dmap->dataDesc[i].fieldType,
-										STRING(m_iClassname), GetDebugName(), szInputName );
-									return false;
-								}
-							}
-#else
-							if ( !Value.Convert( (fieldtype_t)dmap->dataDesc[i].fieldType ) )
-							{
-								// bad conversion
-								Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
-									STRING(m_iClassname), GetDebugName(), szInputName, 
-									( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
-									( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>" );
-								return false;
-							}
-#endif
+					// Attempt to convert to string and back.
+					// Almost all field types support being converted to a string, and many support being parsed from a string too.
+					fieldtype_t originalfield = Value.FieldType();
+					if (Value.Convert(FIELD_STRING))
+					{
+						bBadConversion = !(Value.Convert((fieldtype_t)pInput->fieldType, this, pActivator, pCaller));
+						if (!bBadConversion)
+						{
+							// Actual support should be added for each field, but if it works, it works.
+							// Warning against it only matters if you're a programmer and want to add support for each field.
+							// Only send a warning in dev mode.
+							DevWarning("!! Had to convert to string and back\n"
+										"!! Source Field Type: %i, Target Field Type: %i\n",
+									originalfield, pInput->fieldType);
 						}
 					}
 
-					// call the input handler, or if there is none just set the value
-					inputfunc_t pfnInput = dmap->dataDesc[i].inputFunc;
-
-					if ( pfnInput )
-					{ 
-						// Package the data into a struct for passing to the input handler.
-						inputdata_t data;
-						data.pActivator = pActivator;
-						data.pCaller = pCaller;
-						data.value = Value;
-						data.nOutputID = outputID;
+					if (bBadConversion)
+					{
+						Warning( "!! ERROR: bad input/output link:\n!! Unable to convert value \"%s\" from %s (%s) to field type %i\n!! Target Entity: %s (%s), Input: %s\n", 
+							Value.GetDebug(),
+							( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
+							( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>",
+							pInput->fieldType,
+							STRING(m_iClassname), GetDebugName(), szInputName );
+						return false;
+					}
+				}
+#else
+				if ( !g_EventQueue.ConvertInputValue( pEvent, Value, (fieldtype_t)pInput->fieldType, this, pActivator, pCaller ) )
+				{
+					// bad conversion
+					Warning( "!! ERROR: bad input/output link:\n!! %s(%s,%s) doesn't match type from %s(%s)\n", 
+						STRING(m_iClassname), GetDebugName(), szInputName, 
+						( pCaller != NULL ) ? STRING(pCaller->m_iClassname) : "<null>",
+						( pCaller != NULL ) ? STRING(pCaller->m_iName.Get()) : "<null>" );
+					return false;
+				}
+#endif
+			}
+		}
 
+		// call the input handler, or if there is none just set the value
+		inputfunc_t pfnInput = pInput->inputFunc;
 
-						// Now, see if there's a function named Input<Name of Input> in this entity's script file. 
-						// If so, execute it and let it decide whether to allow the default behavior to also execute.
-						bool bCallInputFunc = true; // Always assume default behavior (do call the input function)
+		if ( pfnInput )
+		{ 
+			// Package the data into a struct for passing to the input handler.
+			inputdata_t data;
+			data.pActivator = pActivator;
+			data.pCaller = pCaller;
+			data.value = Value;
+			data.nOutputID = outputID;
 
-						if ( m_ScriptScope.IsInitialized() )
-						{
-							ScriptVariant_t functionReturn;
-							if ( ScriptInputHook( szInputName, pActivator, pCaller, Value, functionReturn ) )
-							{
-								bCallInputFunc = functionReturn.m_bool;
-							}
-						}
 
-						if( bCallInputFunc )
-						{
-							(this->*pfnInput)( data );
-						}
-					}
-					else if ( dmap->dataDesc[i].flags & FTYPEDESC_KEY )
-					{
-						// set the value directly
-						Value.SetOther( ((char*)this) + dmap->dataDesc[i].fieldOffset[ TD_OFFSET_NORMAL ]);
-					
-						// TODO: if this becomes evil and causes too many full entity updates, then we should make
-						// a macro like this:
-						//
-						// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
-						//
-						// Then the datadesc points at that function and we call it here. The only pain is to add
-						// that function for all the DEFINE_INPUT calls.
-						NetworkStateChanged();
-					}
+			// Now, see if there's a function named Input<Name of Input> in this entity's script file. 
+			// If so, execute it and let it decide whether to allow the default behavior to also execute.
+			bool bCallInputFunc = true; // Always assume default behavior (do call the input function)
 
-					return true;
+			if ( m_ScriptScope.IsInitialized() )
+			{
+				ScriptVariant_t functionReturn;
+				if ( ScriptInputHook( szInputName, pActivator, pCaller, Value, functionReturn ) )
+				{
+					bCallInputFunc = functionReturn.m_bool;
 				}
 			}
+
+			if( bCallInputFunc )
+			{
+				(this->*pfnInput)( data );
+			}
 		}
+		else if ( pInput->flags & FTYPEDESC_KEY )
+		{
+			// set the value directly
+			Value.SetOther( ((char*)this) + pInput->fieldOffset[ TD_OFFSET_NORMAL ]);
+		
+			// TODO: if this becomes evil and causes too many full entity updates, then we should make
+			// a macro like this:
+			//
+			// define MAKE_INPUTVAR(x) void Note##x##Modified() { x.GetForModify(); }
+			//
+			// Then the datadesc points at that function and we call it here. The only pain is to add
+			// that function for all the DEFINE_INPUT calls.
+			NetworkStateChanged();
+		}
+
+		return true;
 	}
 
 #ifdef MAPBASE_VSCRIPT
@@ -4766,21 +4804,12 @@ bool CBaseEntity::ReadKeyField( const char *varName, variant_t *var )
 	if ( !varName )
 		return false;
 
-	// loop through the data description list, restoring each data desc block
-	for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
+	// find the readable field in this class's datamap
+	typedescription_t *pField = DataMap_FindField( GetDataDescMap(), DATADESC_LOOKUP_KEY_OR_OUTPUT, varName );
+	if ( pField )
 	{
-		// search through all the readable fields in the data description, looking for a match
-		for ( int i = 0; i < dmap->dataNumFields; i++ )
-		{
-			if ( dmap->dataDesc[i].flags & (FTYPEDESC_OUTPUT | FTYPEDESC_KEY) )
-			{
-				if ( !Q_stricmp(dmap->dataDesc[i].externalName, varName) )
-				{
-					var->Set( dmap->dataDesc[i].fieldType, ((char*)this) + dmap->dataDesc[i].fieldOffset[ TD_OFFSET_NORMAL ] );
-					return true;
-				}
-			}
-		}
+		var->Set( pField->fieldType, ((char*)this) + pField->fieldOffset[ TD_OFFSET_NORMAL ] );
+		return true;
 	}
 
 	return false;
@@ -5422,6 +5451,12 @@ void ModelSoundsCacheShutdown()
 }
 
 static CUtlSymbolTable g_ModelSoundsSymbolHelper( 0, 32, true );
+
+// Models whose components were precached this level, by model index
+static CUtlVector<bool> g_ModelComponentsPrecached;
+static int g_nModelComponentPrecaches;
+static int g_nModelComponentRepeats;
+
 class CModelSoundsCacheSaver: public CAutoGameSystem
 {
 public:
@@ -5442,6 +5477,9 @@ public:
 	}
 	virtual void LevelShutdownPostEntity()
 	{
+		// Precache tables are rebuilt for the next level
+		g_ModelComponentsPrecached.Purge();
+
 		if ( IsX360() )
 		{
 			// Unforunate that this table must persist through duration of level.
@@ -5503,6 +5541,16 @@ static CWatchForModelAccess g_WatchForModels;
 #define CL_EVENT_MFOOTSTEP_LEFT		6006
 #define CL_EVENT_MFOOTSTEP_RIGHT	6007
 
+//-----------------------------------------------------------------------------
+// Purpose: Model component precaches done and skipped as repeats, since the last call
+//-----------------------------------------------------------------------------
+void CBaseEntity::GetModelComponentPrecacheStats( int &nPrecached, int &nRepeats )
+{
+	nPrecached = g_nModelComponentPrecaches;
+	nRepeats = g_nModelComponentRepeats;
+	g_nModelComponentPrecaches = g_nModelComponentRepeats = 0;
+}
+
 //-----------------------------------------------------------------------------
 // Precache model sound. Requires a local symbol table to prevent
 // a very expensive call to PrecacheScriptSound().
@@ -5542,6 +5590,20 @@ void CBaseEntity::PrecacheModelComponents( int nModelIndex )
 		return;
 	}
 
+	// Every entity using a model precaches it, but its components only need walking once a level
+	if ( nModelIndex < g_ModelComponentsPrecached.Count() && g_ModelComponentsPrecached[nModelIndex] )
+	{
+		g_nModelComponentRepeats++;
+		return;
+	}
+
+	while ( g_ModelComponentsPrecached.Count() <= nModelIndex )
+	{
+		g_ModelComponentsPrecached.AddToTail( false );
+	}
+	g_ModelComponentsPrecached[nModelIndex] = true;
+	g_nModelComponentPrecaches++;
+
 	// sounds
 	if ( IsPC() )
 	{
@@ -626,6 +626,8 @@ public:
 	bool		ClassMatches( const char *pszClassOrWildcard );
 	bool		NameMatches( string_t nameStr );
 	bool		ClassMatches( string_t nameStr );
+	bool		NameMatches( CHashedPooledString &name );		// No wildcards or !player, see gamestringpool.h
+	bool		ClassMatches( CHashedPooledString &className );
 
 private:
 	bool		NameMatchesComplex( const char *pszNameOrWildcard );
@@ -1395,6 +1397,8 @@ public:
 
 	virtual	bool FVisible ( CBaseEntity *pEntity, int traceMask = MASK_BLOCKLOS, CBaseEntity **ppBlocker = NULL );
 	virtual bool FVisible( const Vector &vecTarget, int traceMask = MASK_BLOCKLOS, CBaseEntity **ppBlocker = NULL );
+	void		TraceLineOfSight( const Vector &vecLookerOrigin, CBaseEntity *pEntity, const Vector &vecTargetOrigin, int traceMask, trace_t *ptr );
+	int			GetLineOfSightMask( int traceMask ) const;
 
 	virtual bool CanBeSeenBy( CAI_BaseNPC *pNPC ) { return true; } // allows entities to be 'invisible' to NPC senses.
 
@@ -1916,6 +1920,7 @@ public:
 public:
 	void							SetSize( const Vector &vecMin, const Vector &vecMax ); // UTIL_SetSize( this, mins, maxs );
 	static int						PrecacheModel( const char *name, bool bPreload = true ); 
+	static void						GetModelComponentPrecacheStats( int &nPrecached, int &nRepeats ); // since the last call
 	static bool						PrecacheSound( const char *name );
 	static void						PrefetchSound( const char *name );
 	void							Remove( ); // UTIL_Remove( this );
@@ -2263,18 +2268,6 @@ inline const char *CBaseEntity::GetPreTemplateName()
 	return szStrippedName;
 }
 
-inline void CBaseEntity::SetName( string_t newName )
-{
-	m_iName = newName;
-}
-
-#ifdef MAPBASE_VSCRIPT
-inline void CBaseEntity::SetNameAsCStr( const char *newName )
-{
-	m_iName = AllocPooledString(newName);
-}
-#endif
-
 inline bool CBaseEntity::NameMatches( const char *pszNameOrWildcard )
 {
 	if ( IDENT_STRINGS(m_iName, pszNameOrWildcard) )
@@ -2309,6 +2302,16 @@ inline bool CBaseEntity::ClassMatches( string_t nameStr )
 	return ClassMatchesComplex( STRING(nameStr) );
 }
 
+inline bool CBaseEntity::NameMatches( CHashedPooledString &name )
+{
+	return name.Matches( m_iName.Get() );
+}
+
+inline bool CBaseEntity::ClassMatches( CHashedPooledString &className )
+{
+	return className.Matches( m_iClassname );
+}
+
 inline int CBaseEntity::GetSpawnFlags( void ) const
 { 
 	return m_spawnflags; 
@@ -3010,6 +3013,11 @@ inline bool FClassnameIs(CBaseEntity *pEntity, const char *szClassname)
 	return pEntity->ClassMatches(szClassname); 
 }
 
+inline bool FClassnameIs(CBaseEntity *pEntity, CHashedPooledString &className)
+{ 
+	return pEntity->ClassMatches(className); 
+}
+
 class CPointEntity : public CBaseEntity
 {
 public:
@@ -284,53 +284,63 @@ void CBaseEntityOutput::FireOutput(variant_t Value, CBaseEntity *pActivator, CBa
 #endif
 		}
 
-		if ( ev->m_flDelay )
+		bool bDebugText = true;
+#ifdef DISABLE_DEBUG_HISTORY
+		// Only the developer 2 message below shows the text
+		bDebugText = ( developer.GetInt() >= 2 );
+#endif
+
+		// Don't format the text for nothing
+		if ( bDebugText )
 		{
-			char szBuffer[256];
-			Q_snprintf( szBuffer,
-						sizeof(szBuffer),
-						"(%0.2f) output: (%s,%s) -> (%s,%s,%.1f)(%s)\n",
+			if ( ev->m_flDelay )
+			{
+				char szBuffer[256];
+				Q_snprintf( szBuffer,
+							sizeof(szBuffer),
+							"(%0.2f) output: (%s,%s) -> (%s,%s,%.1f)(%s)\n",
 #ifdef TF_DLL
-						engine->GetServerTime(),
+							engine->GetServerTime(),
 #else
-						gpGlobals->curtime,
+							gpGlobals->curtime,
 #endif
-						pCaller ? STRING(pCaller->m_iClassname) : "NULL",
-						pCaller ? STRING(pCaller->GetEntityName()) : "NULL",
-						STRING(ev->m_iTarget),
-						STRING(ev->m_iTargetInput),
-						ev->m_flDelay,
-						STRING(ev->m_iParameter) );
+							pCaller ? STRING(pCaller->m_iClassname) : "NULL",
+							pCaller ? STRING(pCaller->GetEntityName()) : "NULL",
+							STRING(ev->m_iTarget),
+							STRING(ev->m_iTargetInput),
+							ev->m_flDelay,
+							STRING(ev->m_iParameter) );
 
 #ifdef MAPBASE
-			CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
+				CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
 #else
-			DevMsg( 2, "%s", szBuffer );
+				DevMsg( 2, "%s", szBuffer );
 #endif
-			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
-		}
-		else
-		{
-			char szBuffer[256];
-			Q_snprintf( szBuffer,
-						sizeof(szBuffer),
-						"(%0.2f) output: (%s,%s) -> (%s,%s)(%s)\n",
+				ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+			}
+			else
+			{
+				char szBuffer[256];
+				Q_snprintf( szBuffer,
+							sizeof(szBuffer),
+							"(%0.2f) output: (%s,%s) -> (%s,%s)(%s)\n",
 #ifdef TF_DLL
-						engine->GetServerTime(),
+							engine->GetServerTime(),
 #else
-						gpGlobals->curtime,
+							gpGlobals->curtime,
 #endif
-						pCaller ? STRING(pCaller->m_iClassname) : "NULL",
-						pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget),
-						STRING(ev->m_iTargetInput),
-						STRING(ev->m_iParameter) );
+							pCaller ? STRING(pCaller->m_iClassname) : "NULL",
+							pCaller ? STRING(pCaller->GetEntityName()) : "NULL", STRING(ev->m_iTarget),
+							STRING(ev->m_iTargetInput),
+							STRING(ev->m_iParameter) );
 
 #ifdef MAPBASE
-			CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
+				CGMsg( 2, CON_GROUP_IO_SYSTEM, "%s", szBuffer );
 #else
-			DevMsg( 2, "%s", szBuffer );
+				DevMsg( 2, "%s", szBuffer );
 #endif
-			ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+				ADD_DEBUG_HISTORY( HISTORY_ENTITY_IO, szBuffer );
+			}
 		}
 
 		if ( pCaller && pCaller->m_debugOverlays & OVERLAY_MESSAGE_BIT)
@@ -690,6 +700,10 @@ CEventQueue::CEventQueue()
 {
 	m_Events.m_flFireTime = -FLT_MAX;
 	m_Events.m_pNext = NULL;
+	m_pLastEvent = &m_Events;
+	m_pDelivering = NULL;
+
+	m_nAdded = m_nInsertSteps = m_nFired = m_nDelivered = m_nConversions = m_nSharedConversions = 0;
 
 	Init();
 }
@@ -813,6 +827,7 @@ void CEventQueue::Clear( void )
 	}
 
 	m_Events.m_pNext = NULL;
+	m_pLastEvent = &m_Events;
 }
 
 void CEventQueue::Dump( void )
@@ -924,14 +939,15 @@ void CEventQueue::AddEvent( CBaseEntity *target, const char *action, float fireD
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 {
-	// loop through the actions looking for a place to insert
+	m_nAdded++;
+
+	// New events almost always fire after everything already queued, so look for a place
+	// to insert from the tail. Going after the last event with the same or an earlier fire
+	// time keeps equal times in the order they were added, as the old scan from the head did.
 	EventQueuePrioritizedEvent_t *pe;
-	for ( pe = &m_Events; pe->m_pNext != NULL; pe = pe->m_pNext )
+	for ( pe = m_pLastEvent; pe->m_flFireTime > newEvent->m_flFireTime; pe = pe->m_pPrev )
 	{
-		if ( pe->m_pNext->m_flFireTime > newEvent->m_flFireTime )
-		{
-			break;
-		}
+		m_nInsertSteps++;
 	}
 
 	Assert( pe );
@@ -944,6 +960,10 @@ void CEventQueue::AddEvent( EventQueuePrioritizedEvent_t *newEvent )
 	{
 		newEvent->m_pNext->m_pPrev = newEvent;
 	}
+	else
+	{
+		m_pLastEvent = newEvent;
+	}
 }
 
 void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
@@ -954,6 +974,75 @@ void CEventQueue::RemoveEvent( EventQueuePrioritizedEvent_t *pe )
 	{
 		pe->m_pNext->m_pPrev = pe->m_pPrev;
 	}
+	else
+	{
+		m_pLastEvent = pe->m_pPrev;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Pumps the event's input into one of its targets
+//-----------------------------------------------------------------------------
+void CEventQueue::DeliverEvent( CBaseEntity *pTarget, EventQueuePrioritizedEvent_t *pe )
+{
+	m_nDelivered++;
+
+	// Claimed by the target's AcceptInput(), so inputs it fires itself don't see the event
+	m_pDelivering = pe;
+	pTarget->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+	m_pDelivering = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Converts an input's value to the type the input takes. An event's value
+//			is the same for all of its targets, so a conversion done for one target
+//			is kept on the event and reused by the others. Entity handles are looked
+//			up relative to each target and are always converted again.
+//-----------------------------------------------------------------------------
+bool CEventQueue::ConvertInputValue( EventQueuePrioritizedEvent_t *pEvent, variant_t &Value, fieldtype_t newType, CBaseEntity *pSelf, CBaseEntity *pActivator, CBaseEntity *pCaller )
+{
+	bool bShare = ( pEvent != NULL && newType != FIELD_EHANDLE && newType != FIELD_VOID && newType != FIELD_INPUT );
+
+	if ( bShare && pEvent->m_ConvertedValue.FieldType() == newType )
+	{
+		m_nSharedConversions++;
+		Value = pEvent->m_ConvertedValue;
+		return true;
+	}
+
+	m_nConversions++;
+
+#ifdef MAPBASE
+	if ( !Value.Convert( newType, pSelf, pActivator, pCaller ) )
+#else
+	if ( !Value.Convert( newType ) )
+#endif
+		return false;
+
+	if ( bShare )
+	{
+		pEvent->m_ConvertedValue = Value;
+	}
+
+	return true;
+}
+
+void CEventQueue::ReportStats( void )
+{
+	Msg( "Events queued: %d (%d steps to find their place), fired: %d, inputs delivered: %d\n",
+		m_nAdded, m_nInsertSteps, m_nFired, m_nDelivered );
+	Msg( "Input values converted: %d, conversions shared between targets: %d\n",
+		m_nConversions, m_nSharedConversions );
+
+	m_nAdded = m_nInsertSteps = m_nFired = m_nDelivered = m_nConversions = m_nSharedConversions = 0;
+}
+
+CON_COMMAND( report_eventqueue_stats, "Reports entity I/O event queue activity since the last report" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_EventQueue.ReportStats();
 }
 
 
@@ -1014,6 +1103,7 @@ void CEventQueue::ServiceEvents( void )
 					if (FStrEq(szName, "!output"))
 					{
 						pe->m_VariantValue.Convert( FIELD_EHANDLE );
+						pe->m_ConvertedValue.Set( FIELD_VOID, NULL );
 						target = pe->m_VariantValue.Entity();
 					}
 				}
@@ -1021,7 +1111,7 @@ void CEventQueue::ServiceEvents( void )
 				if (target)
 				{
 					// pump the action into the target
-					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+					DeliverEvent( target, pe );
 					targetFound = true;
 				}
 			}
@@ -1044,7 +1134,7 @@ void CEventQueue::ServiceEvents( void )
 					if ( ent->NameMatches( szName ) )
 					{
 						// pump the action into the target
-						ent->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+						DeliverEvent( ent, pe );
 						targetFound = true;
 					}
 				}
@@ -1058,7 +1148,7 @@ void CEventQueue::ServiceEvents( void )
 					break;
 
 				// pump the action into the target
-				target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+				DeliverEvent( target, pe );
 				targetFound = true;
 			}
 #endif
@@ -1067,7 +1157,7 @@ void CEventQueue::ServiceEvents( void )
 		// direct pointer
 		if ( pe->m_pEntTarget != NULL )
 		{
-			pe->m_pEntTarget->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+			DeliverEvent( pe->m_pEntTarget, pe );
 			targetFound = true;
 		}
 
@@ -1084,7 +1174,7 @@ void CEventQueue::ServiceEvents( void )
 						break;
 
 					// pump the action into the target
-					target->AcceptInput( STRING(pe->m_iTargetInput), pe->m_pActivator, pe->m_pCaller, pe->m_VariantValue, pe->m_iOutputID );
+					DeliverEvent( target, pe );
 					targetFound = true;
 				}
 			}
@@ -1114,6 +1204,7 @@ void CEventQueue::ServiceEvents( void )
 		// remove the event from the list (remembering that the queue may have been added to)
 		RemoveEvent( pe );
 		delete pe;
+		m_nFired++;
 
 		//
 		// If we are in debug mode, exit the loop if we have fired the correct number of events.
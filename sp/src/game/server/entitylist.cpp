@@ -17,6 +17,8 @@
 #include "ai_initutils.h"
 #include "globalstate.h"
 #include "datacache/imdlcache.h"
+#include "utlhashtable.h"
+#include "worldsize.h"
 
 #ifdef HL2_DLL
 #include "npc_playercompanion.h"
@@ -36,6 +38,515 @@ static CUtlVector<IServerNetworkable*> g_DeleteList;
 CGlobalEntityList gEntList;
 CBaseEntityList *g_pEntityList = &gEntList;
 
+ConVar ent_find_index( "ent_find_index", "1", 0, "Use the classname, targetname and spatial indices for entity searches" );
+
+#define ENT_FIND_CELL_SIZE			512.0f
+#define ENT_FIND_CELL_BITS			10
+#define ENT_FIND_MAX_ENTITY_CELLS	64		// Entities covering more cells than this are tested by every search
+#define ENT_FIND_MAX_SEARCH_CELLS	1024	// Searches covering more cells than this walk the entity list instead
+
+//-----------------------------------------------------------------------------
+// Purpose: Lookups behind the find functions.
+//
+//			Name buckets hold every entity whose classname or targetname
+//			matches the key case-insensitively. Entities are always added at
+//			the tail of the entity list, so ordering buckets by the order
+//			entities were added in matches the list, and a search can resume
+//			after the last entity it found.
+//
+//			The grid holds networked entities by a box around their origin
+//			that covers their collision bounds at any angle, so it only has
+//			to change when they move or are resized. Moved entities are
+//			re-filed by the next spatial search.
+//-----------------------------------------------------------------------------
+struct EntityFindEntry_t
+{
+	unsigned		nSequence;
+	CBaseEntity *	pEntity;
+};
+
+typedef CUtlVector<EntityFindEntry_t> EntityFindBucket_t;
+
+class CEntityFindIndex
+{
+public:
+	CEntityFindIndex();
+	~CEntityFindIndex() { Purge(); }
+
+	void	AddEntity( CBaseEntity *pEntity, int iSlot );
+	void	RemoveEntity( int iSlot );
+	void	UpdateNames( CBaseEntity *pEntity );
+	void	MarkMoved( CBaseEntity *pEntity );
+	void	Purge();
+
+	// False if pStartEntity isn't indexed, so a search resuming after it has to walk the list
+	bool	CanResumeAfter( CBaseEntity *pStartEntity ) const;
+
+	// Position to resume a search after, 0 to start at the head of the list
+	unsigned GetSequence( CBaseEntity *pStartEntity ) const;
+
+	// NULL if no entity has used the name this level
+	const EntityFindBucket_t *FindClassBucket( const char *pszName ) const	{ return FindBucket( m_ClassBuckets, pszName ); }
+	const EntityFindBucket_t *FindNameBucket( const char *pszName ) const		{ return FindBucket( m_NameBuckets, pszName ); }
+
+	// Networked entities that may touch the box, in entity list order, or NULL if the box is
+	// too big for the grid to help. Repeated searches of the same box reuse the result until
+	// something is added, removed or moved, and it's only valid until the next call.
+	const EntityFindBucket_t *FindInBox( const Vector &vecMins, const Vector &vecMaxs );
+
+	// Position of the first entry added after nSequence
+	static int FirstAfter( const EntityFindBucket_t &entries, unsigned nSequence );
+
+private:
+	typedef CUtlHashtable<const char *, EntityFindBucket_t *, CaselessStringHashFunctor, CaselessStringEqualFunctor> BucketTable_t;
+
+	enum
+	{
+		SPATIAL_NONE = 0,	// Not networked, never found by spatial searches
+		SPATIAL_CELLS,		// Filed under every cell it covers
+		SPATIAL_LARGE,		// Too big for the grid, tested by every search
+	};
+
+	struct Slot_t
+	{
+		CBaseEntity *	pEntity;
+		unsigned		nSequence;
+
+		// Names the entity is filed under
+		const char *	pszClassname;
+		const char *	pszName;
+
+		int				spatialState;
+		bool			bMoved;
+		int				cellMins[3];
+		int				cellMaxs[3];
+		unsigned		nSearchMark;
+	};
+
+	void	UpdateSlotNames( int iSlot );
+	void	UpdateSlotCells( int iSlot );
+	void	FileInCells( int iSlot, bool bAdd );
+
+	static const EntityFindBucket_t *FindBucket( const BucketTable_t &table, const char *pszName );
+	static void	AddToBucket( BucketTable_t &table, const char *pszName, const Slot_t &slot );
+	static void	RemoveFromBucket( BucketTable_t &table, const char *pszName, const Slot_t &slot );
+
+	static int	CellCoord( float flCoord );
+	static unsigned	CellKey( int x, int y, int z );
+
+	Slot_t				m_Slots[NUM_ENT_ENTRIES];
+	unsigned			m_nNextSequence;
+
+	// Empty buckets are kept until the level ends, so a search walking one never sees it freed
+	BucketTable_t		m_ClassBuckets;
+	BucketTable_t		m_NameBuckets;
+
+	CUtlHashtable<unsigned, CUtlVector<int> *> m_Cells;
+	CUtlVector<int>		m_LargeSlots;
+	CUtlVector<int>		m_MovedSlots;
+	unsigned			m_nSearchMark;
+
+	unsigned			m_nGeneration;
+	unsigned			m_nResultGeneration;
+	Vector				m_vecResultMins;
+	Vector				m_vecResultMaxs;
+	EntityFindBucket_t	m_Result;
+};
+
+static CEntityFindIndex s_EntityFindIndex;
+
+CEntityFindIndex::CEntityFindIndex()
+{
+	memset( m_Slots, 0, sizeof( m_Slots ) );
+	m_nNextSequence = 1;
+	m_nSearchMark = 0;
+	m_nGeneration = 1;
+	m_nResultGeneration = 0;
+}
+
+void CEntityFindIndex::AddEntity( CBaseEntity *pEntity, int iSlot )
+{
+	Slot_t &slot = m_Slots[iSlot];
+	Assert( !slot.pEntity );
+
+	memset( &slot, 0, sizeof( slot ) );
+	slot.pEntity = pEntity;
+	slot.nSequence = m_nNextSequence++;
+
+	UpdateSlotNames( iSlot );
+
+	// Filed in the grid by the next spatial search, the entity isn't set up yet
+	slot.bMoved = true;
+	m_MovedSlots.AddToTail( iSlot );
+	m_nGeneration++;
+}
+
+void CEntityFindIndex::RemoveEntity( int iSlot )
+{
+	Slot_t &slot = m_Slots[iSlot];
+	if ( !slot.pEntity )
+		return;
+
+	if ( slot.pszClassname )
+		RemoveFromBucket( m_ClassBuckets, slot.pszClassname, slot );
+	if ( slot.pszName )
+		RemoveFromBucket( m_NameBuckets, slot.pszName, slot );
+
+	if ( slot.spatialState == SPATIAL_CELLS )
+		FileInCells( iSlot, false );
+	else if ( slot.spatialState == SPATIAL_LARGE )
+		m_LargeSlots.FindAndFastRemove( iSlot );
+
+	if ( slot.bMoved )
+		m_MovedSlots.FindAndFastRemove( iSlot );
+
+	memset( &slot, 0, sizeof( slot ) );
+	m_nGeneration++;
+}
+
+void CEntityFindIndex::UpdateNames( CBaseEntity *pEntity )
+{
+	int iSlot = pEntity->GetRefEHandle().GetEntryIndex();
+	if ( m_Slots[iSlot].pEntity == pEntity )
+	{
+		UpdateSlotNames( iSlot );
+	}
+}
+
+void CEntityFindIndex::MarkMoved( CBaseEntity *pEntity )
+{
+	int iSlot = pEntity->GetRefEHandle().GetEntryIndex();
+	Slot_t &slot = m_Slots[iSlot];
+	if ( slot.pEntity != pEntity )
+		return;
+
+	m_nGeneration++;
+	if ( !slot.bMoved )
+	{
+		slot.bMoved = true;
+		m_MovedSlots.AddToTail( iSlot );
+	}
+}
+
+void CEntityFindIndex::Purge()
+{
+	for ( UtlHashHandle_t h = m_ClassBuckets.FirstHandle(); h != m_ClassBuckets.InvalidHandle(); h = m_ClassBuckets.NextHandle( h ) )
+	{
+		delete m_ClassBuckets[h];
+	}
+	for ( UtlHashHandle_t h = m_NameBuckets.FirstHandle(); h != m_NameBuckets.InvalidHandle(); h = m_NameBuckets.NextHandle( h ) )
+	{
+		delete m_NameBuckets[h];
+	}
+	for ( UtlHashHandle_t h = m_Cells.FirstHandle(); h != m_Cells.InvalidHandle(); h = m_Cells.NextHandle( h ) )
+	{
+		delete m_Cells[h];
+	}
+
+	m_ClassBuckets.Purge();
+	m_NameBuckets.Purge();
+	m_Cells.Purge();
+	m_LargeSlots.Purge();
+	m_MovedSlots.Purge();
+	m_Result.Purge();
+
+	memset( m_Slots, 0, sizeof( m_Slots ) );
+	m_nGeneration++;
+}
+
+bool CEntityFindIndex::CanResumeAfter( CBaseEntity *pStartEntity ) const
+{
+	return ( !pStartEntity || m_Slots[pStartEntity->GetRefEHandle().GetEntryIndex()].pEntity == pStartEntity );
+}
+
+unsigned CEntityFindIndex::GetSequence( CBaseEntity *pStartEntity ) const
+{
+	if ( !pStartEntity )
+		return 0;
+
+	Assert( CanResumeAfter( pStartEntity ) );
+	return m_Slots[pStartEntity->GetRefEHandle().GetEntryIndex()].nSequence;
+}
+
+int CEntityFindIndex::FirstAfter( const EntityFindBucket_t &entries, unsigned nSequence )
+{
+	int iLow = 0;
+	int iHigh = entries.Count();
+	while ( iLow < iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if ( entries[iMid].nSequence <= nSequence )
+			iLow = iMid + 1;
+		else
+			iHigh = iMid;
+	}
+	return iLow;
+}
+
+//-----------------------------------------------------------------------------
+
+void CEntityFindIndex::UpdateSlotNames( int iSlot )
+{
+	Slot_t &slot = m_Slots[iSlot];
+
+	string_t iszClassname = slot.pEntity->m_iClassname;
+	const char *pszClassname = ( iszClassname != NULL_STRING ) ? STRING( iszClassname ) : NULL;
+	if ( pszClassname != slot.pszClassname )
+	{
+		if ( slot.pszClassname )
+			RemoveFromBucket( m_ClassBuckets, slot.pszClassname, slot );
+
+		slot.pszClassname = pszClassname;
+
+		if ( pszClassname )
+			AddToBucket( m_ClassBuckets, pszClassname, slot );
+	}
+
+	string_t iszName = slot.pEntity->GetEntityName();
+	const char *pszName = ( iszName != NULL_STRING ) ? STRING( iszName ) : NULL;
+	if ( pszName != slot.pszName )
+	{
+		if ( slot.pszName )
+			RemoveFromBucket( m_NameBuckets, slot.pszName, slot );
+
+		slot.pszName = pszName;
+
+		if ( pszName )
+			AddToBucket( m_NameBuckets, pszName, slot );
+	}
+}
+
+const EntityFindBucket_t *CEntityFindIndex::FindBucket( const BucketTable_t &table, const char *pszName )
+{
+	UtlHashHandle_t h = table.Find( pszName );
+	return ( h != table.InvalidHandle() ) ? table[h] : NULL;
+}
+
+void CEntityFindIndex::AddToBucket( BucketTable_t &table, const char *pszName, const Slot_t &slot )
+{
+	// Game strings live until the level ends, so the first name seen can be the key
+	UtlHashHandle_t h = table.Find( pszName );
+	if ( h == table.InvalidHandle() )
+	{
+		h = table.Insert( pszName, new EntityFindBucket_t );
+	}
+
+	EntityFindBucket_t *pBucket = table[h];
+	EntityFindEntry_t entry = { slot.nSequence, slot.pEntity };
+	pBucket->InsertBefore( FirstAfter( *pBucket, slot.nSequence ), entry );
+}
+
+void CEntityFindIndex::RemoveFromBucket( BucketTable_t &table, const char *pszName, const Slot_t &slot )
+{
+	UtlHashHandle_t h = table.Find( pszName );
+	if ( h == table.InvalidHandle() )
+	{
+		Assert( 0 );
+		return;
+	}
+
+	EntityFindBucket_t *pBucket = table[h];
+	int i = FirstAfter( *pBucket, slot.nSequence - 1 );
+	if ( i < pBucket->Count() && (*pBucket)[i].nSequence == slot.nSequence )
+	{
+		pBucket->Remove( i );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+int CEntityFindIndex::CellCoord( float flCoord )
+{
+	// Written so NaNs clamp too
+	if ( !( flCoord > -COORD_EXTENT ) )
+		flCoord = -COORD_EXTENT;
+	else if ( !( flCoord < COORD_EXTENT ) )
+		flCoord = COORD_EXTENT;
+
+	return (int)floorf( flCoord * ( 1.0f / ENT_FIND_CELL_SIZE ) );
+}
+
+unsigned CEntityFindIndex::CellKey( int x, int y, int z )
+{
+	const unsigned mask = ( 1 << ENT_FIND_CELL_BITS ) - 1;
+	return ( (unsigned)x & mask ) | ( ( (unsigned)y & mask ) << ENT_FIND_CELL_BITS ) | ( ( (unsigned)z & mask ) << ( 2 * ENT_FIND_CELL_BITS ) );
+}
+
+void CEntityFindIndex::UpdateSlotCells( int iSlot )
+{
+	Slot_t &slot = m_Slots[iSlot];
+	CBaseEntity *pEntity = slot.pEntity;
+
+	int spatialState = SPATIAL_NONE;
+	int cellMins[3] = { 0, 0, 0 };
+	int cellMaxs[3] = { 0, 0, 0 };
+
+	if ( pEntity->edict() )
+	{
+		// Farthest the collision box reaches from the origin at any angle
+		const Vector &vecOBBMins = pEntity->CollisionProp()->OBBMins();
+		const Vector &vecOBBMaxs = pEntity->CollisionProp()->OBBMaxs();
+		Vector vecReach( MAX( fabs( vecOBBMins.x ), fabs( vecOBBMaxs.x ) ),
+			MAX( fabs( vecOBBMins.y ), fabs( vecOBBMaxs.y ) ),
+			MAX( fabs( vecOBBMins.z ), fabs( vecOBBMaxs.z ) ) );
+		float flReach = vecReach.Length();
+
+		const Vector &vecOrigin = pEntity->GetAbsOrigin();
+		int nCells = 1;
+		for ( int i = 0; i < 3; i++ )
+		{
+			cellMins[i] = CellCoord( vecOrigin[i] - flReach );
+			cellMaxs[i] = CellCoord( vecOrigin[i] + flReach );
+			nCells *= cellMaxs[i] - cellMins[i] + 1;
+		}
+
+		spatialState = ( nCells > ENT_FIND_MAX_ENTITY_CELLS ) ? SPATIAL_LARGE : SPATIAL_CELLS;
+	}
+
+	if ( spatialState == slot.spatialState )
+	{
+		if ( spatialState != SPATIAL_CELLS )
+			return;
+
+		if ( !memcmp( cellMins, slot.cellMins, sizeof( cellMins ) ) && !memcmp( cellMaxs, slot.cellMaxs, sizeof( cellMaxs ) ) )
+			return;
+	}
+
+	if ( slot.spatialState == SPATIAL_CELLS )
+		FileInCells( iSlot, false );
+	else if ( slot.spatialState == SPATIAL_LARGE )
+		m_LargeSlots.FindAndFastRemove( iSlot );
+
+	slot.spatialState = spatialState;
+	memcpy( slot.cellMins, cellMins, sizeof( cellMins ) );
+	memcpy( slot.cellMaxs, cellMaxs, sizeof( cellMaxs ) );
+
+	if ( spatialState == SPATIAL_CELLS )
+		FileInCells( iSlot, true );
+	else if ( spatialState == SPATIAL_LARGE )
+		m_LargeSlots.AddToTail( iSlot );
+}
+
+void CEntityFindIndex::FileInCells( int iSlot, bool bAdd )
+{
+	const Slot_t &slot = m_Slots[iSlot];
+
+	for ( int x = slot.cellMins[0]; x <= slot.cellMaxs[0]; x++ )
+	{
+		for ( int y = slot.cellMins[1]; y <= slot.cellMaxs[1]; y++ )
+		{
+			for ( int z = slot.cellMins[2]; z <= slot.cellMaxs[2]; z++ )
+			{
+				unsigned key = CellKey( x, y, z );
+				UtlHashHandle_t h = m_Cells.Find( key );
+				if ( bAdd )
+				{
+					if ( h == m_Cells.InvalidHandle() )
+					{
+						h = m_Cells.Insert( key, new CUtlVector<int> );
+					}
+					m_Cells[h]->AddToTail( iSlot );
+				}
+				else if ( h != m_Cells.InvalidHandle() )
+				{
+					m_Cells[h]->FindAndFastRemove( iSlot );
+				}
+			}
+		}
+	}
+}
+
+static int __cdecl EntityFindEntrySort( const EntityFindEntry_t *pLeft, const EntityFindEntry_t *pRight )
+{
+	if ( pLeft->nSequence < pRight->nSequence )
+		return -1;
+	return ( pLeft->nSequence > pRight->nSequence ) ? 1 : 0;
+}
+
+const EntityFindBucket_t *CEntityFindIndex::FindInBox( const Vector &vecMins, const Vector &vecMaxs )
+{
+	if ( m_nResultGeneration == m_nGeneration && vecMins == m_vecResultMins && vecMaxs == m_vecResultMaxs )
+		return &m_Result;
+
+	int cellMins[3], cellMaxs[3];
+	int nCells = 1;
+	for ( int i = 0; i < 3; i++ )
+	{
+		cellMins[i] = CellCoord( vecMins[i] );
+		cellMaxs[i] = CellCoord( vecMaxs[i] );
+		nCells *= MAX( cellMaxs[i] - cellMins[i] + 1, 0 );
+	}
+
+	if ( nCells > ENT_FIND_MAX_SEARCH_CELLS )
+		return NULL;
+
+	// Re-file everything that moved since the last search
+	for ( int i = 0; i < m_MovedSlots.Count(); i++ )
+	{
+		int iSlot = m_MovedSlots[i];
+		if ( m_Slots[iSlot].bMoved )
+		{
+			m_Slots[iSlot].bMoved = false;
+			UpdateSlotCells( iSlot );
+		}
+	}
+	m_MovedSlots.RemoveAll();
+
+	m_Result.RemoveAll();
+	m_nSearchMark++;
+
+	for ( int i = 0; i < m_LargeSlots.Count(); i++ )
+	{
+		Slot_t &slot = m_Slots[m_LargeSlots[i]];
+		EntityFindEntry_t entry = { slot.nSequence, slot.pEntity };
+		m_Result.AddToTail( entry );
+	}
+
+	for ( int x = cellMins[0]; x <= cellMaxs[0]; x++ )
+	{
+		for ( int y = cellMins[1]; y <= cellMaxs[1]; y++ )
+		{
+			for ( int z = cellMins[2]; z <= cellMaxs[2]; z++ )
+			{
+				UtlHashHandle_t h = m_Cells.Find( CellKey( x, y, z ) );
+				if ( h == m_Cells.InvalidHandle() )
+					continue;
+
+				const CUtlVector<int> &cell = *m_Cells[h];
+				for ( int i = 0; i < cell.Count(); i++ )
+				{
+					Slot_t &slot = m_Slots[cell[i]];
+					if ( slot.nSearchMark == m_nSearchMark )
+						continue;
+
+					slot.nSearchMark = m_nSearchMark;
+					EntityFindEntry_t entry = { slot.nSequence, slot.pEntity };
+					m_Result.AddToTail( entry );
+				}
+			}
+		}
+	}
+
+	m_Result.Sort( EntityFindEntrySort );
+
+	m_nResultGeneration = m_nGeneration;
+	m_vecResultMins = vecMins;
+	m_vecResultMaxs = vecMaxs;
+	return &m_Result;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Names the index can look up directly. Wildcards and regular
+//			expressions still have to be matched against every entity.
+//-----------------------------------------------------------------------------
+static bool EntityFindIsPattern( const char *pszName )
+{
+	if ( !pszName || !pszName[0] || pszName[0] == '@' )
+		return true;
+
+	return ( strpbrk( pszName, "*?" ) != NULL );
+}
+
 class CAimTargetManager : public IEntityListener
 {
 public:
@@ -130,18 +641,35 @@ void AimTarget_ForceRepopulateList()
 // NOTE: This is usually a small subset of the global entity list, so it's
 // an optimization to maintain this list incrementally rather than polling each
 // frame.
+//
+// Entities that only think are also filed on a timing wheel by their next
+// think tick, and moved into the ready set when that tick comes around, so
+// each frame only visits what's due. The ready set is kept by list position
+// so due entities still come out in list order.
+ConVar sv_simthink_schedule( "sv_simthink_schedule", "1", 0, "Only visit entities whose think is due instead of scanning every thinking entity each tick" );
+
+#define SIMTHINK_WHEEL_BITS		8
+#define SIMTHINK_WHEEL_SIZE		( 1 << SIMTHINK_WHEEL_BITS )
+#define SIMTHINK_WHEEL_MASK		( SIMTHINK_WHEEL_SIZE - 1 )
+
 struct simthinkentry_t
 {
 	unsigned short	entEntry;
 	unsigned short	unused0;
 	int				nextThinkTick;
 };
+struct simthinkscheduled_t
+{
+	unsigned short	entEntry;
+	int				nextThinkTick;
+};
 class CSimThinkManager : public IEntityListener
 {
 public:
 	CSimThinkManager()
 	{
 		Clear();
+		ResetStats();
 	}
 	void Clear()
 	{
@@ -150,6 +678,13 @@ public:
 		{
 			m_entinfoIndex[i] = 0xFFFF;
 		}
+		for ( int i = 0; i < SIMTHINK_WHEEL_SIZE; i++ )
+		{
+			m_thinkWheel[i].Purge();
+		}
+		m_readyList.ClearAll();
+		m_nScheduleTick = 0;
+		m_bRebuildSchedule = true;
 	}
 	void LevelInitPreEntity()
 	{
@@ -178,8 +713,16 @@ public:
 		if ( listHandle != 0xFFFF )
 		{
 			Assert(m_simThinkList[listHandle].entEntry == index);
+			int lastHandle = m_simThinkList.Count() - 1;
 			m_simThinkList.FastRemove( listHandle );
 			m_entinfoIndex[index] = 0xFFFF;
+
+			// fast remove moved the last entry into this slot, its ready state goes with it
+			if ( m_readyList.IsBitSet( lastHandle ) )
+				m_readyList.Set( listHandle );
+			else
+				m_readyList.Clear( listHandle );
+			m_readyList.Clear( lastHandle );
 			
 			// fast remove shifted someone, update that someone
 			if ( listHandle < m_simThinkList.Count() )
@@ -197,21 +740,35 @@ public:
 	{
 		int count = MIN(listMax, ListCount());
 		int out = 0;
-		for ( int i = 0; i < count; i++ )
+
+		if ( !sv_simthink_schedule.GetBool() )
 		{
-			// only copy out entities that will simulate or think this frame
-			if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+			// Stop filing entities on the wheel, it's rebuilt if the schedule is turned back on
+			m_bRebuildSchedule = true;
+
+			for ( int i = 0; i < count; i++ )
 			{
-				Assert(m_simThinkList[i].nextThinkTick>=0);
-				int entinfoIndex = m_simThinkList[i].entEntry;
-				const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
-				pList[out] = (CBaseEntity *)pInfo->m_pEntity;
-				Assert(m_simThinkList[i].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[i].nextThinkTick);
-				Assert( gEntList.IsEntityPtr( pList[out] ) );
-				out++;
+				// only copy out entities that will simulate or think this frame
+				if ( m_simThinkList[i].nextThinkTick <= gpGlobals->tickcount )
+				{
+					CopyEntry( i, pList, out );
+				}
 			}
+
+			NoteFrame( count, out );
+			return out;
+		}
+
+		m_nVisited = 0;
+		AdvanceSchedule( gpGlobals->tickcount );
+
+		for ( int i = m_readyList.FindNextSetBit( 0 ); i >= 0 && i < count; i = m_readyList.FindNextSetBit( i + 1 ) )
+		{
+			m_nVisited++;
+			CopyEntry( i, pList, out );
 		}
 
+		NoteFrame( m_nVisited, out );
 		return out;
 	}
 
@@ -244,9 +801,12 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = pEntity->GetFirstThinkTick();
 					Assert(m_simThinkList[m_entinfoIndex[index]].nextThinkTick>=0);
 				}
+				Schedule( m_entinfoIndex[index] );
 			}
 			else
 			{
+				int oldThinkTick = m_simThinkList[m_entinfoIndex[index]].nextThinkTick;
+
 				// updating existing entry - if no sim, reset think time
 				if ( pEntity->IsEFlagSet(EFL_NO_GAME_PHYSICS_SIMULATION) )
 				{
@@ -257,13 +817,144 @@ public:
 				{
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
+
+				if ( m_simThinkList[m_entinfoIndex[index]].nextThinkTick != oldThinkTick )
+				{
+					Schedule( m_entinfoIndex[index] );
+				}
 			}
 		}
 	}
 
+	void ReportStats()
+	{
+		Msg( "Last frame: %d of %d entities visited, %d simulated or thought\n", m_nLastVisited, ListCount(), m_nLastCopied );
+		if ( m_nFrames )
+		{
+			Msg( "Average over %d frames: %.1f visited, %.1f simulated or thought\n",
+				m_nFrames, (float)m_nTotalVisited / m_nFrames, (float)m_nTotalCopied / m_nFrames );
+		}
+		ResetStats();
+	}
+
 private:
+	void CopyEntry( int listHandle, CBaseEntity *pList[], int &out )
+	{
+		Assert(m_simThinkList[listHandle].nextThinkTick>=0);
+		int entinfoIndex = m_simThinkList[listHandle].entEntry;
+		const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entinfoIndex );
+		pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+		Assert(m_simThinkList[listHandle].nextThinkTick==0 || pList[out]->GetFirstThinkTick()==m_simThinkList[listHandle].nextThinkTick);
+		Assert( gEntList.IsEntityPtr( pList[out] ) );
+		out++;
+	}
+
+	// Files an entry as ready or on the wheel by its think tick
+	void Schedule( int listHandle )
+	{
+		if ( m_bRebuildSchedule )
+			return;
+
+		const simthinkentry_t &entry = m_simThinkList[listHandle];
+		if ( entry.nextThinkTick <= m_nScheduleTick )
+		{
+			m_readyList.Set( listHandle );
+		}
+		else
+		{
+			// Entries aren't removed from the wheel when they're rescheduled, stale ones are dropped when their tick comes up
+			m_readyList.Clear( listHandle );
+			simthinkscheduled_t scheduled = { entry.entEntry, entry.nextThinkTick };
+			m_thinkWheel[entry.nextThinkTick & SIMTHINK_WHEEL_MASK].AddToTail( scheduled );
+		}
+	}
+
+	void AdvanceSchedule( int tick )
+	{
+		if ( m_bRebuildSchedule || tick < m_nScheduleTick || tick - m_nScheduleTick > SIMTHINK_WHEEL_SIZE )
+		{
+			RebuildSchedule( tick );
+			return;
+		}
+
+		while ( m_nScheduleTick < tick )
+		{
+			m_nScheduleTick++;
+
+			CUtlVector<simthinkscheduled_t> &bucket = m_thinkWheel[m_nScheduleTick & SIMTHINK_WHEEL_MASK];
+			int kept = 0;
+			for ( int i = 0; i < bucket.Count(); i++ )
+			{
+				m_nVisited++;
+
+				simthinkscheduled_t scheduled = bucket[i];
+				int listHandle = m_entinfoIndex[scheduled.entEntry];
+				if ( listHandle == 0xFFFF || m_simThinkList[listHandle].nextThinkTick != scheduled.nextThinkTick )
+					continue;
+
+				if ( scheduled.nextThinkTick <= m_nScheduleTick )
+				{
+					m_readyList.Set( listHandle );
+				}
+				else
+				{
+					// Due on a later turn of the wheel
+					bucket[kept++] = scheduled;
+				}
+			}
+			bucket.RemoveMultipleFromTail( bucket.Count() - kept );
+		}
+	}
+
+	void RebuildSchedule( int tick )
+	{
+		for ( int i = 0; i < SIMTHINK_WHEEL_SIZE; i++ )
+		{
+			m_thinkWheel[i].RemoveAll();
+		}
+		m_readyList.ClearAll();
+
+		m_nScheduleTick = tick;
+		m_bRebuildSchedule = false;
+
+		for ( int i = 0; i < m_simThinkList.Count(); i++ )
+		{
+			m_nVisited++;
+			Schedule( i );
+		}
+	}
+
+	void NoteFrame( int visited, int copied )
+	{
+		m_nLastVisited = visited;
+		m_nLastCopied = copied;
+		m_nTotalVisited += visited;
+		m_nTotalCopied += copied;
+		m_nFrames++;
+	}
+
+	void ResetStats()
+	{
+		m_nVisited = m_nLastVisited = m_nLastCopied = 0;
+		m_nTotalVisited = m_nTotalCopied = 0;
+		m_nFrames = 0;
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	// Ready entries by list position, and everything else by think tick
+	CBitVec<NUM_ENT_ENTRIES>	m_readyList;
+	CUtlVector<simthinkscheduled_t> m_thinkWheel[SIMTHINK_WHEEL_SIZE];
+	int				m_nScheduleTick;
+	bool			m_bRebuildSchedule;
+
+	int				m_nVisited;
+	int				m_nLastVisited;
+	int				m_nLastCopied;
+	int64			m_nTotalVisited;
+	int64			m_nTotalCopied;
+	int				m_nFrames;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -283,6 +974,14 @@ void SimThink_EntityChanged( CBaseEntity *pEntity )
 	g_SimThinkManager.EntityChanged( pEntity );
 }
 
+CON_COMMAND( report_simthink_stats, "Reports how many thinking entities were visited and how many were due, since the last report" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_SimThinkManager.ReportStats();
+}
+
 static CBaseEntityClassList *s_pClassLists = NULL;
 CBaseEntityClassList::CBaseEntityClassList()
 {
@@ -379,6 +1078,7 @@ void CGlobalEntityList::Clear( void )
 	CleanupDeleteList();
 	// free the memory
 	g_DeleteList.Purge();
+	s_EntityFindIndex.Purge();
 
 	CBaseEntity::m_nDebugPlayer = -1;
 	CBaseEntity::m_bInDebugSelect = false; 
@@ -488,6 +1188,27 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity
 CBaseEntity *CGlobalEntityList::FindEntityByClassname( CBaseEntity *pStartEntity, const char *szName )
 #endif
 {
+	if ( ent_find_index.GetBool() && !EntityFindIsPattern( szName ) && s_EntityFindIndex.CanResumeAfter( pStartEntity ) )
+	{
+		const EntityFindBucket_t *pBucket = s_EntityFindIndex.FindClassBucket( szName );
+		if ( !pBucket )
+			return NULL;
+
+		// Index each time, the filter could rename something into this bucket
+		for ( int i = CEntityFindIndex::FirstAfter( *pBucket, s_EntityFindIndex.GetSequence( pStartEntity ) ); i < pBucket->Count(); i++ )
+		{
+			CBaseEntity *pEntity = (*pBucket)[i].pEntity;
+#ifdef MAPBASE
+			if ( pFilter && !pFilter->ShouldFindEntity(pEntity) )
+				continue;
+#endif
+
+			return pEntity;
+		}
+
+		return NULL;
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -655,6 +1376,24 @@ CBaseEntity *CGlobalEntityList::FindEntityByName( CBaseEntity *pStartEntity, con
 
 		return NULL;
 	}
+
+	if ( ent_find_index.GetBool() && !EntityFindIsPattern( szName ) && s_EntityFindIndex.CanResumeAfter( pStartEntity ) )
+	{
+		const EntityFindBucket_t *pBucket = s_EntityFindIndex.FindNameBucket( szName );
+		if ( !pBucket )
+			return NULL;
+
+		for ( int i = CEntityFindIndex::FirstAfter( *pBucket, s_EntityFindIndex.GetSequence( pStartEntity ) ); i < pBucket->Count(); i++ )
+		{
+			CBaseEntity *ent = (*pBucket)[i].pEntity;
+			if ( pFilter && !pFilter->ShouldFindEntity(ent) )
+				continue;
+
+			return ent;
+		}
+
+		return NULL;
+	}
 	
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
@@ -741,6 +1480,16 @@ CBaseEntity	*CGlobalEntityList::FindEntityByTarget( CBaseEntity *pStartEntity, c
 }
 
 
+static bool IsEntityInSphere( CBaseEntity *ent, const Vector &vecCenter, float flRadius )
+{
+	if ( !ent->edict() )
+		return false;
+
+	Vector vecRelativeCenter;
+	ent->CollisionProp()->WorldToCollisionSpace( vecCenter, &vecRelativeCenter );
+	return IsBoxIntersectingSphere( ent->CollisionProp()->OBBMins(),	ent->CollisionProp()->OBBMaxs(), vecRelativeCenter, flRadius );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Used to iterate all the entities within a sphere.
 // Input  : pStartEntity - 
@@ -749,6 +1498,23 @@ CBaseEntity	*CGlobalEntityList::FindEntityByTarget( CBaseEntity *pStartEntity, c
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
 {
+	if ( ent_find_index.GetBool() && flRadius >= 0 && s_EntityFindIndex.CanResumeAfter( pStartEntity ) )
+	{
+		Vector vecExtents( flRadius, flRadius, flRadius );
+		const EntityFindBucket_t *pCandidates = s_EntityFindIndex.FindInBox( vecCenter - vecExtents, vecCenter + vecExtents );
+		if ( pCandidates )
+		{
+			for ( int i = CEntityFindIndex::FirstAfter( *pCandidates, s_EntityFindIndex.GetSequence( pStartEntity ) ); i < pCandidates->Count(); i++ )
+			{
+				CBaseEntity *ent = (*pCandidates)[i].pEntity;
+				if ( IsEntityInSphere( ent, vecCenter, flRadius ) )
+					return ent;
+			}
+
+			return NULL;
+		}
+	}
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -760,12 +1526,7 @@ CBaseEntity *CGlobalEntityList::FindEntityInSphere( CBaseEntity *pStartEntity, c
 			continue;
 		}
 
-		if ( !ent->edict() )
-			continue;
-
-		Vector vecRelativeCenter;
-		ent->CollisionProp()->WorldToCollisionSpace( vecCenter, &vecRelativeCenter );
-		if ( !IsBoxIntersectingSphere( ent->CollisionProp()->OBBMins(),	ent->CollisionProp()->OBBMaxs(), vecRelativeCenter, flRadius ) )
+		if ( !IsEntityInSphere( ent, vecCenter, flRadius ) )
 			continue;
 
 		return ent;
@@ -842,6 +1603,28 @@ CBaseEntity *CGlobalEntityList::FindEntityByNameWithin( CBaseEntity *pStartEntit
 		return gEntList.FindEntityByName( pEntity, szName, pSearchingEntity, pActivator, pCaller );
 	}
 
+	// Literal names are quicker through the name index, patterns only need testing against what's nearby
+	if ( ent_find_index.GetBool() && szName && szName[0] != '!' && szName[0] != 0 && EntityFindIsPattern( szName ) && s_EntityFindIndex.CanResumeAfter( pStartEntity ) )
+	{
+		float flExtent = fabs( flRadius );
+		Vector vecExtents( flExtent, flExtent, flExtent );
+		const EntityFindBucket_t *pCandidates = s_EntityFindIndex.FindInBox( vecSrc - vecExtents, vecSrc + vecExtents );
+		if ( pCandidates )
+		{
+			for ( int i = CEntityFindIndex::FirstAfter( *pCandidates, s_EntityFindIndex.GetSequence( pStartEntity ) ); i < pCandidates->Count(); i++ )
+			{
+				pEntity = (*pCandidates)[i].pEntity;
+				if ( !pEntity->GetEntityName() || !pEntity->NameMatches( szName ) )
+					continue;
+
+				if ( flMaxDist2 > (pEntity->GetAbsOrigin() - vecSrc).LengthSqr() )
+					return pEntity;
+			}
+
+			return NULL;
+		}
+	}
+
 	while ((pEntity = gEntList.FindEntityByName( pEntity, szName, pSearchingEntity, pActivator, pCaller )) != NULL)
 	{
 		if ( !pEntity->edict() )
@@ -920,6 +1703,27 @@ CBaseEntity *CGlobalEntityList::FindEntityByClassnameWithin( CBaseEntity *pStart
 		return gEntList.FindEntityByClassname( pEntity, szName );
 	}
 
+	if ( ent_find_index.GetBool() && EntityFindIsPattern( szName ) && s_EntityFindIndex.CanResumeAfter( pStartEntity ) )
+	{
+		float flExtent = fabs( flRadius );
+		Vector vecExtents( flExtent, flExtent, flExtent );
+		const EntityFindBucket_t *pCandidates = s_EntityFindIndex.FindInBox( vecSrc - vecExtents, vecSrc + vecExtents );
+		if ( pCandidates )
+		{
+			for ( int i = CEntityFindIndex::FirstAfter( *pCandidates, s_EntityFindIndex.GetSequence( pStartEntity ) ); i < pCandidates->Count(); i++ )
+			{
+				pEntity = (*pCandidates)[i].pEntity;
+				if ( !pEntity->ClassMatches( szName ) )
+					continue;
+
+				if ( flMaxDist2 > (pEntity->GetAbsOrigin() - vecSrc).LengthSqr() )
+					return pEntity;
+			}
+
+			return NULL;
+		}
+	}
+
 	while ((pEntity = gEntList.FindEntityByClassname( pEntity, szName )) != NULL)
 	{
 		if ( !pEntity->edict() )
@@ -1172,6 +1976,8 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	CBaseEntity *pBaseEnt = static_cast<IServerUnknown*>(pEnt)->GetBaseEntity();
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts++;
+
+	s_EntityFindIndex.AddEntity( pBaseEnt, handle.GetEntryIndex() );
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
@@ -1205,9 +2011,21 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts--;
 
+	s_EntityFindIndex.RemoveEntity( handle.GetEntryIndex() );
+
 	m_iNumEnts--;
 }
 
+void CGlobalEntityList::ReportEntityNamesChanged( CBaseEntity *pEntity )
+{
+	s_EntityFindIndex.UpdateNames( pEntity );
+}
+
+void CGlobalEntityList::ReportEntityMoved( CBaseEntity *pEntity )
+{
+	s_EntityFindIndex.MarkMoved( pEntity );
+}
+
 void CGlobalEntityList::NotifyCreateEntity( CBaseEntity *pEnt )
 {
 	if ( !pEnt )
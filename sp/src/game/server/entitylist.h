@@ -118,6 +118,11 @@ public:
 
 	void ReportEntityFlagsChanged( CBaseEntity *pEntity, unsigned int flagsOld, unsigned int flagsNow );
 
+	// Keep the search indices current. Call after changing an entity's classname or targetname
+	// without SetClassname()/SetName(), and whenever it moves or changes size.
+	void ReportEntityNamesChanged( CBaseEntity *pEntity );
+	void ReportEntityMoved( CBaseEntity *pEntity );
+
 	// entity is about to be removed, notify the listeners
 	void NotifyCreateEntity( CBaseEntity *pEnt );
 	void NotifySpawn( CBaseEntity *pEnt );
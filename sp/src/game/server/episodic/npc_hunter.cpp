@@ -2472,7 +2472,7 @@ void CNPC_Hunter::ManageSiegeTargets()
 			// Create a bullseye that will live for 20 seconds. If we can't attack it within 20 seconds, it's probably
 			// out of reach anyone, so have it clean itself up after that long.
 			CBaseEntity *pSiegeTarget = CreateCustomTarget( pSiegeTargetLocation->GetAbsOrigin(), 20.0f );
-			pSiegeTarget->SetName( MAKE_STRING("siegetarget") );
+			pSiegeTarget->SetName( AllocPooledString("siegetarget") );
 
 			m_hCurrentSiegeTarget.Set( pSiegeTarget );
 
@@ -28,6 +28,10 @@ struct EventQueuePrioritizedEvent_t
 
 	variant_t m_VariantValue;	// variable-type parameter
 
+	// m_VariantValue converted for the first target that needed another type, shared with
+	// the rest of the event's targets that take that type. Not saved.
+	variant_t m_ConvertedValue;
+
 	EventQueuePrioritizedEvent_t *m_pNext;
 	EventQueuePrioritizedEvent_t *m_pPrev;
 
@@ -70,6 +74,12 @@ public:
 	void Clear( void ); // resets the list
 
 	void Dump( void );
+	void ReportStats( void );
+
+	// Called by CBaseEntity::AcceptInput(). Returns the event being delivered, if the call
+	// is one of its deliveries (nested inputs see NULL), and converts input values through it.
+	EventQueuePrioritizedEvent_t *ClaimDeliveringEvent( void ) { EventQueuePrioritizedEvent_t *pe = m_pDelivering; m_pDelivering = NULL; return pe; }
+	bool ConvertInputValue( EventQueuePrioritizedEvent_t *pEvent, variant_t &Value, fieldtype_t newType, CBaseEntity *pSelf, CBaseEntity *pActivator, CBaseEntity *pCaller );
 
 #ifdef MAPBASE_VSCRIPT
 	void CancelEventsByInput( CBaseEntity *pTarget, const char *szInput );
@@ -81,10 +91,20 @@ private:
 
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
+	void DeliverEvent( CBaseEntity *pTarget, EventQueuePrioritizedEvent_t *pe );
 
 	DECLARE_SIMPLE_DATADESC();
 	EventQueuePrioritizedEvent_t m_Events;
+	EventQueuePrioritizedEvent_t *m_pLastEvent;	// tail of the list, &m_Events when empty
+	EventQueuePrioritizedEvent_t *m_pDelivering;
 	int m_iListCount;
+
+	int m_nAdded;
+	int m_nInsertSteps;
+	int m_nFired;
+	int m_nDelivered;
+	int m_nConversions;
+	int m_nSharedConversions;
 };
 
 extern CEventQueue g_EventQueue;
@@ -58,6 +58,29 @@ END_SCRIPTDESC();
 
 //-----------------------------------------------------------------------------
 
+int CBaseFilter::s_iSettingsSerial = 0;
+
+bool CBaseFilter::KeyValue( const char *szKeyName, const char *szValue )
+{
+	NoteSettingsChanged();
+	return BaseClass::KeyValue( szKeyName, szValue );
+}
+
+void CBaseFilter::Activate( void )
+{
+	NoteSettingsChanged();
+	BaseClass::Activate();
+}
+
+void CBaseFilter::UpdateOnRemove( void )
+{
+	// Filters holding a handle to us change their results
+	NoteSettingsChanged();
+	BaseClass::UpdateOnRemove();
+}
+
+//-----------------------------------------------------------------------------
+
 bool CBaseFilter::PassesFilterImpl( CBaseEntity *pCaller, CBaseEntity *pEntity )
 {
 	return true;
@@ -191,6 +214,7 @@ class CFilterMultiple : public CBaseFilter
 	bool PassesDamageFilterImpl(const CTakeDamageInfo &info);
 #endif
 	void Activate(void);
+	bool CanCacheResults( void );
 
 #ifdef MAPBASE
 	bool BloodAllowed( CBaseEntity *pCaller, const CTakeDamageInfo &info );
@@ -259,6 +283,21 @@ void CFilterMultiple::Activate( void )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Our results can be cached if all of our filters' can.
+//-----------------------------------------------------------------------------
+bool CFilterMultiple::CanCacheResults( void )
+{
+	for ( int i = 0; i < MAX_FILTERS; i++ )
+	{
+		CBaseFilter *pFilter = (CBaseFilter *)(m_hFilter[i].Get());
+		if ( pFilter && ( pFilter == this || !pFilter->CanCacheResults() ) )
+			return false;
+	}
+	return true;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Returns true if the entity passes our filter, false if not.
 // Input  : pEntity - Entity to test.
@@ -494,11 +533,14 @@ public:
 		}
 	}
 
+	bool CanCacheResults( void ) { return true; }
+
 #ifdef MAPBASE
 	void InputSetField( inputdata_t& inputdata )
 	{
 		inputdata.value.Convert(FIELD_STRING);
 		m_iFilterName = inputdata.value.StringID();
+		NoteSettingsChanged();
 	}
 #endif
 };
@@ -530,11 +572,14 @@ public:
 		return pEntity->ClassMatches( STRING(m_iFilterClass) );
 	}
 
+	bool CanCacheResults( void ) { return true; }
+
 #ifdef MAPBASE
 	void InputSetField( inputdata_t& inputdata )
 	{
 		inputdata.value.Convert(FIELD_STRING);
 		m_iFilterClass = inputdata.value.StringID();
+		NoteSettingsChanged();
 	}
 #endif
 };
@@ -565,11 +610,14 @@ public:
 	 	return ( pEntity->GetTeamNumber() == m_iFilterTeam );
 	}
 
+	bool CanCacheResults( void ) { return true; }
+
 #ifdef MAPBASE
 	void InputSetField( inputdata_t& inputdata )
 	{
 		inputdata.value.Convert(FIELD_INTEGER);
 		m_iFilterTeam = inputdata.value.Int();
+		NoteSettingsChanged();
 	}
 #endif
 };
@@ -1000,10 +1048,14 @@ public:
 		return false;
 	}
 
+	// Skins aren't part of the cached state
+	bool CanCacheResults( void ) { return FStrEq(STRING(m_strFilterSkin), "-1"); }
+
 	void InputSetField( inputdata_t& inputdata )
 	{
 		inputdata.value.Convert(FIELD_STRING);
 		m_iFilterModel = inputdata.value.StringID();
+		NoteSettingsChanged();
 	}
 };
 
@@ -43,6 +43,17 @@ public:
 #endif
 
 	bool PassesFilter( CBaseEntity *pCaller, CBaseEntity *pEntity );
+
+	// Result caching. A result can be kept if the filter only looks at the tested entity's
+	// name, class, model, team and flags. Changing any filter's settings bumps the serial.
+	virtual bool CanCacheResults( void ) { return false; }
+	static int GetSettingsSerial( void ) { return s_iSettingsSerial; }
+	static void NoteSettingsChanged( void ) { s_iSettingsSerial++; }
+
+	virtual bool KeyValue( const char *szKeyName, const char *szValue );
+	virtual void Activate( void );
+	virtual void UpdateOnRemove( void );
+
 #ifdef MAPBASE
 	bool PassesDamageFilter( CBaseEntity *pCaller, const CTakeDamageInfo &info );
 
@@ -91,6 +102,9 @@ protected:
 #else
 	virtual bool PassesDamageFilterImpl(const CTakeDamageInfo &info);
 #endif
+
+private:
+	static int s_iSettingsSerial;
 };
 
 #ifdef MAPBASE
@@ -89,6 +89,7 @@
 #include "tier3/tier3.h"
 #include "serverbenchmark_base.h"
 #include "querycache.h"
+#include "ai_senses.h"
 #ifdef MAPBASE
 #include "world.h"
 #endif
@@ -641,6 +642,9 @@ bool CServerGameDLL::DLLInit( CreateInterfaceFn appSystemFactory,
 		}
 	}
 
+	// Pre-parsed copies of script files, see KeyValues::LoadFromFile()
+	KeyValues::SetBinaryCacheEnabled( !CommandLine()->CheckParm( "-nokvcache" ) );
+
 	// If not running dedicated, grab the engine vgui interface
 	if ( !engine->IsDedicatedServer() )
 	{
@@ -1255,6 +1259,7 @@ void CServerGameDLL::GameFrame( bool simulating )
 #endif
 
 	UpdateQueryCache();
+	AI_UpdateSensingPrepass();
 	g_pServerBenchmark->UpdateBenchmark();
 
 	Physics_RunThinkFunctions( simulating );
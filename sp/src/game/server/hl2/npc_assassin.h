@@ -59,6 +59,7 @@ public:
 	bool		FValidateHintType ( CAI_Hint *pHint );
 	bool		IsJumpLegal(const Vector &startPos, const Vector &apex, const Vector &endPos) const;
 	bool		MovementCost( int moveType, const Vector &vecStart, const Vector &vecEnd, float *pCost );
+	bool		HasCustomMovementCost() const	{ return true; }
 
 	float		MaxYawSpeed( void );
 
@@ -5547,12 +5547,15 @@ void CGrenadeHelicopter::ExplodeConcussion( CBaseEntity *pOther )
 	}
 
 #ifdef HL2_EPISODIC
+	static CHashedPooledString s_BoneFollower( "phys_bone_follower" );
+	static CHashedPooledString s_Helicopter( "npc_helicopter" );
+
 	CBaseEntity *pEntityHit = pOther;
-	if ( pEntityHit->ClassMatches( "phys_bone_follower" ) && pEntityHit->GetOwnerEntity() )
+	if ( pEntityHit->ClassMatches( s_BoneFollower ) && pEntityHit->GetOwnerEntity() )
 	{
 		pEntityHit = pEntityHit->GetOwnerEntity();
 	}
-	if ( ( CLASS_COMBINE_GUNSHIP != pEntityHit->Classify() ) || !pEntityHit->ClassMatches( "npc_helicopter" ) )
+	if ( ( CLASS_COMBINE_GUNSHIP != pEntityHit->Classify() ) || !pEntityHit->ClassMatches( s_Helicopter ) )
 	{
 		// We hit something other than a helicopter.  If the player threw us, send a miss event
 		if ( IsThrownByPlayer() )
@@ -252,6 +252,7 @@ public:
 
 	bool IsJumpLegal(const Vector &startPos, const Vector &apex, const Vector &endPos) const;
 	bool MovementCost( int moveType, const Vector &vecStart, const Vector &vecEnd, float *pCost );
+	bool HasCustomMovementCost() const { return true; }
 	bool ShouldFailNav( bool bMovementFailed );
 
 	int	SelectFailSchedule( int failedSchedule, int failedTask, AI_TaskFailureCode_t taskFailCode );
@@ -5467,6 +5467,21 @@ bool CLogicFieldAccessor::TestKey(CBaseEntity *pTarget, const char *szKeyName)
 //-----------------------------------------------------------------------------
 bool CLogicFieldAccessor::SetKeyValue(CBaseEntity *pTarget, const char *szKeyName, const char *szValue)
 {
+	// Plain field names go straight to the field
+	typedescription_t *pIndexedField = Datadesc_FindField( pTarget, szKeyName );
+	if ( pIndexedField )
+	{
+		fieldtype_t fieldtype = FIELD_VOID;
+		char *data = Datadesc_SetFieldString( szValue, pTarget, pIndexedField, &fieldtype );
+		if ( data && fieldtype != FIELD_VOID )
+		{
+			variant_t var;
+			var.Set(fieldtype, data);
+			m_OutValue.Set(var, pTarget, this);
+			return true;
+		}
+	}
+
 	for ( datamap_t *dmap = pTarget->GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
 	{
 		// search through all the readable fields in the data description, looking for a match
@@ -7,8 +7,19 @@
 #include "cbase.h"
 #include "datadesc_mod.h"
 #include "saverestore.h"
+#include "datamap_index.h"
 
 
+// Finds a saved or keyvalue field by its internal name.
+typedescription_t *Datadesc_FindField( CBaseEntity *pObject, const char *szFieldName )
+{
+	// Patterns can match more than one field
+	if ( strpbrk( szFieldName, "*?@" ) )
+		return NULL;
+
+	return DataMap_FindField( pObject->GetDataDescMap(), DATADESC_LOOKUP_SAVED, szFieldName );
+}
+
 // Sets a field's value to a specific string.
 char *Datadesc_SetFieldString( const char *szValue, CBaseEntity *pObject, typedescription_t *pField, fieldtype_t *pFieldType )
 {
@@ -21,6 +32,7 @@ char *Datadesc_SetFieldString( const char *szValue, CBaseEntity *pObject, typede
 	case FIELD_SOUNDNAME:
 	case FIELD_STRING:
 		(*(string_t *)((char *)pObject + fieldOffset)) = AllocPooledString( szValue );
+		gEntList.ReportEntityNamesChanged( pObject );
 		fieldtype = FIELD_STRING;
 		break;
 
@@ -8,4 +8,8 @@
 
 char *Datadesc_SetFieldString( const char *szValue, CBaseEntity *pObject, typedescription_t *pField, fieldtype_t *pFieldType = NULL );
 
+// Finds a saved or keyvalue field by its internal name using the datamap index.
+// Returns NULL for wildcard/regex queries, which still need to be matched against each field.
+typedescription_t *Datadesc_FindField( CBaseEntity *pObject, const char *szFieldName );
+
 bool ReadUnregisteredKeyfields( CBaseEntity *pTarget, const char *szKeyName, variant_t *variant );
@@ -18,6 +18,7 @@
 #include "datacache/imdlcache.h"
 #include "world.h"
 #include "toolframework/iserverenginetools.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -32,6 +33,133 @@ struct HierarchicalSpawnMapData_t
 static CStringRegistry *g_pClassnameSpawnPriority = NULL;
 extern edict_t *g_pForceAttachEdict;
 
+ConVar mapentities_parallel_parse( "mapentities_parallel_parse", "1", 0, "Tokenize the map's entity blocks on worker threads before creating the entities" );
+
+static const char *MapEntity_ParseEntity( CBaseEntity *&pEntity, CEntityMapData &entData, IMapEntityFilter *pFilter );
+
+//-----------------------------------------------------------------------------
+// An entity block in the entity lump, tokenized ahead of time.
+//-----------------------------------------------------------------------------
+struct MapEntityBlock_t
+{
+	const char		*m_pStart;		// just past the opening brace
+	const char		*m_pEnd;		// the closing brace
+	CEntityMapKeys	m_Keys;
+};
+
+static void ParseMapEntityBlock( MapEntityBlock_t &block )
+{
+	block.m_Keys.Parse( block.m_pStart );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The keys of each block must end right at its closing brace, as
+//			they do when the text is parsed one entity at a time. Braces
+//			where keys or values belong would break that.
+//-----------------------------------------------------------------------------
+static bool MapEntity_CheckBlocks( const CUtlVector<MapEntityBlock_t> &blocks )
+{
+	char token[MAPKEY_MAXLENGTH];
+	for ( int i = 0; i < blocks.Count(); i++ )
+	{
+		const char *pNext = MapEntity_ParseToken( blocks[i].m_Keys.EndPosition(), token );
+		if ( pNext != blocks[i].m_pEnd + 1 || token[0] != '}' )
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the entity blocks in the lump without copying any tokens,
+//			following MapEntity_ParseToken()'s rules. Returns false on anything
+//			unusual, like quoted strings too long for a token, so the caller
+//			can fall back to parsing the text one entity at a time.
+//-----------------------------------------------------------------------------
+static bool MapEntity_FindBlocks( const char *pMapData, CUtlVector<MapEntityBlock_t> &blocks )
+{
+	// Make sure the brace table is built before any worker uses it
+	char token[MAPKEY_MAXLENGTH];
+	MapEntity_ParseToken( "{", token );
+
+	int nDepth = 0;
+	const char *data = pMapData;
+	while ( true )
+	{
+		int c;
+
+		// skip whitespace and // comments
+		while ( true )
+		{
+			while ( ( c = *data ) <= ' ' )
+			{
+				if ( c == 0 )
+					return ( nDepth == 0 );
+				data++;
+			}
+
+			if ( c == '/' && data[1] == '/' )
+			{
+				while ( *data && *data != '\n' )
+					data++;
+				continue;
+			}
+			break;
+		}
+
+		if ( c == '\"' )
+		{
+			const char *pEnd = strchr( data + 1, '\"' );
+			if ( !pEnd || pEnd - ( data + 1 ) >= MAPKEY_MAXLENGTH )
+				return false;
+
+			if ( nDepth == 0 )
+				return false;	// expected an opening brace
+
+			data = pEnd + 1;
+			continue;
+		}
+
+		if ( c == '{' )
+		{
+			if ( nDepth++ == 0 )
+			{
+				blocks[ blocks.AddToTail() ].m_pStart = data + 1;
+			}
+			data++;
+			continue;
+		}
+
+		if ( c == '}' )
+		{
+			if ( nDepth == 0 )
+				return false;
+			if ( --nDepth == 0 )
+			{
+				blocks.Tail().m_pEnd = data;
+			}
+			data++;
+			continue;
+		}
+
+		if ( nDepth == 0 )
+			return false;	// expected an opening brace
+
+		if ( c == '(' || c == ')' || c == '\'' )
+		{
+			data++;
+			continue;
+		}
+
+		// a regular word
+		do
+		{
+			data++;
+			c = *data;
+		}
+		while ( c > 32 && c != '{' && c != '}' && c != '(' && c != ')' && c != '\'' );
+	}
+}
+
 // creates an entity by string name, but does not spawn it
 CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
 {
@@ -325,33 +453,83 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 		pMapData = serverenginetools->GetEntityData( pMapData );
 	}
 
+	CFastTimer timer;
+	timer.Start();
+
+	// Tokenize all the entity blocks up front, in parallel. Entities are still created
+	// and spawned one at a time below, in the order they appear in the lump.
+	CUtlVector<MapEntityBlock_t> blocks;
+	bool bPreParsed = false;
+	if ( mapentities_parallel_parse.GetBool() && pMapData )
+	{
+		bPreParsed = MapEntity_FindBlocks( pMapData, blocks ) && blocks.Count();
+		if ( bPreParsed )
+		{
+			ParallelProcess( "MapEntity_ParseAllEntities", blocks.Base(), blocks.Count(), &ParseMapEntityBlock );
+			bPreParsed = MapEntity_CheckBlocks( blocks );
+		}
+
+		if ( !bPreParsed )
+		{
+			blocks.Purge();
+		}
+	}
+
+	timer.End();
+	float flParseTime = timer.GetDuration().GetMillisecondsF();
+	timer.Start();
+
+	int nModelsPrecached, nModelRepeats;
+	CBaseEntity::GetModelComponentPrecacheStats( nModelsPrecached, nModelRepeats );
+
 	//  Loop through all entities in the map data, creating each.
-	for ( ; true; pMapData = MapEntity_SkipToNextEntity(pMapData, szTokenBuffer) )
+	for ( int iBlock = 0; true; iBlock++ )
 	{
-		//
-		// Parse the opening brace.
-		//
-		char token[MAPKEY_MAXLENGTH];
-		pMapData = MapEntity_ParseToken( pMapData, token );
+		CBaseEntity *pEntity;
+		const char *pCurMapData;
 
-		//
-		// Check to see if we've finished or not.
-		//
-		if (!pMapData)
-			break;
+		if ( bPreParsed )
+		{
+			if ( iBlock == blocks.Count() )
+				break;
 
-		if (token[0] != '{')
+			pCurMapData = blocks[iBlock].m_pStart;
+
+			CEntityMapData entData( (char*)pCurMapData, &blocks[iBlock].m_Keys );
+			pMapData = MapEntity_ParseEntity( pEntity, entData, pFilter );
+		}
+		else
 		{
-			Error( "MapEntity_ParseAllEntities: found %s when expecting {", token);
-			continue;
+			if ( iBlock > 0 )
+			{
+				pMapData = MapEntity_SkipToNextEntity( pMapData, szTokenBuffer );
+			}
+
+			//
+			// Parse the opening brace.
+			//
+			char token[MAPKEY_MAXLENGTH];
+			pMapData = MapEntity_ParseToken( pMapData, token );
+
+			//
+			// Check to see if we've finished or not.
+			//
+			if (!pMapData)
+				break;
+
+			if (token[0] != '{')
+			{
+				Error( "MapEntity_ParseAllEntities: found %s when expecting {", token);
+				continue;
+			}
+
+			//
+			// Parse the entity and add it to the spawn list.
+			//
+			pCurMapData = pMapData;
+			pMapData = MapEntity_ParseEntity(pEntity, pMapData, pFilter);
 		}
 
-		//
-		// Parse the entity and add it to the spawn list.
-		//
-		CBaseEntity *pEntity;
-		const char *pCurMapData = pMapData;
-		pMapData = MapEntity_ParseEntity(pEntity, pMapData, pFilter);
 		if (pEntity == NULL)
 			continue;
 
@@ -434,6 +612,10 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 		}
 	}
 
+	timer.End();
+	float flCreateTime = timer.GetDuration().GetMillisecondsF();
+	timer.Start();
+
 	// Now loop through all our point_template entities and tell them to make templates of everything they're pointing to
 	int iTemplates = pPointTemplates.Count();
 	for ( int i = 0; i < iTemplates; i++ )
@@ -481,8 +663,21 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 		pPointTemplate->FinishBuildingTemplates();
 	}
 
+	timer.End();
+	float flTemplateTime = timer.GetDuration().GetMillisecondsF();
+	timer.Start();
+
 	SpawnHierarchicalList( nEntities, pSpawnList, bActivateEntities );
 
+	timer.End();
+	float flSpawnTime = timer.GetDuration().GetMillisecondsF();
+
+	CBaseEntity::GetModelComponentPrecacheStats( nModelsPrecached, nModelRepeats );
+
+	DevMsg( "Map entities: %.1f ms tokenizing %d blocks%s, %.1f ms creating, %.1f ms templates, %.1f ms spawning %d entities\n",
+		flParseTime, blocks.Count(), bPreParsed ? "" : " (serial)", flCreateTime, flTemplateTime, flSpawnTime, nEntities );
+	DevMsg( "Map entities: %d models had their components precached, %d repeat precaches skipped\n", nModelsPrecached, nModelRepeats );
+
 	delete [] pSpawnMapData;
 	delete [] pSpawnList;
 }
@@ -548,6 +743,11 @@ void MapEntity_PrecacheEntity( const char *pEntData, int &nStringSize )
 const char *MapEntity_ParseEntity(CBaseEntity *&pEntity, const char *pEntData, IMapEntityFilter *pFilter)
 {
 	CEntityMapData entData( (char*)pEntData );
+	return MapEntity_ParseEntity( pEntity, entData, pFilter );
+}
+
+static const char *MapEntity_ParseEntity( CBaseEntity *&pEntity, CEntityMapData &entData, IMapEntityFilter *pFilter )
+{
 	char className[MAPKEY_MAXLENGTH];
 	
 	if (!entData.ExtractValue("classname", className))
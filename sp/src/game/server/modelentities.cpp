@@ -8,6 +8,7 @@
 #include "entityoutput.h"
 #include "ndebugoverlay.h"
 #include "modelentities.h"
+#include "ai_moveprobe.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -171,6 +172,8 @@ void CFuncBrush::TurnOff( void )
 
 	AddEffects( EF_NODRAW );
 	m_iDisabled = TRUE;
+
+	CAI_MoveProbe::InvalidateCache();
 }
 
 
@@ -188,6 +191,8 @@ void CFuncBrush::TurnOn( void )
 	}
 
 	RemoveEffects( EF_NODRAW );
+
+	CAI_MoveProbe::InvalidateCache();
 }
 
 
@@ -9,6 +9,7 @@
 #include "cbase.h"
 #include "BasePropDoor.h"
 #include "ai_basenpc.h"
+#include "ai_moveprobe.h"
 #include "npcevent.h"
 #include "engine/IEngineSound.h"
 #include "locksounds.h"
@@ -3012,6 +3013,7 @@ void CPhysicsProp::Spawn( )
 	{
 #ifdef MAPBASE
 		m_iClassname = gm_isz_class_PropPhysics;
+		gEntList.ReportEntityNamesChanged( this );
 #else
 		SetClassname( "prop_physics" );
 #endif
@@ -3027,6 +3029,7 @@ void CPhysicsProp::Spawn( )
 	if ( EntIsClass( this, gm_isz_class_PropPhysicsOverride ) )
 	{
 		m_iClassname = gm_isz_class_PropPhysics;
+		gEntList.ReportEntityNamesChanged( this );
 	}
 #else
 	if ( FClassnameIs( this, "prop_physics_override") )
@@ -4693,6 +4696,8 @@ void CBasePropDoor::DoorOpen(CBaseEntity *pOpenAwayFrom)
 	
 	SetMoveDone(&CBasePropDoor::DoorOpenMoveDone);
 
+	CAI_MoveProbe::InvalidateCache();
+
 	// Virtual function that starts the door moving for whatever type of door this is.
 	BeginOpening(pOpenAwayFrom);
 
@@ -4727,6 +4732,7 @@ void CBasePropDoor::DoorOpen(CBaseEntity *pOpenAwayFrom)
 void CBasePropDoor::DoorOpenMoveDone(void)
 {
 	SetDoorBlocker( NULL );
+	CAI_MoveProbe::InvalidateCache();
 
 	if (!HasSpawnFlags(SF_DOOR_SILENT))
 	{
@@ -4816,6 +4822,8 @@ void CBasePropDoor::DoorClose(void)
 
 	SetMoveDone(&CBasePropDoor::DoorCloseMoveDone);
 
+	CAI_MoveProbe::InvalidateCache();
+
 	// This will set the movedone time.
 	BeginClosing();
 
@@ -4848,6 +4856,7 @@ void CBasePropDoor::DoorClose(void)
 void CBasePropDoor::DoorCloseMoveDone(void)
 {
 	SetDoorBlocker( NULL );
+	CAI_MoveProbe::InvalidateCache();
 
 	if (!HasSpawnFlags(SF_DOOR_SILENT))
 	{
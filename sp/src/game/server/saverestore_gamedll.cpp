@@ -8,126 +8,147 @@
 #include "cbase.h"
 #include "isaverestore.h"
 #include "saverestoretypes.h"
+#include "datamap_index.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+//-----------------------------------------------------------------------------
+// Purpose: The next keyvalue field in this level of the map named szKeyName,
+//			starting at iField, or -1. The index only knows the first one.
+//-----------------------------------------------------------------------------
+static int FindNextKeyField( datamap_t *pMap, int iField, const char *szKeyName )
+{
+	for ( ; iField < pMap->dataNumFields; iField++ )
+	{
+		const typedescription_t &field = pMap->dataDesc[iField];
+		if ( (field.flags & FTYPEDESC_KEY) && !stricmp( field.externalName, szKeyName ) )
+			return iField;
+	}
+
+	return -1;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: iterates through a typedescript data block, so it can insert key/value data into the block
 // Input  : *pObject - pointer to the struct or class the data is to be insterted into
-//			*pFields - description of the data
-//			iNumFields - number of fields contained in pFields
+//			*pMap - description of the data, only this level is searched
 //			char *szKeyName - name of the variable to look for
 //			char *szValue - value to set the variable to
 // Output : Returns true if the variable is found and set, false if the key is not found.
 //-----------------------------------------------------------------------------
-bool ParseKeyvalue( void *pObject, typedescription_t *pFields, int iNumFields, const char *szKeyName, const char *szValue )
+bool ParseKeyvalue( void *pObject, datamap_t *pMap, const char *szKeyName, const char *szValue )
 {
-	int i;
-	typedescription_t 	*pField;
+	const CUtlVector<int> &embeddedFields = DataDesc_GetEmbeddedFields( pMap );
+	int iEmbedded = 0;
 
-	for ( i = 0; i < iNumFields; i++ )
+	// A key with a type that can't be handled doesn't end the search: later fields
+	// with the same key and nested classes in this level are still tried.
+	for ( int iKeyField = DataDesc_FindFieldIndex( pMap, DATADESC_LOOKUP_KEY, szKeyName ); ; iKeyField = FindNextKeyField( pMap, iKeyField + 1, szKeyName ) )
 	{
-		pField = &pFields[i];
-
-		int fieldOffset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
-
-		// Check the nested classes, but only if they aren't in array form.
-		if ((pField->fieldType == FIELD_EMBEDDED) && (pField->fieldSize == 1))
+		// Check the nested classes declared ahead of the key, but only if they aren't in array form.
+		for ( ; iEmbedded < embeddedFields.Count(); iEmbedded++ )
 		{
-			for ( datamap_t *dmap = pField->td; dmap != NULL; dmap = dmap->baseMap )
+			if ( iKeyField != -1 && embeddedFields[iEmbedded] > iKeyField )
+				break;
+
+			typedescription_t *pEmbeddedField = &pMap->dataDesc[ embeddedFields[iEmbedded] ];
+			void *pEmbeddedObject = (void*)((char*)pObject + pEmbeddedField->fieldOffset[ TD_OFFSET_NORMAL ]);
+			for ( datamap_t *dmap = pEmbeddedField->td; dmap != NULL; dmap = dmap->baseMap )
 			{
-				void *pEmbeddedObject = (void*)((char*)pObject + fieldOffset);
-				if ( ParseKeyvalue( pEmbeddedObject, dmap->dataDesc, dmap->dataNumFields, szKeyName, szValue) )
+				if ( ParseKeyvalue( pEmbeddedObject, dmap, szKeyName, szValue ) )
 					return true;
 			}
 		}
 
-		if ( (pField->flags & FTYPEDESC_KEY) && !stricmp(pField->externalName, szKeyName) )
+		if ( iKeyField == -1 )
+			break;
+
+		typedescription_t *pField = &pMap->dataDesc[ iKeyField ];
+		int fieldOffset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
+
+		switch( pField->fieldType )
 		{
-			switch( pField->fieldType )
-			{
-			case FIELD_MODELNAME:
-			case FIELD_SOUNDNAME:
-			case FIELD_STRING:
-				(*(string_t *)((char *)pObject + fieldOffset)) = AllocPooledString( szValue );
-				return true;
-
-			case FIELD_TIME:
-			case FIELD_FLOAT:
-				(*(float *)((char *)pObject + fieldOffset)) = atof( szValue );
-				return true;
-
-			case FIELD_BOOLEAN:
-				(*(bool *)((char *)pObject + fieldOffset)) = (bool)(atoi( szValue ) != 0);
-				return true;
-
-			case FIELD_CHARACTER:
-				(*(char *)((char *)pObject + fieldOffset)) = (char)atoi( szValue );
-				return true;
-
-			case FIELD_SHORT:
-				(*(short *)((char *)pObject + fieldOffset)) = (short)atoi( szValue );
-				return true;
-
-			case FIELD_INTEGER:
-			case FIELD_TICK:
-				(*(int *)((char *)pObject + fieldOffset)) = atoi( szValue );
-				return true;
-
-			case FIELD_POSITION_VECTOR:
-			case FIELD_VECTOR:
-				UTIL_StringToVector( (float *)((char *)pObject + fieldOffset), szValue );
-				return true;
-
-			case FIELD_VMATRIX:
-			case FIELD_VMATRIX_WORLDSPACE:
-				UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 16, szValue );
-				return true;
-
-			case FIELD_MATRIX3X4_WORLDSPACE:
-				UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 12, szValue );
-				return true;
-
-			case FIELD_COLOR32:
-				UTIL_StringToColor32( (color32 *) ((char *)pObject + fieldOffset), szValue );
-				return true;
+		case FIELD_MODELNAME:
+		case FIELD_SOUNDNAME:
+		case FIELD_STRING:
+			(*(string_t *)((char *)pObject + fieldOffset)) = AllocPooledString( szValue );
+			return true;
+
+		case FIELD_TIME:
+		case FIELD_FLOAT:
+			(*(float *)((char *)pObject + fieldOffset)) = atof( szValue );
+			return true;
+
+		case FIELD_BOOLEAN:
+			(*(bool *)((char *)pObject + fieldOffset)) = (bool)(atoi( szValue ) != 0);
+			return true;
+
+		case FIELD_CHARACTER:
+			(*(char *)((char *)pObject + fieldOffset)) = (char)atoi( szValue );
+			return true;
+
+		case FIELD_SHORT:
+			(*(short *)((char *)pObject + fieldOffset)) = (short)atoi( szValue );
+			return true;
+
+		case FIELD_INTEGER:
+		case FIELD_TICK:
+			(*(int *)((char *)pObject + fieldOffset)) = atoi( szValue );
+			return true;
+
+		case FIELD_POSITION_VECTOR:
+		case FIELD_VECTOR:
+			UTIL_StringToVector( (float *)((char *)pObject + fieldOffset), szValue );
+			return true;
+
+		case FIELD_VMATRIX:
+		case FIELD_VMATRIX_WORLDSPACE:
+			UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 16, szValue );
+			return true;
+
+		case FIELD_MATRIX3X4_WORLDSPACE:
+			UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 12, szValue );
+			return true;
+
+		case FIELD_COLOR32:
+			UTIL_StringToColor32( (color32 *) ((char *)pObject + fieldOffset), szValue );
+			return true;
 
 #ifdef MAPBASE
-			case FIELD_EHANDLE:
-				((CBaseHandle*)((char*)pObject + fieldOffset))->Set(gEntList.FindEntityByName(NULL, szValue));
-				return true;
-
-			case FIELD_INTERVAL:
-				extern interval_t ReadInterval( const char *pString );
-				(*(interval_t*)((char *)pObject + fieldOffset)) = ReadInterval( szValue );
-				return true;
+		case FIELD_EHANDLE:
+			((CBaseHandle*)((char*)pObject + fieldOffset))->Set(gEntList.FindEntityByName(NULL, szValue));
+			return true;
+
+		case FIELD_INTERVAL:
+			extern interval_t ReadInterval( const char *pString );
+			(*(interval_t*)((char *)pObject + fieldOffset)) = ReadInterval( szValue );
+			return true;
 #endif
 
-			case FIELD_CUSTOM:
+		case FIELD_CUSTOM:
+		{
+			SaveRestoreFieldInfo_t fieldInfo =
 			{
-				SaveRestoreFieldInfo_t fieldInfo =
-				{
-					(char *)pObject + fieldOffset,
-					pObject,
-					pField
-				};
-				pField->pSaveRestoreOps->Parse( fieldInfo, szValue );
-				return true;
-			}
+				(char *)pObject + fieldOffset,
+				pObject,
+				pField
+			};
+			pField->pSaveRestoreOps->Parse( fieldInfo, szValue );
+			return true;
+		}
 
-			default:
+		default:
 #ifndef MAPBASE
-			case FIELD_INTERVAL: // Fixme, could write this if needed
+		case FIELD_INTERVAL: // Fixme, could write this if needed
 #endif
-			case FIELD_CLASSPTR:
-			case FIELD_MODELINDEX:
-			case FIELD_MATERIALINDEX:
-			case FIELD_EDICT:
-				Warning( "Bad field in entity!!\n" );
-				Assert(0);
-				break;
-			}
+		case FIELD_CLASSPTR:
+		case FIELD_MODELINDEX:
+		case FIELD_MATERIALINDEX:
+		case FIELD_EDICT:
+			Warning( "Bad field in entity!!\n" );
+			Assert(0);
+			break;
 		}
 	}
 
@@ -138,115 +159,119 @@ bool ParseKeyvalue( void *pObject, typedescription_t *pFields, int iNumFields, c
 //-----------------------------------------------------------------------------
 // Purpose: iterates through a typedescript data block, so it can insert key/value data into the block
 // Input  : *pObject - pointer to the struct or class the data is to be insterted into
-//			*pFields - description of the data
-//			iNumFields - number of fields contained in pFields
+//			*pMap - description of the data, only this level is searched
 //			char *szKeyName - name of the variable to look for
 //			char *szValue - value to set the variable to
 // Output : Returns true if the variable is found and set, false if the key is not found.
 //-----------------------------------------------------------------------------
-bool ExtractKeyvalue( void *pObject, typedescription_t *pFields, int iNumFields, const char *szKeyName, char *szValue, int iMaxLen )
+bool ExtractKeyvalue( void *pObject, datamap_t *pMap, const char *szKeyName, char *szValue, int iMaxLen )
 {
-	int i;
-	typedescription_t 	*pField;
+	const CUtlVector<int> &embeddedFields = DataDesc_GetEmbeddedFields( pMap );
+	int iEmbedded = 0;
 
-	for ( i = 0; i < iNumFields; i++ )
+	// A key with a type that can't be handled doesn't end the search: later fields
+	// with the same key and nested classes in this level are still tried.
+	for ( int iKeyField = DataDesc_FindFieldIndex( pMap, DATADESC_LOOKUP_KEY, szKeyName ); ; iKeyField = FindNextKeyField( pMap, iKeyField + 1, szKeyName ) )
 	{
-		pField = &pFields[i];
-
-		int fieldOffset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
-
-		// Check the nested classes, but only if they aren't in array form.
-		if ((pField->fieldType == FIELD_EMBEDDED) && (pField->fieldSize == 1))
+		// Check the nested classes declared ahead of the key, but only if they aren't in array form.
+		for ( ; iEmbedded < embeddedFields.Count(); iEmbedded++ )
 		{
-			for ( datamap_t *dmap = pField->td; dmap != NULL; dmap = dmap->baseMap )
+			if ( iKeyField != -1 && embeddedFields[iEmbedded] > iKeyField )
+				break;
+
+			typedescription_t *pEmbeddedField = &pMap->dataDesc[ embeddedFields[iEmbedded] ];
+			void *pEmbeddedObject = (void*)((char*)pObject + pEmbeddedField->fieldOffset[ TD_OFFSET_NORMAL ]);
+			for ( datamap_t *dmap = pEmbeddedField->td; dmap != NULL; dmap = dmap->baseMap )
 			{
-				void *pEmbeddedObject = (void*)((char*)pObject + fieldOffset);
-				if ( ExtractKeyvalue( pEmbeddedObject, dmap->dataDesc, dmap->dataNumFields, szKeyName, szValue, iMaxLen ) )
+				if ( ExtractKeyvalue( pEmbeddedObject, dmap, szKeyName, szValue, iMaxLen ) )
 					return true;
 			}
 		}
 
-		if ( (pField->flags & FTYPEDESC_KEY) && !stricmp(pField->externalName, szKeyName) )
+		if ( iKeyField == -1 )
+			break;
+
+		typedescription_t *pField = &pMap->dataDesc[ iKeyField ];
+		int fieldOffset = pField->fieldOffset[ TD_OFFSET_NORMAL ];
+
+		switch( pField->fieldType )
 		{
-			switch( pField->fieldType )
-			{
-			case FIELD_MODELNAME:
-			case FIELD_SOUNDNAME:
-			case FIELD_STRING:
-				Q_strncpy( szValue, ((char *)pObject + fieldOffset), iMaxLen );
-				return true;
-
-			case FIELD_TIME:
-			case FIELD_FLOAT:
-				Q_snprintf( szValue, iMaxLen, "%f", (*(float *)((char *)pObject + fieldOffset)) );
-				return true;
-
-			case FIELD_BOOLEAN:
-				Q_snprintf( szValue, iMaxLen, "%d", (*(bool *)((char *)pObject + fieldOffset)) != 0);
-				return true;
-
-			case FIELD_CHARACTER:
-				Q_snprintf( szValue, iMaxLen, "%d", (*(char *)((char *)pObject + fieldOffset)) );
-				return true;
-
-			case FIELD_SHORT:
-				Q_snprintf( szValue, iMaxLen, "%d", (*(short *)((char *)pObject + fieldOffset)) );
-				return true;
-
-			case FIELD_INTEGER:
-			case FIELD_TICK:
-				Q_snprintf( szValue, iMaxLen, "%d", (*(int *)((char *)pObject + fieldOffset)) );
-				return true;
-
-			case FIELD_POSITION_VECTOR:
-			case FIELD_VECTOR:
-				Q_snprintf( szValue, iMaxLen, "%f %f %f", 
-					((float *)((char *)pObject + fieldOffset))[0],
-					((float *)((char *)pObject + fieldOffset))[1],
-					((float *)((char *)pObject + fieldOffset))[2] );
-				return true;
-
-			case FIELD_VMATRIX:
-			case FIELD_VMATRIX_WORLDSPACE:
-				//UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 16, szValue );
-				return false;
-
-			case FIELD_MATRIX3X4_WORLDSPACE:
-				//UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 12, szValue );
-				return false;
-
-			case FIELD_COLOR32:
-				Q_snprintf( szValue, iMaxLen, "%d %d %d %d", 
-					((int *)((char *)pObject + fieldOffset))[0],
-					((int *)((char *)pObject + fieldOffset))[1],
-					((int *)((char *)pObject + fieldOffset))[2],
-					((int *)((char *)pObject + fieldOffset))[3] );
-				return true;
-
-			case FIELD_CUSTOM:
+		case FIELD_MODELNAME:
+		case FIELD_SOUNDNAME:
+		case FIELD_STRING:
+			Q_strncpy( szValue, ((char *)pObject + fieldOffset), iMaxLen );
+			return true;
+
+		case FIELD_TIME:
+		case FIELD_FLOAT:
+			Q_snprintf( szValue, iMaxLen, "%f", (*(float *)((char *)pObject + fieldOffset)) );
+			return true;
+
+		case FIELD_BOOLEAN:
+			Q_snprintf( szValue, iMaxLen, "%d", (*(bool *)((char *)pObject + fieldOffset)) != 0);
+			return true;
+
+		case FIELD_CHARACTER:
+			Q_snprintf( szValue, iMaxLen, "%d", (*(char *)((char *)pObject + fieldOffset)) );
+			return true;
+
+		case FIELD_SHORT:
+			Q_snprintf( szValue, iMaxLen, "%d", (*(short *)((char *)pObject + fieldOffset)) );
+			return true;
+
+		case FIELD_INTEGER:
+		case FIELD_TICK:
+			Q_snprintf( szValue, iMaxLen, "%d", (*(int *)((char *)pObject + fieldOffset)) );
+			return true;
+
+		case FIELD_POSITION_VECTOR:
+		case FIELD_VECTOR:
+			Q_snprintf( szValue, iMaxLen, "%f %f %f", 
+				((float *)((char *)pObject + fieldOffset))[0],
+				((float *)((char *)pObject + fieldOffset))[1],
+				((float *)((char *)pObject + fieldOffset))[2] );
+			return true;
+
+		case FIELD_VMATRIX:
+		case FIELD_VMATRIX_WORLDSPACE:
+			//UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 16, szValue );
+			return false;
+
+		case FIELD_MATRIX3X4_WORLDSPACE:
+			//UTIL_StringToFloatArray( (float *)((char *)pObject + fieldOffset), 12, szValue );
+			return false;
+
+		case FIELD_COLOR32:
+			Q_snprintf( szValue, iMaxLen, "%d %d %d %d", 
+				((int *)((char *)pObject + fieldOffset))[0],
+				((int *)((char *)pObject + fieldOffset))[1],
+				((int *)((char *)pObject + fieldOffset))[2],
+				((int *)((char *)pObject + fieldOffset))[3] );
+			return true;
+
+		case FIELD_CUSTOM:
+		{
+			/*
+			SaveRestoreFieldInfo_t fieldInfo =
 			{
-				/*
-				SaveRestoreFieldInfo_t fieldInfo =
-				{
-					(char *)pObject + fieldOffset,
-					pObject,
-					pField
-				};
-				pField->pSaveRestoreOps->Parse( fieldInfo, szValue );
-				*/
-				return false;
-			}
+				(char *)pObject + fieldOffset,
+				pObject,
+				pField
+			};
+			pField->pSaveRestoreOps->Parse( fieldInfo, szValue );
+			*/
+			return false;
+		}
 
-			default:
-			case FIELD_INTERVAL: // Fixme, could write this if needed
-			case FIELD_CLASSPTR:
-			case FIELD_MODELINDEX:
-			case FIELD_MATERIALINDEX:
-			case FIELD_EDICT:
-				Warning( "Bad field in entity!!\n" );
-				Assert(0);
-				break;
-			}
+		default:
+		case FIELD_INTERVAL: // Fixme, could write this if needed
+		case FIELD_CLASSPTR:
+		case FIELD_MODELINDEX:
+		case FIELD_MATERIALINDEX:
+		case FIELD_EDICT:
+			Warning( "Bad field in entity!!\n" );
+			Assert(0);
+			break;
 		}
 	}
 
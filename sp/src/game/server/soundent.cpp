@@ -9,6 +9,7 @@
 #include "soundent.h"
 #include "game.h"
 #include "world.h"
+#include "isaverestore.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -21,6 +22,8 @@
 #define SOUNDLISTTYPE_FREE		1
 #define SOUNDLISTTYPE_ACTIVE	2
 
+// size of the grid cells sounds are bucketed by, in world units.
+#define SOUNDENT_BUCKET_SIZE	2048.0f
 
 
 LINK_ENTITY_TO_CLASS( soundent, CSoundEnt );
@@ -84,6 +87,10 @@ void CSound::Clear ( void )
 	m_bNoExpirationTime = false;
 	m_iNext				= SOUNDLIST_EMPTY;
 	m_iNextAudible		= 0;
+	m_iBucket			= SOUNDLIST_EMPTY;
+	m_iBucketNext		= SOUNDLIST_EMPTY;
+	m_iBucketPrev		= SOUNDLIST_EMPTY;
+	m_iSerial			= -1;
 }
 
 //=========================================================
@@ -96,6 +103,19 @@ void CSound::Reset ( void )
 	m_iType			= 0;
 	m_iVolume		= 0;
 	m_iNext			= SOUNDLIST_EMPTY;
+
+	CSoundEnt::UpdateSoundBucket( this );
+}
+
+//=========================================================
+// SetSoundOrigin - moves the sound, refiling it for
+// listeners if it lives in the sound pool.
+//=========================================================
+void CSound::SetSoundOrigin( const Vector &vecOrigin )
+{
+	m_vecOrigin = vecOrigin;
+
+	CSoundEnt::UpdateSoundBucket( this );
 }
 
 //=========================================================
@@ -214,6 +234,11 @@ BEGIN_DATADESC( CSoundEnt )
 	DEFINE_FIELD( m_iActiveSound,		FIELD_INTEGER ),
 	DEFINE_FIELD( m_cLastActiveSounds,	FIELD_INTEGER ),
 	DEFINE_EMBEDDED_ARRAY( m_SoundPool, MAX_WORLD_SOUNDS_SP ),
+	DEFINE_FIELD( m_nExtraSoundBlocks,	FIELD_INTEGER ),
+//	m_ExtraSoundBlocks		(saved in Save())
+//	m_SoundBuckets			(not saved, rebuilt)
+//	m_nReservedSounds		(not saved, rebuilt)
+//	m_iNextSerial			(not saved, rebuilt)
 
 END_DATADESC()
 
@@ -249,10 +274,121 @@ void CSoundEnt::ShutdownSoundEnt()
 //-----------------------------------------------------------------------------
 CSoundEnt::CSoundEnt()
 {
+	m_nExtraSoundBlocks = 0;
+	m_nReservedSounds = 0;
+	m_iNextSerial = 0;
+	m_nActiveSounds = 0;
+	m_nSoundsInserted = 0;
+	m_nListens = 0;
+	m_nSoundsExamined = 0;
+	m_nActiveSoundsAtListens = 0;
 }
 
 CSoundEnt::~CSoundEnt()
 {
+	FreePoolBlocks();
+}
+
+
+//-----------------------------------------------------------------------------
+// Pool access. Indices past the fixed array refer to the grown blocks, which
+// are allocated separately so outstanding CSound pointers stay valid.
+//-----------------------------------------------------------------------------
+inline CSound &CSoundEnt::Sound( int iSound )
+{
+	if ( iSound < MAX_WORLD_SOUNDS_MP )
+		return m_SoundPool[ iSound ];
+
+	iSound -= MAX_WORLD_SOUNDS_MP;
+	return m_ExtraSoundBlocks[ iSound / SOUNDENT_POOL_BLOCK_SIZE ][ iSound % SOUNDENT_POOL_BLOCK_SIZE ];
+}
+
+inline int CSoundEnt::PoolSize( void ) const
+{
+	return MAX_WORLD_SOUNDS_MP + m_ExtraSoundBlocks.Count() * SOUNDENT_POOL_BLOCK_SIZE;
+}
+
+//=========================================================
+// GrowPool - adds a block of sounds to the free list once
+// the fixed pool has run out.
+//=========================================================
+bool CSoundEnt::GrowPool( void )
+{
+	int iFirst = PoolSize();
+	if ( iFirst + SOUNDENT_POOL_BLOCK_SIZE > MAX_WORLD_SOUNDS_DYNAMIC )
+		return false;
+
+	CSound *pBlock = new CSound[ SOUNDENT_POOL_BLOCK_SIZE ];
+	m_ExtraSoundBlocks.AddToTail( pBlock );
+	m_nExtraSoundBlocks = m_ExtraSoundBlocks.Count();
+
+	for ( int i = 0; i < SOUNDENT_POOL_BLOCK_SIZE; i++ )
+	{
+		pBlock[ i ].Clear();
+		pBlock[ i ].m_iMyIndex = iFirst + i;
+		pBlock[ i ].m_iNext = ( i < SOUNDENT_POOL_BLOCK_SIZE - 1 ) ? iFirst + i + 1 : m_iFreeSound;
+	}
+
+	m_iFreeSound = iFirst;
+
+	DevMsg( 2, "CSoundEnt grew its pool to %d sounds\n", PoolSize() );
+	return true;
+}
+
+void CSoundEnt::FreePoolBlocks( void )
+{
+	for ( int i = 0; i < m_ExtraSoundBlocks.Count(); i++ )
+	{
+		delete [] m_ExtraSoundBlocks[ i ];
+	}
+
+	m_ExtraSoundBlocks.Purge();
+	m_nExtraSoundBlocks = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Save/load of the grown blocks. These follow the datadesc fields, and
+// m_nExtraSoundBlocks tells the restore how many there are.
+//-----------------------------------------------------------------------------
+int CSoundEnt::Save( ISave &save )
+{
+	if ( !BaseClass::Save( save ) )
+		return 0;
+
+	for ( int i = 0; i < m_ExtraSoundBlocks.Count(); i++ )
+	{
+		for ( int j = 0; j < SOUNDENT_POOL_BLOCK_SIZE; j++ )
+		{
+			save.WriteAll( &m_ExtraSoundBlocks[ i ][ j ], &CSound::m_DataMap );
+		}
+	}
+
+	return 1;
+}
+
+int CSoundEnt::Restore( IRestore &restore )
+{
+	if ( !BaseClass::Restore( restore ) )
+		return 0;
+
+	int nBlocks = m_nExtraSoundBlocks;
+	FreePoolBlocks();
+
+	for ( int i = 0; i < nBlocks; i++ )
+	{
+		CSound *pBlock = new CSound[ SOUNDENT_POOL_BLOCK_SIZE ];
+		m_ExtraSoundBlocks.AddToTail( pBlock );
+
+		for ( int j = 0; j < SOUNDENT_POOL_BLOCK_SIZE; j++ )
+		{
+			pBlock[ j ].Clear();
+			restore.ReadAll( &pBlock[ j ], &CSound::m_DataMap );
+		}
+	}
+
+	m_nExtraSoundBlocks = m_ExtraSoundBlocks.Count();
+	return 1;
 }
 
 
@@ -278,6 +414,9 @@ void CSoundEnt::OnRestore()
 		UTIL_Remove( g_pSoundEnt );
 	}
 	g_pSoundEnt = this;
+
+	m_nReservedSounds = gpGlobals->maxClients;
+	RebuildBuckets();
 }
 
 
@@ -298,17 +437,17 @@ void CSoundEnt::Think ( void )
 
 	while ( iSound != SOUNDLIST_EMPTY )
 	{
-		if ( (m_SoundPool[ iSound ].m_flExpireTime <= gpGlobals->curtime && (!m_SoundPool[ iSound ].m_bNoExpirationTime)) || !m_SoundPool[iSound].ValidateOwner() )
+		if ( (Sound( iSound ).m_flExpireTime <= gpGlobals->curtime && (!Sound( iSound ).m_bNoExpirationTime)) || !Sound( iSound ).ValidateOwner() )
 		{
-			int iNext = m_SoundPool[ iSound ].m_iNext;
+			int iNext = Sound( iSound ).m_iNext;
 
 			if( displaysoundlist.GetInt() == 1 )
 			{
-				Msg("  Removed Sound: %d (Time:%f)\n", m_SoundPool[ iSound ].SoundType(), gpGlobals->curtime );
+				Msg("  Removed Sound: %d (Time:%f)\n", Sound( iSound ).SoundType(), gpGlobals->curtime );
 			}
-			if( displaysoundlist.GetInt() == 2 && m_SoundPool[ iSound ].IsSoundType( SOUND_DANGER ) )
+			if( displaysoundlist.GetInt() == 2 && Sound( iSound ).IsSoundType( SOUND_DANGER ) )
 			{
-				Msg("  Removed Danger Sound: %d (time:%f)\n", m_SoundPool[ iSound ].SoundType(), gpGlobals->curtime );
+				Msg("  Removed Danger Sound: %d (time:%f)\n", Sound( iSound ).SoundType(), gpGlobals->curtime );
 			}
 
 			// move this sound back into the free list
@@ -329,7 +468,7 @@ void CSoundEnt::Think ( void )
 				g = 255;
 				b = 0;
 
-				CSound *pSound = &m_SoundPool[ iSound ];
+				CSound *pSound = &Sound( iSound );
 
 				if( pSound->IsSoundType( SOUND_DANGER ) )
 				{
@@ -369,7 +508,7 @@ void CSoundEnt::Think ( void )
 			}
 
 			iPreviousSound = iSound;
-			iSound = m_SoundPool[ iSound ].m_iNext;
+			iSound = Sound( iSound ).m_iNext;
 		}
 	}
 
@@ -399,17 +538,21 @@ void CSoundEnt::FreeSound ( int iSound, int iPrevious )
 	{
 		// iSound is not the head of the active list, so
 		// must fix the index for the Previous sound
-		g_pSoundEnt->m_SoundPool[ iPrevious ].m_iNext = g_pSoundEnt->m_SoundPool[ iSound ].m_iNext;
+		g_pSoundEnt->Sound( iPrevious ).m_iNext = g_pSoundEnt->Sound( iSound ).m_iNext;
 	}
 	else 
 	{
 		// the sound we're freeing IS the head of the active list.
-		g_pSoundEnt->m_iActiveSound = g_pSoundEnt->m_SoundPool [ iSound ].m_iNext;
+		g_pSoundEnt->m_iActiveSound = g_pSoundEnt->Sound( iSound ).m_iNext;
 	}
 
 	// make iSound the head of the Free list.
-	g_pSoundEnt->m_SoundPool[ iSound ].m_iNext = g_pSoundEnt->m_iFreeSound;
+	CSound *pSound = &g_pSoundEnt->Sound( iSound );
+	g_pSoundEnt->RemoveFromBucket( pSound );
+	pSound->m_iSerial = -1;
+	pSound->m_iNext = g_pSoundEnt->m_iFreeSound;
 	g_pSoundEnt->m_iFreeSound = iSound;
+	g_pSoundEnt->m_nActiveSounds--;
 }
 
 //=========================================================
@@ -420,7 +563,7 @@ int CSoundEnt::IAllocSound( void )
 {
 	int iNewSound;
 
-	if ( m_iFreeSound == SOUNDLIST_EMPTY )
+	if ( m_iFreeSound == SOUNDLIST_EMPTY && !GrowPool() )
 	{
 		// no free sound!
 		if ( developer.GetInt() >= 2 )
@@ -434,15 +577,15 @@ int CSoundEnt::IAllocSound( void )
 	
 	iNewSound = m_iFreeSound;// copy the index of the next free sound
 
-	m_iFreeSound = m_SoundPool[ m_iFreeSound ].m_iNext;// move the index down into the free list. 
+	m_iFreeSound = Sound( m_iFreeSound ).m_iNext;// move the index down into the free list. 
 
-	m_SoundPool[ iNewSound ].m_iNext = m_iActiveSound;// point the new sound at the top of the active list.
+	Sound( iNewSound ).m_iNext = m_iActiveSound;// point the new sound at the top of the active list.
 
 	m_iActiveSound = iNewSound;// now make the new sound the top of the active list. You're done.
 
-#ifdef DEBUG
-	m_SoundPool[ iNewSound ].m_iMyIndex = iNewSound;
-#endif // DEBUG
+	Sound( iNewSound ).m_iMyIndex = iNewSound;
+	Sound( iNewSound ).m_iSerial = m_iNextSerial++;
+	m_nActiveSounds++;
 
 	return iNewSound;
 }
@@ -478,9 +621,9 @@ void CSoundEnt::InsertSound ( int iType, const Vector &vecOrigin, int iVolume, f
 
 	CSound *pSound;
 
-	pSound = &g_pSoundEnt->m_SoundPool[ iThisSound ];
+	pSound = &g_pSoundEnt->Sound( iThisSound );
 
-	pSound->SetSoundOrigin( vecOrigin );
+	pSound->m_vecOrigin = vecOrigin;
 	pSound->m_iType = iType;
 	pSound->m_iVolume = iVolume;
 	pSound->m_flOcclusionScale = 0.5;
@@ -502,6 +645,9 @@ void CSoundEnt::InsertSound ( int iType, const Vector &vecOrigin, int iVolume, f
 		pSound->m_bHasOwner = false;
 	}
 
+	UpdateSoundBucket( pSound );
+	g_pSoundEnt->m_nSoundsInserted++;
+
 	if( displaysoundlist.GetInt() == 1 )
 	{
 		Msg("  Added Sound! Type:%d  Duration:%f (Time:%f)\n", pSound->SoundType(), flDuration, gpGlobals->curtime );
@@ -520,7 +666,7 @@ int CSoundEnt::FindOrAllocateSound( CBaseEntity *pOwner, int soundChannelIndex )
 
 	while ( iSound != SOUNDLIST_EMPTY )
 	{
-		CSound &sound = m_SoundPool[iSound];
+		CSound &sound = Sound( iSound );
 		
 		if ( sound.m_ownerChannelIndex == soundChannelIndex && sound.m_hOwner == pOwner )
 		{
@@ -546,6 +692,12 @@ void CSoundEnt::Initialize ( void )
 	m_iFreeSound = 0;
 	m_iActiveSound = SOUNDLIST_EMPTY;
 
+	FreePoolBlocks();
+	m_SoundBuckets.Purge();
+	m_nReservedSounds = gpGlobals->maxClients;
+	m_iNextSerial = 0;
+	m_nActiveSounds = 0;
+
 	// In SP, we should only use the first 64 slots so save/load works right.
 	// In MP, have one for each player and 32 extras.
 	int nTotalSoundsInPool = MAX_WORLD_SOUNDS_SP;
@@ -560,11 +712,12 @@ void CSoundEnt::Initialize ( void )
 	for ( i = 0 ; i < nTotalSoundsInPool ; i++ )
 	{
 		// clear all sounds, and link them into the free sound list.
-		m_SoundPool[ i ].Clear();
-		m_SoundPool[ i ].m_iNext = i + 1;
+		Sound( i ).Clear();
+		Sound( i ).m_iMyIndex = i;
+		Sound( i ).m_iNext = i + 1;
 	}
 
-	m_SoundPool[ i - 1 ].m_iNext = SOUNDLIST_EMPTY;// terminate the list here.
+	Sound( i - 1 ).m_iNext = SOUNDLIST_EMPTY;// terminate the list here.
 
 	
 	// now reserve enough sounds for each client
@@ -578,7 +731,7 @@ void CSoundEnt::Initialize ( void )
 			return;
 		}
 
-		m_SoundPool[ iSound ].m_bNoExpirationTime = true;
+		Sound( iSound ).m_bNoExpirationTime = true;
 	}
 }
 
@@ -615,7 +768,7 @@ int CSoundEnt::ISoundsInList ( int iListType )
 	{
 		i++;
 
-		iThisSound = m_SoundPool[ iThisSound ].m_iNext;
+		iThisSound = Sound( iThisSound ).m_iNext;
 	}
 
 	return i;
@@ -658,7 +811,7 @@ CSound*	CSoundEnt::SoundPointerForIndex( int iIndex )
 		return NULL;
 	}
 
-	if ( iIndex > ( MAX_WORLD_SOUNDS_MP - 1 ) )
+	if ( iIndex > ( g_pSoundEnt->PoolSize() - 1 ) )
 	{
 		Msg( "SoundPointerForIndex() - Index too large!\n" );
 		return NULL;
@@ -670,7 +823,7 @@ CSound*	CSoundEnt::SoundPointerForIndex( int iIndex )
 		return NULL;
 	}
 
-	return &g_pSoundEnt->m_SoundPool[ iIndex ];
+	return &g_pSoundEnt->Sound( iIndex );
 }
 
 //=========================================================
@@ -735,6 +888,273 @@ CSound*	CSoundEnt::GetLoudestSoundOfType( int iType, const Vector &vecEarPositio
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Refiles a pooled sound after its type, volume or origin changed.
+//			Copies of sounds (e.g. locked best sounds) and the reserved client
+//			sounds aren't filed.
+//-----------------------------------------------------------------------------
+void CSoundEnt::UpdateSoundBucket( CSound *pSound )
+{
+	if ( !g_pSoundEnt )
+		return;
+
+	int iSound = pSound->m_iMyIndex;
+	if ( iSound < g_pSoundEnt->m_nReservedSounds || iSound >= g_pSoundEnt->PoolSize() || &g_pSoundEnt->Sound( iSound ) != pSound )
+		return;
+
+	g_pSoundEnt->RemoveFromBucket( pSound );
+	g_pSoundEnt->AddToBucket( pSound );
+}
+
+void CSoundEnt::AddToBucket( CSound *pSound )
+{
+	Assert( pSound->m_iBucket == SOUNDLIST_EMPTY );
+
+	// Only sounds on the active list are filed
+	if ( pSound->m_iSerial < 0 )
+		return;
+
+	int x = Floor2Int( pSound->m_vecOrigin.x * ( 1.0f / SOUNDENT_BUCKET_SIZE ) );
+	int y = Floor2Int( pSound->m_vecOrigin.y * ( 1.0f / SOUNDENT_BUCKET_SIZE ) );
+
+	int iBucket = SOUNDLIST_EMPTY;
+	int iEmptyBucket = SOUNDLIST_EMPTY;
+	for ( int i = 0; i < m_SoundBuckets.Count(); i++ )
+	{
+		const SoundBucket_t &bucket = m_SoundBuckets[ i ];
+		if ( bucket.nSounds == 0 )
+		{
+			if ( iEmptyBucket == SOUNDLIST_EMPTY )
+				iEmptyBucket = i;
+		}
+		else if ( bucket.iType == pSound->m_iType && bucket.x == x && bucket.y == y )
+		{
+			iBucket = i;
+			break;
+		}
+	}
+
+	if ( iBucket == SOUNDLIST_EMPTY )
+	{
+		iBucket = ( iEmptyBucket != SOUNDLIST_EMPTY ) ? iEmptyBucket : m_SoundBuckets.AddToTail();
+
+		SoundBucket_t &bucket = m_SoundBuckets[ iBucket ];
+		bucket.iType = pSound->m_iType;
+		bucket.x = x;
+		bucket.y = y;
+		bucket.flMaxVolume = 0;
+		bucket.iHead = SOUNDLIST_EMPTY;
+		bucket.nSounds = 0;
+	}
+
+	SoundBucket_t &bucket = m_SoundBuckets[ iBucket ];
+
+	pSound->m_iBucket = iBucket;
+	pSound->m_iBucketPrev = SOUNDLIST_EMPTY;
+	pSound->m_iBucketNext = bucket.iHead;
+	if ( bucket.iHead != SOUNDLIST_EMPTY )
+	{
+		Sound( bucket.iHead ).m_iBucketPrev = pSound->m_iMyIndex;
+	}
+
+	bucket.iHead = pSound->m_iMyIndex;
+	bucket.nSounds++;
+	bucket.flMaxVolume = MAX( bucket.flMaxVolume, (float)pSound->m_iVolume );
+}
+
+void CSoundEnt::RemoveFromBucket( CSound *pSound )
+{
+	if ( pSound->m_iBucket == SOUNDLIST_EMPTY )
+		return;
+
+	SoundBucket_t &bucket = m_SoundBuckets[ pSound->m_iBucket ];
+
+	if ( pSound->m_iBucketPrev != SOUNDLIST_EMPTY )
+	{
+		Sound( pSound->m_iBucketPrev ).m_iBucketNext = pSound->m_iBucketNext;
+	}
+	else
+	{
+		bucket.iHead = pSound->m_iBucketNext;
+	}
+
+	if ( pSound->m_iBucketNext != SOUNDLIST_EMPTY )
+	{
+		Sound( pSound->m_iBucketNext ).m_iBucketPrev = pSound->m_iBucketPrev;
+	}
+
+	bucket.nSounds--;
+
+	pSound->m_iBucket = SOUNDLIST_EMPTY;
+	pSound->m_iBucketNext = SOUNDLIST_EMPTY;
+	pSound->m_iBucketPrev = SOUNDLIST_EMPTY;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds the listener buckets and allocation order from the
+//			restored active list.
+//-----------------------------------------------------------------------------
+void CSoundEnt::RebuildBuckets( void )
+{
+	m_SoundBuckets.Purge();
+
+	for ( int i = 0; i < PoolSize(); i++ )
+	{
+		CSound &sound = Sound( i );
+		sound.m_iMyIndex = i;
+		sound.m_iBucket = SOUNDLIST_EMPTY;
+		sound.m_iBucketNext = SOUNDLIST_EMPTY;
+		sound.m_iBucketPrev = SOUNDLIST_EMPTY;
+		sound.m_iSerial = -1;
+	}
+
+	// The head of the active list is the newest sound
+	m_nActiveSounds = ISoundsInList( SOUNDLISTTYPE_ACTIVE );
+	m_iNextSerial = m_nActiveSounds;
+
+	int iSerial = m_nActiveSounds;
+	for ( int iSound = m_iActiveSound; iSound != SOUNDLIST_EMPTY; iSound = Sound( iSound ).m_iNext )
+	{
+		CSound *pSound = &Sound( iSound );
+		pSound->m_iSerial = --iSerial;
+
+		if ( iSound >= m_nReservedSounds )
+		{
+			AddToBucket( pSound );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Sorts sound indices newest first, which is the order of the active list.
+//-----------------------------------------------------------------------------
+int __cdecl CSoundEnt::SortBySerial( const int *pLeft, const int *pRight )
+{
+	return g_pSoundEnt->Sound( *pRight ).m_iSerial - g_pSoundEnt->Sound( *pLeft ).m_iSerial;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gathers the sounds a listener at vecEarPosition could hear.
+//			Uses the same range test as CAI_Senses::CanHearSound(), so the
+//			caller only needs to apply its own occlusion/owner checks.
+//-----------------------------------------------------------------------------
+void CSoundEnt::GetSoundsInRange( int iSoundMask, const Vector &vecEarPosition, float flHearingSensitivity, SoundList_t *pSounds )
+{
+	pSounds->RemoveAll();
+
+	if ( !g_pSoundEnt )
+		return;
+
+	CSoundEnt *pSoundEnt = g_pSoundEnt;
+
+	// Client sounds are updated in place every frame, so they're always checked directly
+	for ( int i = 0; i < pSoundEnt->m_nReservedSounds; i++ )
+	{
+		CSound &sound = pSoundEnt->Sound( i );
+		if ( sound.m_iSerial < 0 || !( iSoundMask & sound.m_iType ) )
+			continue;
+
+		float flHearDistance = sound.Volume() * flHearingSensitivity;
+		if ( sound.GetSoundOrigin().DistToSqr( vecEarPosition ) <= flHearDistance * flHearDistance )
+		{
+			pSounds->AddToTail( i );
+		}
+	}
+
+	for ( int i = 0; i < pSoundEnt->m_SoundBuckets.Count(); i++ )
+	{
+		const SoundBucket_t &bucket = pSoundEnt->m_SoundBuckets[ i ];
+		if ( bucket.nSounds == 0 || !( iSoundMask & bucket.iType ) )
+			continue;
+
+		// Skip the cell if even its loudest sound can't reach the ear
+		float flMinX = bucket.x * SOUNDENT_BUCKET_SIZE;
+		float flMinY = bucket.y * SOUNDENT_BUCKET_SIZE;
+		float dx = 0, dy = 0;
+
+		if ( vecEarPosition.x < flMinX )
+			dx = flMinX - vecEarPosition.x;
+		else if ( vecEarPosition.x > flMinX + SOUNDENT_BUCKET_SIZE )
+			dx = vecEarPosition.x - ( flMinX + SOUNDENT_BUCKET_SIZE );
+
+		if ( vecEarPosition.y < flMinY )
+			dy = flMinY - vecEarPosition.y;
+		else if ( vecEarPosition.y > flMinY + SOUNDENT_BUCKET_SIZE )
+			dy = vecEarPosition.y - ( flMinY + SOUNDENT_BUCKET_SIZE );
+
+		float flReach = bucket.flMaxVolume * flHearingSensitivity;
+		if ( dx * dx + dy * dy > flReach * flReach )
+			continue;
+
+		for ( int iSound = bucket.iHead; iSound != SOUNDLIST_EMPTY; )
+		{
+			CSound &sound = pSoundEnt->Sound( iSound );
+
+			float flHearDistance = sound.Volume() * flHearingSensitivity;
+			if ( sound.GetSoundOrigin().DistToSqr( vecEarPosition ) <= flHearDistance * flHearDistance )
+			{
+				pSounds->AddToTail( iSound );
+			}
+
+			iSound = sound.m_iBucketNext;
+		}
+	}
+
+	if ( pSounds->Count() > 1 )
+	{
+		pSounds->Sort( SortBySerial );
+	}
+
+	pSoundEnt->m_nListens++;
+	pSoundEnt->m_nSoundsExamined += pSounds->Count();
+	pSoundEnt->m_nActiveSoundsAtListens += pSoundEnt->m_nActiveSounds;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Prints pool usage and listener counters, then resets the counters.
+//-----------------------------------------------------------------------------
+void CSoundEnt::ReportStats( void )
+{
+	int nBuckets = 0;
+	for ( int i = 0; i < m_SoundBuckets.Count(); i++ )
+	{
+		if ( m_SoundBuckets[ i ].nSounds )
+			nBuckets++;
+	}
+
+	Msg( "Sound pool: %d sounds (%d extra blocks), %d active, %d free, %d reserved\n",
+		PoolSize(), m_ExtraSoundBlocks.Count(), m_nActiveSounds, ISoundsInList( SOUNDLISTTYPE_FREE ), m_nReservedSounds );
+	Msg( "Buckets: %d in use, %d allocated\n", nBuckets, m_SoundBuckets.Count() );
+	Msg( "Sounds inserted: %d\n", m_nSoundsInserted );
+
+	if ( m_nListens )
+	{
+		Msg( "Listens: %d, sounds examined: %d (%.2f per listen, %.2f active per listen)\n",
+			m_nListens, m_nSoundsExamined, (float)m_nSoundsExamined / m_nListens, (float)m_nActiveSoundsAtListens / m_nListens );
+	}
+	else
+	{
+		Msg( "Listens: 0\n" );
+	}
+
+	m_nSoundsInserted = 0;
+	m_nListens = 0;
+	m_nSoundsExamined = 0;
+	m_nActiveSoundsAtListens = 0;
+}
+
+CON_COMMAND( ai_sound_stats, "Reports sound pool usage and how many sounds listeners examined since the last report." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( g_pSoundEnt )
+	{
+		g_pSoundEnt->ReportStats();
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Inserts an AI sound into the world sound list.
 //-----------------------------------------------------------------------------
@@ -21,7 +21,10 @@ enum
 	MAX_WORLD_SOUNDS_SP	= 64,	// Maximum number of sounds handled by the world at one time in single player.
 	// This is also the number of entries saved in a savegame file (for b/w compatibility).
 
-	MAX_WORLD_SOUNDS_MP	= 128	// The sound array size is set this large but we'll only use gpGlobals->maxPlayers+32 entries in mp.
+	MAX_WORLD_SOUNDS_MP	= 128,	// The sound array size is set this large but we'll only use gpGlobals->maxPlayers+32 entries in mp.
+
+	SOUNDENT_POOL_BLOCK_SIZE = 64,	// Once the fixed array runs out, the pool grows by blocks of this many sounds.
+	MAX_WORLD_SOUNDS_DYNAMIC = 2048	// Upper limit for the grown pool. Sound indices must fit in a short.
 };
 
 enum
@@ -120,7 +123,7 @@ class CSound
 public:
 	bool	DoesSoundExpire() const;
 	float	SoundExpirationTime() const;
-	void	SetSoundOrigin( const Vector &vecOrigin ) { m_vecOrigin = vecOrigin; }
+	void	SetSoundOrigin( const Vector &vecOrigin );
 	const	Vector& GetSoundOrigin( void ) { return m_vecOrigin; }
 	const	Vector& GetSoundReactOrigin( void );
 	bool	FIsSound( void );
@@ -161,9 +164,13 @@ private:
 
 	bool	m_bHasOwner;	// Lets us know if this sound was created with an owner. In case the owner goes null.
 
-#ifdef DEBUG
-	int		m_iMyIndex;		// debugging
-#endif
+	int		m_iMyIndex;		// index of this sound in the pool
+
+	// Listener index (not saved, rebuilt on restore)
+	int		m_iBucket;		// bucket this sound is filed under, or SOUNDLIST_EMPTY
+	short	m_iBucketNext;
+	short	m_iBucketPrev;
+	int		m_iSerial;		// allocation order, mirrors the order of the active list
 
 	friend class CSoundEnt;
 };
@@ -255,16 +262,62 @@ public:
 	static CSound*	GetLoudestSoundOfType( int iType, const Vector &vecEarPosition );
 	static int		ClientSoundIndex ( edict_t *pClient );
 
+	// Fills pSounds with the active sounds matching iSoundMask which are loud enough to reach
+	// vecEarPosition, in active list order. Used by listeners instead of walking the active list.
+	typedef CUtlVectorFixedGrowable<int, 32> SoundList_t;
+	static void		GetSoundsInRange( int iSoundMask, const Vector &vecEarPosition, float flHearingSensitivity, SoundList_t *pSounds );
+	static void		UpdateSoundBucket( CSound *pSound );
+
 	bool	IsEmpty( void );
 	int		ISoundsInList ( int iListType );
 	int		IAllocSound ( void );
 	int		FindOrAllocateSound( CBaseEntity *pOwner, int soundChannelIndex );
+
+	virtual int		Save( ISave &save );
+	virtual int		Restore( IRestore &restore );
+
+	void	ReportStats( void );
 	
 private:
+	CSound	&Sound( int iSound );
+	int		PoolSize( void ) const;
+	bool	GrowPool( void );
+	void	FreePoolBlocks( void );
+
+	// Sounds are filed into buckets by exact type and coarse grid cell, so listeners
+	// can skip whole groups of sounds they aren't interested in or can't reach.
+	struct SoundBucket_t
+	{
+		int		iType;
+		int		x, y;
+		float	flMaxVolume;	// loudest sound filed here since the bucket was last empty
+		short	iHead;
+		short	nSounds;
+	};
+
+	void	AddToBucket( CSound *pSound );
+	void	RemoveFromBucket( CSound *pSound );
+	void	RebuildBuckets( void );
+	static int __cdecl SortBySerial( const int *pLeft, const int *pRight );
+
 	int		m_iFreeSound;	// index of the first sound in the free sound list
 	int		m_iActiveSound; // indes of the first sound in the active sound list
 	int		m_cLastActiveSounds; // keeps track of the number of active sounds at the last update. (for diagnostic work)
 	CSound	m_SoundPool[ MAX_WORLD_SOUNDS_MP ];
+
+	CUtlVector<CSound *>	m_ExtraSoundBlocks;	// pool growth past m_SoundPool, SOUNDENT_POOL_BLOCK_SIZE sounds each
+	int						m_nExtraSoundBlocks; // saved so restore knows how many blocks follow
+
+	CUtlVector<SoundBucket_t> m_SoundBuckets;
+	int		m_nReservedSounds;	// client sounds; updated in place every frame, so never bucketed
+	int		m_iNextSerial;
+
+	// Diagnostics (ai_sound_stats)
+	int		m_nActiveSounds;
+	int		m_nSoundsInserted;
+	int		m_nListens;
+	int		m_nSoundsExamined;
+	int		m_nActiveSoundsAtListens;	// what the listeners would have walked without buckets
 };
 
 
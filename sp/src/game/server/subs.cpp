@@ -10,6 +10,7 @@
 #include "doors.h"
 #include "entitylist.h"
 #include "globals.h"
+#include "ai_moveprobe.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -208,6 +209,8 @@ void CBaseToggle::LinearMove( const Vector &vecDest, float flSpeed )
 	m_vecFinalDest = vecDest;
 
 	m_movementType = MOVE_TOGGLE_LINEAR;
+	CAI_MoveProbe::InvalidateCache();
+
 	// Already there?
 	if (vecDest == GetLocalOrigin())
 	{
@@ -241,6 +244,7 @@ void CBaseToggle::MoveDone( void )
 		break;
 	}
 	m_movementType = MOVE_TOGGLE_NONE;
+	CAI_MoveProbe::InvalidateCache();
 	BaseClass::MoveDone();
 }
 //-----------------------------------------------------------------------------
@@ -277,6 +281,8 @@ void CBaseToggle::AngularMove( const QAngle &vecDestAngle, float flSpeed )
 	m_vecFinalAngle = vecDestAngle;
 
 	m_movementType = MOVE_TOGGLE_ANGULAR;
+	CAI_MoveProbe::InvalidateCache();
+
 	// Already there?
 	if (vecDestAngle == GetLocalAngles())
 	{
@@ -0,0 +1,927 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Console commands that time tier1 containers and utilities against
+//			what they replace. They're cheats since a run can hold up the
+//			server for seconds, and only a server admin can start one.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "filesystem.h"
+#include "tier0/fasttimer.h"
+#include "tier1/strtools.h"
+#include "kvchildindex.h"
+#include "vstdlib/jobthread.h"
+#include "vstdlib/random.h"
+#include "utlsymbol.h"
+#include "utlstring.h"
+#include "fmtstr.h"
+#include "checksum_crc.h"
+#include "lzmaDecoder.h"
+#include "mempool.h"
+#include "taskpool.h"
+#include "bitbuf.h"
+#include "coordsize.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Shared by the benchmarks
+//-----------------------------------------------------------------------------
+
+// Optional numeric argument iArg, clamped to [nMin, nMax]
+static int BenchmarkArg( const CCommand &args, int iArg, int nDefault, int nMin, int nMax )
+{
+	return clamp( ( args.ArgC() > iArg ) ? atoi( args[iArg] ) : nDefault, nMin, nMax );
+}
+
+// Times one stretch of a benchmark. EndMS() never returns zero, so results
+// can be divided by it.
+class CBenchmarkTimer
+{
+public:
+	void	Start()		{ m_Timer.Start(); }
+	float	EndMS()		{ m_Timer.End(); return MAX( (float)m_Timer.GetDuration().GetMillisecondsF(), 0.001f ); }
+
+private:
+	CFastTimer	m_Timer;
+};
+
+static inline float BenchmarkNanoseconds( float flMS, float flItems )
+{
+	return flMS * 1000000.0f / flItems;
+}
+
+static inline float BenchmarkMBPerSecond( float flMB, float flMS )
+{
+	return flMB * 1000.0f / flMS;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compares loading a KeyValues file as text and from the binary
+//			cache, then finding every child of its largest section with
+//			FindKey() and with a hashed index.
+//-----------------------------------------------------------------------------
+static int KeyValuesBenchmarkCountChildren( KeyValues *pKey )
+{
+	int nChildren = 0;
+	FOR_EACH_SUBKEY( pKey, pSubKey )
+	{
+		nChildren++;
+	}
+	return nChildren;
+}
+
+static KeyValues *KeyValuesBenchmarkLoad( const char *pszFile, bool bCache )
+{
+	KeyValues::SetBinaryCacheEnabled( bCache );
+
+	KeyValues *pKV = new KeyValues( "benchmark" );
+	if ( !pKV->LoadFromFile( filesystem, pszFile ) )
+	{
+		pKV->deleteThis();
+		return NULL;
+	}
+	return pKV;
+}
+
+static void KeyValuesBenchmarkSave( KeyValues *pKV, CUtlBuffer &buf )
+{
+	for ( KeyValues *pPeer = pKV; pPeer != NULL; pPeer = pPeer->GetNextKey() )
+	{
+		pPeer->RecursiveSaveToFile( buf, 0 );
+	}
+}
+
+CON_COMMAND_F( kv_benchmark, "Times loading a KeyValues file as text and from the binary cache, and child lookups with and without a hashed index. Usage: kv_benchmark <file> [iterations]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: kv_benchmark <file> [iterations]\n" );
+		return;
+	}
+
+	const char *pszFile = args[1];
+	int nIterations = BenchmarkArg( args, 2, 20, 1, INT_MAX );
+	bool bWasEnabled = KeyValues::IsBinaryCacheEnabled();
+
+	// Text, then the cache; the first cached load writes the cache file
+	KeyValues *pText = KeyValuesBenchmarkLoad( pszFile, false );
+	KeyValues *pCached = pText ? KeyValuesBenchmarkLoad( pszFile, true ) : NULL;
+	if ( !pText || !pCached )
+	{
+		Msg( "Couldn't load %s\n", pszFile );
+		if ( pText )
+			pText->deleteThis();
+		KeyValues::SetBinaryCacheEnabled( bWasEnabled );
+		return;
+	}
+
+	pCached->deleteThis();
+
+	float flLoadMS[2];
+	for ( int iCache = 0; iCache < 2; iCache++ )
+	{
+		CBenchmarkTimer timer;
+		timer.Start();
+		for ( int i = 0; i < nIterations; i++ )
+		{
+			KeyValues *pKV = KeyValuesBenchmarkLoad( pszFile, iCache != 0 );
+			if ( pKV )
+				pKV->deleteThis();
+		}
+		flLoadMS[iCache] = timer.EndMS() / nIterations;
+	}
+
+	pCached = KeyValuesBenchmarkLoad( pszFile, true );
+	KeyValues::SetBinaryCacheEnabled( bWasEnabled );
+
+	CUtlBuffer textBuf( 0, 0, CUtlBuffer::TEXT_BUFFER ), cachedBuf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	KeyValuesBenchmarkSave( pText, textBuf );
+	KeyValuesBenchmarkSave( pCached, cachedBuf );
+	bool bMatch = ( textBuf.TellPut() == cachedBuf.TellPut() && !V_memcmp( textBuf.Base(), cachedBuf.Base(), textBuf.TellPut() ) );
+
+	Msg( "%s: text %.3f ms, cached %.3f ms per load (%d loads), trees %s\n",
+		pszFile, flLoadMS[0], flLoadMS[1], nIterations, bMatch ? "match" : "DIFFER" );
+
+	// Lookups into the section with the most children, one level down at most
+	KeyValues *pLargest = pText;
+	for ( KeyValues *pPeer = pText; pPeer != NULL; pPeer = pPeer->GetNextKey() )
+	{
+		if ( KeyValuesBenchmarkCountChildren( pPeer ) > KeyValuesBenchmarkCountChildren( pLargest ) )
+			pLargest = pPeer;
+
+		FOR_EACH_TRUE_SUBKEY( pPeer, pSubKey )
+		{
+			if ( KeyValuesBenchmarkCountChildren( pSubKey ) > KeyValuesBenchmarkCountChildren( pLargest ) )
+				pLargest = pSubKey;
+		}
+	}
+
+	CUtlVector<const char *> names;
+	FOR_EACH_SUBKEY( pLargest, pSubKey )
+	{
+		names.AddToTail( pSubKey->GetName() );
+	}
+
+	if ( names.Count() )
+	{
+		// About a thousand lookups per iteration, spread over the children
+		int nRounds = MAX( nIterations * 1000 / names.Count(), 1 );
+		int nFound[2] = { 0, 0 };
+
+		CBenchmarkTimer linearTimer;
+		linearTimer.Start();
+		for ( int i = 0; i < nRounds; i++ )
+		{
+			for ( int j = 0; j < names.Count(); j++ )
+			{
+				if ( pLargest->FindKey( names[j] ) )
+					nFound[0]++;
+			}
+		}
+		float flLinearMS = linearTimer.EndMS();
+
+		// Building the index is part of the cost
+		CBenchmarkTimer hashedTimer;
+		hashedTimer.Start();
+		CKeyValuesChildIndex index( pLargest );
+		for ( int i = 0; i < nRounds; i++ )
+		{
+			for ( int j = 0; j < names.Count(); j++ )
+			{
+				if ( index.FindKey( names[j] ) )
+					nFound[1]++;
+			}
+		}
+		float flHashedMS = hashedTimer.EndMS();
+
+		float flLookups = (float)nRounds * names.Count();
+		Msg( "\"%s\" (%d children): FindKey %.1f ns, hashed index %.1f ns per lookup, %s\n",
+			pLargest->GetName(), names.Count(),
+			BenchmarkNanoseconds( flLinearMS, flLookups ), BenchmarkNanoseconds( flHashedMS, flLookups ),
+			( nFound[0] == nFound[1] ) ? "same results" : "RESULTS DIFFER" );
+	}
+
+	pText->deleteThis();
+	pCached->deleteThis();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compares symbol lookups in the locking and lock-free symbol
+//			tables, from one thread and from every thread in the pool.
+//-----------------------------------------------------------------------------
+struct SymbolBenchmarkJob_t
+{
+	CUtlSymbolTableMT			*pLocking;
+	CUtlConcurrentSymbolTable	*pConcurrent;
+	const CUtlVector<CUtlString> *pNames;
+	int							nLookups;
+	int							nFound;
+};
+
+static void SymbolBenchmarkLocking( SymbolBenchmarkJob_t &job )
+{
+	const CUtlVector<CUtlString> &names = *job.pNames;
+	for ( int i = 0; i < job.nLookups; i++ )
+	{
+		if ( job.pLocking->Find( names[i % names.Count()] ).IsValid() )
+			job.nFound++;
+	}
+}
+
+static void SymbolBenchmarkConcurrent( SymbolBenchmarkJob_t &job )
+{
+	const CUtlVector<CUtlString> &names = *job.pNames;
+	for ( int i = 0; i < job.nLookups; i++ )
+	{
+		if ( job.pConcurrent->Find( names[i % names.Count()] ).IsValid() )
+			job.nFound++;
+	}
+}
+
+CON_COMMAND_F( utlsymbol_benchmark, "Times symbol lookups in CUtlSymbolTableMT and CUtlConcurrentSymbolTable. Usage: utlsymbol_benchmark [strings] [lookups per job]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nStrings = BenchmarkArg( args, 1, 4096, 1, 60000 );
+	int nLookups = BenchmarkArg( args, 2, 100000, 1, INT_MAX );
+
+	CUtlVector<CUtlString> names;
+	CUtlSymbolTableMT locking;
+	CUtlConcurrentSymbolTable concurrent;
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		names.AddToTail( CUtlString( CFmtStr( "models/benchmark/symbol_%d.mdl", i ) ) );
+		locking.AddString( names[i] );
+		concurrent.AddString( names[i] );
+	}
+
+	int nJobs = g_pThreadPool ? MAX( g_pThreadPool->NumThreads(), 1 ) * 4 : 4;
+	CUtlVector<SymbolBenchmarkJob_t> jobs;
+	jobs.SetCount( nJobs );
+
+	// One thread first, then every pool thread at once
+	for ( int iParallel = 0; iParallel < 2; iParallel++ )
+	{
+		float flMS[2];
+		for ( int iTable = 0; iTable < 2; iTable++ )
+		{
+			for ( int i = 0; i < nJobs; i++ )
+			{
+				SymbolBenchmarkJob_t job = { &locking, &concurrent, &names, nLookups, 0 };
+				jobs[i] = job;
+			}
+
+			void (*pfnJob)( SymbolBenchmarkJob_t & ) = iTable ? &SymbolBenchmarkConcurrent : &SymbolBenchmarkLocking;
+
+			CBenchmarkTimer timer;
+			timer.Start();
+			if ( iParallel )
+			{
+				ParallelProcess( "utlsymbol_benchmark", jobs.Base(), jobs.Count(), pfnJob );
+			}
+			else
+			{
+				for ( int i = 0; i < nJobs; i++ )
+				{
+					pfnJob( jobs[i] );
+				}
+			}
+			flMS[iTable] = timer.EndMS();
+
+			for ( int i = 0; i < nJobs; i++ )
+			{
+				Assert( jobs[i].nFound == nLookups );
+			}
+		}
+
+		Msg( "%s, %d x %d lookups over %d strings: CUtlSymbolTableMT %.2f ms, CUtlConcurrentSymbolTable %.2f ms\n",
+			iParallel ? "Thread pool" : "One thread", nJobs, nLookups, nStrings, flMS[0], flMS[1] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Checksum throughput, against a byte at a time table CRC.
+//-----------------------------------------------------------------------------
+CON_COMMAND_F( crc_benchmark, "Measures CRC32 and CRC32C throughput in MB/s. Usage: crc_benchmark [megabytes]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nMegabytes = BenchmarkArg( args, 1, 64, 1, 256 );
+	int nBytes = nMegabytes * 1024 * 1024;
+
+	// Any bytes will do, so skip RandomInt() and fill a word at a time
+	unsigned int *pWords = new unsigned int[nBytes / sizeof( unsigned int )];
+	unsigned int nSeed = RandomInt( 1, INT_MAX );
+	for ( int i = 0; i < nBytes / (int)sizeof( unsigned int ); i++ )
+	{
+		nSeed = nSeed * 1664525 + 1013904223;
+		pWords[i] = nSeed;
+	}
+	unsigned char *pBuffer = (unsigned char *)pWords;
+
+	CRC32_t results[3];
+	float flMS[3];
+	for ( int iTest = 0; iTest < 3; iTest++ )
+	{
+		CBenchmarkTimer timer;
+		timer.Start();
+
+		CRC32_t crc;
+		switch ( iTest )
+		{
+		case 0:
+			CRC32_Init( &crc );
+			for ( int i = 0; i < nBytes; i++ )
+			{
+				crc = CRC32_GetTableEntry( pBuffer[i] ^ (unsigned char)crc ) ^ ( crc >> 8 );
+			}
+			CRC32_Final( &crc );
+			break;
+
+		case 1:
+			crc = CRC32_ProcessSingleBuffer( pBuffer, nBytes );
+			break;
+
+		default:
+			crc = CRC32C_ProcessSingleBuffer( pBuffer, nBytes );
+			break;
+		}
+
+		flMS[iTest] = timer.EndMS();
+		results[iTest] = crc;
+	}
+
+	Msg( "%d MB: byte at a time %.0f MB/s, CRC32 %.0f MB/s (%s), CRC32C %.0f MB/s (%s)\n", nMegabytes,
+		BenchmarkMBPerSecond( nMegabytes, flMS[0] ),
+		BenchmarkMBPerSecond( nMegabytes, flMS[1] ), ( results[0] == results[1] ) ? "same result" : "RESULT DIFFERS",
+		BenchmarkMBPerSecond( nMegabytes, flMS[2] ), CRC32C_IsHardwareAccelerated() ? "SSE4.2" : "software" );
+
+	delete [] pWords;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: LZMA decode throughput for a compressed file, whole buffer against
+//			streamed in chunks, and several copies one at a time against
+//			decoding them in parallel.
+//-----------------------------------------------------------------------------
+static void LZMABenchmarkDiscard( void *pContext, const unsigned char *pData, unsigned int nSize )
+{
+	*(unsigned int *)pContext += nSize;
+}
+
+CON_COMMAND_F( lzma_benchmark, "Measures LZMA decode speed for a compressed file. Usage: lzma_benchmark <file> [chunk KB] [copies]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: lzma_benchmark <file> [chunk KB] [copies]\n" );
+		return;
+	}
+
+	int nChunk = BenchmarkArg( args, 2, 64, 1, 16 * 1024 ) * 1024;
+	int nCopies = BenchmarkArg( args, 3, 8, 1, 64 );
+
+	CUtlBuffer buf;
+	CLZMA lzma;
+	if ( !filesystem->ReadFile( args[1], "GAME", buf ) || !lzma.IsCompressed( (unsigned char *)buf.Base() ) )
+	{
+		Msg( "Couldn't load %s or it isn't LZMA compressed\n", args[1] );
+		return;
+	}
+
+	unsigned int nActualSize = lzma.GetActualSize( (unsigned char *)buf.Base() );
+	CUtlMemory<unsigned char> output( 0, nActualSize * nCopies );
+
+	CBenchmarkTimer timer;
+	timer.Start();
+	unsigned int nResult = lzma.Uncompress( (unsigned char *)buf.Base(), output.Base() );
+	float flWholeMS = timer.EndMS();
+
+	unsigned int nStreamed = 0;
+	CLZMAStream stream;
+	timer.Start();
+	for ( int nPos = 0; nPos < buf.TellPut() && !stream.IsFinished(); nPos += nChunk )
+	{
+		if ( !stream.Decode( (unsigned char *)buf.Base() + nPos, MIN( nChunk, buf.TellPut() - nPos ), LZMABenchmarkDiscard, &nStreamed ) )
+			break;
+	}
+	float flStreamMS = timer.EndMS();
+
+	timer.Start();
+	for ( int i = 0; i < nCopies; i++ )
+	{
+		lzma.Uncompress( (unsigned char *)buf.Base(), output.Base() + i * nActualSize );
+	}
+	float flSerialMS = timer.EndMS();
+
+	CUtlVector<lzma_job_t> jobs;
+	jobs.SetCount( nCopies );
+	for ( int i = 0; i < nCopies; i++ )
+	{
+		jobs[i].pInput = (unsigned char *)buf.Base();
+		jobs[i].nInputSize = buf.TellPut();
+		jobs[i].pOutput = output.Base() + i * nActualSize;
+	}
+
+	timer.Start();
+	lzma.UncompressParallel( jobs.Base(), jobs.Count() );
+	float flParallelMS = timer.EndMS();
+
+	float flMB = nActualSize / ( 1024.0f * 1024.0f );
+	Msg( "%s: %u -> %u bytes (%s)\n", args[1], buf.TellPut(), nActualSize,
+		( *(unsigned int *)buf.Base() == LZMA_BLOCK_ID ) ? "block container" : "single stream" );
+	Msg( "Whole buffer %.0f MB/s%s, streamed in %d KB chunks %.0f MB/s%s\n",
+		BenchmarkMBPerSecond( flMB, flWholeMS ), ( nResult == nActualSize ) ? "" : " (FAILED)",
+		nChunk / 1024, BenchmarkMBPerSecond( flMB, flStreamMS ), ( nStreamed == nActualSize ) ? "" : " (FAILED)" );
+	Msg( "%d copies: one at a time %.2f ms, parallel %.2f ms\n", nCopies, flSerialMS, flParallelMS );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Pool alloc/free throughput from many threads, CMemoryPoolMT's
+//			single lock against CMemoryPoolTS's per-thread magazines.
+//-----------------------------------------------------------------------------
+#define MEMPOOL_BENCHMARK_LIVE	64
+
+struct MemPoolBenchmarkJob_t
+{
+	CMemoryPoolMT	*pLocking;
+	CMemoryPoolTS	*pMagazines;
+	int				nOps;
+};
+
+static void MemPoolBenchmarkLocking( MemPoolBenchmarkJob_t &job )
+{
+	void *pLive[MEMPOOL_BENCHMARK_LIVE] = {};
+	for ( int i = 0; i < job.nOps; i++ )
+	{
+		int iSlot = ( i * 7 ) % MEMPOOL_BENCHMARK_LIVE;
+		job.pLocking->Free( pLive[iSlot] );
+		pLive[iSlot] = job.pLocking->Alloc();
+	}
+	for ( int i = 0; i < MEMPOOL_BENCHMARK_LIVE; i++ )
+	{
+		job.pLocking->Free( pLive[i] );
+	}
+}
+
+static void MemPoolBenchmarkMagazines( MemPoolBenchmarkJob_t &job )
+{
+	void *pLive[MEMPOOL_BENCHMARK_LIVE] = {};
+	for ( int i = 0; i < job.nOps; i++ )
+	{
+		int iSlot = ( i * 7 ) % MEMPOOL_BENCHMARK_LIVE;
+		job.pMagazines->Free( pLive[iSlot] );
+		pLive[iSlot] = job.pMagazines->Alloc();
+	}
+	for ( int i = 0; i < MEMPOOL_BENCHMARK_LIVE; i++ )
+	{
+		job.pMagazines->Free( pLive[i] );
+	}
+}
+
+CON_COMMAND_F( mempool_benchmark, "Times pool allocations from every pool thread with CMemoryPoolMT and CMemoryPoolTS. Usage: mempool_benchmark [ops per job] [block size]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nOps = BenchmarkArg( args, 1, 1000000, 1, INT_MAX );
+	int nBlockSize = BenchmarkArg( args, 2, 64, 4, 4096 );
+
+	CMemoryPoolMT locking( nBlockSize, 256, UTLMEMORYPOOL_GROW_FAST, "mempool_benchmark" );
+	CMemoryPoolTS magazines( nBlockSize, 256, UTLMEMORYPOOL_GROW_FAST, "mempool_benchmark" );
+
+	int nJobs = g_pThreadPool ? MAX( g_pThreadPool->NumThreads(), 1 ) * 4 : 4;
+	CUtlVector<MemPoolBenchmarkJob_t> jobs;
+	jobs.SetCount( nJobs );
+	for ( int i = 0; i < nJobs; i++ )
+	{
+		MemPoolBenchmarkJob_t job = { &locking, &magazines, nOps };
+		jobs[i] = job;
+	}
+
+	float flMS[2];
+	for ( int iPool = 0; iPool < 2; iPool++ )
+	{
+		CBenchmarkTimer timer;
+		timer.Start();
+		ParallelProcess( "mempool_benchmark", jobs.Base(), jobs.Count(), iPool ? &MemPoolBenchmarkMagazines : &MemPoolBenchmarkLocking );
+		flMS[iPool] = timer.EndMS();
+	}
+
+	MemoryPoolTSStats_t stats;
+	magazines.GetStats( stats );
+
+	Msg( "%d x %d allocs of %d bytes: CMemoryPoolMT %.2f ms, CMemoryPoolTS %.2f ms\n", nJobs, nOps, nBlockSize, flMS[0], flMS[1] );
+	Msg( "CMemoryPoolTS: %d outstanding, peak %d, %d blobs, %d depot refills, %d depot flushes, %d blob refills, %d contended\n",
+		stats.nOutstanding, stats.nPeakOutstanding, stats.nBlobs, stats.nDepotRefills, stats.nDepotFlushes, stats.nBlobRefills, stats.nContended );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Bit buffer encoders, each run over the same values. The array
+//			versions are listed next to the one value at a time calls they
+//			replace.
+//-----------------------------------------------------------------------------
+enum BitBufBenchmark_t
+{
+	BITBUF_BENCH_ONEBIT,
+	BITBUF_BENCH_UBITLONG_7,
+	BITBUF_BENCH_UBITLONG_7_ARRAY,
+	BITBUF_BENCH_UBITLONG_32,
+	BITBUF_BENCH_UBITLONG_32_ARRAY,
+	BITBUF_BENCH_SBITLONG_12,
+	BITBUF_BENCH_SBITLONG_12_ARRAY,
+	BITBUF_BENCH_UBITVAR,
+	BITBUF_BENCH_VARINT32,
+	BITBUF_BENCH_FLOAT,
+	BITBUF_BENCH_FLOAT_ARRAY,
+	BITBUF_BENCH_COORD,
+	BITBUF_BENCH_COORD_ARRAY,
+	BITBUF_BENCH_COORDMP,
+	BITBUF_BENCH_NORMAL,
+	BITBUF_BENCH_NORMAL_ARRAY,
+	BITBUF_BENCH_VEC3COORD,
+	BITBUF_BENCH_VEC3NORMAL,
+	BITBUF_BENCH_ANGLE,
+	BITBUF_BENCH_BITS,
+
+	NUM_BITBUF_BENCHMARKS
+};
+
+static const char *s_pszBitBufBenchmarks[NUM_BITBUF_BENCHMARKS] =
+{
+	"WriteOneBit",
+	"WriteUBitLong 7",
+	"WriteUBitLongArray 7",
+	"WriteUBitLong 32",
+	"WriteUBitLongArray 32",
+	"WriteSBitLong 12",
+	"WriteSBitLongArray 12",
+	"WriteUBitVar",
+	"WriteVarInt32",
+	"WriteBitFloat",
+	"WriteBitFloatArray",
+	"WriteBitCoord",
+	"WriteBitCoordArray",
+	"WriteBitCoordMP",
+	"WriteBitNormal",
+	"WriteBitNormalArray",
+	"WriteBitVec3Coord",
+	"WriteBitVec3Normal",
+	"WriteBitAngle 16",
+	"WriteBits 32",
+};
+
+struct BitBufBenchmarkData_t
+{
+	CUtlVector<unsigned int>	uints;
+	CUtlVector<int>				ints;
+	CUtlVector<float>			coords;
+	CUtlVector<float>			normals;
+	CUtlVector<Vector>			vectors;
+};
+
+static void BitBufBenchmarkWrite( int iTest, bf_write &buf, BitBufBenchmarkData_t &data )
+{
+	int nValues = data.uints.Count();
+	int i;
+
+	switch ( iTest )
+	{
+	case BITBUF_BENCH_ONEBIT:			for ( i = 0; i < nValues; i++ ) buf.WriteOneBit( data.uints[i] & 1 ); break;
+	case BITBUF_BENCH_UBITLONG_7:		for ( i = 0; i < nValues; i++ ) buf.WriteUBitLong( data.uints[i] & 0x7f, 7 ); break;
+	case BITBUF_BENCH_UBITLONG_7_ARRAY:	buf.WriteUBitLongArray( data.uints.Base(), nValues, 7 ); break;
+	case BITBUF_BENCH_UBITLONG_32:		for ( i = 0; i < nValues; i++ ) buf.WriteUBitLong( data.uints[i], 32 ); break;
+	case BITBUF_BENCH_UBITLONG_32_ARRAY: buf.WriteUBitLongArray( data.uints.Base(), nValues, 32 ); break;
+	case BITBUF_BENCH_SBITLONG_12:		for ( i = 0; i < nValues; i++ ) buf.WriteSBitLong( data.ints[i], 12 ); break;
+	case BITBUF_BENCH_SBITLONG_12_ARRAY: buf.WriteSBitLongArray( data.ints.Base(), nValues, 12 ); break;
+	case BITBUF_BENCH_UBITVAR:			for ( i = 0; i < nValues; i++ ) buf.WriteUBitVar( data.uints[i] >> ( i & 31 ) ); break;
+	case BITBUF_BENCH_VARINT32:			for ( i = 0; i < nValues; i++ ) buf.WriteVarInt32( data.uints[i] >> ( i & 31 ) ); break;
+	case BITBUF_BENCH_FLOAT:			for ( i = 0; i < nValues; i++ ) buf.WriteBitFloat( data.coords[i] ); break;
+	case BITBUF_BENCH_FLOAT_ARRAY:		buf.WriteBitFloatArray( data.coords.Base(), nValues ); break;
+	case BITBUF_BENCH_COORD:			for ( i = 0; i < nValues; i++ ) buf.WriteBitCoord( data.coords[i] ); break;
+	case BITBUF_BENCH_COORD_ARRAY:		buf.WriteBitCoordArray( data.coords.Base(), nValues ); break;
+	case BITBUF_BENCH_COORDMP:			for ( i = 0; i < nValues; i++ ) buf.WriteBitCoordMP( data.coords[i], false, false ); break;
+	case BITBUF_BENCH_NORMAL:			for ( i = 0; i < nValues; i++ ) buf.WriteBitNormal( data.normals[i] ); break;
+	case BITBUF_BENCH_NORMAL_ARRAY:		buf.WriteBitNormalArray( data.normals.Base(), nValues ); break;
+	case BITBUF_BENCH_VEC3COORD:		for ( i = 0; i < nValues; i++ ) buf.WriteBitVec3Coord( data.vectors[i] ); break;
+	case BITBUF_BENCH_VEC3NORMAL:		for ( i = 0; i < nValues; i++ ) buf.WriteBitVec3Normal( data.vectors[i] ); break;
+	case BITBUF_BENCH_ANGLE:			for ( i = 0; i < nValues; i++ ) buf.WriteBitAngle( data.normals[i] * 180.0f, 16 ); break;
+	case BITBUF_BENCH_BITS:				for ( i = 0; i < nValues; i++ ) buf.WriteBits( &data.uints[i], 32 ); break;
+	}
+}
+
+CON_COMMAND_F( bitbuf_benchmark, "Times every bf_write encoder, and the array readers against their single value versions. Usage: bitbuf_benchmark [passes]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nPasses = BenchmarkArg( args, 1, 200, 1, 100000 );
+	const int nValues = 4096;
+
+	BitBufBenchmarkData_t data;
+	for ( int i = 0; i < nValues; i++ )
+	{
+		data.uints.AddToTail( (unsigned int)RandomInt( 0, 0x7fff ) << 16 | RandomInt( 0, 0xffff ) );
+		data.ints.AddToTail( RandomInt( -2048, 2047 ) );
+		data.coords.AddToTail( RandomFloat( -MAX_COORD_FLOAT, MAX_COORD_FLOAT ) );
+		data.normals.AddToTail( RandomFloat( -1.0f, 1.0f ) );
+		data.vectors.AddToTail( RandomVector( -MAX_COORD_FLOAT, MAX_COORD_FLOAT ) );
+	}
+
+	// Widest case is WriteBitVec3Coord at 69 bits a value
+	CUtlMemory<unsigned char> buffer( 0, nValues * 9 + 16 );
+
+	Msg( "%d passes of %d values, ns per value:\n", nPasses, nValues );
+	for ( int iTest = 0; iTest < NUM_BITBUF_BENCHMARKS; iTest++ )
+	{
+		bf_write buf( "bitbuf_benchmark", buffer.Base(), buffer.Count() );
+
+		CBenchmarkTimer timer;
+		timer.Start();
+		for ( int iPass = 0; iPass < nPasses; iPass++ )
+		{
+			buf.Reset();
+			BitBufBenchmarkWrite( iTest, buf, data );
+		}
+		float flMS = timer.EndMS();
+
+		Msg( "  %-24s %7.2f (%d bits)%s\n", s_pszBitBufBenchmarks[iTest], BenchmarkNanoseconds( flMS, (float)nPasses * nValues ),
+			buf.GetNumBitsWritten(), buf.IsOverflowed() ? " OVERFLOWED" : "" );
+	}
+
+	// Readers, over buffers the writers above fill
+	static const int s_ReadTests[] = { BITBUF_BENCH_UBITLONG_7, BITBUF_BENCH_COORD, BITBUF_BENCH_NORMAL };
+	CUtlVector<unsigned int> uintsOut;
+	CUtlVector<float> floatsOut;
+	uintsOut.SetCount( nValues );
+	floatsOut.SetCount( nValues );
+
+	for ( int i = 0; i < ARRAYSIZE( s_ReadTests ); i++ )
+	{
+		bf_write buf( "bitbuf_benchmark", buffer.Base(), buffer.Count() );
+		BitBufBenchmarkWrite( s_ReadTests[i], buf, data );
+
+		float flMS[2];
+		bool bMatch = true;
+		for ( int bArray = 0; bArray < 2; bArray++ )
+		{
+			bf_read in( "bitbuf_benchmark", buffer.Base(), buf.GetNumBytesWritten() );
+
+			CBenchmarkTimer timer;
+			timer.Start();
+			for ( int iPass = 0; iPass < nPasses; iPass++ )
+			{
+				in.Seek( 0 );
+				for ( int j = 0; !bArray && j < nValues; j++ )
+				{
+					switch ( s_ReadTests[i] )
+					{
+					case BITBUF_BENCH_UBITLONG_7:	uintsOut[j] = in.ReadUBitLong( 7 ); break;
+					case BITBUF_BENCH_COORD:		floatsOut[j] = in.ReadBitCoord(); break;
+					default:						floatsOut[j] = in.ReadBitNormal(); break;
+					}
+				}
+
+				if ( bArray )
+				{
+					switch ( s_ReadTests[i] )
+					{
+					case BITBUF_BENCH_UBITLONG_7:	in.ReadUBitLongArray( uintsOut.Base(), nValues, 7 ); break;
+					case BITBUF_BENCH_COORD:		in.ReadBitCoordArray( floatsOut.Base(), nValues ); break;
+					default:						in.ReadBitNormalArray( floatsOut.Base(), nValues ); break;
+					}
+				}
+			}
+			flMS[bArray] = timer.EndMS();
+			bMatch = bMatch && !in.IsOverflowed() && in.GetNumBitsRead() == buf.GetNumBitsWritten();
+		}
+
+		// Spot check the last array read against the values written
+		float flExpected = ( s_ReadTests[i] == BITBUF_BENCH_COORD ) ? data.coords[nValues - 1] : data.normals[nValues - 1];
+		if ( s_ReadTests[i] == BITBUF_BENCH_UBITLONG_7 )
+			bMatch = bMatch && uintsOut[nValues - 1] == ( data.uints[nValues - 1] & 0x7f );
+		else
+			bMatch = bMatch && fabs( floatsOut[nValues - 1] - flExpected ) < 0.05f;
+
+		Msg( "  read %-19s %7.2f single, %7.2f array%s\n", s_pszBitBufBenchmarks[s_ReadTests[i]] + 5,
+			BenchmarkNanoseconds( flMS[0], (float)nPasses * nValues ), BenchmarkNanoseconds( flMS[1], (float)nPasses * nValues ),
+			bMatch ? "" : " (MISMATCH)" );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Case-insensitive string functions with their SSE2 scanning turned
+//			off and on. Strings look like classnames and paths; compares are
+//			between the same string in different case, searches are for the
+//			tail of the string, and the character search misses.
+//-----------------------------------------------------------------------------
+enum StrToolsBenchmark_t
+{
+	STRTOOLS_BENCH_STRICMP,
+	STRTOOLS_BENCH_STRNICMP,
+	STRTOOLS_BENCH_STRISTR,
+	STRTOOLS_BENCH_STRNISTR,
+	STRTOOLS_BENCH_STRNCHR,
+	STRTOOLS_BENCH_STRLEN,
+
+	NUM_STRTOOLS_BENCHMARKS
+};
+
+static const char *s_pszStrToolsBenchmarks[NUM_STRTOOLS_BENCHMARKS] =
+{
+	"V_stricmp",
+	"V_strnicmp",
+	"V_stristr",
+	"V_strnistr",
+	"V_strnchr",
+	"V_strlen",
+};
+
+struct StrToolsBenchmarkData_t
+{
+	CUtlVector<char *>	strings;
+	CUtlVector<char *>	otherCase;
+	CUtlVector<char *>	tails;
+};
+
+static int StrToolsBenchmarkRun( int iTest, StrToolsBenchmarkData_t &data )
+{
+	int nTotal = 0;
+	for ( int i = 0; i < data.strings.Count(); i++ )
+	{
+		const char *pszString = data.strings[i];
+		switch ( iTest )
+		{
+		case STRTOOLS_BENCH_STRICMP:	nTotal += V_stricmp( pszString, data.otherCase[i] ); break;
+		case STRTOOLS_BENCH_STRNICMP:	nTotal += V_strnicmp( pszString, data.otherCase[i], 256 ); break;
+		case STRTOOLS_BENCH_STRISTR:	nTotal += V_stristr( pszString, data.tails[i] ) - pszString; break;
+		case STRTOOLS_BENCH_STRNISTR:	nTotal += V_strnistr( pszString, data.tails[i], 256 ) - pszString; break;
+		case STRTOOLS_BENCH_STRNCHR:	nTotal += V_strnchr( pszString, '#', 256 ) ? 1 : 0; break;
+		case STRTOOLS_BENCH_STRLEN:		nTotal += V_strlen( pszString ); break;
+		}
+	}
+	return nTotal;
+}
+
+CON_COMMAND_F( strtools_benchmark, "Times the case-insensitive string functions with and without SSE2. Usage: strtools_benchmark [passes] [max length]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nPasses = BenchmarkArg( args, 1, 200, 1, 100000 );
+	int nMaxLength = BenchmarkArg( args, 2, 64, 8, 255 );
+	const int nStrings = 4096;
+
+	static const char s_szChars[] = "abcdefghijklmnopqrstuvwxyz0123456789_/.";
+
+	StrToolsBenchmarkData_t data;
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		int nLength = RandomInt( 8, nMaxLength );
+		char *pszString = new char[nLength + 1];
+		char *pszOtherCase = new char[nLength + 1];
+		for ( int j = 0; j < nLength; j++ )
+		{
+			pszString[j] = s_szChars[RandomInt( 0, sizeof( s_szChars ) - 2 )];
+			pszOtherCase[j] = ( pszString[j] >= 'a' && pszString[j] <= 'z' ) ? ( pszString[j] - 'a' + 'A' ) : pszString[j];
+		}
+		pszString[nLength] = pszOtherCase[nLength] = 0;
+
+		data.strings.AddToTail( pszString );
+		data.otherCase.AddToTail( pszOtherCase );
+		data.tails.AddToTail( pszOtherCase + nLength - 6 );
+	}
+
+	bool bWasEnabled = V_IsStringSIMDEnabled();
+
+	Msg( "%d passes of %d strings (8 to %d chars), ns per call:\n", nPasses, nStrings, nMaxLength );
+	for ( int iTest = 0; iTest < NUM_STRTOOLS_BENCHMARKS; iTest++ )
+	{
+		float flMS[2];
+		int nResults[2];
+		for ( int bSIMD = 0; bSIMD < 2; bSIMD++ )
+		{
+			V_SetStringSIMDEnabled( bSIMD != 0 );
+
+			CBenchmarkTimer timer;
+			timer.Start();
+			for ( int iPass = 0; iPass < nPasses; iPass++ )
+			{
+				nResults[bSIMD] = StrToolsBenchmarkRun( iTest, data );
+			}
+			flMS[bSIMD] = timer.EndMS();
+		}
+
+		Msg( "  %-12s %7.2f scalar, %7.2f %s%s\n", s_pszStrToolsBenchmarks[iTest],
+			BenchmarkNanoseconds( flMS[0], (float)nPasses * nStrings ), BenchmarkNanoseconds( flMS[1], (float)nPasses * nStrings ),
+			V_IsStringSIMDEnabled() ? "SSE2" : "scalar (no SSE2)", ( nResults[0] == nResults[1] ) ? "" : " (RESULTS DIFFER)" );
+	}
+
+	V_SetStringSIMDEnabled( bWasEnabled );
+
+	for ( int i = 0; i < nStrings; i++ )
+	{
+		delete [] data.strings[i];
+		delete [] data.otherCase[i];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Per-task cost of the task pool against queuing calls on the job
+//			thread pool. Tasks are empty, so this is all overhead.
+//-----------------------------------------------------------------------------
+static void TaskPoolBenchmarkTask( void *pContext )
+{
+}
+
+static void TaskPoolBenchmarkRange( void *pContext, int iBegin, int iEnd )
+{
+}
+
+static void TaskPoolBenchmarkCall()
+{
+}
+
+CON_COMMAND_F( taskpool_benchmark, "Times empty tasks on the task pool and empty calls on the job thread pool, in ns per task. Usage: taskpool_benchmark [tasks]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nTasks = BenchmarkArg( args, 1, 100000, 1, 10000000 );
+	int nChain = MIN( nTasks, 10000 );
+	int nJobs = MIN( nTasks, 10000 );
+
+	g_TaskPool.ResetStats();
+
+	CBenchmarkTimer timer;
+	timer.Start();
+	{
+		CTaskCounter counter;
+		for ( int i = 0; i < nTasks; i++ )
+		{
+			g_TaskPool.AddTask( &TaskPoolBenchmarkTask, NULL, &counter );
+		}
+		g_TaskPool.Wait( &counter );
+	}
+	float flAddTask = timer.EndMS();
+
+	timer.Start();
+	g_TaskPool.ParallelFor( nTasks, &TaskPoolBenchmarkRange, NULL, 1 );
+	float flParallelFor = timer.EndMS();
+
+	// Each task is held until the one before it has run
+	CTaskCounter *pCounters = new CTaskCounter[nChain];
+	timer.Start();
+	g_TaskPool.AddTask( &TaskPoolBenchmarkTask, NULL, &pCounters[0] );
+	for ( int i = 1; i < nChain; i++ )
+	{
+		g_TaskPool.AddTaskAfter( &pCounters[i - 1], &TaskPoolBenchmarkTask, NULL, &pCounters[i] );
+	}
+	for ( int i = 0; i < nChain; i++ )
+	{
+		g_TaskPool.Wait( &pCounters[i] );
+	}
+	float flChain = timer.EndMS();
+	delete [] pCounters;
+
+	float flJobs = 0.0f;
+	if ( g_pThreadPool )
+	{
+		CUtlVector<CJob *> jobs;
+		jobs.EnsureCapacity( nJobs );
+		timer.Start();
+		for ( int i = 0; i < nJobs; i++ )
+		{
+			jobs.AddToTail( g_pThreadPool->QueueCall( &TaskPoolBenchmarkCall ) );
+		}
+		for ( int i = 0; i < nJobs; i++ )
+		{
+			jobs[i]->WaitForFinishAndRelease();
+		}
+		flJobs = timer.EndMS();
+	}
+
+	TaskPoolStats_t stats;
+	g_TaskPool.GetStats( stats );
+
+	Msg( "%d threads, ns per task:\n", g_TaskPool.NumThreads() );
+	Msg( "  AddTask       %8.1f (%d tasks)\n", BenchmarkNanoseconds( flAddTask, nTasks ), nTasks );
+	Msg( "  ParallelFor   %8.1f (%d indices, grain 1)\n", BenchmarkNanoseconds( flParallelFor, nTasks ), nTasks );
+	Msg( "  AddTaskAfter  %8.1f (chain of %d)\n", BenchmarkNanoseconds( flChain, nChain ), nChain );
+	if ( g_pThreadPool )
+	{
+		Msg( "  QueueCall     %8.1f (%d jobs)\n", BenchmarkNanoseconds( flJobs, nJobs ), nJobs );
+	}
+	Msg( "Task pool: %d run, %d stolen, %d run inline, %d pool threads borrowed\n",
+		stats.nExecuted, stats.nStolen, stats.nRanInline, stats.nHelpersStarted );
+}
@@ -55,6 +55,8 @@ CUtlVector< CHandle<CTriggerMultiple> >	g_hWeaponFireTriggers;
 extern CServerGameDLL	g_ServerGameDLL;
 extern bool				g_fGameOver;
 ConVar showtriggers( "showtriggers", "0", FCVAR_CHEAT, "Shows trigger brushes" );
+ConVar trigger_filter_cache( "trigger_filter_cache", "1", 0, "Reuse trigger filter results for touching entities until the entity or the filter changes" );
+ConVar trigger_filter_stats( "trigger_filter_stats", "0", 0, "Count and time trigger filter tests for report_trigger_filter_stats" );
 
 bool IsTriggerClass( CBaseEntity *pEntity );
 
@@ -214,6 +216,8 @@ void CBaseTrigger::UpdateOnRemove( void )
 		VPhysicsGetObject()->RemoveTrigger();
 	}
 
+	m_FilterResults.Purge();
+
 	BaseClass::UpdateOnRemove();
 }
 
@@ -384,7 +388,139 @@ void CBaseTrigger::InitTrigger( )
 // Purpose: Returns true if this entity passes the filter criteria, false if not.
 // Input  : pOther - The entity to be filtered.
 //-----------------------------------------------------------------------------
+#define MAX_TRIGGER_FILTER_RESULTS	16
+
+// These checks look at more than the state a cached result is kept with
+#define SF_TRIGGER_UNCACHEABLE	( SF_TRIGGER_ONLY_PLAYER_ALLY_NPCS | SF_TRIGGER_ONLY_CLIENTS_IN_VEHICLES | SF_TRIGGER_ONLY_CLIENTS_OUT_OF_VEHICLES | SF_TRIGGER_ONLY_NPCS_IN_VEHICLES )
+
+static int			s_nTriggerFilterTests;
+static int			s_nTriggerFilterCacheHits;
+static int			s_nTriggerFilterStatsTick;
+static CCycleCount	s_TriggerFilterTime;
+
+static void FillTriggerFilterResult( TriggerFilterResult_t &result, CBaseEntity *pOther, int iSpawnFlags, CBaseEntity *pFilter )
+{
+	result.hEntity = pOther;
+	result.iName = pOther->GetEntityName();
+	result.iClassname = pOther->m_iClassname;
+	result.iModelName = pOther->GetModelName();
+	result.fFlags = pOther->GetFlags();
+	result.iTeam = pOther->GetTeamNumber();
+	result.iCollisionGroup = pOther->GetCollisionGroup();
+	result.moveType = pOther->GetMoveType();
+	result.bAlive = pOther->IsAlive();
+	result.iSpawnFlags = iSpawnFlags;
+	result.pFilter = pFilter;
+	result.iFilterSerial = CBaseFilter::GetSettingsSerial();
+}
+
+static bool TriggerFilterResultsMatch( const TriggerFilterResult_t &a, const TriggerFilterResult_t &b )
+{
+	return ( a.iName == b.iName && a.iClassname == b.iClassname && a.iModelName == b.iModelName &&
+		a.fFlags == b.fFlags && a.iTeam == b.iTeam && a.iCollisionGroup == b.iCollisionGroup &&
+		a.moveType == b.moveType && a.bAlive == b.bAlive &&
+		a.iSpawnFlags == b.iSpawnFlags && a.pFilter == b.pFilter && a.iFilterSerial == b.iFilterSerial );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Entities touching a trigger are tested against its filters every
+//			time they touch, usually every tick. If the filter only looks at
+//			state that can be compared cheaply, the last result for each
+//			entity is kept until that state changes.
+//-----------------------------------------------------------------------------
 bool CBaseTrigger::PassesTriggerFilters(CBaseEntity *pOther)
+{
+	bool bStats = trigger_filter_stats.GetBool();
+
+	CFastTimer timer;
+	if ( bStats )
+	{
+		timer.Start();
+	}
+
+	bool bPasses;
+	CBaseFilter *pFilter = m_hFilter.Get();
+	if ( !pFilter || !trigger_filter_cache.GetBool() || HasSpawnFlags( SF_TRIGGER_UNCACHEABLE ) || !pFilter->CanCacheResults() )
+	{
+		bPasses = TestTriggerFilters( pOther );
+	}
+	else
+	{
+		bPasses = CachedTriggerFilters( pOther, pFilter );
+	}
+
+	if ( bStats )
+	{
+		timer.End();
+		s_TriggerFilterTime += timer.GetDuration();
+		s_nTriggerFilterTests++;
+	}
+	return bPasses;
+}
+
+bool CBaseTrigger::CachedTriggerFilters(CBaseEntity *pOther, CBaseFilter *pFilter)
+{
+	TriggerFilterResult_t current;
+	FillTriggerFilterResult( current, pOther, m_spawnflags, pFilter );
+
+	int iResult = -1;
+	for ( int i = 0; i < m_FilterResults.Count(); i++ )
+	{
+		if ( m_FilterResults[i].hEntity == current.hEntity )
+		{
+			iResult = i;
+			break;
+		}
+	}
+
+	if ( iResult != -1 && TriggerFilterResultsMatch( m_FilterResults[iResult], current ) )
+	{
+		if ( trigger_filter_stats.GetBool() )
+		{
+			s_nTriggerFilterCacheHits++;
+		}
+		return m_FilterResults[iResult].bPasses;
+	}
+
+	current.bPasses = TestTriggerFilters( pOther );
+
+	if ( iResult == -1 )
+	{
+		if ( m_FilterResults.Count() >= MAX_TRIGGER_FILTER_RESULTS )
+		{
+			// Drop the oldest
+			m_FilterResults.Remove( 0 );
+		}
+		iResult = m_FilterResults.AddToTail();
+	}
+	m_FilterResults[iResult] = current;
+
+	return current.bPasses;
+}
+
+CON_COMMAND( report_trigger_filter_stats, "Reports trigger filter tests, cache hits and time spent per tick since the last report" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( !trigger_filter_stats.GetBool() )
+	{
+		Msg( "Trigger filter stats are off, set trigger_filter_stats 1 to collect them\n" );
+	}
+
+	int nTicks = MAX( gpGlobals->tickcount - s_nTriggerFilterStatsTick, 1 );
+	Msg( "Trigger filter tests: %d over %d ticks, %d reused a cached result\n", s_nTriggerFilterTests, nTicks, s_nTriggerFilterCacheHits );
+	Msg( "Time in trigger filters: %.3f ms total, %.2f us per tick\n", s_TriggerFilterTime.GetMillisecondsF(), s_TriggerFilterTime.GetMicrosecondsF() / nTicks );
+
+	s_nTriggerFilterTests = s_nTriggerFilterCacheHits = 0;
+	s_nTriggerFilterStatsTick = gpGlobals->tickcount;
+	s_TriggerFilterTime.Init();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Tests an entity against the spawnflags and filter entity.
+//-----------------------------------------------------------------------------
+bool CBaseTrigger::TestTriggerFilters(CBaseEntity *pOther)
 {
 	// First test spawn flag filters
 	if ( HasSpawnFlags(SF_TRIGGER_ALLOW_ALL) ||
@@ -520,6 +656,15 @@ void CBaseTrigger::StartTouch(CBaseEntity *pOther)
 //-----------------------------------------------------------------------------
 void CBaseTrigger::EndTouch(CBaseEntity *pOther)
 {
+	for ( int i = 0; i < m_FilterResults.Count(); i++ )
+	{
+		if ( m_FilterResults[i].hEntity == pOther )
+		{
+			m_FilterResults.Remove( i );
+			break;
+		}
+	}
+
 	if ( IsTouching( pOther ) )
 	{
 		EHANDLE hOther;
@@ -42,6 +42,29 @@ enum
 #endif
 };
 
+//-----------------------------------------------------------------------------
+// Purpose: A PassesTriggerFilters() result, along with everything about the
+//			entity it was worked out from. Only kept for cacheable filters.
+//-----------------------------------------------------------------------------
+struct TriggerFilterResult_t
+{
+	EHANDLE		hEntity;
+	string_t	iName;
+	string_t	iClassname;
+	string_t	iModelName;
+	int			fFlags;
+	int			iTeam;
+	int			iCollisionGroup;
+	int			moveType;
+	bool		bAlive;
+
+	int			iSpawnFlags;
+	CBaseEntity	*pFilter;
+	int			iFilterSerial;
+
+	bool		bPasses;
+};
+
 // DVS TODO: get rid of CBaseToggle
 //-----------------------------------------------------------------------------
 // Purpose: 
@@ -79,6 +102,7 @@ public:
 
 	virtual bool UsesFilter( void ){ return ( m_hFilter.Get() != NULL ); }
 	virtual bool PassesTriggerFilters(CBaseEntity *pOther);
+	bool TestTriggerFilters(CBaseEntity *pOther);
 	virtual void StartTouch(CBaseEntity *pOther);
 	virtual void EndTouch(CBaseEntity *pOther);
 	bool IsTouching( CBaseEntity *pOther );
@@ -119,6 +143,10 @@ protected:
 	// Entities currently being touched by this trigger
 	CUtlVector< EHANDLE >	m_hTouchingEntities;
 
+	// Filter results for entities that touched us recently. Not saved.
+	bool CachedTriggerFilters( CBaseEntity *pOther, class CBaseFilter *pFilter );
+	CUtlVector< TriggerFilterResult_t >	m_FilterResults;
+
 #ifdef MAPBASE
 	// We don't descend from CBaseToggle anymore. These have to be defined here now.
 	EHANDLE		m_hActivator;
@@ -1220,7 +1220,8 @@ bool IsEntityCreationAllowedInScripts( void )
 	return g_VScriptGameSystem.m_bAllowEntityCreationInScripts;
 }
 
-static short VSCRIPT_SERVER_SAVE_RESTORE_VERSION = 2;
+// 3: Strings and function prototypes are written once and referenced after that
+static short VSCRIPT_SERVER_SAVE_RESTORE_VERSION = 3;
 
 
 //-----------------------------------------------------------------------------
@@ -1229,7 +1230,8 @@ class CVScriptSaveRestoreBlockHandler : public CDefSaveRestoreBlockHandler
 {
 public:
 	CVScriptSaveRestoreBlockHandler() :
-		m_InstanceMap( DefLessFunc(const char *) )
+		m_InstanceMap( DefLessFunc(const char *) ),
+		m_nLastStateSize( 0 )
 	{
 	}
 	const char *GetBlockName()
@@ -1249,9 +1251,12 @@ public:
 		{
 			temp = g_pScriptVM->GetLanguage();
 			pSave->WriteInt( &temp );
+			// Saves are usually about the size of the last one, so skip growing the buffer up to it
 			CUtlBuffer buffer;
+			buffer.EnsureCapacity( m_nLastStateSize );
 			g_pScriptVM->WriteState( &buffer );
 			temp = buffer.TellPut();
+			m_nLastStateSize = temp;
 			pSave->WriteInt( &temp );
 			if ( temp > 0 )
 			{
@@ -1343,6 +1348,7 @@ public:
 
 private:
 	bool m_fDoLoad;
+	int m_nLastStateSize;
 };
 
 //-----------------------------------------------------------------------------
@@ -68,8 +68,8 @@ ConVar hl2_episodic( "hl2_episodic", "0", FCVAR_REPLICATED );
 
 #ifdef GAME_DLL
 	ConVar ent_debugkeys( "ent_debugkeys", "" );
-	extern bool ParseKeyvalue( void *pObject, typedescription_t *pFields, int iNumFields, const char *szKeyName, const char *szValue );
-	extern bool ExtractKeyvalue( void *pObject, typedescription_t *pFields, int iNumFields, const char *szKeyName, char *szValue, int iMaxLen );
+	extern bool ParseKeyvalue( void *pObject, datamap_t *pMap, const char *szKeyName, const char *szValue );
+	extern bool ExtractKeyvalue( void *pObject, datamap_t *pMap, const char *szKeyName, char *szValue, int iMaxLen );
 #endif
 
 bool CBaseEntity::m_bAllowPrecache = false;
@@ -463,7 +463,13 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 	
 	if ( FStrEq( szKeyName, "targetname" ) )
 	{
-		m_iName = AllocPooledString( szValue );
+		SetName( AllocPooledString( szValue ) );
+		return true;
+	}
+
+	if ( FStrEq( szKeyName, "classname" ) )
+	{
+		SetClassname( szValue );
 		return true;
 	}
 
@@ -472,7 +478,7 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 	{
 		for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
 		{
-			if ( ::ParseKeyvalue(this, dmap->dataDesc, dmap->dataNumFields, szKeyName, szValue) )
+			if ( ::ParseKeyvalue(this, dmap, szKeyName, szValue) )
 				return true;
 		}
 	}
@@ -499,7 +505,7 @@ bool CBaseEntity::KeyValue( const char *szKeyName, const char *szValue )
 				debugName = dmap->dataClassName;
 			}
 
-			if ( ::ParseKeyvalue(this, dmap->dataDesc, dmap->dataNumFields, szKeyName, szValue) )
+			if ( ::ParseKeyvalue(this, dmap, szKeyName, szValue) )
 			{
 				if ( printKeyHits )
 					Msg( "(%s) key: %-16s value: %s\n", debugName, szKeyName, szValue );
@@ -626,7 +632,7 @@ bool CBaseEntity::GetKeyValue( const char *szKeyName, char *szValue, int iMaxLen
 
 	for ( datamap_t *dmap = GetDataDescMap(); dmap != NULL; dmap = dmap->baseMap )
 	{
-		if ( ::ExtractKeyvalue( this, dmap->dataDesc, dmap->dataNumFields, szKeyName, szValue, iMaxLen ) )
+		if ( ::ExtractKeyvalue( this, dmap, szKeyName, szValue, iMaxLen ) )
 			return true;
 	}
 #endif
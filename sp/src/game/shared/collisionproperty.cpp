@@ -1359,6 +1359,10 @@ void CCollisionProperty::MarkPartitionHandleDirty()
 	// don't bother with the world
 	if ( m_pOuter->entindex() == 0 )
 		return;
+
+#ifndef CLIENT_DLL
+	gEntList.ReportEntityMoved( m_pOuter );
+#endif
 	
 	if ( !m_pOuter->IsEFlagSet( EFL_DIRTY_SPATIAL_PARTITION ) )
 	{
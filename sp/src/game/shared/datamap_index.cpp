@@ -0,0 +1,214 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Hashed name lookups into datamaps.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "datamap_index.h"
+#include "utlhashtable.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Lookups for one datamap. Keys pack an interned name with the lookup type.
+//-----------------------------------------------------------------------------
+struct DataDescIndex_t
+{
+	DataDescIndex_t() : bLevelBuilt( false ), bClassBuilt( false ) {}
+
+	// This level of the map only, name -> field position
+	bool										bLevelBuilt;
+	CUtlHashtable<unsigned, int>				levelFields;
+	CUtlHashtable<unsigned>						duplicatedFields;	// keys more than one field in this level has
+	CUtlVector<int>								embeddedFields;
+
+	// The map and all its bases, name -> first field found
+	bool										bClassBuilt;
+	CUtlHashtable<unsigned, typedescription_t *> classFields;
+};
+
+//-----------------------------------------------------------------------------
+// Datamaps are static, so indices are kept for the life of the module.
+// Only touched from the main thread.
+//-----------------------------------------------------------------------------
+class CDataDescIndexCache
+{
+public:
+	~CDataDescIndexCache()
+	{
+		for ( UtlHashHandle_t h = m_Indices.FirstHandle(); h != m_Indices.InvalidHandle(); h = m_Indices.NextHandle( h ) )
+		{
+			delete m_Indices[h];
+		}
+	}
+
+	DataDescIndex_t *GetLevel( datamap_t *pMap )
+	{
+		DataDescIndex_t *pIndex = Get( pMap );
+		if ( !pIndex->bLevelBuilt )
+		{
+			BuildLevel( pMap, pIndex );
+		}
+		return pIndex;
+	}
+
+	DataDescIndex_t *GetClass( datamap_t *pMap )
+	{
+		DataDescIndex_t *pIndex = Get( pMap );
+		if ( !pIndex->bClassBuilt )
+		{
+			BuildClass( pMap, pIndex );
+		}
+		return pIndex;
+	}
+
+	// -1 if no datamap field has ever used this name
+	int FindSymbol( const char *pszName ) const
+	{
+		UtlHashHandle_t h = m_Symbols.Find( pszName );
+		return ( h != m_Symbols.InvalidHandle() ) ? m_Symbols[h] : -1;
+	}
+
+	static unsigned Key( int iSymbol, int lookup )
+	{
+		return ( (unsigned)iSymbol * NUM_DATADESC_LOOKUPS ) + lookup;
+	}
+
+private:
+	DataDescIndex_t *Get( datamap_t *pMap )
+	{
+		UtlHashHandle_t h = m_Indices.Find( pMap );
+		if ( h == m_Indices.InvalidHandle() )
+		{
+			h = m_Indices.Insert( pMap, new DataDescIndex_t );
+		}
+		return m_Indices[h];
+	}
+
+	int AddSymbol( const char *pszName )
+	{
+		// Datadesc names are string literals, so the pointer can be kept
+		return m_Symbols[ m_Symbols.Insert( pszName, m_Symbols.Count() ) ];
+	}
+
+	static const char *LookupName( const typedescription_t &field, int lookup )
+	{
+		switch ( lookup )
+		{
+		case DATADESC_LOOKUP_INPUT:			return ( field.flags & FTYPEDESC_INPUT ) ? field.externalName : NULL;
+		case DATADESC_LOOKUP_KEY:			return ( field.flags & FTYPEDESC_KEY ) ? field.externalName : NULL;
+		case DATADESC_LOOKUP_KEY_OR_OUTPUT:	return ( field.flags & (FTYPEDESC_KEY | FTYPEDESC_OUTPUT) ) ? field.externalName : NULL;
+		case DATADESC_LOOKUP_SAVED:			return ( field.flags & (FTYPEDESC_SAVE | FTYPEDESC_KEY) ) ? field.fieldName : NULL;
+		case DATADESC_LOOKUP_FIELD:			return field.fieldName;
+		}
+		return NULL;
+	}
+
+	void BuildLevel( datamap_t *pMap, DataDescIndex_t *pIndex )
+	{
+		for ( int i = 0; i < pMap->dataNumFields; i++ )
+		{
+			const typedescription_t &field = pMap->dataDesc[i];
+
+			if ( field.fieldType == FIELD_EMBEDDED && field.fieldSize == 1 )
+			{
+				pIndex->embeddedFields.AddToTail( i );
+			}
+
+			for ( int lookup = 0; lookup < NUM_DATADESC_LOOKUPS; lookup++ )
+			{
+				const char *pszName = LookupName( field, lookup );
+				if ( pszName )
+				{
+					// Insert() keeps the existing entry, so the first field with a name wins like the old linear searches
+					unsigned key = Key( AddSymbol( pszName ), lookup );
+					bool bInserted;
+					pIndex->levelFields.Insert( key, i, &bInserted );
+					if ( !bInserted )
+					{
+						pIndex->duplicatedFields.Insert( key );
+					}
+				}
+			}
+		}
+
+		pIndex->bLevelBuilt = true;
+	}
+
+	void BuildClass( datamap_t *pMap, DataDescIndex_t *pIndex )
+	{
+		for ( datamap_t *dmap = pMap; dmap != NULL; dmap = dmap->baseMap )
+		{
+			for ( int i = 0; i < dmap->dataNumFields; i++ )
+			{
+				typedescription_t *pField = &dmap->dataDesc[i];
+
+				for ( int lookup = 0; lookup < NUM_DATADESC_LOOKUPS; lookup++ )
+				{
+					const char *pszName = LookupName( *pField, lookup );
+					if ( pszName )
+					{
+						pIndex->classFields.Insert( Key( AddSymbol( pszName ), lookup ), pField );
+					}
+				}
+			}
+		}
+
+		pIndex->bClassBuilt = true;
+	}
+
+	CUtlHashtable<const char *, int, CaselessStringHashFunctor, CaselessStringEqualFunctor> m_Symbols;
+	CUtlHashtable<datamap_t *, DataDescIndex_t *, PointerHashFunctor, PointerEqualFunctor> m_Indices;
+};
+
+static CDataDescIndexCache s_DataDescIndexCache;
+
+//-----------------------------------------------------------------------------
+
+int DataDesc_FindFieldIndex( datamap_t *pMap, DataDescLookup_t lookup, const char *pszName, bool *pbDuplicated )
+{
+	if ( pbDuplicated )
+	{
+		*pbDuplicated = false;
+	}
+
+	if ( !pMap || !pszName )
+		return -1;
+
+	DataDescIndex_t *pIndex = s_DataDescIndexCache.GetLevel( pMap );
+
+	int iSymbol = s_DataDescIndexCache.FindSymbol( pszName );
+	if ( iSymbol == -1 )
+		return -1;
+
+	unsigned key = CDataDescIndexCache::Key( iSymbol, lookup );
+	if ( pbDuplicated && pIndex->duplicatedFields.Count() )
+	{
+		*pbDuplicated = ( pIndex->duplicatedFields.Find( key ) != pIndex->duplicatedFields.InvalidHandle() );
+	}
+
+	UtlHashHandle_t h = pIndex->levelFields.Find( key );
+	return ( h != pIndex->levelFields.InvalidHandle() ) ? pIndex->levelFields[h] : -1;
+}
+
+const CUtlVector<int> &DataDesc_GetEmbeddedFields( datamap_t *pMap )
+{
+	return s_DataDescIndexCache.GetLevel( pMap )->embeddedFields;
+}
+
+typedescription_t *DataMap_FindField( datamap_t *pMap, DataDescLookup_t lookup, const char *pszName )
+{
+	if ( !pMap || !pszName )
+		return NULL;
+
+	DataDescIndex_t *pIndex = s_DataDescIndexCache.GetClass( pMap );
+
+	int iSymbol = s_DataDescIndexCache.FindSymbol( pszName );
+	if ( iSymbol == -1 )
+		return NULL;
+
+	UtlHashHandle_t h = pIndex->classFields.Find( CDataDescIndexCache::Key( iSymbol, lookup ) );
+	return ( h != pIndex->classFields.InvalidHandle() ) ? pIndex->classFields[h] : NULL;
+}
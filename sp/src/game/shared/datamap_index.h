@@ -0,0 +1,56 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Hashed name lookups into datamaps. Inputs, keyvalues and saved
+//			fields used to be found by walking every level of a class's
+//			datamap and comparing names; these indices are built the first
+//			time a map is searched and shared by every object using it.
+//
+//			Names are interned once, case-insensitively, so each lookup
+//			hashes the query string a single time.
+//
+//=============================================================================//
+
+#ifndef DATAMAP_INDEX_H
+#define DATAMAP_INDEX_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "datamap.h"
+#include "utlvector.h"
+
+enum DataDescLookup_t
+{
+	DATADESC_LOOKUP_INPUT = 0,		// FTYPEDESC_INPUT fields, by external name
+	DATADESC_LOOKUP_KEY,			// FTYPEDESC_KEY fields, by external name
+	DATADESC_LOOKUP_KEY_OR_OUTPUT,	// FTYPEDESC_KEY or FTYPEDESC_OUTPUT fields, by external name
+	DATADESC_LOOKUP_SAVED,			// FTYPEDESC_SAVE or FTYPEDESC_KEY fields, by field name
+	DATADESC_LOOKUP_FIELD,			// Any field, by field name
+
+	NUM_DATADESC_LOOKUPS,
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Position of the first matching field in this level of the map only
+//			(base maps aren't searched), or -1. If pbDuplicated is given, it's
+//			set when more than one field in the level matches.
+//
+//			The map must outlive the index. Maps built on the stack by the
+//			container save/restore ops must not be passed in.
+//-----------------------------------------------------------------------------
+int DataDesc_FindFieldIndex( datamap_t *pMap, DataDescLookup_t lookup, const char *pszName, bool *pbDuplicated = NULL );
+
+//-----------------------------------------------------------------------------
+// Purpose: Positions of the single (non-array) embedded fields in this level
+//			of the map, in declaration order.
+//-----------------------------------------------------------------------------
+const CUtlVector<int> &DataDesc_GetEmbeddedFields( datamap_t *pMap );
+
+//-----------------------------------------------------------------------------
+// Purpose: First matching field in the whole map, searching derived classes
+//			before their bases. Returns NULL if there isn't one.
+//-----------------------------------------------------------------------------
+typedescription_t *DataMap_FindField( datamap_t *pMap, DataDescLookup_t lookup, const char *pszName );
+
+#endif // DATAMAP_INDEX_H
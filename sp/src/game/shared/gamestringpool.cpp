@@ -19,6 +19,8 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+int g_iGameStringPoolSerial = 0;
+
 //-----------------------------------------------------------------------------
 // Purpose: The actual storage for pooled per-level strings
 //-----------------------------------------------------------------------------
@@ -42,11 +44,30 @@ class CGameStringPool : public CBaseGameSystem
 #endif
 		m_Strings.Purge();
 		m_KeyLookupCache.Purge();
+		m_Capitalizations.Purge();
+		g_iGameStringPoolSerial++;
+	}
+
+	const char *Insert( const char *string, unsigned int nCaselessHash )
+	{
+		const char *pszPooled = m_Strings[ m_Strings.Insert( string ) ].Get();
+
+		// Keyed by the first capitalization pooled, which lives as long as the entry
+		UtlHashHandle_t i = m_Capitalizations.Insert( pszPooled, 0, nCaselessHash );
+		if ( ++m_Capitalizations[i] == 2 )
+		{
+			g_iGameStringPoolSerial++;
+		}
+
+		return pszPooled;
 	}
 
 	CUtlHashtable<CUtlConstString> m_Strings;
 	CUtlHashtable<const void*, const char*> m_KeyLookupCache;
 
+	// Number of strings pooled with each text, ignoring case
+	CUtlHashtable<const char*, int, CaselessStringHashFunctor, CaselessStringEqualFunctor> m_Capitalizations;
+
 public:
 
 	CGameStringPool() : m_Strings(256) { }
@@ -82,7 +103,21 @@ public:
 
 	const char *Allocate(const char *string)
 	{
-		return m_Strings[ m_Strings.Insert( string ) ].Get();
+		UtlHashHandle_t i = m_Strings.Find( string );
+		if ( i != m_Strings.InvalidHandle() )
+			return m_Strings[ i ].Get();
+
+		return Insert( string, CaselessStringHashFunctor()( string ) );
+	}
+
+	// Same as Allocate(), with the hashes already worked out
+	const char *Allocate( const char *string, unsigned int nHash, unsigned int nCaselessHash, bool *pbOtherCapitalizations )
+	{
+		UtlHashHandle_t i = m_Strings.Find( string, nHash );
+		const char *pszPooled = ( i != m_Strings.InvalidHandle() ) ? m_Strings[ i ].Get() : Insert( string, nCaselessHash );
+
+		*pbOtherCapitalizations = ( m_Capitalizations[ m_Capitalizations.Find( string, nCaselessHash ) ] > 1 );
+		return pszPooled;
 	}
 
 	const char *AllocateWithKey(const char *string, const void* key)
@@ -130,6 +165,30 @@ string_t FindPooledString( const char *pszValue )
 	return MAKE_STRING( g_GameStringPool.Find( pszValue ) );
 }
 
+//-----------------------------------------------------------------------------
+// Hashed strings
+//-----------------------------------------------------------------------------
+CHashedPooledString::CHashedPooledString( const char *pszValue )
+{
+	AssertMsg( pszValue && *pszValue && *pszValue != '!' && *pszValue != '@' && !strpbrk( pszValue, "*?" ),
+		"CHashedPooledString \"%s\" needs a wildcard match", pszValue );
+
+	m_pszValue = pszValue;
+	m_nHash = StringHashFunctor()( pszValue );
+	m_nCaselessHash = CaselessStringHashFunctor()( pszValue );
+	m_Pooled = NULL_STRING;
+	m_iSerial = g_iGameStringPoolSerial - 1;
+	m_bCaseVariants = false;
+}
+
+void CHashedPooledString::Refresh()
+{
+	m_Pooled = MAKE_STRING( g_GameStringPool.Allocate( m_pszValue, m_nHash, m_nCaselessHash, &m_bCaseVariants ) );
+
+	// After pooling, which may have changed the serial itself
+	m_iSerial = g_iGameStringPoolSerial;
+}
+
 #if !defined(CLIENT_DLL) && !defined( GC )
 //------------------------------------------------------------------------------
 // Purpose: 
@@ -22,6 +22,62 @@ string_t AllocPooledString_StaticConstantStringPointer( const char *pszGlobalCon
 string_t FindPooledString( const char *pszValue );
 
 #define AssertIsValidString( s )	AssertMsg( s == NULL_STRING || s == FindPooledString( STRING(s) ), "Invalid string " #s );
+
+// Changes whenever the pool is freed, or first holds two capitalizations of
+// the same text. Read only outside gamestringpool.cpp.
+extern int g_iGameStringPoolSerial;
+
+//-----------------------------------------------------------------------------
+// Purpose: A fixed string that pooled strings are compared against, like a
+//			classname in code. Names and classnames are always pooled, so once
+//			this has its own pooled copy an exact match is a pointer compare.
+//			A caseless compare is only needed while the pool holds some other
+//			capitalization of this text.
+//
+//			The text is hashed once, when this is constructed, and those
+//			hashes find the pooled copy again after each level change.
+//			Declare these static:
+//
+//				static CHashedPooledString s_Bullseye( "npc_bullseye" );
+//				if ( pEntity->ClassMatches( s_Bullseye ) ) ...
+//
+//			Wildcards aren't expanded; use the const char * matchers for them.
+//-----------------------------------------------------------------------------
+class CHashedPooledString
+{
+public:
+	explicit CHashedPooledString( const char *pszValue );
+
+	const char		*GetText() const	{ return m_pszValue; }
+	string_t		Get()				{ Update(); return m_Pooled; }
+
+	// Caseless compare against a pooled (or null) string
+	bool Matches( string_t str )
+	{
+		Update();
+		if ( IDENT_STRINGS( str, m_Pooled ) )
+			return true;
+		return m_bCaseVariants && str != NULL_STRING && !V_stricmp( STRING( str ), m_pszValue );
+	}
+
+private:
+	void Update()
+	{
+		if ( m_iSerial != g_iGameStringPoolSerial )
+		{
+			Refresh();
+		}
+	}
+
+	void Refresh();
+
+	const char		*m_pszValue;
+	unsigned int	m_nHash;
+	unsigned int	m_nCaselessHash;
+	string_t		m_Pooled;
+	int				m_iSerial;
+	bool			m_bCaseVariants;
+};
 		 
 #ifndef GC
 //-----------------------------------------------------------------------------
@@ -370,7 +370,7 @@ public:
 
 		// Spawn the commentary semaphore entity
 		CBaseEntity *pSemaphore = CreateEntityByName( "info_target" );
-		pSemaphore->SetName( MAKE_STRING(MAPEDIT_SPAWNED_SEMAPHORE) );
+		pSemaphore->SetName( AllocPooledString(MAPEDIT_SPAWNED_SEMAPHORE) );
 
 		bool oldLock = engine->LockNetworkStringTables( false );
 
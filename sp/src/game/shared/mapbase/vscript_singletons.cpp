@@ -20,6 +20,7 @@
 
 #include "filesystem.h"
 #include "igameevents.h"
+#include "utlhashtable.h"
 
 #include "vscript_singletons.h"
 
@@ -34,88 +35,162 @@ extern IScriptManager *scriptmanager;
 //=============================================================================
 class CScriptNetPropManager
 {
-public:
-
 #ifdef CLIENT_DLL
-	RecvProp *RecurseTable( RecvTable *pTable, const char *pszPropName )
+	typedef ClientClass	NetClass_t;
+	typedef RecvTable	NetTable_t;
+	typedef RecvProp	NetProp_t;
 #else
-	SendProp *RecurseTable( SendTable *pTable, const char *pszPropName )
+	typedef ServerClass	NetClass_t;
+	typedef SendTable	NetTable_t;
+	typedef SendProp	NetProp_t;
 #endif
+
+	// A resolved name. Misses are kept too, with a NULL prop.
+	struct NetPropEntry_t
 	{
-#ifdef CLIENT_DLL
-		RecvProp *pProp = NULL;
-#else
-		SendProp *pProp = NULL;
-#endif
+		NetProp_t	*pProp;
+		int			iType;
+		int			iOffset;	// From the start of the entity, including the tables the prop is nested in
+		int			iElements;
+	};
+
+	typedef CUtlHashtable<const char *, NetPropEntry_t, CaselessStringHashFunctor, CaselessStringEqualFunctor> NetPropNames_t;
+
+public:
+	~CScriptNetPropManager()
+	{
+		PurgeCache();
+	}
+
+	// Called when the VM starts for a new level
+	void PurgeCache()
+	{
+		FOR_EACH_HASHTABLE( m_Classes, i )
+		{
+			NetPropNames_t *pNames = m_Classes[i];
+			FOR_EACH_HASHTABLE( *pNames, j )
+			{
+				delete [] pNames->Key( j );
+			}
+			delete pNames;
+		}
+		m_Classes.Purge();
+	}
+
+	//-----------------------------------------------------------------------------
+	// Finds a prop in a table or any table nested in it. "m_Collision.m_vecMins" names a prop
+	// inside a particular table, and arrays sent as tables can be named as a whole ("m_iAmmo")
+	// or by element ("m_iAmmo.005").
+	//-----------------------------------------------------------------------------
+	bool FindInTable( NetTable_t *pTable, const char *pszPropName, int iBaseOffset, NetPropEntry_t &entry )
+	{
+		const char *pszRest = strchr( pszPropName, '.' );
+		int nNameLen = pszRest ? pszRest - pszPropName : V_strlen( pszPropName );
+
 		for (int i = 0; i < pTable->GetNumProps(); i++)
 		{
-			pProp = pTable->GetProp( i );
+			NetProp_t *pProp = pTable->GetProp( i );
+			const char *pszName = pProp->GetName();
+			bool bNameMatch = pszName && !V_strnicmp( pszName, pszPropName, nNameLen ) && pszName[nNameLen] == '\0';
+
 			if (pProp->GetType() == DPT_DataTable)
 			{
-				pProp = RecurseTable(pProp->GetDataTable(), pszPropName);
-				if (pProp)
-					return pProp;
+				NetTable_t *pSubTable = pProp->GetDataTable();
+				if (!pSubTable)
+					continue;
+
+				int iOffset = iBaseOffset + pProp->GetOffset();
+
+				if (bNameMatch)
+				{
+					if (pszRest)
+					{
+						if (FindInTable( pSubTable, pszRest + 1, iOffset, entry ))
+							return true;
+					}
+					else if (pSubTable->GetNumProps() > 0 && FStrEq( pSubTable->GetProp( 0 )->GetName(), "000" ))
+					{
+						NetProp_t *pFirst = pSubTable->GetProp( 0 );
+						entry.pProp = pFirst;
+						entry.iType = pFirst->GetType();
+						entry.iOffset = iOffset + pFirst->GetOffset();
+						entry.iElements = pSubTable->GetNumProps();
+						return true;
+					}
+				}
+
+				if (FindInTable( pSubTable, pszPropName, iOffset, entry ))
+					return true;
 			}
-			else
+			else if (bNameMatch && !pszRest)
 			{
-				if (FStrEq( pProp->GetName(), pszPropName ))
-					return pProp;
+				entry.pProp = pProp;
+				entry.iType = pProp->GetType();
+				entry.iOffset = iBaseOffset + pProp->GetOffset();
+				entry.iElements = pProp->GetNumElements();
+				return true;
 			}
 		}
 
-		return NULL;
+		return false;
 	}
 
-#ifdef CLIENT_DLL
-	RecvProp *RecurseNetworkClass( ClientClass *pClass, const char *pszPropName )
-#else
-	SendProp *RecurseNetworkClass( ServerClass *pClass, const char *pszPropName )
-#endif
+	//-----------------------------------------------------------------------------
+	// Names are resolved once per network class and kept until the next level,
+	// scripts polling netprops every frame used to search the whole table each time.
+	//-----------------------------------------------------------------------------
+	const NetPropEntry_t *GetPropByName( CBaseEntity *pEnt, const char *pszPropName )
 	{
+		if (!pEnt || !pszPropName)
+			return NULL;
+
 #ifdef CLIENT_DLL
-		RecvProp *pProp = RecurseTable( pClass->m_pRecvTable, pszPropName );
+		NetClass_t *pClass = pEnt->GetClientClass();
+		NetTable_t *pTable = pClass ? pClass->m_pRecvTable : NULL;
 #else
-		SendProp *pProp = RecurseTable( pClass->m_pTable, pszPropName );
+		NetClass_t *pClass = pEnt->GetServerClass();
+		NetTable_t *pTable = pClass ? pClass->m_pTable : NULL;
 #endif
-		if (pProp)
-			return pProp;
-
-		if (pClass->m_pNext)
-			return RecurseNetworkClass( pClass->m_pNext, pszPropName );
-		else
+		if (!pTable)
 			return NULL;
-	}
 
-#ifdef CLIENT_DLL
-	RecvProp *GetPropByName( CBaseEntity *pEnt, const char *pszPropName )
-	{
-		if (pEnt)
+		UtlHashHandle_t hClass = m_Classes.Find( pClass );
+		if (hClass == m_Classes.InvalidHandle())
 		{
-			return RecurseNetworkClass( pEnt->GetClientClass(), pszPropName );
+			hClass = m_Classes.Insert( pClass, new NetPropNames_t );
 		}
 
-		return NULL;
-	}
-#else
-	SendProp *GetPropByName( CBaseEntity *pEnt, const char *pszPropName )
-	{
-		if (pEnt)
+		NetPropNames_t *pNames = m_Classes[hClass];
+		UtlHashHandle_t hName = pNames->Find( pszPropName );
+		if (hName == pNames->InvalidHandle())
 		{
-			return RecurseNetworkClass( pEnt->GetServerClass(), pszPropName );
+			NetPropEntry_t entry;
+			if (!FindInTable( pTable, pszPropName, 0, entry ))
+			{
+				entry.pProp = NULL;
+				entry.iType = -1;
+				entry.iOffset = 0;
+				entry.iElements = -1;
+			}
+
+			int nLen = V_strlen( pszPropName ) + 1;
+			char *pszKey = new char[nLen];
+			V_memcpy( pszKey, pszPropName, nLen );
+			hName = pNames->Insert( pszKey, entry );
 		}
 
-		return NULL;
+		const NetPropEntry_t *pEntry = &pNames->Element( hName );
+		return pEntry->pProp ? pEntry : NULL;
 	}
-#endif
 
 	int GetPropArraySize( HSCRIPT hEnt, const char *pszPropName )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry)
 		{
 			// TODO: Is this what this function wants?
-			return pProp->GetNumElements();
+			return pEntry->iElements;
 		}
 
 		return -1;
@@ -125,10 +200,10 @@ public:
 	varType name( HSCRIPT hEnt, const char *pszPropName ) \
 	{ \
 		CBaseEntity *pEnt = ToEnt( hEnt ); \
-		auto *pProp = GetPropByName( pEnt, pszPropName ); \
-		if (pProp && pProp->GetType() == propType) \
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName ); \
+		if (pEntry && pEntry->iType == propType) \
 		{ \
-			return *(varType*)((char *)pEnt + pProp->GetOffset()); \
+			return *(varType*)((char *)pEnt + pEntry->iOffset); \
 		} \
 		return defaultval; \
 	} \
@@ -137,10 +212,10 @@ public:
 	varType name( HSCRIPT hEnt, const char *pszPropName, int iArrayElement ) \
 	{ \
 		CBaseEntity *pEnt = ToEnt( hEnt ); \
-		auto *pProp = GetPropByName( pEnt, pszPropName ); \
-		if (pProp && pProp->GetType() == propType) \
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName ); \
+		if (pEntry && pEntry->iType == propType) \
 		{ \
-			return ((varType*)((char *)pEnt + pProp->GetOffset()))[iArrayElement]; \
+			return ((varType*)((char *)pEnt + pEntry->iOffset))[iArrayElement]; \
 		} \
 		return defaultval; \
 	} \
@@ -155,10 +230,10 @@ public:
 	HSCRIPT GetPropEntity( HSCRIPT hEnt, const char *pszPropName )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp && pProp->GetType() == DPT_Int)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry && pEntry->iType == DPT_Int)
 		{
-			return ToHScript( *(CHandle<CBaseEntity>*)((char *)pEnt + pProp->GetOffset()) );
+			return ToHScript( *(CHandle<CBaseEntity>*)((char *)pEnt + pEntry->iOffset) );
 		}
 
 		return NULL;
@@ -167,10 +242,10 @@ public:
 	HSCRIPT GetPropEntityArray( HSCRIPT hEnt, const char *pszPropName, int iArrayElement )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp && pProp->GetType() == DPT_Int)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry && pEntry->iType == DPT_Int)
 		{
-			return ToHScript( ((CHandle<CBaseEntity>*)((char *)pEnt + pProp->GetOffset()))[iArrayElement] );
+			return ToHScript( ((CHandle<CBaseEntity>*)((char *)pEnt + pEntry->iOffset))[iArrayElement] );
 		}
 
 		return NULL;
@@ -179,10 +254,10 @@ public:
 	const char *GetPropString( HSCRIPT hEnt, const char *pszPropName )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp && pProp->GetType() == DPT_Int)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry && pEntry->iType == DPT_Int)
 		{
-			return (const char*)((char *)pEnt + pProp->GetOffset());
+			return (const char*)((char *)pEnt + pEntry->iOffset);
 		}
 
 		return NULL;
@@ -191,10 +266,10 @@ public:
 	const char *GetPropStringArray( HSCRIPT hEnt, const char *pszPropName, int iArrayElement )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp && pProp->GetType() == DPT_Int)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry && pEntry->iType == DPT_Int)
 		{
-			return ((const char**)((char *)pEnt + pProp->GetOffset()))[iArrayElement];
+			return ((const char**)((char *)pEnt + pEntry->iOffset))[iArrayElement];
 		}
 
 		return NULL;
@@ -203,10 +278,10 @@ public:
 	const char *GetPropType( HSCRIPT hEnt, const char *pszPropName )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry)
 		{
-			switch (pProp->GetType())
+			switch (pEntry->iType)
 			{
 			case DPT_Int:		return "integer";
 			case DPT_Float:		return "float";
@@ -231,10 +306,10 @@ public:
 	void name( HSCRIPT hEnt, const char *pszPropName, varType value ) \
 	{ \
 		CBaseEntity *pEnt = ToEnt( hEnt ); \
-		auto *pProp = GetPropByName( pEnt, pszPropName ); \
-		if (pProp && pProp->GetType() == propType) \
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName ); \
+		if (pEntry && pEntry->iType == propType) \
 		{ \
-			*(varType*)((char *)pEnt + pProp->GetOffset()) = value; \
+			*(varType*)((char *)pEnt + pEntry->iOffset) = value; \
 		} \
 	} \
 
@@ -242,10 +317,10 @@ public:
 	void name( HSCRIPT hEnt, const char *pszPropName, varType value, int iArrayElement ) \
 	{ \
 		CBaseEntity *pEnt = ToEnt( hEnt ); \
-		auto *pProp = GetPropByName( pEnt, pszPropName ); \
-		if (pProp && pProp->GetType() == propType) \
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName ); \
+		if (pEntry && pEntry->iType == propType) \
 		{ \
-			((varType*)((char *)pEnt + pProp->GetOffset()))[iArrayElement] = value; \
+			((varType*)((char *)pEnt + pEntry->iOffset))[iArrayElement] = value; \
 		} \
 	} \
 
@@ -261,26 +336,27 @@ public:
 	void SetPropEntity( HSCRIPT hEnt, const char *pszPropName, HSCRIPT value )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp && pProp->GetType() == DPT_Int)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry && pEntry->iType == DPT_Int)
 		{
-			*((CHandle<CBaseEntity>*)((char *)pEnt + pProp->GetOffset())) = ToEnt(value);
+			*((CHandle<CBaseEntity>*)((char *)pEnt + pEntry->iOffset)) = ToEnt(value);
 		}
 	}
 
 	HSCRIPT SetPropEntityArray( HSCRIPT hEnt, const char *pszPropName, HSCRIPT value, int iArrayElement )
 	{
 		CBaseEntity *pEnt = ToEnt( hEnt );
-		auto *pProp = GetPropByName( pEnt, pszPropName );
-		if (pProp && pProp->GetType() == DPT_Int)
+		const NetPropEntry_t *pEntry = GetPropByName( pEnt, pszPropName );
+		if (pEntry && pEntry->iType == DPT_Int)
 		{
-			((CHandle<CBaseEntity>*)((char *)pEnt + pProp->GetOffset()))[iArrayElement] = ToEnt(value);
+			((CHandle<CBaseEntity>*)((char *)pEnt + pEntry->iOffset))[iArrayElement] = ToEnt(value);
 		}
 
 		return NULL;
 	}
 
 private:
+	CUtlHashtable<NetClass_t *, NetPropNames_t *> m_Classes;
 } g_ScriptNetPropManager;
 
 BEGIN_SCRIPTDESC_ROOT_NAMED( CScriptNetPropManager, "CNetPropManager", SCRIPT_SINGLETON "Allows reading and updating the network properties of an entity." )
@@ -1337,6 +1413,7 @@ void RegisterScriptSingletons()
 	ScriptRegisterFunction( g_pScriptVM, FireGameEventLocal, "Fire a game event without broadcasting to the client." );
 #endif
 
+	g_ScriptNetPropManager.PurgeCache();
 	g_pScriptVM->RegisterInstance( &g_ScriptNetPropManager, "NetProps" );
 	g_pScriptVM->RegisterInstance( &g_ScriptLocalize, "Localize" );
 #ifndef CLIENT_DLL
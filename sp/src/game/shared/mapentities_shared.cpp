@@ -203,16 +203,59 @@ skipwhite:
 
 #endif // !STATIC_LINKED || CLIENT_DLL
 
+/* ================= CEntityMapKeys definition ================ */
+
+void CEntityMapKeys::Parse( const char *pEntData )
+{
+	CEntityMapData entData( (char*)pEntData );
+	char keyName[MAPKEY_MAXLENGTH];
+	char value[MAPKEY_MAXLENGTH];
+
+	m_Keys.RemoveAll();
+	m_Strings.RemoveAll();
+
+	if ( entData.GetFirstKey( keyName, value ) )
+	{
+		do
+		{
+			KeyValueIndex_t &index = m_Keys[ m_Keys.AddToTail() ];
+
+			int nKeyLength = V_strlen( keyName ) + 1;
+			index.iKey = m_Strings.AddMultipleToTail( nKeyLength, keyName );
+
+			int nValueLength = V_strlen( value ) + 1;
+			index.iValue = m_Strings.AddMultipleToTail( nValueLength, value );
+		}
+		while ( entData.GetNextKey( keyName, value ) );
+	}
+
+	m_pEnd = entData.CurrentBufferPosition();
+}
+
 /* ================= CEntityMapData definition ================ */
 
 bool CEntityMapData::ExtractValue( const char *keyName, char *value )
 {
+	if ( m_pKeys )
+	{
+		for ( int i = 0; i < m_pKeys->Count(); i++ )
+		{
+			if ( !strcmp( m_pKeys->Key( i ), keyName ) )
+			{
+				Q_strncpy( value, m_pKeys->Value( i ), MAPKEY_MAXLENGTH );
+				return true;
+			}
+		}
+		return false;
+	}
+
 	return MapEntity_ExtractValue( m_pEntData, keyName, value );
 }
 
 bool CEntityMapData::GetFirstKey( char *keyName, char *value )
 {
 	m_pCurrentKey = m_pEntData; // reset the status pointer
+	m_iNextKey = 0;
 	return GetNextKey( keyName, value );
 }
 
@@ -223,6 +266,20 @@ const char *CEntityMapData::CurrentBufferPosition( void )
 
 bool CEntityMapData::GetNextKey( char *keyName, char *value )
 {
+	if ( m_pKeys )
+	{
+		if ( m_iNextKey >= m_pKeys->Count() )
+		{
+			m_pCurrentKey = (char*)m_pKeys->EndPosition();
+			return false;
+		}
+
+		Q_strncpy( keyName, m_pKeys->Key( m_iNextKey ), MAPKEY_MAXLENGTH );
+		Q_strncpy( value, m_pKeys->Value( m_iNextKey ), MAPKEY_MAXLENGTH );
+		m_iNextKey++;
+		return true;
+	}
+
 	char token[MAPKEY_MAXLENGTH];
 
 	// parse key
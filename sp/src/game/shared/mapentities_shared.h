@@ -10,8 +10,42 @@
 #pragma once
 #endif
 
+#include "utlvector.h"
+
 #define MAPKEY_MAXLENGTH	2048
 
+//-----------------------------------------------------------------------------
+// Purpose: The key/value pairs of one entity block, tokenized ahead of time
+//			so blocks can be parsed off the main thread. CEntityMapData reads
+//			from these instead of the text when it's given them.
+//-----------------------------------------------------------------------------
+class CEntityMapKeys
+{
+public:
+	CEntityMapKeys() : m_pEnd( NULL ) {}
+
+	// Reads the keys following an entity's opening brace, as CEntityMapData::GetNextKey() would
+	void Parse( const char *pEntData );
+
+	int Count( void ) const				{ return m_Keys.Count(); }
+	const char *Key( int i ) const		{ return m_Strings.Base() + m_Keys[i].iKey; }
+	const char *Value( int i ) const	{ return m_Strings.Base() + m_Keys[i].iValue; }
+
+	// Where the text parse stopped after the last key
+	const char *EndPosition( void ) const { return m_pEnd; }
+
+private:
+	struct KeyValueIndex_t
+	{
+		int iKey;
+		int iValue;
+	};
+
+	CUtlVector<KeyValueIndex_t>	m_Keys;
+	CUtlVector<char>			m_Strings;
+	const char					*m_pEnd;
+};
+
 
 //-----------------------------------------------------------------------------
 // Purpose: encapsulates the data string in the map file 
@@ -25,9 +59,16 @@ private:
 	int		m_nEntDataSize;
 	char	*m_pCurrentKey;
 
+	const CEntityMapKeys *m_pKeys;
+	int		m_iNextKey;
+
 public:
 	explicit CEntityMapData( char *entBlock, int nEntBlockSize = -1 ) : 
-		m_pEntData(entBlock), m_nEntDataSize(nEntBlockSize), m_pCurrentKey(entBlock) {}
+		m_pEntData(entBlock), m_nEntDataSize(nEntBlockSize), m_pCurrentKey(entBlock), m_pKeys(NULL), m_iNextKey(0) {}
+
+	// Reads pre-parsed keys of entBlock. The text can't be modified through SetValue().
+	CEntityMapData( char *entBlock, const CEntityMapKeys *pKeys ) : 
+		m_pEntData(entBlock), m_nEntDataSize(-1), m_pCurrentKey(entBlock), m_pKeys(pKeys), m_iNextKey(0) {}
 
 	// find the keyName in the entdata and puts it's value into Value.  returns false if key is not found
 	bool ExtractValue( const char *keyName, char *Value );
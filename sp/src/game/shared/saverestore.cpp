@@ -24,6 +24,7 @@
 #include "vphysics/object_hash.h"
 #include "datacache/imdlcache.h"
 #include "tier0/vprof.h"
+#include "datamap_index.h"
 
 #if !defined( CLIENT_DLL )
 
@@ -51,6 +52,8 @@ void AddRestoredEntity( C_BaseEntity *pEntity );
 #define ZERO_TIME ((FLT_MAX*-0.5))
 // A bit arbitrary, but unlikely to collide with any saved games...
 #define TICK_NEVER_THINK_ENCODE	( INT_MAX - 3 )
+// Below this many fields, a restore search just scans the datamap
+#define RESTORE_MIN_INDEXED_FIELDS	8
 
 ASSERT_INVARIANT( sizeof(EHandlePlaceholder_t) == sizeof(EHANDLE) );
 
@@ -1333,7 +1336,8 @@ CRestore::CRestore( CSaveRestoreData *pdata )
  :	m_pData( pdata ),
 	m_pGameInfo( pdata ),
 	m_global( 0 ),
-	m_precache( true )
+	m_precache( true ),
+	m_pReadMap( NULL )
 {
 	m_BlockEndStack.EnsureCapacity( 32 );
 }
@@ -1503,6 +1507,28 @@ typedescription_t *CRestore::FindField( const char *pszFieldName, typedescriptio
 	int &fieldNumber = *pCookie;
 	if ( pszFieldName )
 	{
+		// Fields usually come back in the order they were written. When one doesn't, long maps
+		// jump straight to it through the datamap index instead of scanning around. Short maps,
+		// including the ones the container ops build on the stack, are cheaper to scan.
+		// Names used by more than one field are left to the scan, which finds the one after
+		// the last field read.
+		if ( fieldCount >= RESTORE_MIN_INDEXED_FIELDS && m_pReadMap && m_pReadMap->dataDesc == pFields &&
+			 stricmp( pFields[fieldNumber].fieldName, pszFieldName ) != 0 )
+		{
+			bool bDuplicated;
+			int iField = DataDesc_FindFieldIndex( m_pReadMap, DATADESC_LOOKUP_FIELD, pszFieldName, &bDuplicated );
+			if ( iField == -1 )
+			{
+				fieldNumber = 0;
+				return NULL;
+			}
+
+			if ( !bDuplicated )
+			{
+				fieldNumber = iField;
+			}
+		}
+
 		typedescription_t *pTest;
 		
 		for ( int i = 0; i < fieldCount; i++ )
@@ -1726,7 +1752,12 @@ int CRestore::DoReadAll( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCur
 			return status;
 	}
 
-	return ReadFields( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap->dataDesc, pCurMap->dataNumFields );
+	datamap_t *pPrevReadMap = m_pReadMap;
+	m_pReadMap = pCurMap;
+	int status = ReadFields( pCurMap->dataClassName, pLeafObject, pLeafMap, pCurMap->dataDesc, pCurMap->dataNumFields );
+	m_pReadMap = pPrevReadMap;
+
+	return status;
 }
 
 //-------------------------------------
@@ -324,6 +324,8 @@ private:
 	CGameSaveRestoreInfo *	m_pGameInfo;
 	int						m_global;		// Restoring a global entity?
 	bool					m_precache;
+
+	datamap_t *				m_pReadMap;		// Map whose fields ReadFields() is reading, if it came from DoReadAll()
 };
 
 
@@ -274,3 +274,165 @@ CON_COMMAND_SHARED( script_dump_all, "Dump the state of the VM to the console" )
 	}
 	g_pScriptVM->DumpState();
 }
+
+CON_COMMAND_SHARED( script_profile_start, "Start timing script functions and the natives they call" )
+{
+	if ( !g_pScriptVM )
+	{
+		CGWarning( 0, CON_GROUP_VSCRIPT, "Scripting disabled or no server running\n" );
+		return;
+	}
+	g_pScriptVM->SetProfilingEnabled( true );
+}
+
+CON_COMMAND_SHARED( script_profile_stop, "Stop timing script functions, the results are kept until script_profile_reset" )
+{
+	if ( !g_pScriptVM )
+	{
+		CGWarning( 0, CON_GROUP_VSCRIPT, "Scripting disabled or no server running\n" );
+		return;
+	}
+	g_pScriptVM->SetProfilingEnabled( false );
+}
+
+CON_COMMAND_SHARED( script_profile_reset, "Clear the script profile" )
+{
+	if ( !g_pScriptVM )
+	{
+		CGWarning( 0, CON_GROUP_VSCRIPT, "Scripting disabled or no server running\n" );
+		return;
+	}
+	g_pScriptVM->ResetProfile();
+}
+
+CON_COMMAND_SHARED( script_profile_dump, "Print the most expensive script functions and hooks. Optional number of entries" )
+{
+	if ( !g_pScriptVM )
+	{
+		CGWarning( 0, CON_GROUP_VSCRIPT, "Scripting disabled or no server running\n" );
+		return;
+	}
+
+	int nMaxEntries = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 30;
+	g_pScriptVM->DumpProfile( MAX( nMaxEntries, 1 ) );
+}
+
+CON_COMMAND_SHARED( script_profile_export, "Write the script profile as collapsed stacks for flame graph tools. Optional file name" )
+{
+	if ( !g_pScriptVM )
+	{
+		CGWarning( 0, CON_GROUP_VSCRIPT, "Scripting disabled or no server running\n" );
+		return;
+	}
+
+#ifdef CLIENT_DLL
+	const char *pszFile = ( args.ArgC() > 1 ) ? args[1] : "vscript_profile_client.txt";
+#else
+	const char *pszFile = ( args.ArgC() > 1 ) ? args[1] : "vscript_profile.txt";
+#endif
+
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	g_pScriptVM->WriteProfileStacks( &buf );
+
+	if ( !filesystem->WriteFile( pszFile, "DEFAULT_WRITE_PATH", buf ) )
+	{
+		CGWarning( 0, CON_GROUP_VSCRIPT, "Unable to write %s\n", pszFile );
+		return;
+	}
+
+	CGMsg( 0, CON_GROUP_VSCRIPT, "Wrote script profile to %s\n", pszFile );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Natives for script_bench_native_calls, one per common signature
+//-----------------------------------------------------------------------------
+static void ScriptBenchVoid()
+{
+}
+
+static int ScriptBenchInt()
+{
+	return 1;
+}
+
+static float ScriptBenchFloat( float flValue )
+{
+	return flValue;
+}
+
+static Vector ScriptBenchVector( const Vector &vecValue )
+{
+	return vecValue;
+}
+
+static bool ScriptBenchString( const char *pszValue )
+{
+	return pszValue[0] != 0;
+}
+
+static bool ScriptBenchHandle( HSCRIPT hValue )
+{
+	bool bValid = ( hValue != NULL );
+	g_pScriptVM->ReleaseScript( hValue );
+	return bValid;
+}
+
+CON_COMMAND_SHARED( script_bench_native_calls, "Times script calls into native functions for common signatures. Optional iteration count" )
+{
+	if ( !g_pScriptVM )
+	{
+		CGWarning( 0, CON_GROUP_VSCRIPT, "Scripting disabled or no server running\n" );
+		return;
+	}
+
+	int nIterations = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 100000;
+	nIterations = MAX( nIterations, 1 );
+
+	// Each registration keeps a stub until the VM shuts down, so only register once per VM
+	if ( !g_pScriptVM->ValueExists( "__BenchVoid" ) )
+	{
+		ScriptRegisterFunctionNamed( g_pScriptVM, ScriptBenchVoid, "__BenchVoid", "" );
+		ScriptRegisterFunctionNamed( g_pScriptVM, ScriptBenchInt, "__BenchInt", "" );
+		ScriptRegisterFunctionNamed( g_pScriptVM, ScriptBenchFloat, "__BenchFloat", "" );
+		ScriptRegisterFunctionNamed( g_pScriptVM, ScriptBenchVector, "__BenchVector", "" );
+		ScriptRegisterFunctionNamed( g_pScriptVM, ScriptBenchString, "__BenchString", "" );
+		ScriptRegisterFunctionNamed( g_pScriptVM, ScriptBenchHandle, "__BenchHandle", "" );
+	}
+
+	static const char *s_pszSignatures[][2] =
+	{
+		{ "empty loop",		"" },
+		{ "void()",			"__BenchVoid()" },
+		{ "int()",			"__BenchInt()" },
+		{ "float(float)",	"__BenchFloat( 1.0 )" },
+		{ "Vector(Vector)",	"__BenchVector( v )" },
+		{ "bool(string)",	"__BenchString( \"bench\" )" },
+		{ "bool(handle)",	"__BenchHandle( t )" },
+	};
+
+	double flBaseline = 0.0;
+	for ( int i = 0; i < ARRAYSIZE( s_pszSignatures ); i++ )
+	{
+		HSCRIPT hScript = g_pScriptVM->CompileScript( CFmtStrN<512>( "local v = Vector( 1, 2, 3 ); local t = {}; for ( local i = 0; i < %d; i++ ) { %s; }", nIterations, s_pszSignatures[i][1] ) );
+		if ( !hScript )
+		{
+			CGWarning( 0, CON_GROUP_VSCRIPT, "Unable to compile benchmark for %s\n", s_pszSignatures[i][0] );
+			continue;
+		}
+
+		double flStart = Plat_FloatTime();
+		g_pScriptVM->Run( hScript );
+		double flTime = Plat_FloatTime() - flStart;
+		g_pScriptVM->ReleaseScript( hScript );
+
+		if ( i == 0 )
+		{
+			flBaseline = flTime;
+			Msg( "%-16s %8.1f ns per iteration\n", s_pszSignatures[i][0], flTime * 1e9 / nIterations );
+		}
+		else
+		{
+			Msg( "%-16s %8.1f ns per call\n", s_pszSignatures[i][0], ( flTime - flBaseline ) * 1e9 / nIterations );
+		}
+	}
+}
@@ -213,11 +213,11 @@ short *CBoneCache::CachedToStudio()
 }
 
 // Construct a singleton
-static CDataManager<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex> g_StudioBoneCache( 128 * 1024L );
+static CDataManager<CBoneCache, bonecacheparams_t, CBoneCache *, CThreadFastMutex> g_StudioBoneCache( 128 * 1024L, "bone cache" );
 
 CBoneCache *Studio_GetBoneCache( memhandle_t cacheHandle )
 {
-	AUTO_LOCK( g_StudioBoneCache.AccessMutex() );
+	// Lookups don't need the mutex, so threaded bone setup doesn't serialize here
 	return g_StudioBoneCache.GetResource_NoLock( cacheHandle );
 }
 
@@ -243,6 +243,15 @@ void Studio_InvalidateBoneCache( memhandle_t cacheHandle )
 	}
 }
 
+#if defined( CLIENT_DLL )
+CON_COMMAND_F( cl_datamanager_stats, "Reports hits, misses and evictions for the client's resource caches. Pass 'reset' to clear them", FCVAR_CHEAT )
+#else
+CON_COMMAND_F( sv_datamanager_stats, "Reports hits, misses and evictions for the server's resource caches. Pass 'reset' to clear them", FCVAR_CHEAT )
+#endif
+{
+	CDataManagerBase::PrintAllStats( args.ArgC() > 1 && !V_stricmp( args[1], "reset" ) );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
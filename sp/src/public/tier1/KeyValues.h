@@ -121,6 +121,12 @@ public:
 	void UsesEscapeSequences(bool state); // default false
 	void UsesConditionals(bool state); // default true
 	bool LoadFromFile( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID = NULL );
+
+	// Files loaded with LoadFromFile() can be kept pre-parsed in a binary cache in the
+	// write path, checked against the size and CRC of the text. Off unless enabled.
+	static void SetBinaryCacheEnabled( bool bEnabled );
+	static bool IsBinaryCacheEnabled();
+
 	bool SaveToFile( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID = NULL, bool sortKeys = false, bool bAllowEmptyString = false );
 
 	// Read from a buffer...  Note that the buffer must be null terminated
@@ -256,6 +262,9 @@ public:
 	void RecursiveMergeKeyValues( KeyValues *baseKV );
 
 private:
+	friend class CKeyValuesBinaryCache;
+	friend class CKeyValuesChildIndex;
+
 	KeyValues( KeyValues& );	// prevent copy constructor being used
 
 	// prevent delete being called except through deleteThis()
@@ -217,6 +217,16 @@ public:
 	void			WriteBitVec3Normal( const Vector& fa );
 	void			WriteBitAngles( const QAngle& fa );
 
+	// Write nCount values of one kind in a single call. These gather bits in a
+	// 64-bit accumulator and store each dword of the buffer once, instead of
+	// masking the value into the buffer per call. The output is identical to
+	// calling the single value version nCount times.
+	void			WriteUBitLongArray( const unsigned int *pData, int nCount, int numbits );
+	void			WriteSBitLongArray( const int *pData, int nCount, int numbits );
+	void			WriteBitFloatArray( const float *pData, int nCount );
+	void			WriteBitCoordArray( const float *pData, int nCount );
+	void			WriteBitNormalArray( const float *pData, int nCount );
+
 
 // Byte functions.
 public:
@@ -592,6 +602,13 @@ public:
 	void			ReadBitVec3Normal( Vector& fa );
 	void			ReadBitAngles( QAngle& fa );
 
+	// Read back what the bf_write array functions wrote, through a 64-bit accumulator
+	void			ReadUBitLongArray( unsigned int *pOut, int nCount, int numbits );
+	void			ReadSBitLongArray( int *pOut, int nCount, int numbits );
+	void			ReadBitFloatArray( float *pOut, int nCount );
+	void			ReadBitCoordArray( float *pOut, int nCount );
+	void			ReadBitNormalArray( float *pOut, int nCount );
+
 	// Faster for comparisons but do not fully decode float values
 	unsigned int	ReadBitCoordBits();
 	unsigned int	ReadBitCoordMPBits( bool bIntegral, bool bLowPrecision );
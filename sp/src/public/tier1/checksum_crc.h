@@ -28,4 +28,24 @@ inline CRC32_t CRC32_ProcessSingleBuffer( const void *p, int len )
 	return crc;
 }
 
+//-----------------------------------------------------------------------------
+// CRC32C (Castagnoli polynomial). Different values from CRC32 above, so only
+// for new data; it uses the SSE4.2 crc32 instruction when the CPU has it.
+//-----------------------------------------------------------------------------
+void CRC32C_Init( CRC32_t *pulCRC );
+void CRC32C_ProcessBuffer( CRC32_t *pulCRC, const void *p, int len );
+void CRC32C_Final( CRC32_t *pulCRC );
+bool CRC32C_IsHardwareAccelerated();
+
+inline CRC32_t CRC32C_ProcessSingleBuffer( const void *p, int len )
+{
+	CRC32_t crc;
+
+	CRC32C_Init( &crc );
+	CRC32C_ProcessBuffer( &crc, p, len );
+	CRC32C_Final( &crc );
+
+	return crc;
+}
+
 #endif // CHECKSUM_CRC_H
@@ -18,6 +18,29 @@ FORWARD_DECLARE_HANDLE( memhandle_t );
 
 #define INVALID_MEMHANDLE ((memhandle_t)0xffffffff)
 
+#define DATAMANAGER_MAX_STAT_THREADS	32	// Threads that count lookups on their own, the rest share interlocked counters
+
+// Counters since the manager was created or the stats were last reset
+struct DataManagerStats_t
+{
+	int		nHits;			// Lookups of a resource that was still resident
+	int		nMisses;		// Lookups of a handle that had been evicted or destroyed
+	int		nEvictions;		// Resources freed to make room
+	int		nSecondChances;	// Touched resources passed over by eviction
+	int		nResident;
+	int		nLocked;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Memory-bounded resource cache. Unlocked resources are evicted
+//			roughly least recently used first.
+//
+//			Recency is tracked CLOCK style: touching a resource only sets its
+//			referenced bit, so TouchResource() and the GetResource_NoLock()
+//			calls don't take the manager's mutex. Eviction walks the LRU list
+//			under the mutex, one resource at a time, and sends referenced
+//			resources back to the tail once before freeing them.
+//-----------------------------------------------------------------------------
 class CDataManagerBase
 {
 public:
@@ -69,6 +92,13 @@ public:
 	void					GetLRUHandleList( CUtlVector< memhandle_t >& list );
 	void					GetLockHandleList( CUtlVector< memhandle_t >& list );
 
+	const char				*GetName() const	{ return m_pszName; }
+	void					GetStats( DataManagerStats_t &stats );
+	void					ResetStats();
+
+	// Every manager in this module, for stats reporting
+	static void				PrintAllStats( bool bReset );
+
 
 protected:
 	// derived class must call these to implement public API
@@ -81,7 +111,7 @@ protected:
 	// NOTE: you must call this from the destructor of the derived class! (will assert otherwise)
 	void					FreeAllLists()	{ FlushAll(); m_listsAreFreed = true; }
 
-							CDataManagerBase( unsigned int maxSize );
+							CDataManagerBase( unsigned int maxSize, const char *pszName = NULL );
 	virtual					~CDataManagerBase();
 	
 	
@@ -99,21 +129,51 @@ protected:
 	void					TouchByIndex( unsigned short memoryIndex );
 	void *					GetForFreeByIndex( unsigned short memoryIndex );
 
-	// One of these is stored per active allocation
+	// One of these is stored per active allocation, and only used under the lock
 	struct resource_lru_element_t
 	{
 		resource_lru_element_t()
 		{
 			lockCount = 0;
-			serial = 1;
-			pStore = 0;
 		}
 
 		unsigned short lockCount;
-		unsigned short serial;
-		void	*pStore;
 	};
 
+	// The parts of an allocation read without the lock. These live in pages
+	// that never move or get freed while the manager exists, so a stale
+	// handle can always be checked against them safely. Only written under
+	// the lock, except for bReferenced.
+	struct resource_clock_entry_t
+	{
+		volatile unsigned short serial;
+		volatile unsigned char	bReferenced;
+		void * volatile			pStore;
+	};
+
+	enum
+	{
+		CLOCK_PAGE_BITS = 8,
+		CLOCK_PAGE_SIZE = 1 << CLOCK_PAGE_BITS,
+		CLOCK_PAGE_COUNT = 0x10000 >> CLOCK_PAGE_BITS,
+	};
+
+	resource_clock_entry_t	&ClockEntry( unsigned short index )	{ return m_pClockPages[index >> CLOCK_PAGE_BITS][index & ( CLOCK_PAGE_SIZE - 1 )]; }
+	resource_clock_entry_t	*FindClockEntry( memhandle_t handle );
+	void					*GetStoreNoLock( memhandle_t handle, bool bTouch );
+
+	// Each thread counts its lookups on its own cache line, so lock-free
+	// lookups on different threads don't write to the same one
+	struct lookup_counts_t
+	{
+		int		nHits;
+		int		nMisses;
+		byte	pad[56];
+	};
+
+	lookup_counts_t			*GetThreadLookupCounts();
+	void					CountLookup( bool bHit );
+
 	unsigned int m_targetMemorySize;
 	unsigned int m_memUsed;
 	
@@ -125,6 +185,19 @@ protected:
 	unsigned short m_listsAreFreed : 1;
 	unsigned short m_unused : 15;
 
+	resource_clock_entry_t * volatile m_pClockPages[CLOCK_PAGE_COUNT];
+
+	const char			*m_pszName;
+	CDataManagerBase	*m_pNextManager;
+
+	// Lookups by threads without their own counts
+	volatile int		m_nHits;
+	volatile int		m_nMisses;
+
+	int					m_nEvictions;
+	int					m_nSecondChances;
+
+	lookup_counts_t		m_ThreadLookups[DATAMANAGER_MAX_STAT_THREADS];
 };
 
 template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, class MUTEX_TYPE = CThreadNullMutex>
@@ -133,7 +206,7 @@ class CDataManager : public CDataManagerBase
 	typedef CDataManagerBase BaseClass;
 public:
 
-	CDataManager<STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE>( unsigned int size = (unsigned)-1 ) : BaseClass(size) {}
+	CDataManager<STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE>( unsigned int size = (unsigned)-1, const char *pszName = NULL ) : BaseClass( size, pszName ) {}
 	
 
 	~CDataManager<STORAGE_TYPE, CREATE_PARAMS, LOCK_TYPE, MUTEX_TYPE>()
@@ -155,6 +228,7 @@ public:
 	}
 
 	// Use GetData() to translate pointer to LOCK_TYPE
+	// Doesn't take the mutex, but the resource can be evicted by another thread at any time
 	LOCK_TYPE GetResource_NoLock( memhandle_t hMem )
 	{
 		void *pLock = const_cast<void *>(BaseClass::GetResource_NoLock( hMem ));
@@ -255,7 +329,7 @@ inline unsigned short CDataManagerBase::FromHandle( memhandle_t handle )
 	unsigned short serial = fullWord>>16;
 	unsigned short index = fullWord & 0xFFFF;
 	index--;
-	if ( m_memoryLists.IsValidIndex(index) && m_memoryLists[index].serial == serial )
+	if ( m_memoryLists.IsValidIndex(index) && ClockEntry(index).serial == serial )
 		return index;
 	return m_memoryLists.InvalidIndex();
 }
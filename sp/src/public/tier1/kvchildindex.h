@@ -0,0 +1,51 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Hashed lookups into the children of one KeyValues node.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef KVCHILDINDEX_H
+#define KVCHILDINDEX_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "KeyValues.h"
+#include "utlhashtable.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: KeyValues::FindKey() walks a node's children in order, which adds
+//			up for callers that search a node with hundreds of children over
+//			and over. This indexes the children by name symbol once and finds
+//			the same key FindKey() would (the first child with the name,
+//			then the chained KeyValues).
+//
+//			The index doesn't track changes to the node; Build() it again
+//			after adding or removing children.
+//-----------------------------------------------------------------------------
+class CKeyValuesChildIndex
+{
+public:
+	CKeyValuesChildIndex() : m_pParent( NULL ) {}
+	explicit CKeyValuesChildIndex( KeyValues *pParent ) : m_pParent( NULL ) { Build( pParent ); }
+
+	void		Build( KeyValues *pParent );
+	void		Purge();
+
+	KeyValues	*GetParent() const	{ return m_pParent; }
+	int			Count() const		{ return m_Children.Count(); }
+
+	// Same results as m_pParent->FindKey( keyName ), "a/b" paths included
+	KeyValues	*FindKey( const char *keyName ) const;
+
+	// Direct children only, like KeyValues::FindKey( int )
+	KeyValues	*FindKey( int keySymbol ) const;
+
+private:
+	KeyValues *m_pParent;
+	CUtlHashtable<int, KeyValues *> m_Children;
+};
+
+#endif // KVCHILDINDEX_H
@@ -12,10 +12,16 @@
 
 #if !defined( _X360 )
 #define LZMA_ID				(('A'<<24)|('M'<<16)|('Z'<<8)|('L'))
+#define LZMA_BLOCK_ID		(('B'<<24)|('M'<<16)|('Z'<<8)|('L'))
 #else
 #define LZMA_ID				(('L'<<24)|('Z'<<16)|('M'<<8)|('A'))
+#define LZMA_BLOCK_ID		(('L'<<24)|('Z'<<16)|('M'<<8)|('B'))
 #endif
 
+#include "tier1/utlvector.h"
+
+class CUtlBuffer;
+
 // bind the buffer for correct identification
 #pragma pack(1)
 struct lzma_header_t
@@ -25,8 +31,33 @@ struct lzma_header_t
 	unsigned int	lzmaSize;		// always little endian
 	unsigned char	properties[5];
 };
+
+// Block container, the data split into blocks that are compressed separately
+// so they can be decoded in parallel. Each block is a complete buffer with its
+// own lzma_header_t.
+struct lzma_block_header_t
+{
+	unsigned int	id;				// LZMA_BLOCK_ID
+	unsigned int	actualSize;		// always little endian, all blocks together
+	unsigned int	blockSize;		// always little endian, uncompressed size of every block but the last
+	unsigned int	numBlocks;		// always little endian
+	// followed by numBlocks little endian offsets of each block's lzma_header_t,
+	// from the start of this header, in increasing order
+};
 #pragma pack()
 
+// Containers with more blocks than this are rejected
+#define LZMA_MAX_BLOCKS		( 64 * 1024 )
+
+// One buffer of a multi-buffer decode
+struct lzma_job_t
+{
+	unsigned char	*pInput;		// LZMA_ID or LZMA_BLOCK_ID buffer
+	unsigned int	nInputSize;		// if not 0, headers and offsets pointing past this many bytes fail the job
+	unsigned char	*pOutput;		// at least GetActualSize( pInput ) bytes
+	unsigned int	nResult;		// set to the uncompressed size, 0 on failure
+};
+
 class CLZMA
 {
 public:
@@ -34,7 +65,73 @@ public:
 	bool			IsCompressed( unsigned char *pInput );
 	unsigned int	GetActualSize( unsigned char *pInput );
 
+	// Uncompresses several buffers at once on the thread pool. The blocks
+	// of block containers are spread over the threads as well. Uncompress()
+	// decodes blocks one after another on the calling thread.
+	//
+	// This is in its own file so only code that calls it needs vstdlib's
+	// thread pool.
+	void			UncompressParallel( lzma_job_t *pJobs, int nJobs );
+
+private:
+	struct WorkItem_t
+	{
+		unsigned char	*pInput;
+		unsigned int	nInputSize;
+		unsigned char	*pOutput;
+		unsigned int	nExpectedSize;
+		bool			bSucceeded;
+	};
+
+	typedef void (*RunWorkItemsFunc_t)( WorkItem_t *pItems, int nItems );
+
+	static bool		AddWorkItems( unsigned char *pInput, unsigned int nInputSize, unsigned char *pOutput, CUtlVector<WorkItem_t> &items );
+	static void		UncompressWorkItem( WorkItem_t &item );
+	static void		RunWorkItems( WorkItem_t *pItems, int nItems );
+	static void		RunWorkItemsInParallel( WorkItem_t *pItems, int nItems );
+	void			UncompressJobs( lzma_job_t *pJobs, int nJobs, RunWorkItemsFunc_t pfnRun );
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes a compressed buffer as it arrives, so decoding can start
+//			before the whole input has been read and the output can be used
+//			in pieces. Takes the same buffers as CLZMA, fed in chunks of any
+//			size. Only a window of the dictionary size (at most the size of
+//			the uncompressed data) is kept in memory.
+//-----------------------------------------------------------------------------
+typedef void (*LZMAOutputFunc_t)( void *pContext, const unsigned char *pData, unsigned int nSize );
+
+struct LZMAStreamState_t;
+
+class CLZMAStream
+{
+public:
+	CLZMAStream();
+	~CLZMAStream();
+
+	// Starts over with a new buffer, keeping allocations
+	void			Reset();
+
+	// Feeds the next nInputSize bytes of the buffer. Decoded bytes are appended
+	// to the output buffer or passed to the callback as soon as they are ready.
+	// Returns false once the data turns out to be bad. Input past the end of
+	// the compressed data is ignored.
+	bool			Decode( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer &output );
+	bool			Decode( const unsigned char *pInput, unsigned int nInputSize, LZMAOutputFunc_t pfnOutput, void *pContext );
+
+	bool			IsFinished() const;
+	bool			IsFailed() const;
+
+	// 0 until the header has been fed
+	unsigned int	GetActualSize() const;
+
+	// Bytes decoded so far
+	unsigned int	GetOutputSize() const;
+
 private:
+	bool			DecodeInternal( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer *pBuffer, LZMAOutputFunc_t pfnOutput, void *pContext );
+
+	LZMAStreamState_t *m_pState;
 };
 
 #endif
@@ -68,6 +68,7 @@ public:
 	// returns number of allocated blocks
 	int Count() { return m_BlocksAllocated; }
 	int PeakCount() { return m_PeakAlloc; }
+	int NumBlobs() const { return m_NumBlobs; }
 
 protected:
 	class CBlob
@@ -127,6 +128,111 @@ private:
 };
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Thread-safe pool that doesn't serialize on a lock. Each thread
+//			caches two magazines of free blocks (about 4K worth each) and only
+//			goes to the shared lock-free depot to trade a whole magazine, so
+//			most allocs and frees touch no shared state. Blobs are carved up
+//			under a lock only when the depot runs dry.
+//
+//			Blocks can be freed on any thread. A thread's magazines go back
+//			to the depot when it exits, and its cache goes to the next new
+//			thread. Threads beyond MEMPOOL_TS_MAX_THREADS running at once
+//			share a single locked cache.
+//-----------------------------------------------------------------------------
+#define MEMPOOL_TS_MAX_THREADS	32
+
+struct MemoryPoolTSStats_t
+{
+	int		nOutstanding;		// blocks allocated and not yet freed
+	int		nPeakOutstanding;	// sampled when a thread refills, so can trail by a magazine per thread
+	int		nBlobs;
+	int		nDepotRefills;		// magazines threads took from the depot
+	int		nDepotFlushes;		// magazines threads gave back to the depot
+	int		nBlobRefills;		// magazines carved from blobs
+	int		nContended;			// times a thread had to wait on a lock
+};
+
+class CMemoryPoolTS
+{
+public:
+				CMemoryPoolTS( int blockSize, int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, const char *pszAllocOwner = NULL, int nAlignment = 0 );
+				~CMemoryPoolTS();
+
+	void*		Alloc();
+	void*		Alloc( size_t amount );
+	void*		AllocZero();
+	void*		AllocZero( size_t amount );
+	void		Free( void *pMem );
+
+	// Frees everything. No other thread may be using the pool.
+	void		Clear();
+
+	// Exact while no other thread is using the pool
+	int			Count() const;
+	int			PeakCount() const { return m_nPeakAlloc; }
+
+	void		GetStats( MemoryPoolTSStats_t &stats ) const;
+
+	// Called on a thread as it exits, for the thread slot allocator
+	static void	ReleaseThreadSlot( int iSlot );
+
+private:
+	struct TSLIST_NODE_ALIGN Magazine_t : public TSLNodeBase_t
+	{
+		void	*m_pBlocks;
+		int		m_nBlocks;
+	} TSLIST_NODE_ALIGN_POST;
+
+	// Free blocks are chained through their first pointer. pPrevious is
+	// always either empty or holds a full magazine.
+	struct ThreadCache_t
+	{
+		void	*pLoaded;
+		int		nLoaded;
+		void	*pPrevious;
+		int		nPrevious;
+		int		nOutstanding;	// allocs minus frees on this thread, can go negative
+	};
+
+	// Keeps threads off each other's cache lines
+	union PaddedThreadCache_t
+	{
+		ThreadCache_t	cache;
+		byte			pad[64];
+	};
+
+	ThreadCache_t	*GetThreadCache();
+	void			LockContended( CThreadFastMutex &mutex );
+	void			*AllocFromCache( ThreadCache_t &cache );
+	void			FreeToCache( ThreadCache_t &cache, void *pMem );
+	bool			Refill( ThreadCache_t &cache );
+	void			Flush( ThreadCache_t &cache );
+	void			ResetCaches();
+
+	CTSListBase			m_Depot;				// full magazines
+	CTSListBase			m_EmptyMagazines;		// headers for reuse
+	CUtlMemoryPool		m_Blobs;				// guarded by m_BlobMutex
+	CThreadFastMutex	m_BlobMutex;
+	ThreadCache_t		m_SharedCache;			// guarded by m_SharedCacheMutex
+	CThreadFastMutex	m_SharedCacheMutex;
+	PaddedThreadCache_t	m_ThreadCaches[MEMPOOL_TS_MAX_THREADS];
+
+	int					m_BlockSize;
+	int					m_nMagazineSize;
+
+	int volatile		m_nPeakAlloc;
+	int volatile		m_nDepotRefills;
+	int volatile		m_nDepotFlushes;
+	int volatile		m_nBlobRefills;
+	int volatile		m_nContended;
+
+	CMemoryPoolTS		*m_pNextPool;
+	static CMemoryPoolTS	*s_pFirstPool;
+	static CThreadFastMutex	s_PoolsMutex;
+};
+
+
 //-----------------------------------------------------------------------------
 // Wrapper macro to make an allocator that returns particular typed allocations
 // and construction and destruction of objects.
@@ -152,6 +258,38 @@ public:
 };
 
 
+//-----------------------------------------------------------------------------
+// Typed wrapper for CMemoryPoolTS. Clear() doesn't destruct objects still
+// allocated, unlike CClassMemoryPool.
+//-----------------------------------------------------------------------------
+template< class T >
+class CClassMemoryPoolTS : public CMemoryPoolTS
+{
+public:
+	CClassMemoryPoolTS( int numElements, int growMode = UTLMEMORYPOOL_GROW_FAST, int nAlignment = 0 ) :
+		CMemoryPoolTS( sizeof(T), numElements, growMode, MEM_ALLOC_CLASSNAME(T), nAlignment ) {}
+
+	T*		Alloc()
+	{
+		T *pRet = (T *)CMemoryPoolTS::Alloc();
+		if ( pRet )
+		{
+			Construct( pRet );
+		}
+		return pRet;
+	}
+
+	void	Free( T *pMem )
+	{
+		if ( pMem )
+		{
+			Destruct( pMem );
+		}
+		CMemoryPoolTS::Free( pMem );
+	}
+};
+
+
 //-----------------------------------------------------------------------------
 // Specialized pool for aligned data management (e.g., Xbox cubemaps)
 //-----------------------------------------------------------------------------
@@ -363,6 +501,18 @@ inline void CClassMemoryPool<T>::Clear()
 #define DEFINE_FIXEDSIZE_ALLOCATOR_MT( _class, _initsize, _grow )					\
 	CMemoryPoolMT   _class::s_Allocator(sizeof(_class), _initsize, _grow, #_class " pool")
 
+#define DECLARE_FIXEDSIZE_ALLOCATOR_TS( _class )									\
+	public:																		\
+	   inline void* operator new( size_t size ) { MEM_ALLOC_CREDIT_(#_class " pool"); return s_Allocator.Alloc(size); }   \
+	   inline void* operator new( size_t size, int nBlockUse, const char *pFileName, int nLine ) { MEM_ALLOC_CREDIT_(#_class " pool"); return s_Allocator.Alloc(size); }   \
+	   inline void  operator delete( void* p ) { s_Allocator.Free(p); }		\
+	   inline void  operator delete( void* p, int nBlockUse, const char *pFileName, int nLine ) { s_Allocator.Free(p); }   \
+	private:																		\
+		static   CMemoryPoolTS   s_Allocator
+
+#define DEFINE_FIXEDSIZE_ALLOCATOR_TS( _class, _initsize, _grow )					\
+	CMemoryPoolTS   _class::s_Allocator(sizeof(_class), _initsize, _grow, #_class " pool")
+
 //-----------------------------------------------------------------------------
 // Macros that make it simple to make a class use a fixed-size allocator
 // This version allows us to use a memory pool which is externally defined...
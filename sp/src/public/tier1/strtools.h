@@ -138,6 +138,12 @@ char*		V_stristr( char* pStr, const char* pSearch );
 const char*	V_stristr( const char* pStr, const char* pSearch );
 const char*	V_strnistr( const char* pStr, const char* pSearch, int n );
 const char*	V_strnchr( const char* pStr, char c, int n );
+
+// V_stricmp, V_strnicmp, V_stristr, V_strnistr and V_strnchr scan 16 bytes at a time
+// with SSE2 when the CPU has it, with the same results. Turning that off is for benchmarks.
+bool		V_IsStringSIMDEnabled();
+void		V_SetStringSIMDEnabled( bool bEnabled );
+
 inline int V_strcasecmp (const char *s1, const char *s2) { return V_stricmp(s1, s2); }
 inline int V_strncasecmp (const char *s1, const char *s2, int n) { return V_strnicmp(s1, s2, n); }
 void		V_qsort_s( void *base, size_t num, size_t width, int ( __cdecl *compare )(void *, const void *,
@@ -0,0 +1,219 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Fine-grained work-stealing tasks on top of the job thread pool.
+//
+//=============================================================================//
+
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "tier1/mempool.h"
+#include "tier1/utlvector.h"
+
+//-----------------------------------------------------------------------------
+// Purpose: Queuing a CJob allocates a functor and a job with its own event
+//			and mutex, and every job goes through one locked queue. That's
+//			fine for a few big pieces of work but too slow to split a frame's
+//			work finely. Tasks here are a function and a context in a pooled
+//			block, and each thread queues them on its own deque, which idle
+//			threads steal from. Threads from g_pThreadPool are borrowed to
+//			help while there is work and given back after it runs out.
+//
+//			Wait() runs tasks on the calling thread until a counter is done,
+//			so tasks can wait on tasks they start. Without a thread pool
+//			everything runs on the thread that queues or waits for it.
+//-----------------------------------------------------------------------------
+#define TASKPOOL_MAX_THREADS	32
+#define TASKPOOL_DEQUE_SIZE		1024	// Power of 2. Tasks that don't fit run right away.
+
+typedef void (*TaskFunc_t)( void *pContext );
+typedef void (*TaskRangeFunc_t)( void *pContext, int iBegin, int iEnd );
+
+struct TaskPoolTask_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Counts tasks that haven't finished. Tasks queued with AddTaskAfter()
+//			are held until it reaches zero. Call CTaskPool::Wait() on it
+//			before it goes out of scope, even if IsDone() says it's done.
+//-----------------------------------------------------------------------------
+class CTaskCounter
+{
+public:
+	CTaskCounter() : m_nPending( 0 ), m_pContinuations( NULL ) {}
+	~CTaskCounter() { Assert( !m_nPending && !m_pContinuations ); }
+
+	bool IsDone() const		{ return ( m_nPending == 0 ); }
+	int GetPending() const	{ return m_nPending; }
+
+private:
+	friend class CTaskPool;
+
+	int volatile		m_nPending;
+	TaskPoolTask_t		*m_pContinuations;	// guarded by m_Mutex
+	CThreadFastMutex	m_Mutex;
+
+	CTaskCounter( const CTaskCounter & );
+	void operator=( const CTaskCounter & );
+};
+
+struct TaskPoolStats_t
+{
+	int		nExecuted;			// tasks run, including pieces of ranges
+	int		nStolen;			// tasks run by a thread other than the one that queued them
+	int		nRanInline;			// tasks run when queued because a deque was full (or there's no thread pool)
+	int		nHelpersStarted;	// pool threads borrowed
+};
+
+//-----------------------------------------------------------------------------
+
+class CTaskPool
+{
+public:
+	CTaskPool();
+
+	// Queues pfnTask( pContext ), counted by pCounter until it has run. Tasks
+	// without a counter still run even if nobody waits, on a pool thread once
+	// one is free.
+	void	AddTask( TaskFunc_t pfnTask, void *pContext, CTaskCounter *pCounter = NULL );
+
+	// Same, but not queued until pDependency is done (right away if it already is)
+	void	AddTaskAfter( CTaskCounter *pDependency, TaskFunc_t pfnTask, void *pContext, CTaskCounter *pCounter = NULL );
+
+	// Runs tasks on this thread until pCounter is done
+	void	Wait( CTaskCounter *pCounter );
+
+	// Calls pfnRange over pieces of [0, nCount) in parallel and returns when all
+	// have run. Ranges are split in half until they are at most nGrain long;
+	// 0 picks a grain that gives each thread a few pieces.
+	void	ParallelFor( int nCount, TaskRangeFunc_t pfnRange, void *pContext, int nGrain = 0 );
+
+	// Like ParallelProcess() in jobthread.h. pfnBegin and pfnEnd are called
+	// around each piece, on the thread running it.
+	template <typename ITEM_TYPE>
+	void	ParallelProcess( ITEM_TYPE *pItems, int nItems, void (*pfnProcess)( ITEM_TYPE & ), void (*pfnBegin)() = NULL, void (*pfnEnd)() = NULL, int nGrain = 0 );
+
+	int		NumThreads();	// Pool threads that can help, plus the caller
+
+	void	GetStats( TaskPoolStats_t &stats ) const;
+	void	ResetStats();
+
+private:
+	// The owning thread pushes and pops at the bottom, other threads steal from the top
+	struct TaskDeque_t
+	{
+		unsigned volatile			nTop;
+		byte						padTop[60];
+		unsigned volatile			nBottom;
+		int							nExecuted;		// stats, written only by the owner
+		int							nStolen;
+		int							nRanInline;
+		byte						padBottom[48];
+		TaskPoolTask_t * volatile	pTasks[TASKPOOL_DEQUE_SIZE];
+	};
+
+	class CHelperJob;
+
+	TaskDeque_t		*GetThreadDeque();
+	void			UpdateMaxHelpers();
+	void			StartHelper();
+	void			RunHelper();
+	bool			HasTasks() const;
+
+	TaskPoolTask_t	*AllocTask( TaskFunc_t pfnTask, TaskRangeFunc_t pfnRange, void *pContext, int iBegin, int iEnd, int nGrain, CTaskCounter *pCounter );
+	void			Queue( TaskPoolTask_t *pTask, TaskDeque_t *pDeque );
+	bool			Push( TaskPoolTask_t *pTask, TaskDeque_t *pDeque );
+	TaskPoolTask_t	*Pop( TaskDeque_t *pDeque );
+	TaskPoolTask_t	*Steal( TaskDeque_t &deque );
+	TaskPoolTask_t	*FindTask( TaskDeque_t *pDeque );
+	void			Execute( TaskPoolTask_t *pTask, TaskDeque_t *pDeque );
+	void			Finish( CTaskCounter *pCounter, TaskDeque_t *pDeque );
+
+	template <typename ITEM_TYPE>
+	struct ParallelProcessContext_t
+	{
+		ITEM_TYPE	*pItems;
+		void		(*pfnProcess)( ITEM_TYPE & );
+		void		(*pfnBegin)();
+		void		(*pfnEnd)();
+	};
+
+	template <typename ITEM_TYPE>
+	static void ParallelProcessRange( void *pContext, int iBegin, int iEnd );
+
+	CClassMemoryPoolTS<TaskPoolTask_t>	m_TaskAllocator;
+
+	int volatile			m_nHelpers;			// started and not yet finished
+	int						m_nMaxHelpers;		// -1 until the thread pool has been checked
+	int volatile			m_nHelpersStarted;
+
+	// Threads beyond TASKPOOL_MAX_THREADS running at once share one locked list
+	CUtlVector<TaskPoolTask_t *>	m_SharedTasks;
+	int volatile					m_nSharedTasks;
+	CThreadFastMutex				m_SharedMutex;
+	int volatile					m_nSharedExecuted;
+	int volatile					m_nSharedRanInline;
+
+	TaskDeque_t				m_Deques[TASKPOOL_MAX_THREADS];
+};
+
+//-----------------------------------------------------------------------------
+
+struct TaskPoolTask_t
+{
+	TaskFunc_t		pfnTask;		// or pfnRange for a range
+	TaskRangeFunc_t	pfnRange;
+	void			*pContext;
+	int				iBegin;
+	int				iEnd;
+	int				nGrain;
+	CTaskCounter	*pCounter;
+	TaskPoolTask_t	*pNext;			// in a counter's continuations
+	int				iQueuedBy;		// deque index + 1, 0 for the shared list
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename ITEM_TYPE>
+void CTaskPool::ParallelProcessRange( void *pContext, int iBegin, int iEnd )
+{
+	ParallelProcessContext_t<ITEM_TYPE> *pProcess = (ParallelProcessContext_t<ITEM_TYPE> *)pContext;
+
+	if ( pProcess->pfnBegin )
+	{
+		pProcess->pfnBegin();
+	}
+
+	for ( int i = iBegin; i < iEnd; i++ )
+	{
+		pProcess->pfnProcess( pProcess->pItems[i] );
+	}
+
+	if ( pProcess->pfnEnd )
+	{
+		pProcess->pfnEnd();
+	}
+}
+
+template <typename ITEM_TYPE>
+inline void CTaskPool::ParallelProcess( ITEM_TYPE *pItems, int nItems, void (*pfnProcess)( ITEM_TYPE & ), void (*pfnBegin)(), void (*pfnEnd)(), int nGrain )
+{
+	ParallelProcessContext_t<ITEM_TYPE> context;
+	context.pItems = pItems;
+	context.pfnProcess = pfnProcess;
+	context.pfnBegin = pfnBegin;
+	context.pfnEnd = pfnEnd;
+
+	ParallelFor( nItems, &ParallelProcessRange<ITEM_TYPE>, &context, nGrain );
+}
+
+//-----------------------------------------------------------------------------
+// One per module, sharing g_pThreadPool's threads
+//-----------------------------------------------------------------------------
+extern CTaskPool g_TaskPool;
+
+#endif // TASKPOOL_H
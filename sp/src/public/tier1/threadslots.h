@@ -0,0 +1,73 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Small per-thread indices that are given back when threads exit
+//
+//=============================================================================//
+
+#ifndef THREADSLOTS_H
+#define THREADSLOTS_H
+
+#if defined( _WIN32 )
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+
+#define THREADSLOTS_MAX		32
+
+//-----------------------------------------------------------------------------
+// Purpose: Hands each thread that asks a slot in [0, nSlots) so per-thread
+//			data can live in a fixed array. When a thread exits, pfnRelease
+//			is called with its slot on that thread and the slot goes to the
+//			next thread that asks, so threads that come and go don't use
+//			the slots up.
+//
+//			Acquire() is slow-ish, so cache the result in a THREAD_LOCAL and
+//			reset it in pfnRelease. Meant for statics, which start zeroed:
+//			until the constructor has run IsReady() is false and Acquire()
+//			hands out nothing, so don't cache the result before then.
+//-----------------------------------------------------------------------------
+class CThreadSlots
+{
+public:
+	typedef void (*ReleaseFunc_t)( int iSlot );
+
+	CThreadSlots( int nSlots, ReleaseFunc_t pfnRelease );
+	~CThreadSlots();
+
+	// False until the constructor has run
+	bool		IsReady() const		{ return ( m_nSlots != 0 ); }
+
+	// A free slot for the calling thread, -1 if they're all taken
+	int			Acquire();
+
+	// One past the highest slot any thread has held
+	int			GetLimit() const	{ return m_nLimit; }
+
+private:
+	struct Slot_t
+	{
+		CThreadSlots	*pOwner;
+		int				iSlot;
+	};
+
+	bool		CreateExitKey();
+	void		Release( int iSlot );
+	static void	OnThreadExit( void *pSlot );
+#ifdef _WIN32
+	static void __stdcall OnFiberExit( void *pSlot );
+#endif
+
+	int					m_nSlots;
+	ReleaseFunc_t		m_pfnRelease;
+
+	unsigned volatile	m_nUsed;			// bit per slot
+	int volatile		m_nLimit;
+	bool volatile		m_bHasExitKey;
+	bool volatile		m_bShutdown;
+	uintp				m_ExitKey;
+	CThreadFastMutex	m_ExitKeyMutex;
+	Slot_t				m_Slots[THREADSLOTS_MAX];
+};
+
+#endif // THREADSLOTS_H
@@ -26,6 +26,7 @@
 //-----------------------------------------------------------------------------
 class CUtlSymbolTable;
 class CUtlSymbolTableMT;
+class CUtlConcurrentSymbolTable;
 
 
 //-----------------------------------------------------------------------------
@@ -70,10 +71,10 @@ protected:
 	static void Initialize();
 	
 	// returns the current symbol table
-	static CUtlSymbolTableMT* CurrTable();
+	static CUtlConcurrentSymbolTable* CurrTable();
 		
 	// The standard global symbol table
-	static CUtlSymbolTableMT* s_pSymbolTable; 
+	static CUtlConcurrentSymbolTable* s_pSymbolTable; 
 
 	static bool s_bAllowStaticSymbolTable;
 
@@ -222,6 +223,85 @@ private:
 };
 
 
+//-----------------------------------------------------------------------------
+// CUtlConcurrentSymbolTable:
+// description:
+//    A symbol table for strings interned from many threads. CUtlSymbolTableMT
+//    locks for every lookup and searches a tree of strings; this hashes each
+//    string once and probes an open addressing table that is only ever
+//    appended to, so Find() and String() never lock or wait. AddString()
+//    locks only to insert a string that isn't there yet.
+//
+//    Symbols are handed out in insertion order, like CUtlSymbolTable.
+//    Strings are never moved, so the pointers from String() stay valid until
+//    RemoveAll(), which must not race with other users of the table.
+//-----------------------------------------------------------------------------
+class CUtlConcurrentSymbolTable
+{
+public:
+	CUtlConcurrentSymbolTable( bool caseInsensitive = false );
+	~CUtlConcurrentSymbolTable();
+
+	// Finds and/or creates a symbol based on the string
+	CUtlSymbol AddString( const char* pString );
+
+	// Finds the symbol for pString
+	CUtlSymbol Find( const char* pString ) const;
+
+	// Look up the string associated with a particular symbol
+	const char* String( CUtlSymbol id ) const;
+
+	// Remove all symbols in the table.
+	void RemoveAll();
+
+	int GetNumStrings( void ) const
+	{
+		return m_nStrings;
+	}
+
+private:
+	enum
+	{
+		STRINGS_PER_BLOCK	= 256,
+		MAX_STRING_BLOCKS	= 65536 / STRINGS_PER_BLOCK,
+		MAX_STRINGS			= UTL_INVAL_SYMBOL,
+		MIN_HASH_SLOTS		= 256,
+		MIN_STRING_POOL_SIZE = 4096,
+	};
+
+	// Each slot holds the top 16 bits of the hash and the symbol + 1, or 0 if empty.
+	// Slots are written once; a full table is replaced by a larger copy.
+	struct HashTable_t
+	{
+		HashTable_t *m_pRetired;	// Replaced tables, other threads may still be probing them
+		unsigned m_nMask;
+		volatile unsigned m_Slots[1];
+	};
+
+	struct StringPool_t
+	{
+		StringPool_t *m_pNext;
+		int m_nSize;
+		int m_nUsed;
+		char m_Data[1];
+	};
+
+	unsigned Hash( const char *pString ) const;
+	UtlSymId_t FindInTable( const HashTable_t *pTable, const char *pString, unsigned nHash ) const;
+	static void InsertIntoTable( HashTable_t *pTable, unsigned nHash, UtlSymId_t id );
+	HashTable_t *AllocTable( int nSlots );
+	const char *CopyString( const char *pString );
+
+	bool m_bInsensitive;
+	HashTable_t * volatile m_pTable;
+	const char * volatile * volatile m_pStringBlocks[MAX_STRING_BLOCKS];
+	volatile int m_nStrings;
+
+	StringPool_t *m_pPools;
+	CThreadFastMutex m_WriteLock;
+};
+
+
 
 //-----------------------------------------------------------------------------
 // CUtlFilenameSymbolTable:
@@ -168,7 +168,7 @@ private:
 
 	UtlTSHashHandle_t Find( KEYTYPE uiKey, HashFixedData_t *pFirstElement, HashFixedData_t *pLastElement );
 	UtlTSHashHandle_t InsertUncommitted( KEYTYPE uiKey, HashBucket_t &bucket );
-	CMemoryPoolMT m_EntryMemory;
+	CMemoryPoolTS m_EntryMemory;
 	HashBucket_t m_aBuckets[BUCKET_COUNT];
 	bool m_bNeedsCommit;
 
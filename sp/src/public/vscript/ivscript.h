@@ -957,6 +957,20 @@ public:
 
 	virtual void DumpState() = 0;
 
+#ifdef MAPBASE_VSCRIPT
+	//----------------------------------------------------------------------------
+	// Profiling. Time is attributed to script functions and native bindings,
+	// and the entry points the game calls (hooks, thinks, inputs) are totalled
+	//----------------------------------------------------------------------------
+	virtual void SetProfilingEnabled( bool bEnabled ) = 0;
+	virtual bool IsProfilingEnabled() = 0;
+	virtual void ResetProfile() = 0;
+	virtual void DumpProfile( int nMaxEntries ) = 0;
+
+	// Writes collapsed stacks ("outer;inner microseconds" per line) for flame graph tools
+	virtual void WriteProfileStacks( CUtlBuffer *pBuffer ) = 0;
+#endif
+
 	virtual void SetOutputCallback( ScriptOutputFunc_t pFunc ) = 0;
 	virtual void SetErrorCallback( ScriptErrorFunc_t pFunc ) = 0;
 
@@ -28,6 +28,8 @@
 #include "utlhash.h"
 #include "UtlSortVector.h"
 #include "convar.h"
+#include "checksum_crc.h"
+#include "kvchildindex.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -46,6 +48,67 @@ static char s_pTokenBuf[KEYVALUES_TOKEN_SIZE];
 #define INTERNALWRITE( pData, len ) InternalWrite( filesystem, f, pBuf, pData, len )
 
 
+//-----------------------------------------------------------------------------
+// Binary cache of parsed text files.
+//
+// Tokenizing, converting numbers and looking up a symbol for every key name
+// is most of the cost of loading a KeyValues file. LoadFromFile() can instead
+// read the finished tree back from kvcache/ in the write path. Each cache file
+// records the size and CRC of the text it was built from and is rebuilt when
+// those don't match; modification times aren't trusted since files in VPKs
+// don't have useful ones. Files using #include or #base aren't cached, since
+// the files they pull in could change on their own.
+//
+// Layout: KeyValuesCacheHeader_t, the key names, then the nodes. Each node is
+// its type, flags and name index followed by its value, or its children and a
+// TYPE_NUMTYPES terminator for TYPE_NONE. The top level peers end the same way.
+//-----------------------------------------------------------------------------
+#define KEYVALUES_CACHE_ID			( ( 'B' << 24 ) | ( 'C' << 16 ) | ( 'V' << 8 ) | 'K' )
+#define KEYVALUES_CACHE_VERSION		1
+#define KEYVALUES_CACHE_DIR			"kvcache"
+#define KEYVALUES_CACHE_PATH_ID		"DEFAULT_WRITE_PATH"
+#define KEYVALUES_CACHE_MAX_DEPTH	100
+
+enum
+{
+	KEYVALUES_CACHE_ESCAPE_SEQUENCES	= 0x01,
+	KEYVALUES_CACHE_CONDITIONALS		= 0x02,
+};
+
+struct KeyValuesCacheHeader_t
+{
+	unsigned int	m_nId;
+	unsigned int	m_nVersion;
+	unsigned int	m_nTextSize;
+	CRC32_t			m_TextCRC;
+	unsigned int	m_nRootFlags;
+	unsigned int	m_nNames;
+	unsigned int	m_nDataSize;	// everything after the header
+	CRC32_t			m_DataCRC;
+};
+
+class CKeyValuesBinaryCache
+{
+public:
+	static bool CanCache( KeyValues *pRoot, const char *pText, int nTextSize );
+	static bool Load( KeyValues *pRoot, IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, CRC32_t textCRC, int nTextSize );
+	static void Save( KeyValues *pRoot, IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, CRC32_t textCRC, int nTextSize );
+
+	static bool s_bEnabled;
+
+private:
+	typedef CUtlHashtable<int, int> NameIndices_t;
+
+	static bool HasConditionals( const char *pText );
+	static void GetCacheFileName( const char *resourceName, const char *pathID, unsigned int nRootFlags, char *pszOut, int nOutSize );
+	static unsigned int GetFlags( const KeyValues *pKey );
+
+	static bool WriteKeys( KeyValues *pFirst, CUtlBuffer &buf, NameIndices_t &names, CUtlVector<int> &nameSymbols );
+	static bool ReadKey( KeyValues *dat, int type, CUtlBuffer &buf, const CUtlVector<int> &nameSymbols, int nDepth );
+	static bool ReadChildren( KeyValues *pParent, CUtlBuffer &buf, const CUtlVector<int> &nameSymbols, int nDepth );
+};
+
+
 // a simple class to keep track of a stack of valid parsed symbols
 const int MAX_ERROR_STACK = 64;
 class CKeyValuesErrorStack
@@ -658,7 +721,19 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 	{
 		buffer[fileSize] = 0; // null terminate file as EOF
 		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
-		bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
+
+		bool bCache = CKeyValuesBinaryCache::CanCache( this, buffer, fileSize );
+		CRC32_t textCRC = bCache ? CRC32_ProcessSingleBuffer( buffer, fileSize ) : 0;
+
+		if ( !bCache || !CKeyValuesBinaryCache::Load( this, filesystem, resourceName, pathID, textCRC, fileSize ) )
+		{
+			bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
+
+			if ( bCache && bRetOK )
+			{
+				CKeyValuesBinaryCache::Save( this, filesystem, resourceName, pathID, textCRC, fileSize );
+			}
+		}
 	}
 
 	((IFileSystem *)filesystem)->FreeOptimalReadBuffer( buffer );
@@ -2639,6 +2714,394 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 	return buffer.IsValid();
 }
 
+//-----------------------------------------------------------------------------
+// Binary cache of parsed text files
+//-----------------------------------------------------------------------------
+bool CKeyValuesBinaryCache::s_bEnabled = false;
+
+void KeyValues::SetBinaryCacheEnabled( bool bEnabled )
+{
+	CKeyValuesBinaryCache::s_bEnabled = bEnabled;
+}
+
+bool KeyValues::IsBinaryCacheEnabled()
+{
+	return CKeyValuesBinaryCache::s_bEnabled;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Only fresh keys loaded from plain text files match their cache
+//			exactly; loading into existing keys appends to them. [$WIN32]
+//			style conditionals are decided for the running platform while
+//			parsing, so files using them are always parsed.
+//-----------------------------------------------------------------------------
+bool CKeyValuesBinaryCache::CanCache( KeyValues *pRoot, const char *pText, int nTextSize )
+{
+	if ( !s_bEnabled || nTextSize <= 0 )
+		return false;
+
+	if ( pRoot->m_iDataType != KeyValues::TYPE_NONE || pRoot->m_pSub || pRoot->m_pPeer || pRoot->m_pChain || pRoot->m_sValue || pRoot->m_wsValue )
+		return false;
+
+	// Unicode files are converted before parsing, skip them rather than search the wide text
+	if ( nTextSize > 2 && (uint8)pText[0] == 0xFF && (uint8)pText[1] == 0xFE )
+		return false;
+
+	return ( !V_stristr( pText, "#include" ) && !V_stristr( pText, "#base" ) && !HasConditionals( pText ) );
+}
+
+bool CKeyValuesBinaryCache::HasConditionals( const char *pText )
+{
+	for ( const char *p = strchr( pText, '[' ); p != NULL; p = strchr( p + 1, '[' ) )
+	{
+		const char *pCond = p + 1;
+		while ( *pCond == ' ' || *pCond == '\t' || *pCond == '!' )
+		{
+			pCond++;
+		}
+
+		if ( *pCond == '$' )
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The parse flags are part of the name so loads with different
+//			flags don't keep replacing each other's cache.
+//-----------------------------------------------------------------------------
+void CKeyValuesBinaryCache::GetCacheFileName( const char *resourceName, const char *pathID, unsigned int nRootFlags, char *pszOut, int nOutSize )
+{
+	char szKey[MAX_PATH * 2];
+	V_snprintf( szKey, sizeof( szKey ), "%s:%s:%x", pathID ? pathID : "", resourceName, nRootFlags );
+	V_FixSlashes( szKey, '/' );
+	V_strlower( szKey );
+
+	char szBase[MAX_PATH];
+	V_FileBase( resourceName, szBase, sizeof( szBase ) );
+
+	V_snprintf( pszOut, nOutSize, "%s/%s_%08x.kvc", KEYVALUES_CACHE_DIR, szBase, CRC32_ProcessSingleBuffer( szKey, V_strlen( szKey ) ) );
+}
+
+unsigned int CKeyValuesBinaryCache::GetFlags( const KeyValues *pKey )
+{
+	return ( pKey->m_bHasEscapeSequences ? KEYVALUES_CACHE_ESCAPE_SEQUENCES : 0 ) |
+		( pKey->m_bEvaluateConditionals ? KEYVALUES_CACHE_CONDITIONALS : 0 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the tree for this text into pRoot and its peers. On failure
+//			pRoot is left as it was.
+//-----------------------------------------------------------------------------
+bool CKeyValuesBinaryCache::Load( KeyValues *pRoot, IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, CRC32_t textCRC, int nTextSize )
+{
+	unsigned int nRootFlags = GetFlags( pRoot );
+
+	char szCacheFile[MAX_PATH];
+	GetCacheFileName( resourceName, pathID, nRootFlags, szCacheFile, sizeof( szCacheFile ) );
+
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( szCacheFile, KEYVALUES_CACHE_PATH_ID, buf ) )
+		return false;
+
+	KeyValuesCacheHeader_t header;
+	if ( buf.TellPut() < (int)sizeof( header ) )
+		return false;
+
+	buf.Get( &header, sizeof( header ) );
+
+	if ( header.m_nId != KEYVALUES_CACHE_ID || header.m_nVersion != KEYVALUES_CACHE_VERSION ||
+		 header.m_nTextSize != (unsigned int)nTextSize || header.m_TextCRC != textCRC || header.m_nRootFlags != nRootFlags )
+		return false;
+
+	const void *pData = buf.PeekGet();
+	if ( header.m_nDataSize != (unsigned int)buf.GetBytesRemaining() || CRC32_ProcessSingleBuffer( pData, header.m_nDataSize ) != header.m_DataCRC )
+		return false;
+
+	// Each name is only looked up once, not once per key
+	CUtlVector<int> nameSymbols;
+	nameSymbols.EnsureCapacity( header.m_nNames );
+	for ( unsigned int i = 0; i < header.m_nNames; i++ )
+	{
+		int nLength = buf.PeekStringLength();
+		if ( nLength <= 0 || nLength > buf.GetBytesRemaining() )
+			return false;
+
+		nameSymbols.AddToTail( KeyValues::s_pfGetSymbolForString( (const char *)buf.PeekGet(), true ) );
+		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nLength );
+	}
+
+	// The top level keys are pRoot and its peers
+	bool bOK = false;
+	KeyValues *pLast = NULL;
+	while ( buf.IsValid() )
+	{
+		int type = buf.GetUnsignedChar();
+		if ( !buf.IsValid() )
+			break;
+
+		if ( type == KeyValues::TYPE_NUMTYPES )
+		{
+			bOK = ( pLast != NULL && buf.GetBytesRemaining() == 0 );
+			break;
+		}
+
+		KeyValues *dat = pRoot;
+		if ( pLast )
+		{
+			dat = new KeyValues( "" );
+			pLast->m_pPeer = dat;
+		}
+		pLast = dat;
+
+		if ( !ReadKey( dat, type, buf, nameSymbols, 0 ) )
+			break;
+	}
+
+	if ( !bOK )
+	{
+		// Back to the empty key we were given so the text can be parsed instead
+		int iName = pRoot->m_iKeyName;
+		pRoot->RemoveEverything();
+		pRoot->Init();
+		pRoot->m_iKeyName = iName;
+		pRoot->m_bHasEscapeSequences = ( nRootFlags & KEYVALUES_CACHE_ESCAPE_SEQUENCES ) != 0;
+		pRoot->m_bEvaluateConditionals = ( nRootFlags & KEYVALUES_CACHE_CONDITIONALS ) != 0;
+	}
+
+	return bOK;
+}
+
+bool CKeyValuesBinaryCache::ReadKey( KeyValues *dat, int type, CUtlBuffer &buf, const CUtlVector<int> &nameSymbols, int nDepth )
+{
+	unsigned int nFlags = buf.GetUnsignedChar();
+	int iName = buf.GetInt();
+	if ( !buf.IsValid() || !nameSymbols.IsValidIndex( iName ) )
+		return false;
+
+	dat->m_iKeyName = nameSymbols[iName];
+	dat->m_bHasEscapeSequences = ( nFlags & KEYVALUES_CACHE_ESCAPE_SEQUENCES ) != 0;
+	dat->m_bEvaluateConditionals = ( nFlags & KEYVALUES_CACHE_CONDITIONALS ) != 0;
+	dat->m_iDataType = type;
+
+	switch ( type )
+	{
+	case KeyValues::TYPE_NONE:
+		return ReadChildren( dat, buf, nameSymbols, nDepth + 1 );
+
+	case KeyValues::TYPE_STRING:
+		{
+			int nLength = buf.PeekStringLength();
+			if ( nLength <= 0 || nLength > buf.GetBytesRemaining() )
+				return false;
+
+			dat->m_sValue = new char[nLength];
+			buf.Get( dat->m_sValue, nLength );
+			break;
+		}
+
+	case KeyValues::TYPE_INT:
+		dat->m_iValue = buf.GetInt();
+		break;
+
+	case KeyValues::TYPE_FLOAT:
+		dat->m_flValue = buf.GetFloat();
+		break;
+
+	case KeyValues::TYPE_UINT64:
+		dat->m_sValue = new char[sizeof( uint64 )];
+		*( (uint64 *)dat->m_sValue ) = buf.GetInt64();
+		break;
+
+	case KeyValues::TYPE_COLOR:
+		dat->m_Color[0] = buf.GetUnsignedChar();
+		dat->m_Color[1] = buf.GetUnsignedChar();
+		dat->m_Color[2] = buf.GetUnsignedChar();
+		dat->m_Color[3] = buf.GetUnsignedChar();
+		break;
+
+	default:
+		return false;
+	}
+
+	return buf.IsValid();
+}
+
+bool CKeyValuesBinaryCache::ReadChildren( KeyValues *pParent, CUtlBuffer &buf, const CUtlVector<int> &nameSymbols, int nDepth )
+{
+	if ( nDepth > KEYVALUES_CACHE_MAX_DEPTH )
+		return false;
+
+	KeyValues *pLastChild = NULL;
+	while ( true )
+	{
+		int type = buf.GetUnsignedChar();
+		if ( !buf.IsValid() )
+			return false;
+
+		if ( type == KeyValues::TYPE_NUMTYPES )
+			return true;
+
+		KeyValues *dat = new KeyValues( "" );
+		pParent->AddSubkeyUsingKnownLastChild( dat, pLastChild );
+		pLastChild = dat;
+
+		if ( !ReadKey( dat, type, buf, nameSymbols, nDepth ) )
+			return false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the tree just parsed from this text into pRoot.
+//-----------------------------------------------------------------------------
+void CKeyValuesBinaryCache::Save( KeyValues *pRoot, IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, CRC32_t textCRC, int nTextSize )
+{
+	NameIndices_t names;
+	CUtlVector<int> nameSymbols;
+	CUtlBuffer keys;
+	if ( !WriteKeys( pRoot, keys, names, nameSymbols ) )
+		return;
+
+	CUtlBuffer data;
+	for ( int i = 0; i < nameSymbols.Count(); i++ )
+	{
+		data.PutString( KeyValues::s_pfGetStringForSymbol( nameSymbols[i] ) );
+	}
+	data.Put( keys.Base(), keys.TellPut() );
+
+	KeyValuesCacheHeader_t header;
+	header.m_nId = KEYVALUES_CACHE_ID;
+	header.m_nVersion = KEYVALUES_CACHE_VERSION;
+	header.m_nTextSize = nTextSize;
+	header.m_TextCRC = textCRC;
+	header.m_nRootFlags = GetFlags( pRoot );
+	header.m_nNames = nameSymbols.Count();
+	header.m_nDataSize = data.TellPut();
+	header.m_DataCRC = CRC32_ProcessSingleBuffer( data.Base(), data.TellPut() );
+
+	CUtlBuffer file( 0, sizeof( header ) + data.TellPut() );
+	file.Put( &header, sizeof( header ) );
+	file.Put( data.Base(), data.TellPut() );
+
+	static bool s_bCreatedDir = false;
+	if ( !s_bCreatedDir )
+	{
+		((IFileSystem *)filesystem)->CreateDirHierarchy( KEYVALUES_CACHE_DIR, KEYVALUES_CACHE_PATH_ID );
+		s_bCreatedDir = true;
+	}
+
+	char szCacheFile[MAX_PATH];
+	GetCacheFileName( resourceName, pathID, header.m_nRootFlags, szCacheFile, sizeof( szCacheFile ) );
+
+	// A torn or stale write fails the CRC checks and is rebuilt on the next load
+	filesystem->WriteFile( szCacheFile, KEYVALUES_CACHE_PATH_ID, file );
+}
+
+bool CKeyValuesBinaryCache::WriteKeys( KeyValues *pFirst, CUtlBuffer &buf, NameIndices_t &names, CUtlVector<int> &nameSymbols )
+{
+	for ( KeyValues *dat = pFirst; dat != NULL; dat = dat->m_pPeer )
+	{
+		UtlHashHandle_t h = names.Find( dat->m_iKeyName );
+		if ( h == names.InvalidHandle() )
+		{
+			h = names.Insert( dat->m_iKeyName, nameSymbols.AddToTail( dat->m_iKeyName ) );
+		}
+
+		buf.PutUnsignedChar( dat->m_iDataType );
+		buf.PutUnsignedChar( GetFlags( dat ) );
+		buf.PutInt( names[h] );
+
+		switch ( dat->m_iDataType )
+		{
+		case KeyValues::TYPE_NONE:
+			if ( dat->m_sValue || !WriteKeys( dat->m_pSub, buf, names, nameSymbols ) )
+				return false;
+			break;
+
+		case KeyValues::TYPE_STRING:
+			buf.PutString( dat->m_sValue ? dat->m_sValue : "" );
+			break;
+
+		case KeyValues::TYPE_INT:
+			buf.PutInt( dat->m_iValue );
+			break;
+
+		case KeyValues::TYPE_FLOAT:
+			buf.PutFloat( dat->m_flValue );
+			break;
+
+		case KeyValues::TYPE_UINT64:
+			buf.PutInt64( *( (int64 *)dat->m_sValue ) );
+			break;
+
+		case KeyValues::TYPE_COLOR:
+			buf.PutUnsignedChar( dat->m_Color[0] );
+			buf.PutUnsignedChar( dat->m_Color[1] );
+			buf.PutUnsignedChar( dat->m_Color[2] );
+			buf.PutUnsignedChar( dat->m_Color[3] );
+			break;
+
+		default:
+			// Pointers and wide strings never come from text
+			return false;
+		}
+	}
+
+	buf.PutUnsignedChar( KeyValues::TYPE_NUMTYPES );
+	return buf.IsValid();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hashed child lookups, see kvchildindex.h
+//-----------------------------------------------------------------------------
+void CKeyValuesChildIndex::Build( KeyValues *pParent )
+{
+	Purge();
+	m_pParent = pParent;
+	if ( !pParent )
+		return;
+
+	for ( KeyValues *dat = pParent->m_pSub; dat != NULL; dat = dat->m_pPeer )
+	{
+		// Insert() keeps the existing entry, so the first child with a name wins like FindKey()
+		m_Children.Insert( dat->m_iKeyName, dat );
+	}
+}
+
+void CKeyValuesChildIndex::Purge()
+{
+	m_pParent = NULL;
+	m_Children.Purge();
+}
+
+KeyValues *CKeyValuesChildIndex::FindKey( int keySymbol ) const
+{
+	UtlHashHandle_t h = m_Children.Find( keySymbol );
+	return ( h != m_Children.InvalidHandle() ) ? m_Children[h] : NULL;
+}
+
+KeyValues *CKeyValuesChildIndex::FindKey( const char *keyName ) const
+{
+	if ( !m_pParent )
+		return NULL;
+
+	// Paths and the empty name behave exactly like FindKey()
+	if ( !keyName || !keyName[0] || strchr( keyName, '/' ) )
+		return m_pParent->FindKey( keyName );
+
+	int iSymbol = KeyValues::s_pfGetSymbolForString( keyName, false );
+	if ( iSymbol == INVALID_KEY_SYMBOL )
+		return NULL;
+
+	KeyValues *dat = FindKey( iSymbol );
+	if ( !dat && m_pParent->m_pChain )
+	{
+		dat = m_pParent->m_pChain->FindKey( keyName, false );
+	}
+
+	return dat;
+}
+
 #include "tier0/memdbgoff.h"
 
 //-----------------------------------------------------------------------------
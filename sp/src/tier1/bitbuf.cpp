@@ -119,6 +119,179 @@ public:
 static CBitWriteMasksInit g_BitWriteMasksInit;
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Writes a run of fields through a 64-bit accumulator. Each dword of
+//			the buffer is stored once when it fills up, and the buffer's
+//			position is only updated by Finish() or Overflow().
+//-----------------------------------------------------------------------------
+class CBitWriteAccumulator
+{
+public:
+	CBitWriteAccumulator( bf_write *pBuf ) : m_pBuf( pBuf )
+	{
+		m_iCurBit = pBuf->m_iCurBit;
+		m_pOut = &pBuf->m_pData[m_iCurBit >> 5];
+		m_nBits = m_iCurBit & 31;
+
+		// Start with the bits already written to the first dword
+		m_Accum = m_nBits ? ( LoadLittleDWord( m_pOut, 0 ) & g_ExtraMasks[m_nBits] ) : 0;
+	}
+
+	// data must fit in numbits, which must be <= 32
+	bool Write( unsigned int data, int numbits )
+	{
+		if ( m_iCurBit + numbits > m_pBuf->m_nDataBits )
+			return false;
+
+		m_Accum |= (uint64)data << m_nBits;
+		m_nBits += numbits;
+		m_iCurBit += numbits;
+
+		if ( m_nBits >= 32 )
+		{
+			StoreLittleDWord( m_pOut, 0, (unsigned long)m_Accum );
+			++m_pOut;
+			m_Accum >>= 32;
+			m_nBits -= 32;
+		}
+		return true;
+	}
+
+	void Finish()
+	{
+		if ( m_nBits )
+		{
+			// Leave the bits past the end alone, like WriteUBitLong does
+			unsigned long mask = g_ExtraMasks[m_nBits];
+			unsigned long dword = LoadLittleDWord( m_pOut, 0 );
+			StoreLittleDWord( m_pOut, 0, ( dword & ~mask ) | ( (unsigned long)m_Accum & mask ) );
+		}
+		m_pBuf->m_iCurBit = m_iCurBit;
+	}
+
+	// Keeps what fit, then fails the same way WriteUBitLong does
+	void Overflow()
+	{
+		Finish();
+		m_pBuf->m_iCurBit = m_pBuf->m_nDataBits;
+		m_pBuf->SetOverflowFlag();
+		CallErrorHandler( BITBUFERROR_BUFFER_OVERRUN, m_pBuf->GetDebugName() );
+	}
+
+private:
+	bf_write		*m_pBuf;
+	unsigned long	*m_pOut;
+	uint64			m_Accum;
+	int				m_nBits;
+	int				m_iCurBit;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads a run of fields through a 64-bit accumulator, loading each
+//			dword of the buffer once.
+//-----------------------------------------------------------------------------
+class CBitReadAccumulator
+{
+public:
+	CBitReadAccumulator( bf_read *pBuf ) : m_pBuf( pBuf ), m_Accum( 0 ), m_nBits( 0 )
+	{
+		m_iCurBit = pBuf->m_iCurBit;
+		m_iWord = m_iCurBit >> 5;
+		m_nSkipBits = m_iCurBit & 31;
+	}
+
+	// numbits must be <= 32
+	bool Read( int numbits, unsigned int &value )
+	{
+		if ( m_iCurBit + numbits > m_pBuf->m_nDataBits )
+			return false;
+
+		// Only dwords holding bits we return are loaded, so this never reads past the data
+		while ( m_nBits < numbits )
+		{
+			uint64 dword = LoadLittleDWord( (unsigned long *)m_pBuf->m_pData, m_iWord++ ) >> m_nSkipBits;
+			m_Accum |= dword << m_nBits;
+			m_nBits += 32 - m_nSkipBits;
+			m_nSkipBits = 0;
+		}
+
+		value = (unsigned int)m_Accum & g_ExtraMasks[numbits];
+		m_Accum >>= numbits;
+		m_nBits -= numbits;
+		m_iCurBit += numbits;
+		return true;
+	}
+
+	void Finish()
+	{
+		m_pBuf->m_iCurBit = m_iCurBit;
+	}
+
+	void Overflow()
+	{
+		m_pBuf->m_iCurBit = m_pBuf->m_nDataBits;
+		m_pBuf->SetOverflowFlag();
+		CallErrorHandler( BITBUFERROR_BUFFER_OVERRUN, m_pBuf->GetDebugName() );
+	}
+
+private:
+	bf_read			*m_pBuf;
+	uint64			m_Accum;
+	int				m_nBits;
+	int				m_iCurBit;
+	unsigned int	m_iWord;
+	int				m_nSkipBits;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: The fields WriteBitCoord sends, packed lowest bit first: integer
+//			flag, fraction flag, then the sign, integer and fraction when
+//			present. At most 22 bits.
+//-----------------------------------------------------------------------------
+static inline unsigned int BitCoordBits( const float f, int &numbits )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	unsigned int bHasInt = ( intval != 0 );
+	unsigned int bHasFract = ( fractval != 0 );
+	unsigned int bHasAny = bHasInt | bHasFract;
+
+	unsigned int bits = bHasInt | ( bHasFract << 1 ) | ( ( signbit & bHasAny ) << 2 );
+	numbits = 2 + bHasAny;
+
+	// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
+	bits |= ( ( intval - 1 ) & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) & ( 0u - bHasInt ) ) << numbits;
+	numbits += bHasInt * COORD_INTEGER_BITS;
+
+	bits |= fractval << numbits;
+	numbits += bHasFract * COORD_FRACTIONAL_BITS;
+
+	return bits;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: WriteBitNormal's sign bit and fraction, 1 + NORMAL_FRACTIONAL_BITS bits
+//-----------------------------------------------------------------------------
+static inline unsigned int BitNormalBits( float f )
+{
+	unsigned int signbit = (f <= -NORMAL_RESOLUTION);
+
+	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+	fractval = ( fractval > NORMAL_DENOMINATOR ) ? NORMAL_DENOMINATOR : fractval;
+
+	return signbit | ( fractval << 1 );
+}
+
+static inline float BitNormalFromBits( unsigned int bits )
+{
+	float value = (float)( bits >> 1 ) * NORMAL_RESOLUTION;
+	return ( bits & 1 ) ? -value : value;
+}
+
+
 // ---------------------------------------------------------------------------------------- //
 // bf_write
 // ---------------------------------------------------------------------------------------- //
@@ -621,92 +794,76 @@ void bf_write::WriteBitCoord (const float f)
 #if defined( BB_PROFILING )
 	VPROF( "bf_write::WriteBitCoord" );
 #endif
-	int		signbit = (f <= -COORD_RESOLUTION);
-	int		intval = (int)abs(f);
-	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
-
-
-	// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-	WriteOneBit( intval );
-	WriteOneBit( fractval );
-
-	if ( intval || fractval )
-	{
-		// Send the sign bit
-		WriteOneBit( signbit );
-
-		// Send the integer if we have one.
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-		}
-		
-		// Send the fraction if we have one
-		if ( fractval )
-		{
-			WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
-		}
-	}
+	// Flags, sign, integer and fraction all go out in one write
+	int numbits;
+	unsigned int bits = BitCoordBits( f, numbits );
+	WriteUBitLong( bits, numbits );
 }
 
 void bf_write::WriteBitVec3Coord( const Vector& fa )
 {
-	int		xflag, yflag, zflag;
+	unsigned int xflag, yflag, zflag;
 
 	xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
 	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
 	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
-	WriteOneBit( zflag );
+	// Up to 69 bits, so this goes through the accumulator rather than WriteUBitLong
+	CBitWriteAccumulator out( this );
+	int numbits;
+	bool bFits = out.Write( xflag | ( yflag << 1 ) | ( zflag << 2 ), 3 );
 
-	if ( xflag )
-		WriteBitCoord( fa[0] );
-	if ( yflag )
-		WriteBitCoord( fa[1] );
-	if ( zflag )
-		WriteBitCoord( fa[2] );
+	if ( xflag && bFits )
+	{
+		unsigned int bits = BitCoordBits( fa[0], numbits );
+		bFits = out.Write( bits, numbits );
+	}
+	if ( yflag && bFits )
+	{
+		unsigned int bits = BitCoordBits( fa[1], numbits );
+		bFits = out.Write( bits, numbits );
+	}
+	if ( zflag && bFits )
+	{
+		unsigned int bits = BitCoordBits( fa[2], numbits );
+		bFits = out.Write( bits, numbits );
+	}
+
+	if ( bFits )
+		out.Finish();
+	else
+		out.Overflow();
 }
 
 void bf_write::WriteBitNormal( float f )
 {
-	int	signbit = (f <= -NORMAL_RESOLUTION);
-
-	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
-	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
-
-	// clamp..
-	if (fractval > NORMAL_DENOMINATOR)
-		fractval = NORMAL_DENOMINATOR;
-
-	// Send the sign bit
-	WriteOneBit( signbit );
-
-	// Send the fractional component
-	WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+	// Sign bit, then the fractional component
+	WriteUBitLong( BitNormalBits( f ), 1 + NORMAL_FRACTIONAL_BITS );
 }
 
 void bf_write::WriteBitVec3Normal( const Vector& fa )
 {
-	int		xflag, yflag;
+	unsigned int xflag, yflag;
 
 	xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
 	yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
+	// Flags, the x and y normals when flagged, and the z sign bit fit in one 27 bit write
+	unsigned int bits = xflag | ( yflag << 1 );
+	int numbits = 2;
+
+	bits |= ( BitNormalBits( fa[0] ) & ( 0u - xflag ) ) << numbits;
+	numbits += xflag * ( 1 + NORMAL_FRACTIONAL_BITS );
+
+	bits |= ( BitNormalBits( fa[1] ) & ( 0u - yflag ) ) << numbits;
+	numbits += yflag * ( 1 + NORMAL_FRACTIONAL_BITS );
 
-	if ( xflag )
-		WriteBitNormal( fa[0] );
-	if ( yflag )
-		WriteBitNormal( fa[1] );
-	
 	// Write z sign bit
-	int	signbit = (fa[2] <= -NORMAL_RESOLUTION);
-	WriteOneBit( signbit );
+	unsigned int signbit = (fa[2] <= -NORMAL_RESOLUTION);
+	bits |= signbit << numbits;
+	numbits++;
+
+	WriteUBitLong( bits, numbits );
 }
 
 void bf_write::WriteBitAngles( const QAngle& fa )
@@ -716,6 +873,92 @@ void bf_write::WriteBitAngles( const QAngle& fa )
 	WriteBitVec3Coord( tmp );
 }
 
+void bf_write::WriteUBitLongArray( const unsigned int *pData, int nCount, int numbits )
+{
+	Assert( numbits >= 0 && numbits <= 32 );
+	unsigned long mask = g_ExtraMasks[numbits];
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		// Out of range values are masked, as WriteUBitLong does in release
+		if ( !out.Write( pData[i] & mask, numbits ) )
+		{
+			out.Overflow();
+			return;
+		}
+	}
+	out.Finish();
+}
+
+void bf_write::WriteSBitLongArray( const int *pData, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+	unsigned long mask = g_ExtraMasks[numbits];
+
+	// Force the sign-extension bit to be correct even in the case of overflow, as in WriteSBitLong
+	int nPreserveBits = ( 0x7FFFFFFF >> ( 32 - numbits ) );
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		int nValue = ( pData[i] & nPreserveBits ) | ( ( pData[i] >> 31 ) & ~nPreserveBits );
+		AssertMsg2( nValue == pData[i], "WriteSBitLongArray: 0x%08x does not fit in %d bits", pData[i], numbits );
+
+		if ( !out.Write( nValue & mask, numbits ) )
+		{
+			out.Overflow();
+			return;
+		}
+	}
+	out.Finish();
+}
+
+void bf_write::WriteBitFloatArray( const float *pData, int nCount )
+{
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		union { float f; uint32 u; } c = { pData[i] };
+		if ( !out.Write( c.u, 32 ) )
+		{
+			out.Overflow();
+			return;
+		}
+	}
+	out.Finish();
+}
+
+void bf_write::WriteBitCoordArray( const float *pData, int nCount )
+{
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		int numbits;
+		unsigned int bits = BitCoordBits( pData[i], numbits );
+		if ( !out.Write( bits, numbits ) )
+		{
+			out.Overflow();
+			return;
+		}
+	}
+	out.Finish();
+}
+
+void bf_write::WriteBitNormalArray( const float *pData, int nCount )
+{
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( !out.Write( BitNormalBits( pData[i] ), 1 + NORMAL_FRACTIONAL_BITS ) )
+		{
+			out.Overflow();
+			return;
+		}
+	}
+	out.Finish();
+}
+
 void bf_write::WriteChar(int val)
 {
 	WriteSBitLong(val, sizeof(char) << 3);
@@ -1290,20 +1533,8 @@ void bf_read::ReadBitVec3Coord( Vector& fa )
 
 float bf_read::ReadBitNormal (void)
 {
-	// Read the sign bit
-	int	signbit = ReadOneBit();
-
-	// Read the fractional part
-	unsigned int fractval = ReadUBitLong( NORMAL_FRACTIONAL_BITS );
-
-	// Calculate the correct floating point value
-	float value = (float)fractval * NORMAL_RESOLUTION;
-
-	// Fixup the sign if negative.
-	if ( signbit )
-		value = -value;
-
-	return value;
+	// The sign bit and the fractional part in one read
+	return BitNormalFromBits( ReadUBitLong( 1 + NORMAL_FRACTIONAL_BITS ) );
 }
 
 void bf_read::ReadBitVec3Normal( Vector& fa )
@@ -1341,6 +1572,111 @@ void bf_read::ReadBitAngles( QAngle& fa )
 	fa.Init( tmp.x, tmp.y, tmp.z );
 }
 
+void bf_read::ReadUBitLongArray( unsigned int *pOut, int nCount, int numbits )
+{
+	Assert( numbits >= 0 && numbits <= 32 );
+
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( !in.Read( numbits, pOut[i] ) )
+		{
+			memset( pOut + i, 0, ( nCount - i ) * sizeof( *pOut ) );
+			in.Overflow();
+			return;
+		}
+	}
+	in.Finish();
+}
+
+void bf_read::ReadSBitLongArray( int *pOut, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+	unsigned int signbit = 1u << ( numbits - 1 );
+
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		unsigned int value;
+		if ( !in.Read( numbits, value ) )
+		{
+			memset( pOut + i, 0, ( nCount - i ) * sizeof( *pOut ) );
+			in.Overflow();
+			return;
+		}
+
+		// Sign-extend
+		pOut[i] = (int)( ( value ^ signbit ) - signbit );
+	}
+	in.Finish();
+}
+
+void bf_read::ReadBitFloatArray( float *pOut, int nCount )
+{
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		union { uint32 u; float f; } c;
+		if ( !in.Read( 32, c.u ) )
+		{
+			memset( pOut + i, 0, ( nCount - i ) * sizeof( *pOut ) );
+			in.Overflow();
+			return;
+		}
+		pOut[i] = c.f;
+	}
+	in.Finish();
+}
+
+void bf_read::ReadBitCoordArray( float *pOut, int nCount )
+{
+	static const int numbits_table[4] =
+	{
+		0,
+		COORD_INTEGER_BITS + 1,
+		COORD_FRACTIONAL_BITS + 1,
+		COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS + 1
+	};
+
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		unsigned int flags, bits = 0;
+		if ( !in.Read( 2, flags ) || !in.Read( numbits_table[flags], bits ) )
+		{
+			memset( pOut + i, 0, ( nCount - i ) * sizeof( *pOut ) );
+			in.Overflow();
+			return;
+		}
+
+		// bits is the sign, then the integer if flagged, then the fraction if flagged
+		unsigned int intmask = 0u - ( flags & 1 );
+		int intval = ( ( bits >> 1 ) & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) & intmask ) + ( flags & 1 );
+		int fractval = ( bits >> ( 1 + ( COORD_INTEGER_BITS & intmask ) ) ) & ( COORD_DENOMINATOR - 1 );
+
+		float value = intval + ((float)fractval * COORD_RESOLUTION);
+		pOut[i] = ( bits & 1 ) ? -value : value;
+	}
+	in.Finish();
+}
+
+void bf_read::ReadBitNormalArray( float *pOut, int nCount )
+{
+	CBitReadAccumulator in( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		unsigned int bits;
+		if ( !in.Read( 1 + NORMAL_FRACTIONAL_BITS, bits ) )
+		{
+			memset( pOut + i, 0, ( nCount - i ) * sizeof( *pOut ) );
+			in.Overflow();
+			return;
+		}
+		pOut[i] = BitNormalFromBits( bits );
+	}
+	in.Finish();
+}
+
 int64 bf_read::ReadLongLong()
 {
 	int64 retval;
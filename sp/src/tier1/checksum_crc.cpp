@@ -7,6 +7,7 @@
 #include "basetypes.h"
 #include "commonmacros.h"
 #include "checksum_crc.h"
+#include "tier0/threadtools.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -98,83 +99,173 @@ CRC32_t	CRC32_GetTableEntry( unsigned int slot )
 	return pulCRCTable[(unsigned char)slot];
 }
 
+//-----------------------------------------------------------------------------
+// Slicing-by-8: table k gives the CRC of a byte followed by k zero bytes, so
+// eight bytes are folded in with eight independent lookups instead of a chain
+// of eight dependent ones. The tables are built from the one above the first
+// time they're needed; building them twice on a race writes the same values.
+//-----------------------------------------------------------------------------
+#define CRC32C_POLYNOMIAL 0x82F63B78UL	// Castagnoli, reflected
+
+static CRC32_t s_CRC32Slices[8][NUM_BYTES];
+static CRC32_t s_CRC32CSlices[8][NUM_BYTES];
+static volatile bool s_bSlicesBuilt = false;
+
+static void CRC32_BuildSlices()
+{
+	for ( int i = 0; i < NUM_BYTES; i++ )
+	{
+		CRC32_t crc = i;
+		for ( int bit = 0; bit < 8; bit++ )
+		{
+			crc = ( crc & 1 ) ? ( crc >> 1 ) ^ CRC32C_POLYNOMIAL : ( crc >> 1 );
+		}
+
+		s_CRC32Slices[0][i] = pulCRCTable[i];
+		s_CRC32CSlices[0][i] = crc;
+	}
+
+	for ( int k = 1; k < 8; k++ )
+	{
+		for ( int i = 0; i < NUM_BYTES; i++ )
+		{
+			CRC32_t crc = s_CRC32Slices[k - 1][i];
+			s_CRC32Slices[k][i] = s_CRC32Slices[0][crc & 0xFF] ^ ( crc >> 8 );
+
+			crc = s_CRC32CSlices[k - 1][i];
+			s_CRC32CSlices[k][i] = s_CRC32CSlices[0][crc & 0xFF] ^ ( crc >> 8 );
+		}
+	}
+
+	ThreadMemoryBarrier();
+	s_bSlicesBuilt = true;
+}
+
+static CRC32_t CRC32_ProcessSliced( const CRC32_t (*pSlices)[NUM_BYTES], CRC32_t ulCrc, const unsigned char *pb, int nBuffer )
+{
+	// Byte at a time up to 4 byte alignment
+	while ( nBuffer > 0 && ( (uintp)pb & 3 ) )
+	{
+		ulCrc = pSlices[0][*pb++ ^ (unsigned char)ulCrc] ^ ( ulCrc >> 8 );
+		nBuffer--;
+	}
+
+	for ( int nMain = nBuffer >> 3; nMain--; pb += 8 )
+	{
+		CRC32_t one = LittleLong( *(const CRC32_t *)pb ) ^ ulCrc;
+		CRC32_t two = LittleLong( *(const CRC32_t *)( pb + 4 ) );
+		ulCrc = pSlices[7][one & 0xFF] ^
+				pSlices[6][( one >> 8 ) & 0xFF] ^
+				pSlices[5][( one >> 16 ) & 0xFF] ^
+				pSlices[4][one >> 24] ^
+				pSlices[3][two & 0xFF] ^
+				pSlices[2][( two >> 8 ) & 0xFF] ^
+				pSlices[1][( two >> 16 ) & 0xFF] ^
+				pSlices[0][two >> 24];
+	}
+
+	for ( nBuffer &= 7; nBuffer--; )
+	{
+		ulCrc = pSlices[0][*pb++ ^ (unsigned char)ulCrc] ^ ( ulCrc >> 8 );
+	}
+
+	return ulCrc;
+}
+
 void CRC32_ProcessBuffer(CRC32_t *pulCRC, const void *pBuffer, int nBuffer)
 {
-	CRC32_t ulCrc = *pulCRC;
-	unsigned char *pb = (unsigned char *)pBuffer;
-    unsigned int nFront;
-    int nMain;
-
-JustAfew:
-
-    switch (nBuffer)
-    {
-    case 7:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 6:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 5:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 4:
-        ulCrc ^= LittleLong( *(CRC32_t *)pb );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-		*pulCRC = ulCrc;
-        return;
-
-    case 3:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 2:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 1:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 0:
-		*pulCRC = ulCrc;
-        return;
-    }
-
-    // We may need to do some alignment work up front, and at the end, so that
-    // the main loop is aligned and only has to worry about 8 byte at a time.
-    //
-    // The low-order two bits of pb and nBuffer in total control the
-    // upfront work.
-    //
-    nFront = ((unsigned int)pb) & 3;
-    nBuffer -= nFront;
-    switch (nFront)
-    {
-    case 3:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    case 2:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    case 1:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    }
-
-    nMain = nBuffer >> 3;
-    while (nMain--)
-    {
-        ulCrc ^= LittleLong( *(CRC32_t *)pb );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc ^= LittleLong( *(CRC32_t *)(pb + 4) );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        pb += 8;
-    }
-
-    nBuffer &= 7;
-    goto JustAfew;
+	if ( !s_bSlicesBuilt )
+	{
+		CRC32_BuildSlices();
+	}
+
+	*pulCRC = CRC32_ProcessSliced( s_CRC32Slices, *pulCRC, (const unsigned char *)pBuffer, nBuffer );
+}
+
+//-----------------------------------------------------------------------------
+// CRC32C. SSE4.2 has an instruction for this polynomial (but not for the one
+// above); without it the same slicing is used.
+//-----------------------------------------------------------------------------
+#if ( defined( _WIN32 ) && !defined( _X360 ) ) || ( defined( GNUC ) && ( defined( __i386__ ) || defined( __x86_64__ ) ) )
+#define CRC32C_HARDWARE
+#endif
+
+#ifdef CRC32C_HARDWARE
+
+#ifdef _WIN32
+#include <nmmintrin.h>
+
+static inline CRC32_t CRC32C_Hardware8( CRC32_t crc, unsigned char b )	{ return _mm_crc32_u8( crc, b ); }
+static inline CRC32_t CRC32C_Hardware32( CRC32_t crc, uint32 n )		{ return _mm_crc32_u32( crc, n ); }
+#else
+// Inline assembly rather than intrinsics, which need -msse4.2 for the whole file on older compilers
+static inline CRC32_t CRC32C_Hardware8( CRC32_t crc, unsigned char b )	{ __asm__( "crc32b %1, %0" : "+r" ( crc ) : "rm" ( b ) ); return crc; }
+static inline CRC32_t CRC32C_Hardware32( CRC32_t crc, uint32 n )		{ __asm__( "crc32l %1, %0" : "+r" ( crc ) : "rm" ( n ) ); return crc; }
+#endif
+
+static CRC32_t CRC32C_ProcessHardware( CRC32_t ulCrc, const unsigned char *pb, int nBuffer )
+{
+	while ( nBuffer > 0 && ( (uintp)pb & 3 ) )
+	{
+		ulCrc = CRC32C_Hardware8( ulCrc, *pb++ );
+		nBuffer--;
+	}
+
+	for ( int nMain = nBuffer >> 2; nMain--; pb += 4 )
+	{
+		ulCrc = CRC32C_Hardware32( ulCrc, *(const uint32 *)pb );
+	}
+
+	for ( nBuffer &= 3; nBuffer--; )
+	{
+		ulCrc = CRC32C_Hardware8( ulCrc, *pb++ );
+	}
+
+	return ulCrc;
+}
+
+#endif // CRC32C_HARDWARE
+
+static int s_nCRC32CHardware = -1;	// -1 until the CPU has been checked
+
+bool CRC32C_IsHardwareAccelerated()
+{
+	if ( s_nCRC32CHardware < 0 )
+	{
+#ifdef CRC32C_HARDWARE
+		s_nCRC32CHardware = GetCPUInformation()->m_bSSE42 ? 1 : 0;
+#else
+		s_nCRC32CHardware = 0;
+#endif
+	}
+
+	return s_nCRC32CHardware != 0;
+}
+
+void CRC32C_Init( CRC32_t *pulCRC )
+{
+	*pulCRC = CRC32_INIT_VALUE;
+}
+
+void CRC32C_Final( CRC32_t *pulCRC )
+{
+	*pulCRC ^= CRC32_XOR_VALUE;
+}
+
+void CRC32C_ProcessBuffer( CRC32_t *pulCRC, const void *pBuffer, int nBuffer )
+{
+#ifdef CRC32C_HARDWARE
+	if ( CRC32C_IsHardwareAccelerated() )
+	{
+		*pulCRC = CRC32C_ProcessHardware( *pulCRC, (const unsigned char *)pBuffer, nBuffer );
+		return;
+	}
+#endif
+
+	if ( !s_bSlicesBuilt )
+	{
+		CRC32_BuildSlices();
+	}
+
+	*pulCRC = CRC32_ProcessSliced( s_CRC32CSlices, *pulCRC, (const unsigned char *)pBuffer, nBuffer );
 }
@@ -8,12 +8,32 @@
 
 #include "basetypes.h"
 #include "datamanager.h"
+#include "tier1/threadslots.h"
 
 DECLARE_POINTER_HANDLE( memhandle_t );
 
 #define AUTO_LOCK_DM() AUTO_LOCK_( CDataManagerBase, *this )
 
-CDataManagerBase::CDataManagerBase( unsigned int maxSize )
+// Managers are usually globals, so this is guarded by a mutex that's safe to use during static construction
+static CDataManagerBase *s_pFirstDataManager;
+static CThreadFastMutex s_DataManagerListMutex;
+
+// A thread gets the same lookup counts in every manager until it exits. The
+// counts it leaves stay in the totals and go on with the next thread.
+#ifndef NO_THREAD_LOCAL
+static THREAD_LOCAL int s_iDataManagerThreadSlot;	// slot + 1, -1 for none, 0 until assigned
+
+static void ReleaseDataManagerThreadSlot( int iSlot )
+{
+	s_iDataManagerThreadSlot = -1;
+}
+#else
+#define ReleaseDataManagerThreadSlot NULL
+#endif
+
+static CThreadSlots s_DataManagerThreadSlots( DATAMANAGER_MAX_STAT_THREADS, ReleaseDataManagerThreadSlot );
+
+CDataManagerBase::CDataManagerBase( unsigned int maxSize, const char *pszName )
 {
 	m_targetMemorySize = maxSize;
 	m_memUsed = 0;
@@ -21,11 +41,41 @@ CDataManagerBase::CDataManagerBase( unsigned int maxSize )
 	m_lockList = m_memoryLists.CreateList();
 	m_freeList = m_memoryLists.CreateList();
 	m_listsAreFreed = 0;
+
+	for ( int i = 0; i < CLOCK_PAGE_COUNT; i++ )
+	{
+		m_pClockPages[i] = NULL;
+	}
+
+	m_pszName = pszName ? pszName : "unnamed";
+	m_nHits = m_nMisses = m_nEvictions = m_nSecondChances = 0;
+	V_memset( m_ThreadLookups, 0, sizeof( m_ThreadLookups ) );
+
+	AUTO_LOCK( s_DataManagerListMutex );
+	m_pNextManager = s_pFirstDataManager;
+	s_pFirstDataManager = this;
 }
 
 CDataManagerBase::~CDataManagerBase() 
 {
 	Assert( m_listsAreFreed );
+
+	{
+		AUTO_LOCK( s_DataManagerListMutex );
+		for ( CDataManagerBase **ppManager = &s_pFirstDataManager; *ppManager; ppManager = &(*ppManager)->m_pNextManager )
+		{
+			if ( *ppManager == this )
+			{
+				*ppManager = m_pNextManager;
+				break;
+			}
+		}
+	}
+
+	for ( int i = 0; i < CLOCK_PAGE_COUNT; i++ )
+	{
+		delete [] m_pClockPages[i];
+	}
 }
 
 void CDataManagerBase::NotifySizeChanged( memhandle_t handle, unsigned int oldSize, unsigned int newSize )
@@ -157,6 +207,7 @@ void *CDataManagerBase::LockResource( memhandle_t handle )
 	unsigned short memoryIndex = FromHandle(handle);
 	if ( memoryIndex != m_memoryLists.InvalidIndex() )
 	{
+		CountLookup( true );
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
 			m_memoryLists.Unlink( m_lruList, memoryIndex );
@@ -164,9 +215,10 @@ void *CDataManagerBase::LockResource( memhandle_t handle )
 		}
 		Assert(m_memoryLists[memoryIndex].lockCount != (unsigned short)-1);
 		m_memoryLists[memoryIndex].lockCount++;
-		return m_memoryLists[memoryIndex].pStore;
+		return ClockEntry(memoryIndex).pStore;
 	}
 
+	CountLookup( false );
 	return NULL;
 }
 
@@ -192,34 +244,120 @@ int CDataManagerBase::UnlockResource( memhandle_t handle )
 	return 0;
 }
 
-void *CDataManagerBase::GetResource_NoLockNoLRUTouch( memhandle_t handle )
+//-----------------------------------------------------------------------------
+// Purpose: Finds the entry for a handle without the lock. The entry may be
+//			freed or reused as soon as this returns, so callers must check the
+//			serial again after reading anything from it.
+//-----------------------------------------------------------------------------
+CDataManagerBase::resource_clock_entry_t *CDataManagerBase::FindClockEntry( memhandle_t handle )
 {
-	AUTO_LOCK_DM();
-	unsigned short memoryIndex = FromHandle(handle);
-	if ( memoryIndex != m_memoryLists.InvalidIndex() )
+	unsigned int fullWord = (unsigned int)handle;
+	unsigned short serial = fullWord>>16;
+	unsigned short index = fullWord & 0xFFFF;
+	index--;
+
+	resource_clock_entry_t *pPage = m_pClockPages[index >> CLOCK_PAGE_BITS];
+	if ( !pPage )
+		return NULL;
+
+	resource_clock_entry_t *pEntry = &pPage[index & ( CLOCK_PAGE_SIZE - 1 )];
+	if ( pEntry->serial != serial )
+		return NULL;
+
+	return pEntry;
+}
+
+void *CDataManagerBase::GetStoreNoLock( memhandle_t handle, bool bTouch )
+{
+	resource_clock_entry_t *pEntry = FindClockEntry( handle );
+	if ( pEntry )
 	{
-		return m_memoryLists[memoryIndex].pStore;
+		ThreadMemoryBarrier();
+		void *pStore = pEntry->pStore;
+		ThreadMemoryBarrier();
+
+		// Freeing clears pStore before bumping the serial, so a matching serial here means pStore was still ours
+		if ( pStore && pEntry->serial == ( (unsigned int)handle >> 16 ) )
+		{
+			if ( bTouch && !pEntry->bReferenced )
+			{
+				pEntry->bReferenced = 1;
+			}
+
+			CountLookup( true );
+			return pStore;
+		}
 	}
+
+	CountLookup( false );
 	return NULL;
 }
 
-
-void *CDataManagerBase::GetResource_NoLock( memhandle_t handle )
+//-----------------------------------------------------------------------------
+// Returns the calling thread's lookup counts, NULL if it has to use the shared ones
+//-----------------------------------------------------------------------------
+CDataManagerBase::lookup_counts_t *CDataManagerBase::GetThreadLookupCounts()
 {
-	AUTO_LOCK_DM();
-	unsigned short memoryIndex = FromHandle(handle);
-	if ( memoryIndex != m_memoryLists.InvalidIndex() )
+#ifndef NO_THREAD_LOCAL
+	int iSlot = s_iDataManagerThreadSlot;
+	if ( !iSlot )
+	{
+		// Used from another static's constructor, ask again once the slots are set up
+		if ( !s_DataManagerThreadSlots.IsReady() )
+			return NULL;
+
+		iSlot = s_DataManagerThreadSlots.Acquire() + 1;
+		if ( !iSlot )
+		{
+			iSlot = -1;
+		}
+		s_iDataManagerThreadSlot = iSlot;
+	}
+
+	if ( iSlot > 0 )
 	{
-		TouchByIndex( memoryIndex );
-		return m_memoryLists[memoryIndex].pStore;
+		return &m_ThreadLookups[iSlot - 1];
 	}
+#endif
 	return NULL;
 }
 
+void CDataManagerBase::CountLookup( bool bHit )
+{
+	lookup_counts_t *pCounts = GetThreadLookupCounts();
+	if ( pCounts )
+	{
+		// Only this thread writes these
+		if ( bHit )
+			pCounts->nHits++;
+		else
+			pCounts->nMisses++;
+	}
+	else
+	{
+		ThreadInterlockedIncrement( bHit ? &m_nHits : &m_nMisses );
+	}
+}
+
+void *CDataManagerBase::GetResource_NoLockNoLRUTouch( memhandle_t handle )
+{
+	return GetStoreNoLock( handle, false );
+}
+
+
+void *CDataManagerBase::GetResource_NoLock( memhandle_t handle )
+{
+	return GetStoreNoLock( handle, true );
+}
+
 void CDataManagerBase::TouchResource( memhandle_t handle )
 {
-	AUTO_LOCK_DM();
-	TouchByIndex( FromHandle(handle) );
+	// A stale handle at worst marks whatever reuses its slot, which only delays that resource's eviction
+	resource_clock_entry_t *pEntry = FindClockEntry( handle );
+	if ( pEntry && !pEntry->bReferenced )
+	{
+		pEntry->bReferenced = 1;
+	}
 }
 
 void CDataManagerBase::MarkAsStale( memhandle_t handle )
@@ -230,6 +368,7 @@ void CDataManagerBase::MarkAsStale( memhandle_t handle )
 	{
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
+			ClockEntry(memoryIndex).bReferenced = 0;
 			m_memoryLists.Unlink( m_lruList, memoryIndex );
 			m_memoryLists.LinkToHead( m_lruList, memoryIndex );
 		}
@@ -287,8 +426,26 @@ unsigned short CDataManagerBase::CreateHandle( bool bCreateLocked )
 	else
 	{
 		memoryIndex = m_memoryLists.AddToTail( list );
+
+		int iPage = (unsigned short)memoryIndex >> CLOCK_PAGE_BITS;
+		if ( !m_pClockPages[iPage] )
+		{
+			resource_clock_entry_t *pPage = new resource_clock_entry_t[CLOCK_PAGE_SIZE];
+			for ( int i = 0; i < CLOCK_PAGE_SIZE; i++ )
+			{
+				pPage[i].serial = 1;
+				pPage[i].bReferenced = 0;
+				pPage[i].pStore = NULL;
+			}
+
+			// Unlocked readers must see the initialized page
+			ThreadMemoryBarrier();
+			m_pClockPages[iPage] = pPage;
+		}
 	}
 
+	ClockEntry( memoryIndex ).bReferenced = 0;
+
 	if ( bCreateLocked )
 	{
 		m_memoryLists[memoryIndex].lockCount++;
@@ -300,18 +457,19 @@ unsigned short CDataManagerBase::CreateHandle( bool bCreateLocked )
 memhandle_t CDataManagerBase::StoreResourceInHandle( unsigned short memoryIndex, void *pStore, unsigned int realSize )
 {
 	AUTO_LOCK_DM();
-	resource_lru_element_t &mem = m_memoryLists[memoryIndex];
-	mem.pStore = pStore;
+	ClockEntry(memoryIndex).pStore = pStore;
 	m_memUsed += realSize;
 	return ToHandle(memoryIndex);
 }
 
+// Lock must be held
 void CDataManagerBase::TouchByIndex( unsigned short memoryIndex )
 {
 	if ( memoryIndex != m_memoryLists.InvalidIndex() )
 	{
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
+			ClockEntry(memoryIndex).bReferenced = 0;
 			m_memoryLists.Unlink( m_lruList, memoryIndex );
 			m_memoryLists.LinkToTail( m_lruList, memoryIndex );
 		}
@@ -320,7 +478,7 @@ void CDataManagerBase::TouchByIndex( unsigned short memoryIndex )
 
 memhandle_t CDataManagerBase::ToHandle( unsigned short index )
 {
-	unsigned int hiword = m_memoryLists.Element(index).serial;
+	unsigned int hiword = ClockEntry(index).serial;
 	hiword <<= 16;
 	index++;
 	return (memhandle_t)( hiword|index );
@@ -348,8 +506,22 @@ unsigned int CDataManagerBase::EnsureCapacity( unsigned int size )
 	unsigned nBytesInitial = MemUsed_Inline();
 	while ( MemUsed_Inline() > MemTotal_Inline() || MemAvailable_Inline() < size )
 	{
+		// The lock is only held to pick one victim, so lookups and creates on other threads can get in between
 		Lock();
 		int lruIndex = m_memoryLists.Head( m_lruList );
+
+		// Referenced resources go back to the tail once. After a full lap
+		// every bit has been cleared, so the head gets evicted regardless.
+		int nSkipsLeft = m_memoryLists.Count( m_lruList );
+		while ( lruIndex != m_memoryLists.InvalidIndex() && ClockEntry( lruIndex ).bReferenced && nSkipsLeft-- > 0 )
+		{
+			ClockEntry( lruIndex ).bReferenced = 0;
+			m_memoryLists.Unlink( m_lruList, lruIndex );
+			m_memoryLists.LinkToTail( m_lruList, lruIndex );
+			m_nSecondChances++;
+			lruIndex = m_memoryLists.Head( m_lruList );
+		}
+
 		if ( lruIndex == m_memoryLists.InvalidIndex() )
 		{
 			Unlock();
@@ -357,6 +529,7 @@ unsigned int CDataManagerBase::EnsureCapacity( unsigned int size )
 		}
 		m_memoryLists.Unlink( m_lruList, lruIndex );
 		void *p = GetForFreeByIndex( lruIndex );
+		m_nEvictions++;
 		Unlock();
 		DestroyResourceStorage( p );
 	}
@@ -371,7 +544,7 @@ void *CDataManagerBase::GetForFreeByIndex( unsigned short memoryIndex )
 	{
 		Assert( m_memoryLists[memoryIndex].lockCount == 0 );
 
-		resource_lru_element_t &mem = m_memoryLists[memoryIndex];
+		resource_clock_entry_t &mem = ClockEntry(memoryIndex);
 		unsigned size = GetRealSize( mem.pStore );
 		if ( size > m_memUsed )
 		{
@@ -380,8 +553,12 @@ void *CDataManagerBase::GetForFreeByIndex( unsigned short memoryIndex )
 		}
 		m_memUsed -= size;
 		p = mem.pStore;
+
+		// Unlocked readers check the serial after reading pStore, so pStore has to be cleared first
 		mem.pStore = NULL;
+		ThreadMemoryBarrier();
 		mem.serial++;
+		mem.bReferenced = 0;
 		m_memoryLists.LinkToTail( m_freeList, memoryIndex );
 	}
 	return p;
@@ -409,3 +586,48 @@ void CDataManagerBase::GetLockHandleList( CUtlVector< memhandle_t >& list )
 	}
 }
 
+void CDataManagerBase::GetStats( DataManagerStats_t &stats )
+{
+	AUTO_LOCK_DM();
+	stats.nHits = m_nHits;
+	stats.nMisses = m_nMisses;
+	for ( int i = 0; i < DATAMANAGER_MAX_STAT_THREADS; i++ )
+	{
+		stats.nHits += m_ThreadLookups[i].nHits;
+		stats.nMisses += m_ThreadLookups[i].nMisses;
+	}
+	stats.nEvictions = m_nEvictions;
+	stats.nSecondChances = m_nSecondChances;
+	stats.nLocked = m_memoryLists.Count( m_lockList );
+	stats.nResident = m_memoryLists.Count( m_lruList ) + stats.nLocked;
+}
+
+void CDataManagerBase::ResetStats()
+{
+	AUTO_LOCK_DM();
+	m_nHits = m_nMisses = m_nEvictions = m_nSecondChances = 0;
+
+	// Lookups running on other threads right now may survive the reset
+	V_memset( m_ThreadLookups, 0, sizeof( m_ThreadLookups ) );
+}
+
+void CDataManagerBase::PrintAllStats( bool bReset )
+{
+	AUTO_LOCK( s_DataManagerListMutex );
+	for ( CDataManagerBase *pManager = s_pFirstDataManager; pManager; pManager = pManager->m_pNextManager )
+	{
+		DataManagerStats_t stats;
+		pManager->GetStats( stats );
+
+		int nLookups = stats.nHits + stats.nMisses;
+		Msg( "%s: %u of %u KB used, %d resident (%d locked)\n", pManager->GetName(),
+			pManager->UsedSize() / 1024, pManager->TargetSize() / 1024, stats.nResident, stats.nLocked );
+		Msg( "  %d hits, %d misses (%.1f%% hit), %d evicted, %d second chances\n",
+			stats.nHits, stats.nMisses, nLookups ? 100.0f * stats.nHits / nLookups : 0.0f, stats.nEvictions, stats.nSecondChances );
+
+		if ( bReset )
+		{
+			pManager->ResetStats();
+		}
+	}
+}
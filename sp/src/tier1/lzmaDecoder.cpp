@@ -10,6 +10,7 @@
 #include "tier0/platform.h"
 #include "tier0/dbg.h"
 #include "tier1/lzmaDecoder.h"
+#include "tier1/utlvector.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -694,13 +695,194 @@ else
 	return LZMA_RESULT_OK;
 }
 
+//-----------------------------------------------------------------------------
+// Decodes a single LZMA_ID buffer of at most nInputSize bytes, returns the
+// uncompressed size.
+//-----------------------------------------------------------------------------
+static unsigned int UncompressStream( unsigned char *pInput, unsigned int nInputSize, unsigned char *pOutput )
+{
+	lzma_header_t *pHeader = (lzma_header_t *)pInput;
+	if ( nInputSize < sizeof( lzma_header_t ) || pHeader->id != LZMA_ID )
+	{
+		// unrecognized
+		return 0;
+	}
+
+	unsigned int actualSize = LittleLong( pHeader->actualSize );
+	if ( !actualSize )
+	{
+		return 0;
+	}
+
+	unsigned int lzmaSize = LittleLong( pHeader->lzmaSize );
+	if ( lzmaSize > nInputSize - sizeof( lzma_header_t ) )
+	{
+		Assert( 0 );
+		return 0;
+	}
+
+	CLzmaDecoderState state;
+	if ( LzmaDecodeProperties( &state.Properties, pHeader->properties, LZMA_PROPERTIES_SIZE ) != LZMA_RESULT_OK )
+	{
+		Assert( 0 );
+	}
+	state.Probs = (CProb *)malloc( LzmaGetNumProbs( &state.Properties ) * sizeof( CProb ) );
+
+	SizeT inProcessed;
+	SizeT outProcessed;
+	int result = LzmaDecode( &state, pInput + sizeof( lzma_header_t ), lzmaSize, &inProcessed, pOutput, actualSize, &outProcessed );
+
+	free( state.Probs );
+
+	if ( result != LZMA_RESULT_OK || outProcessed != (SizeT)actualSize )
+	{
+		Assert( 0 );
+		return 0;
+	}
+
+	return outProcessed;
+}
+
+//-----------------------------------------------------------------------------
+// A single stream of a multi-buffer decode
+//-----------------------------------------------------------------------------
+void CLZMA::UncompressWorkItem( WorkItem_t &item )
+{
+	lzma_header_t *pHeader = (lzma_header_t *)item.pInput;
+	item.bSucceeded = ( pHeader->id == LZMA_ID && LittleLong( pHeader->actualSize ) == item.nExpectedSize &&
+						( !item.nExpectedSize || UncompressStream( item.pInput, item.nInputSize, item.pOutput ) == item.nExpectedSize ) );
+}
+
+//-----------------------------------------------------------------------------
+// Adds the streams of a buffer, one per block for block containers. Each
+// block must start past the offset table, have room for its header before
+// the next one, and if the buffer's size is known, all of it must be inside
+// the buffer.
+//-----------------------------------------------------------------------------
+bool CLZMA::AddWorkItems( unsigned char *pInput, unsigned int nInputSize, unsigned char *pOutput, CUtlVector<WorkItem_t> &items )
+{
+	lzma_header_t *pHeader = (lzma_header_t *)pInput;
+	if ( !pHeader || nInputSize < sizeof( unsigned int ) )
+		return false;
+
+	if ( pHeader->id == LZMA_ID )
+	{
+		WorkItem_t &item = items[items.AddToTail()];
+		item.pInput = pInput;
+		item.nInputSize = nInputSize;
+		item.pOutput = pOutput;
+		item.nExpectedSize = ( nInputSize >= sizeof( lzma_header_t ) ) ? LittleLong( pHeader->actualSize ) : 0;
+		item.bSucceeded = false;
+		return ( item.nExpectedSize != 0 );
+	}
+
+	if ( pHeader->id != LZMA_BLOCK_ID || nInputSize < sizeof( lzma_block_header_t ) )
+		return false;
+
+	lzma_block_header_t *pBlockHeader = (lzma_block_header_t *)pInput;
+	unsigned int actualSize = LittleLong( pBlockHeader->actualSize );
+	unsigned int blockSize = LittleLong( pBlockHeader->blockSize );
+	unsigned int numBlocks = LittleLong( pBlockHeader->numBlocks );
+	if ( !actualSize || !blockSize || numBlocks > LZMA_MAX_BLOCKS || numBlocks != actualSize / blockSize + ( ( actualSize % blockSize ) != 0 ) )
+	{
+		Assert( 0 );
+		return false;
+	}
+
+	// Can't overflow with the block count capped
+	unsigned int nTableEnd = sizeof( lzma_block_header_t ) + numBlocks * sizeof( unsigned int );
+	if ( nTableEnd > nInputSize )
+	{
+		Assert( 0 );
+		return false;
+	}
+
+	unsigned int *pOffsets = (unsigned int *)( pBlockHeader + 1 );
+	unsigned int nPrevEnd = nTableEnd;
+	for ( unsigned int i = 0; i < numBlocks; i++ )
+	{
+		unsigned int nOffset = LittleLong( pOffsets[i] );
+		unsigned int nEnd = ( i + 1 < numBlocks ) ? LittleLong( pOffsets[i + 1] ) : nInputSize;
+		if ( nOffset < nPrevEnd || nOffset > nEnd || nEnd > nInputSize || nEnd - nOffset < sizeof( lzma_header_t ) )
+		{
+			Assert( 0 );
+			return false;
+		}
+		nPrevEnd = nEnd;
+
+		WorkItem_t &item = items[items.AddToTail()];
+		item.pInput = pInput + nOffset;
+		item.nInputSize = nEnd - nOffset;
+		item.pOutput = pOutput + i * blockSize;
+		item.nExpectedSize = MIN( blockSize, actualSize - i * blockSize );
+		item.bSucceeded = false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Splits the jobs into streams, has pfnRun decode all of them, then sets each
+// job's result.
+//-----------------------------------------------------------------------------
+void CLZMA::UncompressJobs( lzma_job_t *pJobs, int nJobs, RunWorkItemsFunc_t pfnRun )
+{
+	CUtlVector<WorkItem_t> items;
+	CUtlVector<int> firstItems;
+	firstItems.SetCount( nJobs + 1 );
+
+	for ( int i = 0; i < nJobs; i++ )
+	{
+		pJobs[i].nResult = 0;
+		firstItems[i] = items.Count();
+
+		unsigned int nInputSize = pJobs[i].nInputSize ? pJobs[i].nInputSize : UINT_MAX;
+		if ( !AddWorkItems( pJobs[i].pInput, nInputSize, pJobs[i].pOutput, items ) )
+		{
+			// Leaves the job out
+			items.SetCountNonDestructively( firstItems[i] );
+		}
+	}
+	firstItems[nJobs] = items.Count();
+
+	if ( items.Count() )
+	{
+		pfnRun( items.Base(), items.Count() );
+	}
+
+	for ( int i = 0; i < nJobs; i++ )
+	{
+		if ( firstItems[i] == firstItems[i + 1] )
+			continue;
+
+		bool bSucceeded = true;
+		for ( int j = firstItems[i]; j < firstItems[i + 1]; j++ )
+		{
+			bSucceeded = bSucceeded && items[j].bSucceeded;
+		}
+
+		if ( bSucceeded )
+		{
+			pJobs[i].nResult = GetActualSize( pJobs[i].pInput );
+		}
+	}
+}
+
+void CLZMA::RunWorkItems( WorkItem_t *pItems, int nItems )
+{
+	for ( int i = 0; i < nItems; i++ )
+	{
+		UncompressWorkItem( pItems[i] );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Returns true if buffer is compressed.
 //-----------------------------------------------------------------------------
 bool CLZMA::IsCompressed( unsigned char *pInput )
 {
 	lzma_header_t *pHeader = (lzma_header_t *)pInput;
-	if ( pHeader && pHeader->id == LZMA_ID )
+	if ( pHeader && ( pHeader->id == LZMA_ID || pHeader->id == LZMA_BLOCK_ID ) )
 	{
 		return true;
 	}
@@ -721,6 +903,11 @@ unsigned int CLZMA::GetActualSize( unsigned char *pInput )
 		return LittleLong( pHeader->actualSize );
 	}
 
+	if ( pHeader && pHeader->id == LZMA_BLOCK_ID )
+	{
+		return LittleLong( ((lzma_block_header_t *)pInput)->actualSize );
+	}
+
 	// unrecognized
 	return 0;
 }
@@ -731,34 +918,20 @@ unsigned int CLZMA::GetActualSize( unsigned char *pInput )
 //-----------------------------------------------------------------------------
 unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 {
-	unsigned int actualSize = GetActualSize( pInput );
-	if ( !actualSize )
-	{
-		// unrecognized
-		return 0;
-	}
-
-	CLzmaDecoderState state;
-	if ( LzmaDecodeProperties( &state.Properties, ((lzma_header_t *)pInput)->properties, LZMA_PROPERTIES_SIZE ) != LZMA_RESULT_OK )
+	lzma_header_t *pHeader = (lzma_header_t *)pInput;
+	if ( pHeader && pHeader->id == LZMA_BLOCK_ID )
 	{
-		Assert( 0 );
+		// The blocks one after another, UncompressParallel() spreads them over threads
+		lzma_job_t job = { pInput, 0, pOutput, 0 };
+		UncompressJobs( &job, 1, &RunWorkItems );
+		return job.nResult;
 	}
-	state.Probs = (CProb *)malloc( LzmaGetNumProbs( &state.Properties ) * sizeof( CProb ) );
-
-	unsigned int lzmaSize = LittleLong( ((lzma_header_t *)pInput)->lzmaSize );
-
-	SizeT inProcessed;
-	SizeT outProcessed;
-	int result = LzmaDecode( &state, pInput + sizeof( lzma_header_t ), lzmaSize, &inProcessed, pOutput, actualSize, &outProcessed );
 
-	free( state.Probs );
-
-	if ( result != LZMA_RESULT_OK || outProcessed != (SizeT)actualSize )
+	if ( !GetActualSize( pInput ) )
 	{
-		Assert( 0 );
+		// unrecognized
 		return 0;
 	}
 
-	return outProcessed;
+	return UncompressStream( pInput, UINT_MAX, pOutput );
 }
-
@@ -0,0 +1,37 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Decodes several LZMA buffers, and the blocks of block containers,
+//			on the thread pool. Kept apart from lzmaDecoder.cpp so code that
+//			only calls CLZMA::Uncompress() doesn't link against vstdlib.
+//
+//=============================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "tier1/lzmaDecoder.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+void CLZMA::RunWorkItemsInParallel( WorkItem_t *pItems, int nItems )
+{
+	if ( nItems > 1 )
+	{
+		ParallelProcess( "CLZMA::UncompressParallel", pItems, nItems, &UncompressWorkItem );
+	}
+	else
+	{
+		RunWorkItems( pItems, nItems );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Uncompress several buffers, each job's output sized as for Uncompress().
+// All of the streams go into one parallel pass, so a single large block
+// container spreads over the threads as well as many small buffers do.
+//-----------------------------------------------------------------------------
+void CLZMA::UncompressParallel( lzma_job_t *pJobs, int nJobs )
+{
+	UncompressJobs( pJobs, nJobs, &RunWorkItemsInParallel );
+}
@@ -0,0 +1,948 @@
+//
+//	LZMA Decoder, state version. Decodes input as it arrives, keeping the
+//	dictionary in its own window instead of the output buffer.
+//
+//	LZMA SDK 4.40 Copyright (c) 1999-2006 Igor Pavlov (2006-05-01)
+//	http://www.7-zip.org/
+//
+// Modified to use Source platform utilities and memory allocation overrides.
+//=====================================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "tier1/lzmaDecoder.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlmemory.h"
+#include "tier1/utlvector.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// Kept out of the global namespace, lzmaDecoder.cpp has its own decoder with the same names
+namespace
+{
+
+typedef unsigned char Byte;
+typedef unsigned short UInt16;
+typedef unsigned int UInt32;
+typedef UInt32 SizeT;
+
+#define _LZMA_PROB32
+/* It can increase speed on some 32-bit CPUs, 
+but memory usage will be doubled in that case */
+
+#ifdef _LZMA_PROB32
+#define CProb UInt32
+#else
+#define CProb UInt16
+#endif
+
+#define LZMA_RESULT_OK 0
+#define LZMA_RESULT_DATA_ERROR 1
+
+#define LZMA_BASE_SIZE 1846
+#define LZMA_LIT_SIZE 768
+
+#define LZMA_PROPERTIES_SIZE 5
+
+typedef struct _CLzmaProperties
+{
+	int lc;
+	int lp;
+	int pb;
+	UInt32 DictionarySize;
+}CLzmaProperties;
+
+int LzmaDecodeProperties(CLzmaProperties *propsRes, const unsigned char *propsData, int size);
+
+#define LzmaGetNumProbs(lzmaProps) (LZMA_BASE_SIZE + (LZMA_LIT_SIZE << ((lzmaProps)->lc + (lzmaProps)->lp)))
+
+#define kLzmaInBufferSize 64   /* don't change it. it must be larger than kRequiredInBufferSize */
+
+#define kLzmaNeedInitId (-2)
+
+typedef struct _CLzmaDecoderState
+{
+	CLzmaProperties Properties;
+	CProb *Probs;
+	unsigned char *Dictionary;
+
+	unsigned char Buffer[kLzmaInBufferSize];
+	int BufferSize;
+
+	UInt32 Range;
+	UInt32 Code;
+	UInt32 DictionaryPos;
+	UInt32 GlobalPos;
+	UInt32 DistanceLimit;
+	UInt32 Reps[4];
+	int State;
+	int RemainLen;  /* -2: decoder needs internal initialization
+	                   -1: stream was finished,
+	                    0: ok
+	                  > 0: need to write RemainLen bytes as match Reps[0],
+	                */
+	unsigned char TempDictionary[4];  /* it's required when DictionarySize = 0 */
+} CLzmaDecoderState;
+
+#define LzmaDecoderInit(vs) { (vs)->RemainLen = kLzmaNeedInitId; (vs)->BufferSize = 0; }
+
+
+int LzmaDecode(CLzmaDecoderState *vs,
+	const unsigned char *inStream, SizeT inSize,  SizeT *inSizeProcessed,
+	unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed,
+	int finishDecoding);
+
+#define kNumTopBits 24
+#define kTopValue ((UInt32)1 << kNumTopBits)
+
+#define kNumBitModelTotalBits 11
+#define kBitModelTotal (1 << kNumBitModelTotalBits)
+#define kNumMoveBits 5
+
+#define RC_READ_BYTE (*Buffer++)
+
+#define RC_INIT Code = 0; Range = 0xFFFFFFFF; \
+	{ int i; for(i = 0; i < 5; i++) { Code = (Code << 8) | RC_READ_BYTE; }}
+
+#define RC_NORMALIZE if (Range < kTopValue) { Range <<= 8; Code = (Code << 8) | RC_READ_BYTE; }
+
+#define IfBit0(p) RC_NORMALIZE; bound = (Range >> kNumBitModelTotalBits) * *(p); if (Code < bound)
+#define UpdateBit0(p) Range = bound; *(p) += (kBitModelTotal - *(p)) >> kNumMoveBits;
+#define UpdateBit1(p) Range -= bound; Code -= bound; *(p) -= (*(p)) >> kNumMoveBits;
+
+#define RC_GET_BIT2(p, mi, A0, A1) IfBit0(p) \
+	{ UpdateBit0(p); mi <<= 1; A0; } else \
+	{ UpdateBit1(p); mi = (mi + mi) + 1; A1; }
+
+#define RC_GET_BIT(p, mi) RC_GET_BIT2(p, mi, ; , ;)
+
+#define RangeDecoderBitTreeDecode(probs, numLevels, res) \
+	{ int i = numLevels; res = 1; \
+	do { CProb *p = probs + res; RC_GET_BIT(p, res) } while(--i != 0); \
+	res -= (1 << numLevels); }
+
+
+#define kNumPosBitsMax 4
+#define kNumPosStatesMax (1 << kNumPosBitsMax)
+
+#define kLenNumLowBits 3
+#define kLenNumLowSymbols (1 << kLenNumLowBits)
+#define kLenNumMidBits 3
+#define kLenNumMidSymbols (1 << kLenNumMidBits)
+#define kLenNumHighBits 8
+#define kLenNumHighSymbols (1 << kLenNumHighBits)
+
+#define LenChoice 0
+#define LenChoice2 (LenChoice + 1)
+#define LenLow (LenChoice2 + 1)
+#define LenMid (LenLow + (kNumPosStatesMax << kLenNumLowBits))
+#define LenHigh (LenMid + (kNumPosStatesMax << kLenNumMidBits))
+#define kNumLenProbs (LenHigh + kLenNumHighSymbols)
+
+
+#define kNumStates 12
+#define kNumLitStates 7
+
+#define kStartPosModelIndex 4
+#define kEndPosModelIndex 14
+#define kNumFullDistances (1 << (kEndPosModelIndex >> 1))
+
+#define kNumPosSlotBits 6
+#define kNumLenToPosStates 4
+
+#define kNumAlignBits 4
+#define kAlignTableSize (1 << kNumAlignBits)
+
+#define kMatchMinLen 2
+
+#define IsMatch 0
+#define IsRep (IsMatch + (kNumStates << kNumPosBitsMax))
+#define IsRepG0 (IsRep + kNumStates)
+#define IsRepG1 (IsRepG0 + kNumStates)
+#define IsRepG2 (IsRepG1 + kNumStates)
+#define IsRep0Long (IsRepG2 + kNumStates)
+#define PosSlot (IsRep0Long + (kNumStates << kNumPosBitsMax))
+#define SpecPos (PosSlot + (kNumLenToPosStates << kNumPosSlotBits))
+#define Align (SpecPos + kNumFullDistances - kEndPosModelIndex)
+#define LenCoder (Align + kAlignTableSize)
+#define RepLenCoder (LenCoder + kNumLenProbs)
+#define Literal (RepLenCoder + kNumLenProbs)
+
+#if Literal != LZMA_BASE_SIZE
+StopCompilingDueBUG
+#endif
+
+/* kRequiredInBufferSize = number of required input bytes for worst case:
+	 longest match with longest distance.
+	 kLzmaInBufferSize must be larger than kRequiredInBufferSize
+	 23 bits = 2 (match select) + 10 (len) + 6 (distance) + 4(align) + 1 (RC_NORMALIZE)
+*/
+
+#define kRequiredInBufferSize ((23 * (kNumBitModelTotalBits - kNumMoveBits + 1) + 26 + 9) / 8)
+
+#define kLzmaStreamWasFinishedId (-1)
+
+int LzmaDecodeProperties(CLzmaProperties *propsRes, const unsigned char *propsData, int size)
+{
+	unsigned char prop0;
+	if (size < LZMA_PROPERTIES_SIZE)
+		return LZMA_RESULT_DATA_ERROR;
+	prop0 = propsData[0];
+	if (prop0 >= (9 * 5 * 5))
+		return LZMA_RESULT_DATA_ERROR;
+	{
+		for (propsRes->pb = 0; prop0 >= (9 * 5); propsRes->pb++, prop0 -= (9 * 5));
+		for (propsRes->lp = 0; prop0 >= 9; propsRes->lp++, prop0 -= 9);
+		propsRes->lc = prop0;
+		/*
+		unsigned char remainder = (unsigned char)(prop0 / 9);
+		propsRes->lc = prop0 % 9;
+		propsRes->pb = remainder / 5;
+		propsRes->lp = remainder % 5;
+		*/
+	}
+
+	{
+		int i;
+		propsRes->DictionarySize = 0;
+		for (i = 0; i < 4; i++)
+			propsRes->DictionarySize += (UInt32)(propsData[1 + i]) << (i * 8);
+		if (propsRes->DictionarySize == 0)
+			propsRes->DictionarySize = 1;
+		return LZMA_RESULT_OK;
+	}
+}
+
+int LzmaDecode(
+		CLzmaDecoderState *vs,
+		const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
+		unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed,
+		int finishDecoding)
+{
+	UInt32 Range = vs->Range;
+	UInt32 Code = vs->Code;
+
+	unsigned char *Buffer = vs->Buffer;
+	int BufferSize = vs->BufferSize; /* don't change it to unsigned int */
+	CProb *p = vs->Probs;
+
+	int state = vs->State;
+	unsigned char previousByte;
+	UInt32 rep0 = vs->Reps[0], rep1 = vs->Reps[1], rep2 = vs->Reps[2], rep3 = vs->Reps[3];
+	SizeT nowPos = 0;
+	UInt32 posStateMask = (1 << (vs->Properties.pb)) - 1;
+	UInt32 literalPosMask = (1 << (vs->Properties.lp)) - 1;
+	int lc = vs->Properties.lc;
+	int len = vs->RemainLen;
+	UInt32 globalPos = vs->GlobalPos;
+	UInt32 distanceLimit = vs->DistanceLimit;
+
+	unsigned char *dictionary = vs->Dictionary;
+	UInt32 dictionarySize = vs->Properties.DictionarySize;
+	UInt32 dictionaryPos = vs->DictionaryPos;
+
+	unsigned char tempDictionary[4];
+
+	(*inSizeProcessed) = 0;
+	(*outSizeProcessed) = 0;
+	if (len == kLzmaStreamWasFinishedId)
+		return LZMA_RESULT_OK;
+
+	if (dictionarySize == 0)
+	{
+		dictionary = tempDictionary;
+		dictionarySize = 1;
+		tempDictionary[0] = vs->TempDictionary[0];
+	}
+
+	if (len == kLzmaNeedInitId)
+	{
+		while (inSize > 0 && BufferSize < kLzmaInBufferSize)
+		{
+			Buffer[BufferSize++] = *inStream++;
+			(*inSizeProcessed)++;
+			inSize--;
+		}
+		if (BufferSize < 5)
+		{
+			vs->BufferSize = BufferSize;
+			return finishDecoding ? LZMA_RESULT_DATA_ERROR : LZMA_RESULT_OK;
+		}
+		{
+			UInt32 numProbs = Literal + ((UInt32)LZMA_LIT_SIZE << (lc + vs->Properties.lp));
+			UInt32 i;
+			for (i = 0; i < numProbs; i++)
+				p[i] = kBitModelTotal >> 1;
+			rep0 = rep1 = rep2 = rep3 = 1;
+			state = 0;
+			globalPos = 0;
+			distanceLimit = 0;
+			dictionaryPos = 0;
+			dictionary[dictionarySize - 1] = 0;
+			RC_INIT;
+		}
+		len = 0;
+	}
+	while(len != 0 && nowPos < outSize)
+	{
+		UInt32 pos = dictionaryPos - rep0;
+		if (pos >= dictionarySize)
+			pos += dictionarySize;
+		outStream[nowPos++] = dictionary[dictionaryPos] = dictionary[pos];
+		if (++dictionaryPos == dictionarySize)
+			dictionaryPos = 0;
+		len--;
+	}
+	if (dictionaryPos == 0)
+		previousByte = dictionary[dictionarySize - 1];
+	else
+		previousByte = dictionary[dictionaryPos - 1];
+
+	while(1)
+	{
+		int bufferPos = (int)(Buffer - vs->Buffer);
+		if (BufferSize - bufferPos < kRequiredInBufferSize)
+		{
+			int i;
+			BufferSize -= bufferPos;
+			if (BufferSize < 0)
+				return LZMA_RESULT_DATA_ERROR;
+			for (i = 0; i < BufferSize; i++)
+				vs->Buffer[i] = Buffer[i];
+			Buffer = vs->Buffer;
+			while (inSize > 0 && BufferSize < kLzmaInBufferSize)
+			{
+				Buffer[BufferSize++] = *inStream++;
+				(*inSizeProcessed)++;
+				inSize--;
+			}
+			if (BufferSize < kRequiredInBufferSize && !finishDecoding)
+				break;
+		}
+		if (nowPos >= outSize)
+			break;
+		{
+		CProb *prob;
+		UInt32 bound;
+		int posState = (int)((nowPos + globalPos) & posStateMask);
+
+		prob = p + IsMatch + (state << kNumPosBitsMax) + posState;
+		IfBit0(prob)
+		{
+			int symbol = 1;
+			UpdateBit0(prob)
+			prob = p + Literal + (LZMA_LIT_SIZE *
+				((((nowPos + globalPos)& literalPosMask) << lc) + (previousByte >> (8 - lc))));
+
+			if (state >= kNumLitStates)
+			{
+				int matchByte;
+				UInt32 pos = dictionaryPos - rep0;
+				if (pos >= dictionarySize)
+					pos += dictionarySize;
+				matchByte = dictionary[pos];
+				do
+				{
+					int bit;
+					CProb *probLit;
+					matchByte <<= 1;
+					bit = (matchByte & 0x100);
+					probLit = prob + 0x100 + bit + symbol;
+					RC_GET_BIT2(probLit, symbol, if (bit != 0) break, if (bit == 0) break)
+				}
+				while (symbol < 0x100);
+			}
+			while (symbol < 0x100)
+			{
+				CProb *probLit = prob + symbol;
+				RC_GET_BIT(probLit, symbol)
+			}
+			previousByte = (unsigned char)symbol;
+
+			outStream[nowPos++] = previousByte;
+			if (distanceLimit < dictionarySize)
+				distanceLimit++;
+
+			dictionary[dictionaryPos] = previousByte;
+			if (++dictionaryPos == dictionarySize)
+				dictionaryPos = 0;
+			if (state < 4) state = 0;
+			else if (state < 10) state -= 3;
+			else state -= 6;
+		}
+		else
+		{
+			UpdateBit1(prob);
+			prob = p + IsRep + state;
+			IfBit0(prob)
+			{
+				UpdateBit0(prob);
+				rep3 = rep2;
+				rep2 = rep1;
+				rep1 = rep0;
+				state = state < kNumLitStates ? 0 : 3;
+				prob = p + LenCoder;
+			}
+			else
+			{
+				UpdateBit1(prob);
+				prob = p + IsRepG0 + state;
+				IfBit0(prob)
+				{
+					UpdateBit0(prob);
+					prob = p + IsRep0Long + (state << kNumPosBitsMax) + posState;
+					IfBit0(prob)
+					{
+						UInt32 pos;
+						UpdateBit0(prob);
+						if (distanceLimit == 0)
+							return LZMA_RESULT_DATA_ERROR;
+						if (distanceLimit < dictionarySize)
+							distanceLimit++;
+						state = state < kNumLitStates ? 9 : 11;
+						pos = dictionaryPos - rep0;
+						if (pos >= dictionarySize)
+							pos += dictionarySize;
+						previousByte = dictionary[pos];
+						dictionary[dictionaryPos] = previousByte;
+						if (++dictionaryPos == dictionarySize)
+							dictionaryPos = 0;
+						outStream[nowPos++] = previousByte;
+						continue;
+					}
+					else
+					{
+						UpdateBit1(prob);
+					}
+				}
+				else
+				{
+					UInt32 distance;
+					UpdateBit1(prob);
+					prob = p + IsRepG1 + state;
+					IfBit0(prob)
+					{
+						UpdateBit0(prob);
+						distance = rep1;
+					}
+					else
+					{
+						UpdateBit1(prob);
+						prob = p + IsRepG2 + state;
+						IfBit0(prob)
+						{
+							UpdateBit0(prob);
+							distance = rep2;
+						}
+						else
+						{
+							UpdateBit1(prob);
+							distance = rep3;
+							rep3 = rep2;
+						}
+						rep2 = rep1;
+					}
+					rep1 = rep0;
+					rep0 = distance;
+				}
+				state = state < kNumLitStates ? 8 : 11;
+				prob = p + RepLenCoder;
+			}
+			{
+				int numBits, offset;
+				CProb *probLen = prob + LenChoice;
+				IfBit0(probLen)
+				{
+					UpdateBit0(probLen);
+					probLen = prob + LenLow + (posState << kLenNumLowBits);
+					offset = 0;
+					numBits = kLenNumLowBits;
+				}
+				else
+				{
+					UpdateBit1(probLen);
+					probLen = prob + LenChoice2;
+					IfBit0(probLen)
+					{
+						UpdateBit0(probLen);
+						probLen = prob + LenMid + (posState << kLenNumMidBits);
+						offset = kLenNumLowSymbols;
+						numBits = kLenNumMidBits;
+					}
+					else
+					{
+						UpdateBit1(probLen);
+						probLen = prob + LenHigh;
+						offset = kLenNumLowSymbols + kLenNumMidSymbols;
+						numBits = kLenNumHighBits;
+					}
+				}
+				RangeDecoderBitTreeDecode(probLen, numBits, len);
+				len += offset;
+			}
+
+			if (state < 4)
+			{
+				int posSlot;
+				state += kNumLitStates;
+				prob = p + PosSlot +
+						((len < kNumLenToPosStates ? len : kNumLenToPosStates - 1) <<
+						kNumPosSlotBits);
+				RangeDecoderBitTreeDecode(prob, kNumPosSlotBits, posSlot);
+				if (posSlot >= kStartPosModelIndex)
+				{
+					int numDirectBits = ((posSlot >> 1) - 1);
+					rep0 = (2 | ((UInt32)posSlot & 1));
+					if (posSlot < kEndPosModelIndex)
+					{
+						rep0 <<= numDirectBits;
+						prob = p + SpecPos + rep0 - posSlot - 1;
+					}
+					else
+					{
+						numDirectBits -= kNumAlignBits;
+						do
+						{
+							RC_NORMALIZE
+							Range >>= 1;
+							rep0 <<= 1;
+							if (Code >= Range)
+							{
+								Code -= Range;
+								rep0 |= 1;
+							}
+						}
+						while (--numDirectBits != 0);
+						prob = p + Align;
+						rep0 <<= kNumAlignBits;
+						numDirectBits = kNumAlignBits;
+					}
+					{
+						int i = 1;
+						int mi = 1;
+						do
+						{
+							CProb *prob3 = prob + mi;
+							RC_GET_BIT2(prob3, mi, ; , rep0 |= i);
+							i <<= 1;
+						}
+						while(--numDirectBits != 0);
+					}
+				}
+				else
+					rep0 = posSlot;
+				if (++rep0 == (UInt32)(0))
+				{
+					/* it's for stream version */
+					len = kLzmaStreamWasFinishedId;
+					break;
+				}
+			}
+
+			len += kMatchMinLen;
+			if (rep0 > distanceLimit)
+				return LZMA_RESULT_DATA_ERROR;
+			if (dictionarySize - distanceLimit > (UInt32)len)
+				distanceLimit += len;
+			else
+				distanceLimit = dictionarySize;
+
+			do
+			{
+				UInt32 pos = dictionaryPos - rep0;
+				if (pos >= dictionarySize)
+					pos += dictionarySize;
+				previousByte = dictionary[pos];
+				dictionary[dictionaryPos] = previousByte;
+				if (++dictionaryPos == dictionarySize)
+					dictionaryPos = 0;
+				len--;
+				outStream[nowPos++] = previousByte;
+			}
+			while(len != 0 && nowPos < outSize);
+		}
+		}
+	}
+	RC_NORMALIZE;
+
+	BufferSize -= (int)(Buffer - vs->Buffer);
+	if (BufferSize < 0)
+		return LZMA_RESULT_DATA_ERROR;
+	{
+		int i;
+		for (i = 0; i < BufferSize; i++)
+			vs->Buffer[i] = Buffer[i];
+	}
+	vs->BufferSize = BufferSize;
+	vs->Range = Range;
+	vs->Code = Code;
+	vs->DictionaryPos = dictionaryPos;
+	vs->GlobalPos = (UInt32)(globalPos + nowPos);
+	vs->DistanceLimit = distanceLimit;
+	vs->Reps[0] = rep0;
+	vs->Reps[1] = rep1;
+	vs->Reps[2] = rep2;
+	vs->Reps[3] = rep3;
+	vs->State = state;
+	vs->RemainLen = len;
+	vs->TempDictionary[0] = tempDictionary[0];
+
+	(*outSizeProcessed) = nowPos;
+	return LZMA_RESULT_OK;
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+// CLZMAStream
+//-----------------------------------------------------------------------------
+#define LZMA_STREAM_CHUNK	( 64 * 1024 )
+
+enum LZMAStreamPhase_t
+{
+	LZMA_STREAM_ID,				// first four bytes, picks the format
+	LZMA_STREAM_CONTAINER,		// rest of the lzma_block_header_t
+	LZMA_STREAM_BLOCK_TABLE,	// block offsets
+	LZMA_STREAM_HEADER,			// lzma_header_t of the next block
+	LZMA_STREAM_DATA,
+	LZMA_STREAM_FINISHED,
+	LZMA_STREAM_FAILED,
+};
+
+struct LZMAStreamState_t
+{
+	CLzmaDecoderState			decoder;
+	CUtlMemory<CProb>			probs;
+	CUtlMemory<unsigned char>	dictionary;
+	CUtlMemory<unsigned char>	chunk;			// output handed to callbacks
+
+	LZMAStreamPhase_t			phase;
+	CUtlVector<unsigned char>	header;			// header bytes gathered so far
+	unsigned int				nInputPos;		// input bytes seen
+	unsigned int				nActualSize;
+	unsigned int				nOutputSize;
+
+	// Block containers only
+	unsigned int				nBlockSize;
+	CUtlVector<unsigned int>	blockOffsets;
+	int							iBlock;
+
+	unsigned int				nBlockInput;	// compressed bytes left in the current block
+	unsigned int				nBlockOutput;	// uncompressed bytes left in the current block
+};
+
+//-----------------------------------------------------------------------------
+// Moves input into the header until it holds nSize bytes. Returns true once it does.
+//-----------------------------------------------------------------------------
+static bool GatherHeader( LZMAStreamState_t &s, const unsigned char *&pInput, unsigned int &nInput, unsigned int nSize )
+{
+	// Nothing bigger than a full block table ever gets gathered
+	Assert( nSize <= sizeof( lzma_block_header_t ) + LZMA_MAX_BLOCKS * sizeof( unsigned int ) );
+
+	unsigned int nCopy = MIN( nSize - (unsigned int)s.header.Count(), nInput );
+	s.header.AddMultipleToTail( nCopy, pInput );
+	pInput += nCopy;
+	nInput -= nCopy;
+	s.nInputPos += nCopy;
+
+	return ( (unsigned int)s.header.Count() == nSize );
+}
+
+//-----------------------------------------------------------------------------
+// Sets the decoder up for the lzma_header_t in the header bytes
+//-----------------------------------------------------------------------------
+static bool StartBlock( LZMAStreamState_t &s, unsigned int nExpectedSize )
+{
+	const lzma_header_t *pHeader = (const lzma_header_t *)s.header.Base();
+	if ( pHeader->id != LZMA_ID || LittleLong( pHeader->actualSize ) != nExpectedSize )
+		return false;
+
+	if ( LzmaDecodeProperties( &s.decoder.Properties, pHeader->properties, LZMA_PROPERTIES_SIZE ) != LZMA_RESULT_OK )
+		return false;
+
+	// Matches can't reach back past the start of the block
+	if ( s.decoder.Properties.DictionarySize > nExpectedSize )
+	{
+		s.decoder.Properties.DictionarySize = MAX( nExpectedSize, 1 );
+	}
+
+	s.probs.EnsureCapacity( LzmaGetNumProbs( &s.decoder.Properties ) );
+	s.dictionary.EnsureCapacity( s.decoder.Properties.DictionarySize );
+	s.decoder.Probs = s.probs.Base();
+	s.decoder.Dictionary = s.dictionary.Base();
+	LzmaDecoderInit( &s.decoder );
+
+	s.nBlockInput = LittleLong( pHeader->lzmaSize );
+	s.nBlockOutput = nExpectedSize;
+	s.phase = LZMA_STREAM_DATA;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+CLZMAStream::CLZMAStream()
+{
+	m_pState = new LZMAStreamState_t;
+	Reset();
+}
+
+CLZMAStream::~CLZMAStream()
+{
+	delete m_pState;
+}
+
+void CLZMAStream::Reset()
+{
+	m_pState->phase = LZMA_STREAM_ID;
+	m_pState->header.RemoveAll();
+	m_pState->nInputPos = 0;
+	m_pState->nActualSize = 0;
+	m_pState->nOutputSize = 0;
+	m_pState->nBlockSize = 0;
+	m_pState->blockOffsets.RemoveAll();
+	m_pState->iBlock = 0;
+	m_pState->nBlockInput = 0;
+	m_pState->nBlockOutput = 0;
+}
+
+bool CLZMAStream::IsFinished() const
+{
+	return ( m_pState->phase == LZMA_STREAM_FINISHED );
+}
+
+bool CLZMAStream::IsFailed() const
+{
+	return ( m_pState->phase == LZMA_STREAM_FAILED );
+}
+
+unsigned int CLZMAStream::GetActualSize() const
+{
+	return m_pState->nActualSize;
+}
+
+unsigned int CLZMAStream::GetOutputSize() const
+{
+	return m_pState->nOutputSize;
+}
+
+bool CLZMAStream::Decode( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer &output )
+{
+	return DecodeInternal( pInput, nInputSize, &output, NULL, NULL );
+}
+
+bool CLZMAStream::Decode( const unsigned char *pInput, unsigned int nInputSize, LZMAOutputFunc_t pfnOutput, void *pContext )
+{
+	Assert( pfnOutput );
+	return DecodeInternal( pInput, nInputSize, NULL, pfnOutput, pContext );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs the input through as many phases as it covers. Returns true
+//			when all of it has been used (or ignored, past the end).
+//-----------------------------------------------------------------------------
+bool CLZMAStream::DecodeInternal( const unsigned char *pInput, unsigned int nInputSize, CUtlBuffer *pBuffer, LZMAOutputFunc_t pfnOutput, void *pContext )
+{
+	LZMAStreamState_t &s = *m_pState;
+
+	for ( ;; )
+	{
+		switch ( s.phase )
+		{
+		case LZMA_STREAM_ID:
+			if ( !GatherHeader( s, pInput, nInputSize, sizeof( unsigned int ) ) )
+				return true;
+
+			if ( *(unsigned int *)s.header.Base() == LZMA_ID )
+			{
+				s.phase = LZMA_STREAM_HEADER;
+			}
+			else if ( *(unsigned int *)s.header.Base() == LZMA_BLOCK_ID )
+			{
+				s.phase = LZMA_STREAM_CONTAINER;
+			}
+			else
+			{
+				s.phase = LZMA_STREAM_FAILED;
+			}
+			break;
+
+		case LZMA_STREAM_CONTAINER:
+			if ( !GatherHeader( s, pInput, nInputSize, sizeof( lzma_block_header_t ) ) )
+				return true;
+
+			{
+				const lzma_block_header_t *pHeader = (const lzma_block_header_t *)s.header.Base();
+				s.nActualSize = LittleLong( pHeader->actualSize );
+				s.nBlockSize = LittleLong( pHeader->blockSize );
+
+				unsigned int numBlocks = LittleLong( pHeader->numBlocks );
+				if ( !s.nBlockSize || numBlocks > LZMA_MAX_BLOCKS || numBlocks != s.nActualSize / s.nBlockSize + ( ( s.nActualSize % s.nBlockSize ) != 0 ) )
+				{
+					s.phase = LZMA_STREAM_FAILED;
+					break;
+				}
+
+				s.blockOffsets.SetCount( numBlocks );
+				s.header.RemoveAll();
+				s.phase = LZMA_STREAM_BLOCK_TABLE;
+			}
+			break;
+
+		case LZMA_STREAM_BLOCK_TABLE:
+			if ( !GatherHeader( s, pInput, nInputSize, s.blockOffsets.Count() * sizeof( unsigned int ) ) )
+				return true;
+
+			for ( int i = 0; i < s.blockOffsets.Count(); i++ )
+			{
+				// Blocks come after the table, in order, each with room for its header
+				unsigned int nOffset = LittleLong( ((unsigned int *)s.header.Base())[i] );
+				unsigned int nMinOffset = i ? s.blockOffsets[i - 1] + sizeof( lzma_header_t ) : s.nInputPos;
+				if ( nOffset < nMinOffset || ( i && nMinOffset < s.blockOffsets[i - 1] ) )
+				{
+					s.phase = LZMA_STREAM_FAILED;
+					break;
+				}
+				s.blockOffsets[i] = nOffset;
+			}
+
+			if ( s.phase == LZMA_STREAM_FAILED )
+				break;
+
+			s.header.RemoveAll();
+			s.iBlock = 0;
+			s.phase = s.blockOffsets.Count() ? LZMA_STREAM_HEADER : LZMA_STREAM_FINISHED;
+			break;
+
+		case LZMA_STREAM_HEADER:
+			if ( s.blockOffsets.Count() && !s.header.Count() )
+			{
+				// Skip ahead to the block
+				unsigned int nOffset = s.blockOffsets[s.iBlock];
+				if ( nOffset < s.nInputPos )
+				{
+					s.phase = LZMA_STREAM_FAILED;
+					break;
+				}
+
+				unsigned int nSkip = MIN( nOffset - s.nInputPos, nInputSize );
+				pInput += nSkip;
+				nInputSize -= nSkip;
+				s.nInputPos += nSkip;
+
+				if ( s.nInputPos < nOffset )
+					return true;
+			}
+
+			if ( !GatherHeader( s, pInput, nInputSize, sizeof( lzma_header_t ) ) )
+				return true;
+
+			{
+				unsigned int nExpectedSize;
+				if ( s.blockOffsets.Count() )
+				{
+					nExpectedSize = MIN( s.nBlockSize, s.nActualSize - s.iBlock * s.nBlockSize );
+				}
+				else
+				{
+					nExpectedSize = s.nActualSize = LittleLong( ((const lzma_header_t *)s.header.Base())->actualSize );
+				}
+
+				if ( !StartBlock( s, nExpectedSize ) )
+				{
+					s.phase = LZMA_STREAM_FAILED;
+				}
+				else if ( s.iBlock + 1 < s.blockOffsets.Count() && s.nBlockInput > s.blockOffsets[s.iBlock + 1] - s.nInputPos )
+				{
+					// Runs into the next block
+					s.phase = LZMA_STREAM_FAILED;
+				}
+			}
+			break;
+
+		case LZMA_STREAM_DATA:
+			while ( s.nBlockOutput )
+			{
+				unsigned int nIn = MIN( nInputSize, s.nBlockInput );
+				unsigned int nOut = MIN( s.nBlockOutput, (unsigned int)LZMA_STREAM_CHUNK );
+				bool bLastInput = ( nIn == s.nBlockInput );
+
+				// Decode straight into the buffer when there is one
+				unsigned char *pOut;
+				if ( pBuffer )
+				{
+					int nPut = pBuffer->TellPut();
+					if ( pBuffer->Size() < nPut + (int)nOut )
+					{
+						// Room for everything that's left, rather than a chunk at a time
+						pBuffer->EnsureCapacity( nPut + ( s.nActualSize - s.nOutputSize ) );
+						if ( pBuffer->Size() < nPut + (int)nOut )
+						{
+							s.phase = LZMA_STREAM_FAILED;
+							return false;
+						}
+					}
+					pOut = (unsigned char *)pBuffer->PeekPut();
+				}
+				else
+				{
+					s.chunk.EnsureCapacity( LZMA_STREAM_CHUNK );
+					pOut = s.chunk.Base();
+				}
+
+				SizeT nInUsed, nOutUsed;
+				if ( LzmaDecode( &s.decoder, pInput, nIn, &nInUsed, pOut, nOut, &nOutUsed, bLastInput ) != LZMA_RESULT_OK )
+				{
+					s.phase = LZMA_STREAM_FAILED;
+					return false;
+				}
+
+				pInput += nInUsed;
+				nInputSize -= nInUsed;
+				s.nInputPos += nInUsed;
+				s.nBlockInput -= nInUsed;
+				s.nBlockOutput -= nOutUsed;
+				s.nOutputSize += nOutUsed;
+
+				if ( nOutUsed )
+				{
+					if ( pBuffer )
+					{
+						pBuffer->SeekPut( CUtlBuffer::SEEK_CURRENT, nOutUsed );
+					}
+					else
+					{
+						pfnOutput( pContext, pOut, nOutUsed );
+					}
+				}
+				else if ( !nInUsed )
+				{
+					// Stuck, fine if more input is coming
+					if ( bLastInput )
+					{
+						s.phase = LZMA_STREAM_FAILED;
+						return false;
+					}
+					return true;
+				}
+			}
+
+			s.header.RemoveAll();
+			if ( s.blockOffsets.Count() && ++s.iBlock < s.blockOffsets.Count() )
+			{
+				s.phase = LZMA_STREAM_HEADER;
+			}
+			else
+			{
+				s.phase = LZMA_STREAM_FINISHED;
+			}
+			break;
+
+		case LZMA_STREAM_FINISHED:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+}
@@ -11,6 +11,7 @@
 #include "tier0/dbg.h"
 #include <ctype.h>
 #include "tier1/strtools.h"
+#include "tier1/threadslots.h"
 
 // Should be last include
 #include "tier0/memdbgon.h"
@@ -310,3 +311,338 @@ void CUtlMemoryPool::Free( void *memBlock )
 }
 
 
+
+
+//-----------------------------------------------------------------------------
+// CMemoryPoolTS
+//-----------------------------------------------------------------------------
+
+// A thread gets a cache slot the first time it uses any CMemoryPoolTS and
+// keeps it in every pool until it exits
+static CThreadSlots s_MemoryPoolThreadSlots( MEMPOOL_TS_MAX_THREADS, &CMemoryPoolTS::ReleaseThreadSlot );
+#ifndef NO_THREAD_LOCAL
+static THREAD_LOCAL int s_iMemoryPoolThreadSlot;	// slot + 1, -1 for none, 0 until assigned
+#endif
+
+// Every pool, so a thread's caches can be flushed when it exits
+CMemoryPoolTS *CMemoryPoolTS::s_pFirstPool = NULL;
+CThreadFastMutex CMemoryPoolTS::s_PoolsMutex;
+
+CMemoryPoolTS::CMemoryPoolTS( int blockSize, int numElements, int growMode, const char *pszAllocOwner, int nAlignment ) :
+	m_Blobs( blockSize, numElements, growMode, pszAllocOwner, nAlignment )
+{
+	m_BlockSize = MAX( blockSize, (int)sizeof(void*) );
+	m_BlockSize = AlignValue( m_BlockSize, ( nAlignment != 0 ) ? nAlignment : 1 );
+	m_nMagazineSize = clamp( 4096 / m_BlockSize, 8, 64 );
+
+	m_nPeakAlloc = 0;
+	m_nDepotRefills = m_nDepotFlushes = m_nBlobRefills = m_nContended = 0;
+	ResetCaches();
+
+	AUTO_LOCK( s_PoolsMutex );
+	m_pNextPool = s_pFirstPool;
+	s_pFirstPool = this;
+}
+
+CMemoryPoolTS::~CMemoryPoolTS()
+{
+	{
+		AUTO_LOCK( s_PoolsMutex );
+		CMemoryPoolTS **ppPool = &s_pFirstPool;
+		while ( *ppPool != this )
+		{
+			ppPool = &(*ppPool)->m_pNextPool;
+		}
+		*ppPool = m_pNextPool;
+	}
+
+	Clear();
+
+	Magazine_t *pMagazine;
+	while ( ( pMagazine = (Magazine_t *)m_EmptyMagazines.Pop() ) != NULL )
+	{
+		MemAlloc_FreeAligned( pMagazine );
+	}
+}
+
+void CMemoryPoolTS::ResetCaches()
+{
+	V_memset( &m_SharedCache, 0, sizeof( m_SharedCache ) );
+	V_memset( m_ThreadCaches, 0, sizeof( m_ThreadCaches ) );
+}
+
+//-----------------------------------------------------------------------------
+// Frees everything. The depot's blocks belong to the blobs, so only the
+// magazine headers are kept.
+//-----------------------------------------------------------------------------
+void CMemoryPoolTS::Clear()
+{
+	Magazine_t *pMagazine;
+	while ( ( pMagazine = (Magazine_t *)m_Depot.Pop() ) != NULL )
+	{
+		m_EmptyMagazines.Push( pMagazine );
+	}
+
+	m_Blobs.Clear();
+	ResetCaches();
+
+	m_nPeakAlloc = 0;
+	m_nDepotRefills = m_nDepotFlushes = m_nBlobRefills = m_nContended = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Returns the calling thread's cache, NULL if it has to use the shared one
+//-----------------------------------------------------------------------------
+CMemoryPoolTS::ThreadCache_t *CMemoryPoolTS::GetThreadCache()
+{
+#ifndef NO_THREAD_LOCAL
+	int iSlot = s_iMemoryPoolThreadSlot;
+	if ( !iSlot )
+	{
+		// Used from another static's constructor, ask again once the slots are set up
+		if ( !s_MemoryPoolThreadSlots.IsReady() )
+			return NULL;
+
+		iSlot = s_MemoryPoolThreadSlots.Acquire() + 1;
+		if ( !iSlot )
+		{
+			iSlot = -1;
+		}
+		s_iMemoryPoolThreadSlot = iSlot;
+	}
+
+	if ( iSlot > 0 )
+	{
+		return &m_ThreadCaches[iSlot - 1].cache;
+	}
+#endif
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Called on a thread that's exiting. Its magazines go to each pool's depot so
+// other threads can use them, and its slot goes to the next new thread.
+//-----------------------------------------------------------------------------
+void CMemoryPoolTS::ReleaseThreadSlot( int iSlot )
+{
+#ifndef NO_THREAD_LOCAL
+	// Anything freed from here on, say by other thread exit hooks, goes to the shared cache
+	s_iMemoryPoolThreadSlot = -1;
+#endif
+
+	AUTO_LOCK( s_PoolsMutex );
+	for ( CMemoryPoolTS *pPool = s_pFirstPool; pPool; pPool = pPool->m_pNextPool )
+	{
+		// The count of blocks it still has out stays with the slot
+		ThreadCache_t &cache = pPool->m_ThreadCaches[iSlot].cache;
+		if ( cache.nPrevious )
+		{
+			pPool->Flush( cache );
+		}
+
+		if ( cache.nLoaded )
+		{
+			V_swap( cache.pLoaded, cache.pPrevious );
+			V_swap( cache.nLoaded, cache.nPrevious );
+			pPool->Flush( cache );
+		}
+	}
+}
+
+void CMemoryPoolTS::LockContended( CThreadFastMutex &mutex )
+{
+	if ( !mutex.TryLock() )
+	{
+		ThreadInterlockedIncrement( &m_nContended );
+		mutex.Lock();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Loads a full magazine into an empty cache, from the depot if it has one
+//-----------------------------------------------------------------------------
+bool CMemoryPoolTS::Refill( ThreadCache_t &cache )
+{
+	Magazine_t *pMagazine = (Magazine_t *)m_Depot.Pop();
+	if ( pMagazine )
+	{
+		cache.pLoaded = pMagazine->m_pBlocks;
+		cache.nLoaded = pMagazine->m_nBlocks;
+		m_EmptyMagazines.Push( pMagazine );
+		ThreadInterlockedIncrement( &m_nDepotRefills );
+	}
+	else
+	{
+		void *pBlocks = NULL;
+		int nBlocks = 0;
+
+		LockContended( m_BlobMutex );
+		while ( nBlocks < m_nMagazineSize )
+		{
+			void *pBlock = m_Blobs.Alloc();
+			if ( !pBlock )
+				break;
+
+			*((void**)pBlock) = pBlocks;
+			pBlocks = pBlock;
+			nBlocks++;
+		}
+		m_BlobMutex.Unlock();
+
+		if ( !nBlocks )
+			return false;
+
+		cache.pLoaded = pBlocks;
+		cache.nLoaded = nBlocks;
+		ThreadInterlockedIncrement( &m_nBlobRefills );
+	}
+
+	// The count only goes up between refills by what the caches held
+	int nCount = Count();
+	int nPeak = m_nPeakAlloc;
+	while ( nCount > nPeak && !ThreadInterlockedAssignIf( &m_nPeakAlloc, nCount, nPeak ) )
+	{
+		nPeak = m_nPeakAlloc;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Hands the cache's full previous magazine to the depot
+//-----------------------------------------------------------------------------
+void CMemoryPoolTS::Flush( ThreadCache_t &cache )
+{
+	Magazine_t *pMagazine = (Magazine_t *)m_EmptyMagazines.Pop();
+	if ( !pMagazine )
+	{
+		MEM_ALLOC_CREDIT_( "CMemoryPoolTS magazines" );
+		pMagazine = (Magazine_t *)MemAlloc_AllocAligned( sizeof( Magazine_t ), TSLIST_NODE_ALIGNMENT );
+	}
+
+	pMagazine->m_pBlocks = cache.pPrevious;
+	pMagazine->m_nBlocks = cache.nPrevious;
+	m_Depot.Push( pMagazine );
+
+	cache.pPrevious = NULL;
+	cache.nPrevious = 0;
+	ThreadInterlockedIncrement( &m_nDepotFlushes );
+}
+
+void *CMemoryPoolTS::AllocFromCache( ThreadCache_t &cache )
+{
+	if ( !cache.nLoaded )
+	{
+		if ( cache.nPrevious )
+		{
+			V_swap( cache.pLoaded, cache.pPrevious );
+			V_swap( cache.nLoaded, cache.nPrevious );
+		}
+		else if ( !Refill( cache ) )
+		{
+			return NULL;
+		}
+	}
+
+	void *pBlock = cache.pLoaded;
+	cache.pLoaded = *((void**)pBlock);
+	cache.nLoaded--;
+	cache.nOutstanding++;
+	return pBlock;
+}
+
+void CMemoryPoolTS::FreeToCache( ThreadCache_t &cache, void *pMem )
+{
+	if ( cache.nLoaded >= m_nMagazineSize )
+	{
+		if ( cache.nPrevious )
+		{
+			Flush( cache );
+		}
+
+		V_swap( cache.pLoaded, cache.pPrevious );
+		V_swap( cache.nLoaded, cache.nPrevious );
+	}
+
+	*((void**)pMem) = cache.pLoaded;
+	cache.pLoaded = pMem;
+	cache.nLoaded++;
+	cache.nOutstanding--;
+}
+
+void* CMemoryPoolTS::Alloc()
+{
+	return Alloc( m_BlockSize );
+}
+
+void* CMemoryPoolTS::AllocZero()
+{
+	return AllocZero( m_BlockSize );
+}
+
+void *CMemoryPoolTS::Alloc( size_t amount )
+{
+	if ( amount > (unsigned int)m_BlockSize )
+		return NULL;
+
+	ThreadCache_t *pCache = GetThreadCache();
+	if ( pCache )
+		return AllocFromCache( *pCache );
+
+	LockContended( m_SharedCacheMutex );
+	void *pBlock = AllocFromCache( m_SharedCache );
+	m_SharedCacheMutex.Unlock();
+	return pBlock;
+}
+
+void *CMemoryPoolTS::AllocZero( size_t amount )
+{
+	void *mem = Alloc( amount );
+	if ( mem )
+	{
+		V_memset( mem, 0x00, amount );
+	}
+	return mem;
+}
+
+void CMemoryPoolTS::Free( void *pMem )
+{
+	if ( !pMem )
+		return;
+
+#ifdef _DEBUG
+	memset( pMem, 0xDD, m_BlockSize );
+#endif
+
+	ThreadCache_t *pCache = GetThreadCache();
+	if ( pCache )
+	{
+		FreeToCache( *pCache, pMem );
+		return;
+	}
+
+	LockContended( m_SharedCacheMutex );
+	FreeToCache( m_SharedCache, pMem );
+	m_SharedCacheMutex.Unlock();
+}
+
+int CMemoryPoolTS::Count() const
+{
+	int nCount = m_SharedCache.nOutstanding;
+	for ( int i = 0; i < MEMPOOL_TS_MAX_THREADS; i++ )
+	{
+		nCount += m_ThreadCaches[i].cache.nOutstanding;
+	}
+	return nCount;
+}
+
+void CMemoryPoolTS::GetStats( MemoryPoolTSStats_t &stats ) const
+{
+	stats.nOutstanding = Count();
+	stats.nPeakOutstanding = MAX( (int)m_nPeakAlloc, stats.nOutstanding );
+	stats.nBlobs = m_Blobs.NumBlobs();
+	stats.nDepotRefills = m_nDepotRefills;
+	stats.nDepotFlushes = m_nDepotFlushes;
+	stats.nBlobRefills = m_nBlobRefills;
+	stats.nContended = m_nContended;
+}
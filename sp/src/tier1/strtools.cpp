@@ -69,6 +69,7 @@
 #include "tier1/strtools.h"
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <time.h>
 #include "tier0/basetypes.h"
 #include "tier1/utldict.h"
@@ -92,6 +93,154 @@ static int FastToLower( char c )
 	return i;
 }
 
+//-----------------------------------------------------------------------------
+// SSE2 scanning for the case-insensitive compares and searches. Each 16 byte
+// block is only used to find where the scalar code would stop (a folded
+// mismatch, a candidate match or the terminator); the scalar code then makes
+// the same decision it always has, so results don't change. Folding is ASCII
+// only, A-Z to a-z, which is all the scalar versions fold below 0x80.
+//
+// Loads never cross into a page the scalar code wouldn't have touched.
+//-----------------------------------------------------------------------------
+#if ( defined( _WIN32 ) && !defined( _X360 ) ) || ( defined( GNUC ) && ( defined( __i386__ ) || defined( __x86_64__ ) ) )
+#define STRTOOLS_SSE2
+#endif
+
+#ifdef STRTOOLS_SSE2
+
+#include <emmintrin.h>
+#ifdef _WIN32
+#include <intrin.h>
+#pragma intrinsic(_BitScanForward)
+#endif
+
+#define STRTOOLS_PAGE_SIZE	4096
+
+static inline int LowestSetBit( unsigned int nMask )
+{
+#ifdef _WIN32
+	unsigned long nBit;
+	_BitScanForward( &nBit, nMask );
+	return (int)nBit;
+#else
+	return __builtin_ctz( nMask );
+#endif
+}
+
+// True if a 16 byte load at p stays in p's page
+static inline bool CanLoad16( const void *p )
+{
+	return ( (uintp)p & ( STRTOOLS_PAGE_SIZE - 1 ) ) <= STRTOOLS_PAGE_SIZE - 16;
+}
+
+static inline __m128i FoldASCIIToLower_SSE2( __m128i v )
+{
+	// 'A'..'Z' land on -128..-103 after the bias, which signed compares can pick out
+	__m128i biased = _mm_add_epi8( v, _mm_set1_epi8( (char)( 0x80 - 'A' ) ) );
+	__m128i upper = _mm_cmplt_epi8( biased, _mm_set1_epi8( (char)( 0x80 + 26 ) ) );
+	return _mm_or_si128( v, _mm_and_si128( upper, _mm_set1_epi8( 0x20 ) ) );
+}
+
+static inline unsigned char FoldASCIIToLower( unsigned char c )
+{
+	return ( (unsigned char)( c - 'A' ) <= ( 'Z' - 'A' ) ) ? ( c | 0x20 ) : c;
+}
+
+//-----------------------------------------------------------------------------
+// Number of leading bytes (at most nMax) that are non-zero in s1 and the same
+// as s2 after folding, which V_stricmp and V_strnicmp step over without
+// deciding anything. Stops early, never late.
+//-----------------------------------------------------------------------------
+static int SkipCaselessEqual_SSE2( const unsigned char *s1, const unsigned char *s2, int nMax )
+{
+	const __m128i zero = _mm_setzero_si128();
+	int nSkipped = 0;
+
+	while ( nMax - nSkipped >= 16 )
+	{
+		if ( !CanLoad16( s1 + nSkipped ) || !CanLoad16( s2 + nSkipped ) )
+		{
+			// One byte at a time up to the page boundary, as the scalar code would read them
+			unsigned char c = s1[nSkipped];
+			if ( !c || FoldASCIIToLower( c ) != FoldASCIIToLower( s2[nSkipped] ) )
+				return nSkipped;
+			nSkipped++;
+			continue;
+		}
+
+		__m128i a = _mm_loadu_si128( (const __m128i *)( s1 + nSkipped ) );
+		__m128i b = _mm_loadu_si128( (const __m128i *)( s2 + nSkipped ) );
+
+		unsigned int nSame = _mm_movemask_epi8( _mm_cmpeq_epi8( FoldASCIIToLower_SSE2( a ), FoldASCIIToLower_SSE2( b ) ) );
+		unsigned int nStop = ( ~nSame & 0xffff ) | _mm_movemask_epi8( _mm_cmpeq_epi8( a, zero ) );
+		if ( nStop )
+			return nSkipped + LowestSetBit( nStop );
+
+		nSkipped += 16;
+	}
+
+	return nSkipped;
+}
+
+//-----------------------------------------------------------------------------
+// First byte at or after p that is c1, c2 or the terminator. With nMax >= 0,
+// gives up (returning NULL) once nMax bytes have been searched, though a stop
+// found further into the last block may be returned. Blocks are aligned, so
+// they never cross pages.
+//-----------------------------------------------------------------------------
+static const unsigned char *FindCharOrEnd_SSE2( const unsigned char *p, unsigned char c1, unsigned char c2, int nMax )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i v1 = _mm_set1_epi8( (char)c1 );
+	const __m128i v2 = _mm_set1_epi8( (char)c2 );
+
+	const unsigned char *pBlock = (const unsigned char *)( (uintp)p & ~(uintp)15 );
+	__m128i v = _mm_load_si128( (const __m128i *)pBlock );
+	unsigned int nStop = _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, v1 ), _mm_cmpeq_epi8( v, v2 ) ), _mm_cmpeq_epi8( v, zero ) ) );
+
+	// Ignore the bytes before p
+	nStop &= 0xffff << ( p - pBlock );
+
+	while ( !nStop )
+	{
+		pBlock += 16;
+		if ( nMax >= 0 && pBlock - p >= nMax )
+			return NULL;
+
+		v = _mm_load_si128( (const __m128i *)pBlock );
+		nStop = _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, v1 ), _mm_cmpeq_epi8( v, v2 ) ), _mm_cmpeq_epi8( v, zero ) ) );
+	}
+
+	return pBlock + LowestSetBit( nStop );
+}
+
+#endif // STRTOOLS_SSE2
+
+static int s_nStringSIMD = -1;	// -1 until the CPU has been checked
+
+bool V_IsStringSIMDEnabled()
+{
+	if ( s_nStringSIMD < 0 )
+	{
+#ifdef STRTOOLS_SSE2
+		s_nStringSIMD = GetCPUInformation()->m_bSSE2 ? 1 : 0;
+#else
+		s_nStringSIMD = 0;
+#endif
+	}
+
+	return s_nStringSIMD != 0;
+}
+
+void V_SetStringSIMDEnabled( bool bEnabled )
+{
+	s_nStringSIMD = -1;
+	if ( !bEnabled || !V_IsStringSIMDEnabled() )
+	{
+		s_nStringSIMD = 0;
+	}
+}
+
 void _V_memset (const char* file, int line, void *dest, int fill, int count)
 {
 	Assert( count >= 0 );
@@ -269,6 +418,14 @@ int V_stricmp( const char *str1, const char *str2 )
 	}
 	const unsigned char *s1 = (const unsigned char*)str1;
 	const unsigned char *s2 = (const unsigned char*)str2;
+#ifdef STRTOOLS_SSE2
+	if ( V_IsStringSIMDEnabled() )
+	{
+		int nSkip = SkipCaselessEqual_SSE2( s1, s2, INT_MAX );
+		s1 += nSkip;
+		s2 += nSkip;
+	}
+#endif
 	for ( ; *s1; ++s1, ++s2 )
 	{
 		if ( *s1 != *s2 )
@@ -294,6 +451,15 @@ int V_strnicmp( const char *str1, const char *str2, int n )
 {
 	const unsigned char *s1 = (const unsigned char*)str1;
 	const unsigned char *s2 = (const unsigned char*)str2;
+#ifdef STRTOOLS_SSE2
+	if ( n >= 16 && V_IsStringSIMDEnabled() )
+	{
+		int nSkip = SkipCaselessEqual_SSE2( s1, s2, n );
+		s1 += nSkip;
+		s2 += nSkip;
+		n -= nSkip;
+	}
+#endif
 	for ( ; n > 0 && *s1; --n, ++s1, ++s2 )
 	{
 		if ( *s1 != *s2 )
@@ -624,9 +790,25 @@ char const* V_stristr( char const* pStr, char const* pSearch )
 
 	char const* pLetter = pStr;
 
+#ifdef STRTOOLS_SSE2
+	// Jump between the places the first character matches. Above 0x80 FastToLower() depends on the locale.
+	unsigned char cLower = FoldASCIIToLower( (unsigned char)*pSearch );
+	unsigned char cUpper = ( cLower >= 'a' && cLower <= 'z' ) ? ( cLower & ~0x20 ) : cLower;
+	bool bSIMD = cLower != 0 && cLower < 0x80 && V_IsStringSIMDEnabled();
+#endif
+
 	// Check the entire string
 	while (*pLetter != 0)
 	{
+#ifdef STRTOOLS_SSE2
+		if ( bSIMD )
+		{
+			pLetter = (char const*)FindCharOrEnd_SSE2( (const unsigned char*)pLetter, cLower, cUpper, -1 );
+			if ( *pLetter == 0 )
+				return 0;
+		}
+#endif
+
 		// Skip over non-matches
 		if (FastToLower((unsigned char)*pLetter) == FastToLower((unsigned char)*pSearch))
 		{
@@ -679,9 +861,27 @@ char const* V_strnistr( char const* pStr, char const* pSearch, int n )
 
 	char const* pLetter = pStr;
 
+#ifdef STRTOOLS_SSE2
+	unsigned char cLower = FoldASCIIToLower( (unsigned char)*pSearch );
+	unsigned char cUpper = ( cLower >= 'a' && cLower <= 'z' ) ? ( cLower & ~0x20 ) : cLower;
+	bool bSIMD = cLower != 0 && cLower < 0x80 && n > 0 && V_IsStringSIMDEnabled();
+#endif
+
 	// Check the entire string
 	while (*pLetter != 0)
 	{
+#ifdef STRTOOLS_SSE2
+		if ( bSIMD )
+		{
+			// Anything skipped wasn't a match, so only the count needs catching up
+			char const* pNext = (char const*)FindCharOrEnd_SSE2( (const unsigned char*)pLetter, cLower, cUpper, n );
+			if ( !pNext || *pNext == 0 )
+				return 0;
+			n -= pNext - pLetter;
+			pLetter = pNext;
+		}
+#endif
+
 		if ( n <= 0 )
 			return 0;
 
@@ -727,6 +927,14 @@ const char* V_strnchr( const char* pStr, char c, int n )
 	char const* pLetter = pStr;
 	char const* pLast = pStr + n;
 
+#ifdef STRTOOLS_SSE2
+	if ( n > 0 && V_IsStringSIMDEnabled() )
+	{
+		pLetter = (char const*)FindCharOrEnd_SSE2( (const unsigned char*)pStr, (unsigned char)c, (unsigned char)c, n );
+		return ( pLetter && pLetter < pLast && *pLetter != 0 ) ? pLetter : NULL;
+	}
+#endif
+
 	// Check the entire string
 	while ( (pLetter < pLast) && (*pLetter != 0) )
 	{
@@ -0,0 +1,536 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Fine-grained work-stealing tasks on top of the job thread pool.
+//
+//=============================================================================//
+
+#include "tier1/taskpool.h"
+#include "tier1/threadslots.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+// How long a borrowed pool thread looks for work before going back to the pool,
+// and how long Wait() spins before it starts yielding
+#define TASKPOOL_HELPER_SPINS	4000
+#define TASKPOOL_WAIT_SPINS		200
+
+CTaskPool g_TaskPool;
+
+// A thread gets a deque the first time it uses a task pool and keeps the same
+// one in every pool until it exits. Tasks it leaves behind can still be stolen,
+// and the deque goes to the next new thread.
+#ifndef NO_THREAD_LOCAL
+static THREAD_LOCAL int s_iTaskPoolThreadSlot;	// slot + 1, -1 for none, 0 until assigned
+
+static void ReleaseTaskPoolThreadSlot( int iSlot )
+{
+	s_iTaskPoolThreadSlot = -1;
+}
+#else
+#define ReleaseTaskPoolThreadSlot NULL
+#endif
+
+static CThreadSlots s_TaskPoolThreadSlots( TASKPOOL_MAX_THREADS, ReleaseTaskPoolThreadSlot );
+
+//-----------------------------------------------------------------------------
+// Runs tasks on a pool thread until there aren't any left
+//-----------------------------------------------------------------------------
+class CTaskPool::CHelperJob : public CJob
+{
+public:
+	CHelperJob( CTaskPool *pPool ) : m_pPool( pPool ) {}
+
+	virtual JobStatus_t DoExecute()
+	{
+		m_pPool->RunHelper();
+		return JOB_OK;
+	}
+
+private:
+	CTaskPool *m_pPool;
+};
+
+//-----------------------------------------------------------------------------
+
+CTaskPool::CTaskPool() :
+	m_TaskAllocator( 256 )
+{
+	m_nHelpers = 0;
+	m_nMaxHelpers = -1;
+	m_nSharedTasks = 0;
+	V_memset( m_Deques, 0, sizeof( m_Deques ) );
+	ResetStats();
+}
+
+CTaskPool::TaskDeque_t *CTaskPool::GetThreadDeque()
+{
+#ifndef NO_THREAD_LOCAL
+	int iSlot = s_iTaskPoolThreadSlot;
+	if ( !iSlot )
+	{
+		// Used from another static's constructor, ask again once the slots are set up
+		if ( !s_TaskPoolThreadSlots.IsReady() )
+			return NULL;
+
+		iSlot = s_TaskPoolThreadSlots.Acquire() + 1;
+		if ( !iSlot )
+		{
+			iSlot = -1;
+		}
+		s_iTaskPoolThreadSlot = iSlot;
+	}
+
+	if ( iSlot > 0 )
+	{
+		return &m_Deques[iSlot - 1];
+	}
+#endif
+	return NULL;
+}
+
+void CTaskPool::UpdateMaxHelpers()
+{
+	// The pool may be started or resized after the first task, so check each time work starts
+	int nMaxHelpers = ( g_pThreadPool ) ? g_pThreadPool->NumThreads() : 0;
+	m_nMaxHelpers = MIN( nMaxHelpers, TASKPOOL_MAX_THREADS - 1 );
+}
+
+int CTaskPool::NumThreads()
+{
+	UpdateMaxHelpers();
+	return m_nMaxHelpers + 1;
+}
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+void CTaskPool::StartHelper()
+{
+	// More helpers are only worth it if there are threads free to run them, but
+	// there's always at least one while tasks are queued. Otherwise a task
+	// nobody waits for could sit in a deque forever. If the pool is busy the
+	// helper runs as soon as a thread frees up.
+	int nHelpers = m_nHelpers;
+	if ( nHelpers >= m_nMaxHelpers || ( nHelpers > 0 && !g_pThreadPool->NumIdleThreads() ) )
+		return;
+
+	// Losing this race means another thread just started one, which will do for now
+	if ( !ThreadInterlockedAssignIf( &m_nHelpers, nHelpers + 1, nHelpers ) )
+		return;
+
+	ThreadInterlockedIncrement( &m_nHelpersStarted );
+
+	CJob *pJob = new CHelperJob( this );
+	g_pThreadPool->AddJob( pJob );
+	pJob->Release();
+}
+
+void CTaskPool::RunHelper()
+{
+	TaskDeque_t *pDeque = GetThreadDeque();
+
+	for ( ;; )
+	{
+		int nSpins = 0;
+		while ( nSpins < TASKPOOL_HELPER_SPINS )
+		{
+			TaskPoolTask_t *pTask = FindTask( pDeque );
+			if ( pTask )
+			{
+				Execute( pTask, pDeque );
+				nSpins = 0;
+			}
+			else
+			{
+				ThreadPause();
+				nSpins++;
+			}
+		}
+
+		ThreadInterlockedDecrement( &m_nHelpers );
+
+		// A task queued while this thread was leaving may have seen the old
+		// helper count and not started anyone, so look once more
+		if ( !HasTasks() )
+			return;
+
+		int nHelpers = m_nHelpers;
+		if ( nHelpers >= m_nMaxHelpers || !ThreadInterlockedAssignIf( &m_nHelpers, nHelpers + 1, nHelpers ) )
+			return;
+	}
+}
+
+bool CTaskPool::HasTasks() const
+{
+	if ( m_nSharedTasks )
+		return true;
+
+	for ( int i = 0; i < TASKPOOL_MAX_THREADS; i++ )
+	{
+		if ( (int)( m_Deques[i].nBottom - m_Deques[i].nTop ) > 0 )
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Queues
+//-----------------------------------------------------------------------------
+TaskPoolTask_t *CTaskPool::AllocTask( TaskFunc_t pfnTask, TaskRangeFunc_t pfnRange, void *pContext, int iBegin, int iEnd, int nGrain, CTaskCounter *pCounter )
+{
+	TaskPoolTask_t *pTask = m_TaskAllocator.Alloc();
+	pTask->pfnTask = pfnTask;
+	pTask->pfnRange = pfnRange;
+	pTask->pContext = pContext;
+	pTask->iBegin = iBegin;
+	pTask->iEnd = iEnd;
+	pTask->nGrain = nGrain;
+	pTask->pCounter = pCounter;
+	pTask->pNext = NULL;
+	pTask->iQueuedBy = 0;
+	return pTask;
+}
+
+bool CTaskPool::Push( TaskPoolTask_t *pTask, TaskDeque_t *pDeque )
+{
+	if ( pDeque )
+	{
+		unsigned nBottom = pDeque->nBottom;
+		if ( (int)( nBottom - pDeque->nTop ) >= TASKPOOL_DEQUE_SIZE )
+			return false;
+
+		pTask->iQueuedBy = (int)( pDeque - m_Deques ) + 1;
+		pDeque->pTasks[nBottom & ( TASKPOOL_DEQUE_SIZE - 1 )] = pTask;
+
+		// Interlocked so the task is visible before the helper count is read below
+		ThreadInterlockedExchange( &pDeque->nBottom, nBottom + 1 );
+	}
+	else
+	{
+		AUTO_LOCK( m_SharedMutex );
+		m_SharedTasks.AddToTail( pTask );
+		m_nSharedTasks = m_SharedTasks.Count();
+	}
+
+	if ( m_nHelpers < m_nMaxHelpers )
+	{
+		StartHelper();
+	}
+	return true;
+}
+
+void CTaskPool::Queue( TaskPoolTask_t *pTask, TaskDeque_t *pDeque )
+{
+	if ( m_nMaxHelpers < 0 )
+	{
+		UpdateMaxHelpers();
+	}
+
+	if ( m_nMaxHelpers > 0 && Push( pTask, pDeque ) )
+		return;
+
+	if ( pDeque )
+	{
+		pDeque->nRanInline++;
+	}
+	else
+	{
+		ThreadInterlockedIncrement( &m_nSharedRanInline );
+	}
+	Execute( pTask, pDeque );
+}
+
+TaskPoolTask_t *CTaskPool::Pop( TaskDeque_t *pDeque )
+{
+	unsigned nBottom = pDeque->nBottom - 1;
+	ThreadInterlockedExchange( &pDeque->nBottom, nBottom );
+
+	unsigned nTop = pDeque->nTop;
+	int nLeft = (int)( nBottom - nTop );
+	if ( nLeft < 0 )
+	{
+		pDeque->nBottom = nBottom + 1;
+		return NULL;
+	}
+
+	TaskPoolTask_t *pTask = pDeque->pTasks[nBottom & ( TASKPOOL_DEQUE_SIZE - 1 )];
+	if ( nLeft > 0 )
+		return pTask;
+
+	// This is the last one, which a thief may be taking too
+	if ( !ThreadInterlockedAssignIf( &pDeque->nTop, nTop + 1, nTop ) )
+	{
+		pTask = NULL;
+	}
+	pDeque->nBottom = nBottom + 1;
+	return pTask;
+}
+
+TaskPoolTask_t *CTaskPool::Steal( TaskDeque_t &deque )
+{
+	unsigned nTop = deque.nTop;
+	ThreadMemoryBarrier();
+	unsigned nBottom = deque.nBottom;
+	if ( (int)( nBottom - nTop ) <= 0 )
+		return NULL;
+
+	TaskPoolTask_t *pTask = deque.pTasks[nTop & ( TASKPOOL_DEQUE_SIZE - 1 )];
+	if ( !ThreadInterlockedAssignIf( &deque.nTop, nTop + 1, nTop ) )
+		return NULL;
+
+	return pTask;
+}
+
+TaskPoolTask_t *CTaskPool::FindTask( TaskDeque_t *pDeque )
+{
+	if ( pDeque )
+	{
+		TaskPoolTask_t *pTask = Pop( pDeque );
+		if ( pTask )
+			return pTask;
+	}
+
+	if ( m_nSharedTasks )
+	{
+		AUTO_LOCK( m_SharedMutex );
+		if ( m_SharedTasks.Count() )
+		{
+			TaskPoolTask_t *pTask = m_SharedTasks.Tail();
+			m_SharedTasks.RemoveMultipleFromTail( 1 );
+			m_nSharedTasks = m_SharedTasks.Count();
+			return pTask;
+		}
+	}
+
+	// Start with the next thread along so thieves don't all pile onto the same deque
+	int nDeques = s_TaskPoolThreadSlots.GetLimit();
+	int iFirst = ( pDeque ) ? (int)( pDeque - m_Deques ) + 1 : 0;
+	for ( int i = 0; i < nDeques; i++ )
+	{
+		TaskDeque_t &victim = m_Deques[( iFirst + i ) % nDeques];
+		if ( &victim == pDeque )
+			continue;
+
+		TaskPoolTask_t *pTask = Steal( victim );
+		if ( pTask )
+			return pTask;
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Running tasks
+//-----------------------------------------------------------------------------
+void CTaskPool::Execute( TaskPoolTask_t *pTask, TaskDeque_t *pDeque )
+{
+	if ( pDeque )
+	{
+		pDeque->nExecuted++;
+		if ( pTask->iQueuedBy && pTask->iQueuedBy != (int)( pDeque - m_Deques ) + 1 )
+		{
+			pDeque->nStolen++;
+		}
+	}
+	else
+	{
+		ThreadInterlockedIncrement( &m_nSharedExecuted );
+	}
+
+	if ( pTask->pfnRange )
+	{
+		// Split off the right half for someone else until what's left is small enough
+		int iBegin = pTask->iBegin;
+		int iEnd = pTask->iEnd;
+		while ( iEnd - iBegin > pTask->nGrain )
+		{
+			int iMid = iBegin + ( iEnd - iBegin ) / 2;
+
+			ThreadInterlockedIncrement( &pTask->pCounter->m_nPending );
+			TaskPoolTask_t *pRight = AllocTask( NULL, pTask->pfnRange, pTask->pContext, iMid, iEnd, pTask->nGrain, pTask->pCounter );
+			if ( !Push( pRight, pDeque ) )
+			{
+				// Full, so run the rest here. This task still holds the counter open.
+				ThreadInterlockedDecrement( &pTask->pCounter->m_nPending );
+				m_TaskAllocator.Free( pRight );
+				break;
+			}
+			iEnd = iMid;
+		}
+
+		pTask->pfnRange( pTask->pContext, iBegin, iEnd );
+	}
+	else
+	{
+		pTask->pfnTask( pTask->pContext );
+	}
+
+	CTaskCounter *pCounter = pTask->pCounter;
+	m_TaskAllocator.Free( pTask );
+	Finish( pCounter, pDeque );
+}
+
+void CTaskPool::Finish( CTaskCounter *pCounter, TaskDeque_t *pDeque )
+{
+	if ( !pCounter )
+		return;
+
+	// Not the last one, so nothing is waiting on this
+	for ( ;; )
+	{
+		int nPending = pCounter->m_nPending;
+		Assert( nPending > 0 );
+		if ( nPending == 1 )
+			break;
+		if ( ThreadInterlockedAssignIf( &pCounter->m_nPending, nPending - 1, nPending ) )
+			return;
+	}
+
+	// Drop to zero under the lock so no continuation is added after they're
+	// released, and so Wait() can't return while the counter is still in use
+	TaskPoolTask_t *pContinuations;
+	{
+		AUTO_LOCK( pCounter->m_Mutex );
+		if ( ThreadInterlockedDecrement( &pCounter->m_nPending ) )
+			return;
+
+		pContinuations = pCounter->m_pContinuations;
+		pCounter->m_pContinuations = NULL;
+	}
+
+	while ( pContinuations )
+	{
+		TaskPoolTask_t *pNext = pContinuations->pNext;
+		pContinuations->pNext = NULL;
+		Queue( pContinuations, pDeque );
+		pContinuations = pNext;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTaskPool::AddTask( TaskFunc_t pfnTask, void *pContext, CTaskCounter *pCounter )
+{
+	Assert( pfnTask );
+
+	if ( pCounter )
+	{
+		ThreadInterlockedIncrement( &pCounter->m_nPending );
+	}
+
+	Queue( AllocTask( pfnTask, NULL, pContext, 0, 0, 0, pCounter ), GetThreadDeque() );
+}
+
+void CTaskPool::AddTaskAfter( CTaskCounter *pDependency, TaskFunc_t pfnTask, void *pContext, CTaskCounter *pCounter )
+{
+	Assert( pfnTask && pDependency != pCounter );
+
+	if ( pCounter )
+	{
+		ThreadInterlockedIncrement( &pCounter->m_nPending );
+	}
+
+	TaskPoolTask_t *pTask = AllocTask( pfnTask, NULL, pContext, 0, 0, 0, pCounter );
+
+	{
+		AUTO_LOCK( pDependency->m_Mutex );
+		if ( pDependency->m_nPending )
+		{
+			pTask->pNext = pDependency->m_pContinuations;
+			pDependency->m_pContinuations = pTask;
+			return;
+		}
+	}
+
+	Queue( pTask, GetThreadDeque() );
+}
+
+void CTaskPool::Wait( CTaskCounter *pCounter )
+{
+	TaskDeque_t *pDeque = GetThreadDeque();
+
+	int nSpins = 0;
+	while ( pCounter->m_nPending )
+	{
+		TaskPoolTask_t *pTask = FindTask( pDeque );
+		if ( pTask )
+		{
+			Execute( pTask, pDeque );
+			nSpins = 0;
+		}
+		else if ( ++nSpins < TASKPOOL_WAIT_SPINS )
+		{
+			ThreadPause();
+		}
+		else
+		{
+			ThreadSleep( 0 );
+		}
+	}
+
+	// The last task may still be releasing continuations; once it lets go of
+	// the lock the counter is free to go away
+	AUTO_LOCK( pCounter->m_Mutex );
+}
+
+void CTaskPool::ParallelFor( int nCount, TaskRangeFunc_t pfnRange, void *pContext, int nGrain )
+{
+	if ( nCount <= 0 )
+		return;
+
+	UpdateMaxHelpers();
+
+	if ( nGrain <= 0 )
+	{
+		nGrain = MAX( nCount / ( ( m_nMaxHelpers + 1 ) * 4 ), 1 );
+	}
+
+	if ( nCount <= nGrain || m_nMaxHelpers == 0 )
+	{
+		pfnRange( pContext, 0, nCount );
+		return;
+	}
+
+	// Run the whole range here; it hands off right halves as it splits
+	CTaskCounter counter;
+	counter.m_nPending = 1;
+
+	TaskDeque_t *pDeque = GetThreadDeque();
+	Execute( AllocTask( NULL, pfnRange, pContext, 0, nCount, nGrain, &counter ), pDeque );
+	Wait( &counter );
+}
+
+//-----------------------------------------------------------------------------
+// Stats
+//-----------------------------------------------------------------------------
+void CTaskPool::GetStats( TaskPoolStats_t &stats ) const
+{
+	stats.nExecuted = m_nSharedExecuted;
+	stats.nStolen = 0;
+	stats.nRanInline = m_nSharedRanInline;
+	stats.nHelpersStarted = m_nHelpersStarted;
+
+	for ( int i = 0; i < TASKPOOL_MAX_THREADS; i++ )
+	{
+		stats.nExecuted += m_Deques[i].nExecuted;
+		stats.nStolen += m_Deques[i].nStolen;
+		stats.nRanInline += m_Deques[i].nRanInline;
+	}
+}
+
+void CTaskPool::ResetStats()
+{
+	m_nHelpersStarted = 0;
+	m_nSharedExecuted = 0;
+	m_nSharedRanInline = 0;
+
+	for ( int i = 0; i < TASKPOOL_MAX_THREADS; i++ )
+	{
+		m_Deques[i].nExecuted = 0;
+		m_Deques[i].nStolen = 0;
+		m_Deques[i].nRanInline = 0;
+	}
+}
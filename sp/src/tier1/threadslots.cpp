@@ -0,0 +1,148 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Small per-thread indices that are given back when threads exit
+//
+//=============================================================================//
+
+#if defined( _WIN32 ) && !defined( _X360 )
+#include "winlite.h"
+#elif defined( POSIX )
+#include <pthread.h>
+#endif
+
+#include "tier1/threadslots.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+CThreadSlots::CThreadSlots( int nSlots, ReleaseFunc_t pfnRelease )
+{
+	m_nSlots = MIN( nSlots, THREADSLOTS_MAX );
+	m_pfnRelease = pfnRelease;
+}
+
+CThreadSlots::~CThreadSlots()
+{
+	// Threads still running when the module goes away keep their slots.
+	// Freeing the key may call OnFiberExit() for them on this thread.
+	m_bShutdown = true;
+
+	if ( m_bHasExitKey )
+	{
+#if defined( _WIN32 ) && !defined( _X360 )
+		FlsFree( (DWORD)m_ExitKey );
+#elif defined( POSIX )
+		pthread_key_delete( (pthread_key_t)m_ExitKey );
+#endif
+		m_bHasExitKey = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The key's value on each thread is its Slot_t, which the OS hands back when
+// the thread exits
+//-----------------------------------------------------------------------------
+bool CThreadSlots::CreateExitKey()
+{
+	if ( m_bHasExitKey )
+		return true;
+
+	AUTO_LOCK( m_ExitKeyMutex );
+	if ( !m_bHasExitKey )
+	{
+#if defined( _WIN32 ) && !defined( _X360 )
+		DWORD index = FlsAlloc( &OnFiberExit );
+		if ( index == FLS_OUT_OF_INDEXES )
+			return false;
+		m_ExitKey = index;
+#elif defined( POSIX )
+		pthread_key_t key;
+		if ( pthread_key_create( &key, &OnThreadExit ) != 0 )
+			return false;
+		m_ExitKey = (uintp)key;
+#else
+		return false;
+#endif
+		ThreadMemoryBarrier();
+		m_bHasExitKey = true;
+	}
+	return true;
+}
+
+int CThreadSlots::Acquire()
+{
+	// Without an exit hook a slot would never come back, so hand out none
+	if ( m_bShutdown || !CreateExitKey() )
+		return -1;
+
+	int iSlot;
+	for ( ;; )
+	{
+		unsigned nUsed = m_nUsed;
+		for ( iSlot = 0; iSlot < m_nSlots; iSlot++ )
+		{
+			if ( !( nUsed & ( 1u << iSlot ) ) )
+				break;
+		}
+
+		if ( iSlot == m_nSlots )
+			return -1;
+
+		if ( ThreadInterlockedAssignIf( &m_nUsed, nUsed | ( 1u << iSlot ), nUsed ) )
+			break;
+	}
+
+	int nLimit = m_nLimit;
+	while ( iSlot >= nLimit && !ThreadInterlockedAssignIf( &m_nLimit, iSlot + 1, nLimit ) )
+	{
+		nLimit = m_nLimit;
+	}
+
+	Slot_t *pSlot = &m_Slots[iSlot];
+	pSlot->pOwner = this;
+	pSlot->iSlot = iSlot;
+
+#if defined( _WIN32 ) && !defined( _X360 )
+	FlsSetValue( (DWORD)m_ExitKey, pSlot );
+#elif defined( POSIX )
+	pthread_setspecific( (pthread_key_t)m_ExitKey, pSlot );
+#endif
+
+	return iSlot;
+}
+
+//-----------------------------------------------------------------------------
+// Called on the exiting thread, which still owns the slot until its bit clears
+//-----------------------------------------------------------------------------
+void CThreadSlots::Release( int iSlot )
+{
+	if ( m_bShutdown )
+		return;
+
+	if ( m_pfnRelease )
+	{
+		m_pfnRelease( iSlot );
+	}
+
+	unsigned nUsed;
+	do
+	{
+		nUsed = m_nUsed;
+	} while ( !ThreadInterlockedAssignIf( &m_nUsed, nUsed & ~( 1u << iSlot ), nUsed ) );
+}
+
+void CThreadSlots::OnThreadExit( void *pSlot )
+{
+	if ( pSlot )
+	{
+		Slot_t *pThreadSlot = (Slot_t *)pSlot;
+		pThreadSlot->pOwner->Release( pThreadSlot->iSlot );
+	}
+}
+
+#ifdef _WIN32
+void __stdcall CThreadSlots::OnFiberExit( void *pSlot )
+{
+	OnThreadExit( pSlot );
+}
+#endif
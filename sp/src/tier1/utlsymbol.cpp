@@ -15,6 +15,7 @@
 #include "stringpool.h"
 #include "utlhashtable.h"
 #include "utlstring.h"
+#include "generichash.h"
 
 // Ensure that everybody has the right compiler version installed. The version
 // number can be obtained by looking at the compiler output when you type 'cl'
@@ -44,7 +45,7 @@
 // globals
 //-----------------------------------------------------------------------------
 
-CUtlSymbolTableMT* CUtlSymbol::s_pSymbolTable = 0; 
+CUtlConcurrentSymbolTable* CUtlSymbol::s_pSymbolTable = 0; 
 bool CUtlSymbol::s_bAllowStaticSymbolTable = true;
 
 
@@ -63,7 +64,7 @@ void CUtlSymbol::Initialize()
 	static bool symbolsInitialized = false;
 	if (!symbolsInitialized)
 	{
-		s_pSymbolTable = new CUtlSymbolTableMT;
+		s_pSymbolTable = new CUtlConcurrentSymbolTable;
 		symbolsInitialized = true;
 	}
 }
@@ -83,7 +84,7 @@ public:
 
 static CCleanupUtlSymbolTable g_CleanupSymbolTable;
 
-CUtlSymbolTableMT* CUtlSymbol::CurrTable()
+CUtlConcurrentSymbolTable* CUtlSymbol::CurrTable()
 {
 	Initialize();
 	return s_pSymbolTable; 
@@ -288,6 +289,217 @@ void CUtlSymbolTable::RemoveAll()
 }
 
 
+//-----------------------------------------------------------------------------
+// Concurrent symbol table
+//
+// Writers fill in the string and its block entry, then publish the hash slot
+// (or a whole new table) last. Readers load the slot or table pointer first,
+// so everything it refers to is already visible.
+//-----------------------------------------------------------------------------
+
+CUtlConcurrentSymbolTable::CUtlConcurrentSymbolTable( bool caseInsensitive ) :
+	m_bInsensitive( caseInsensitive ), m_pTable( NULL ), m_nStrings( 0 ), m_pPools( NULL )
+{
+	memset( (void *)m_pStringBlocks, 0, sizeof( m_pStringBlocks ) );
+	m_pTable = AllocTable( MIN_HASH_SLOTS );
+}
+
+CUtlConcurrentSymbolTable::~CUtlConcurrentSymbolTable()
+{
+	RemoveAll();
+
+	HashTable_t *pTable = m_pTable;
+	m_pTable = NULL;
+	free( pTable );
+}
+
+inline unsigned CUtlConcurrentSymbolTable::Hash( const char *pString ) const
+{
+	return m_bInsensitive ? HashStringCaseless( pString ) : HashString( pString );
+}
+
+CUtlConcurrentSymbolTable::HashTable_t *CUtlConcurrentSymbolTable::AllocTable( int nSlots )
+{
+	HashTable_t *pTable = (HashTable_t *)malloc( sizeof( HashTable_t ) + ( nSlots - 1 ) * sizeof( unsigned ) );
+	pTable->m_pRetired = NULL;
+	pTable->m_nMask = nSlots - 1;
+	memset( (void *)pTable->m_Slots, 0, nSlots * sizeof( unsigned ) );
+	return pTable;
+}
+
+UtlSymId_t CUtlConcurrentSymbolTable::FindInTable( const HashTable_t *pTable, const char *pString, unsigned nHash ) const
+{
+	unsigned nTag = nHash & 0xFFFF0000;
+	for ( unsigned i = nHash & pTable->m_nMask; ; i = ( i + 1 ) & pTable->m_nMask )
+	{
+		unsigned nSlot = pTable->m_Slots[i];
+		if ( !nSlot )
+			return UTL_INVAL_SYMBOL;
+
+		if ( ( nSlot & 0xFFFF0000 ) == nTag )
+		{
+			ThreadMemoryBarrier();
+
+			UtlSymId_t id = ( nSlot & 0xFFFF ) - 1;
+			const char *pSymbol = m_pStringBlocks[id / STRINGS_PER_BLOCK][id % STRINGS_PER_BLOCK];
+			if ( !( m_bInsensitive ? V_stricmp( pSymbol, pString ) : V_strcmp( pSymbol, pString ) ) )
+				return id;
+		}
+	}
+}
+
+void CUtlConcurrentSymbolTable::InsertIntoTable( HashTable_t *pTable, unsigned nHash, UtlSymId_t id )
+{
+	unsigned i = nHash & pTable->m_nMask;
+	while ( pTable->m_Slots[i] )
+	{
+		i = ( i + 1 ) & pTable->m_nMask;
+	}
+
+	// The string must be visible before the slot that leads to it
+	ThreadMemoryBarrier();
+	pTable->m_Slots[i] = ( nHash & 0xFFFF0000 ) | ( id + 1 );
+}
+
+const char *CUtlConcurrentSymbolTable::CopyString( const char *pString )
+{
+	int len = V_strlen( pString ) + 1;
+
+	StringPool_t *pPool = m_pPools;
+	if ( !pPool || pPool->m_nSize - pPool->m_nUsed < len )
+	{
+		// Pools are only appended to; the old one keeps whatever fit
+		int nSize = max( len, (int)MIN_STRING_POOL_SIZE );
+		pPool = (StringPool_t *)malloc( sizeof( StringPool_t ) + nSize - 1 );
+		pPool->m_pNext = m_pPools;
+		pPool->m_nSize = nSize;
+		pPool->m_nUsed = 0;
+		m_pPools = pPool;
+	}
+
+	char *pCopy = &pPool->m_Data[pPool->m_nUsed];
+	memcpy( pCopy, pString, len );
+	pPool->m_nUsed += len;
+	return pCopy;
+}
+
+CUtlSymbol CUtlConcurrentSymbolTable::Find( const char* pString ) const
+{
+	if ( !pString )
+		return CUtlSymbol();
+
+	const HashTable_t *pTable = m_pTable;
+	ThreadMemoryBarrier();
+
+	return CUtlSymbol( FindInTable( pTable, pString, Hash( pString ) ) );
+}
+
+CUtlSymbol CUtlConcurrentSymbolTable::AddString( const char* pString )
+{
+	if ( !pString )
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	unsigned nHash = Hash( pString );
+
+	HashTable_t *pTable = m_pTable;
+	ThreadMemoryBarrier();
+
+	UtlSymId_t id = FindInTable( pTable, pString, nHash );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	AUTO_LOCK( m_WriteLock );
+
+	// Another thread may have added it since the lookup above
+	pTable = m_pTable;
+	id = FindInTable( pTable, pString, nHash );
+	if ( id != UTL_INVAL_SYMBOL )
+		return CUtlSymbol( id );
+
+	if ( m_nStrings >= MAX_STRINGS )
+	{
+		AssertMsg( false, "CUtlConcurrentSymbolTable: out of symbols\n" );
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+	}
+
+	id = m_nStrings;
+
+	const char * volatile *pBlock = m_pStringBlocks[id / STRINGS_PER_BLOCK];
+	if ( !pBlock )
+	{
+		pBlock = (const char * volatile *)calloc( STRINGS_PER_BLOCK, sizeof( const char * ) );
+		m_pStringBlocks[id / STRINGS_PER_BLOCK] = pBlock;
+	}
+	pBlock[id % STRINGS_PER_BLOCK] = CopyString( pString );
+
+	// String() has to accept the id before any reader can find it in the table
+	ThreadMemoryBarrier();
+	m_nStrings = id + 1;
+
+	// Keep the table at most half full so probes stay short
+	if ( ( id + 1 ) * 2 > (int)( pTable->m_nMask + 1 ) )
+	{
+		HashTable_t *pNewTable = AllocTable( ( pTable->m_nMask + 1 ) * 2 );
+		for ( int i = 0; i < id; i++ )
+		{
+			const char *pSymbol = m_pStringBlocks[i / STRINGS_PER_BLOCK][i % STRINGS_PER_BLOCK];
+			InsertIntoTable( pNewTable, Hash( pSymbol ), i );
+		}
+		pNewTable->m_pRetired = pTable;
+
+		ThreadMemoryBarrier();
+		m_pTable = pNewTable;
+		pTable = pNewTable;
+	}
+
+	InsertIntoTable( pTable, nHash, id );
+
+	return CUtlSymbol( id );
+}
+
+const char* CUtlConcurrentSymbolTable::String( CUtlSymbol id ) const
+{
+	if ( !id.IsValid() || (UtlSymId_t)id >= m_nStrings )
+		return "";
+
+	ThreadMemoryBarrier();
+	return m_pStringBlocks[(UtlSymId_t)id / STRINGS_PER_BLOCK][(UtlSymId_t)id % STRINGS_PER_BLOCK];
+}
+
+void CUtlConcurrentSymbolTable::RemoveAll()
+{
+	AUTO_LOCK( m_WriteLock );
+
+	HashTable_t *pTable = m_pTable;
+	if ( pTable )
+	{
+		for ( HashTable_t *pRetired = pTable->m_pRetired; pRetired; )
+		{
+			HashTable_t *pNext = pRetired->m_pRetired;
+			free( pRetired );
+			pRetired = pNext;
+		}
+		pTable->m_pRetired = NULL;
+		memset( (void *)pTable->m_Slots, 0, ( pTable->m_nMask + 1 ) * sizeof( unsigned ) );
+	}
+
+	for ( int i = 0; i < MAX_STRING_BLOCKS; i++ )
+	{
+		free( (void *)m_pStringBlocks[i] );
+		m_pStringBlocks[i] = NULL;
+	}
+
+	while ( m_pPools )
+	{
+		StringPool_t *pNext = m_pPools->m_pNext;
+		free( m_pPools );
+		m_pPools = pNext;
+	}
+
+	m_nStrings = 0;
+}
+
+
 
 class CUtlFilenameSymbolTable::HashTable : public CUtlStableHashtable<CUtlConstString>
 {
@@ -12,6 +12,8 @@
 #include "tier1/utlbuffer.h"
 #include "tier1/utlmap.h"
 #include "tier1/utlstring.h"
+#include "tier1/utlhashtable.h"
+#include "tier0/fasttimer.h"
 
 #include "squirrel.h"
 #include "sqstdaux.h"
@@ -39,18 +41,19 @@
 
 #include <cstdarg>
 
+// Objects written more than once are written in full the first time and as
+// a marker after that. Markers are handed out in write order, so the reader
+// can keep them in a flat array as it goes.
 struct WriteStateMap
 {
-	CUtlMap<void*, int> cache;
-	WriteStateMap() : cache(DefLessFunc(void*))
-	{}
+	CUtlHashtable<void*, int> cache;
 
 	bool CheckCache(CUtlBuffer* pBuffer, void* ptr)
 	{
-		auto idx = cache.Find(ptr);
-		if (idx != cache.InvalidIndex())
+		UtlHashHandle_t h = cache.Find(ptr);
+		if (h != cache.InvalidHandle())
 		{
-			pBuffer->PutInt(cache[idx]);
+			pBuffer->PutInt(cache[h]);
 			return true;
 		}
 		else
@@ -65,14 +68,15 @@ struct WriteStateMap
 
 struct ReadStateMap
 {
-	CUtlMap<int, HSQOBJECT> cache;
+	// Block storage, callers hold on to entries while reading nested objects
+	CUtlBlockVector<HSQOBJECT> cache;
 	HSQUIRRELVM vm_;
-	ReadStateMap(HSQUIRRELVM vm) : cache(DefLessFunc(int)), vm_(vm)
+	ReadStateMap(HSQUIRRELVM vm) : cache(256), vm_(vm)
 	{}
 
 	~ReadStateMap()
 	{
-		FOR_EACH_MAP_FAST(cache, i)
+		FOR_EACH_VEC(cache, i)
 		{
 			HSQOBJECT& obj = cache[i];
 			sq_release(vm_, &obj);
@@ -83,23 +87,331 @@ struct ReadStateMap
 	{
 		int marker = pBuffer->GetInt();
 
-		auto idx = cache.Find(marker);
-		if (idx != cache.InvalidIndex())
+		if (marker >= 0 && marker < cache.Count())
 		{
-			*obj = &cache[idx];
+			*obj = &cache[marker];
 			return true;
 		}
 		else
 		{
-			HSQOBJECT temp;
-			sq_resetobject(&temp);
-			auto idx = cache.Insert(marker, temp);
-			*obj = &cache[idx];
+			Assert(marker == cache.Count());
+			HSQOBJECT* temp = &cache[cache.AddToTail()];
+			sq_resetobject(temp);
+			*obj = temp;
 			return false;
 		}
 	}
 };
 
+uint64 profileNodeKey(int parentNode, int function)
+{
+	return ((uint64)(uint32)(parentNode + 1) << 32) | (uint32)function;
+}
+
+struct ProfileNodeKeyHash
+{
+	unsigned int operator()(uint64 key) const
+	{
+		return Mix32HashFunctor()((uint32)key ^ ((uint32)(key >> 32) * 0x9E3779B1));
+	}
+};
+
+// Attributes VM time to script functions and native bindings. Script functions
+// are timed from the call and return debug hook events and natives from
+// function_stub, so script self time excludes the natives it calls. Time is
+// kept in CPU cycles and only converted when reported.
+//
+// Every call path is also kept as a tree for flame graph export. Threads
+// created before profiling started don't get the debug hook and are skipped.
+struct SquirrelProfiler
+{
+	struct Function_t
+	{
+		CUtlString name;
+		const void* nameKey;
+		const void* sourceKey;
+		int line;
+		bool native;
+		int64 calls;
+		uint64 selfCycles;
+		uint64 totalCycles; // Outermost activations only, recursion isn't counted twice
+		int64 entryCalls; // Calls made by the game itself: hooks, thinks, inputs, script files
+		uint64 entryCycles;
+		int active;
+	};
+
+	struct Node_t
+	{
+		int function;
+		int parent;
+		uint64 selfCycles;
+	};
+
+	struct Frame_t
+	{
+		HSQUIRRELVM vm;
+		SQInteger depth; // vm's call stack size, natives share their caller's
+		int function;
+		int node;
+		uint64 start;
+		uint64 childCycles;
+	};
+
+	bool enabled_ = false;
+	uint64 enabledAt_ = 0;
+	uint64 profiledCycles_ = 0;
+
+	CUtlVector<Function_t> functions_;
+	CUtlHashtable<const void*, int> functionIndex_; // SQFunctionProto or ScriptFunctionBinding_t
+	CUtlVector<Node_t> nodes_;
+	CUtlHashtable<uint64, int, ProfileNodeKeyHash> nodeIndex_;
+	CUtlVector<Frame_t> stack_;
+
+	void setEnabled(HSQUIRRELVM vm, SQDEBUGHOOK hook, bool enabled)
+	{
+		if (enabled == enabled_)
+			return;
+
+		if (enabled)
+		{
+			enabledAt_ = CCycleCount::GetTimestamp();
+		}
+		else
+		{
+			unwind(0);
+			profiledCycles_ += CCycleCount::GetTimestamp() - enabledAt_;
+		}
+
+		enabled_ = enabled;
+		sq_setnativedebughook(vm, enabled ? hook : nullptr);
+	}
+
+	void reset()
+	{
+		functions_.Purge();
+		functionIndex_.Purge();
+		nodes_.Purge();
+		nodeIndex_.Purge();
+		stack_.Purge();
+		profiledCycles_ = 0;
+		enabledAt_ = CCycleCount::GetTimestamp();
+	}
+
+	int findFunction(const void* key, const char* pszName, const char* pszClassName, const char* pszSource, int line, bool native)
+	{
+		UtlHashHandle_t h = functionIndex_.Find(key);
+		if (h != functionIndex_.InvalidHandle())
+		{
+			// A freed prototype's address can be reused by another function. Squirrel
+			// strings are interned, so the same prototype always passes the same pointers
+			const Function_t& function = functions_[functionIndex_[h]];
+			if (native || (function.nameKey == pszName && function.sourceKey == pszSource && function.line == line))
+				return functionIndex_[h];
+		}
+
+		int i = functions_.AddToTail();
+		Function_t& function = functions_[i];
+		function.nameKey = pszName;
+		function.sourceKey = pszSource;
+		function.line = line;
+		if (native)
+			function.name.Format("%s%s%s", pszClassName ? pszClassName : "", pszClassName ? "::" : "", pszName);
+		else
+			function.name.Format("%s (%s:%d)", pszName ? pszName : "<anonymous>", pszSource ? pszSource : "?", line);
+		function.native = native;
+		function.calls = function.entryCalls = 0;
+		function.selfCycles = function.totalCycles = function.entryCycles = 0;
+		function.active = 0;
+
+		if (h != functionIndex_.InvalidHandle())
+			functionIndex_[h] = i;
+		else
+			functionIndex_.Insert(key, i);
+		return i;
+	}
+
+	void enter(HSQUIRRELVM vm, int function)
+	{
+		int parent = stack_.Count() ? stack_.Tail().node : -1;
+
+		uint64 key = profileNodeKey(parent, function);
+		UtlHashHandle_t h = nodeIndex_.Find(key);
+		int node;
+		if (h != nodeIndex_.InvalidHandle())
+		{
+			node = nodeIndex_[h];
+		}
+		else
+		{
+			node = nodes_.AddToTail();
+			nodes_[node].function = function;
+			nodes_[node].parent = parent;
+			nodes_[node].selfCycles = 0;
+			nodeIndex_.Insert(key, node);
+		}
+
+		functions_[function].calls++;
+		functions_[function].active++;
+
+		Frame_t& frame = stack_[stack_.AddToTail()];
+		frame.vm = vm;
+		frame.depth = vm->_callsstacksize;
+		frame.function = function;
+		frame.node = node;
+		frame.childCycles = 0;
+		frame.start = CCycleCount::GetTimestamp();
+	}
+
+	void leave(HSQUIRRELVM vm)
+	{
+		// Frames of a suspended thread were already closed when the call into it returned.
+		// Returns from another depth have no matching call: a generator created by a tail
+		// call returns once per call in that frame every time it yields, but each resume
+		// only reports one call
+		if (!stack_.Count() || stack_.Tail().vm != vm || stack_.Tail().depth != vm->_callsstacksize)
+			return;
+
+		closeFrame(CCycleCount::GetTimestamp());
+	}
+
+	void closeFrame(uint64 now)
+	{
+		const Frame_t& frame = stack_.Tail();
+		uint64 elapsed = now - frame.start;
+		uint64 self = elapsed > frame.childCycles ? elapsed - frame.childCycles : 0;
+
+		Function_t& function = functions_[frame.function];
+		function.selfCycles += self;
+		if (--function.active == 0)
+			function.totalCycles += elapsed;
+
+		nodes_[frame.node].selfCycles += self;
+
+		if (stack_.Count() == 1)
+		{
+			function.entryCalls++;
+			function.entryCycles += elapsed;
+		}
+		else
+		{
+			stack_[stack_.Count() - 2].childCycles += elapsed;
+		}
+
+		stack_.RemoveMultipleFromTail(1);
+	}
+
+	// Closes frames left open by suspended threads once the call that ran them returns
+	void unwind(int depth)
+	{
+		if (stack_.Count() <= depth)
+			return;
+
+		uint64 now = CCycleCount::GetTimestamp();
+		while (stack_.Count() > depth)
+			closeFrame(now);
+	}
+
+	static double toMilliseconds(uint64 cycles)
+	{
+		return CCycleCount(cycles).GetMillisecondsF();
+	}
+
+	static int compareSelf(const Function_t* lhs, const Function_t* rhs)
+	{
+		if (lhs->selfCycles != rhs->selfCycles)
+			return lhs->selfCycles > rhs->selfCycles ? -1 : 1;
+		return 0;
+	}
+
+	static int compareEntry(const Function_t* lhs, const Function_t* rhs)
+	{
+		if (lhs->entryCycles != rhs->entryCycles)
+			return lhs->entryCycles > rhs->entryCycles ? -1 : 1;
+		return 0;
+	}
+
+	void dump(int maxEntries)
+	{
+		uint64 profiled = profiledCycles_;
+		if (enabled_)
+			profiled += CCycleCount::GetTimestamp() - enabledAt_;
+
+		CUtlVector<Function_t> sorted;
+		sorted.AddVectorToTail(functions_);
+
+		uint64 scriptCycles = 0, nativeCycles = 0;
+		FOR_EACH_VEC(sorted, i)
+		{
+			if (sorted[i].native)
+				nativeCycles += sorted[i].selfCycles;
+			else
+				scriptCycles += sorted[i].selfCycles;
+		}
+
+		Msg("VScript profile: %.2f ms profiled, %.2f ms in script, %.2f ms in natives, %d functions\n",
+			toMilliseconds(profiled), toMilliseconds(scriptCycles), toMilliseconds(nativeCycles), sorted.Count());
+
+		sorted.Sort(compareSelf);
+
+		Msg("\n%10s %10s %10s %10s  %s\n", "calls", "self ms", "total ms", "self us/c", "function");
+		for (int i = 0; i < sorted.Count() && i < maxEntries; ++i)
+		{
+			const Function_t& function = sorted[i];
+			Msg("%10lld %10.3f %10.3f %10.3f  %s%s\n", function.calls,
+				toMilliseconds(function.selfCycles), toMilliseconds(function.totalCycles),
+				function.calls ? toMilliseconds(function.selfCycles) * 1000.0 / function.calls : 0.0,
+				function.native ? "[native] " : "", function.name.Get());
+		}
+
+		sorted.Sort(compareEntry);
+
+		Msg("\nCalled by the game (hooks, thinks, inputs, script files):\n");
+		Msg("%10s %10s %10s  %s\n", "calls", "total ms", "us/call", "function");
+		for (int i = 0; i < sorted.Count() && i < maxEntries && sorted[i].entryCalls; ++i)
+		{
+			const Function_t& function = sorted[i];
+			Msg("%10lld %10.3f %10.3f  %s\n", function.entryCalls, toMilliseconds(function.entryCycles),
+				toMilliseconds(function.entryCycles) * 1000.0 / function.entryCalls, function.name.Get());
+		}
+	}
+
+	// One "outer;inner microseconds" line per call path, the collapsed stack format read by flame graph tools
+	void writeStacks(CUtlBuffer* pBuffer)
+	{
+		CUtlVector<int> path;
+		FOR_EACH_VEC(nodes_, i)
+		{
+			uint64 micros = CCycleCount(nodes_[i].selfCycles).GetUlMicroseconds();
+			if (!micros)
+				continue;
+
+			path.RemoveAll();
+			for (int node = i; node != -1; node = nodes_[node].parent)
+				path.AddToTail(nodes_[node].function);
+
+			for (int j = path.Count() - 1; j >= 0; --j)
+			{
+				const Function_t& function = functions_[path[j]];
+				if (function.native)
+					pBuffer->PutString("[native] ");
+				pBuffer->PutString(function.name.Get());
+				pBuffer->PutChar(j ? ';' : ' ');
+			}
+			pBuffer->Printf("%llu\n", micros);
+		}
+	}
+};
+
+// Serialized bytecode of a compiled function. Functions never change once
+// compiled, so this is kept between saves.
+struct SavedFunctionProto
+{
+	SQObjectPtr proto;
+	CUtlBuffer bytes;
+};
+
+struct SquirrelFunctionStub_t;
+
 class SquirrelVM : public IScriptVM
 {
 public:
@@ -213,6 +525,14 @@ public:
 
 	virtual void DumpState() override;
 
+	//----------------------------------------------------------------------------
+
+	virtual void SetProfilingEnabled(bool bEnabled) override;
+	virtual bool IsProfilingEnabled() override;
+	virtual void ResetProfile() override;
+	virtual void DumpProfile(int nMaxEntries) override;
+	virtual void WriteProfileStacks(CUtlBuffer* pBuffer) override;
+
 	virtual void SetOutputCallback(ScriptOutputFunc_t pFunc) override;
 	virtual void SetErrorCallback(ScriptErrorFunc_t pFunc) override;
 
@@ -223,10 +543,16 @@ public:
 
 	void WriteObject(CUtlBuffer* pBuffer, WriteStateMap& writeState, SQInteger idx);
 	void ReadObject(CUtlBuffer* pBuffer, ReadStateMap& readState);
+	void WriteFunctionProto(CUtlBuffer* pBuffer, SQFunctionProto* pProto);
+	void PurgeSavedProtos(bool bAll);
+	SquirrelFunctionStub_t* CreateFunctionStub(ScriptFunctionBinding_t* pFunc, const char* pszClassName = nullptr);
 	HSQUIRRELVM vm_ = nullptr;
 	HSQOBJECT lastError_;
 	HSQOBJECT vectorClass_;
 	HSQOBJECT regexpClass_;
+	CUtlVector<SquirrelFunctionStub_t*> functionStubs_;
+	SquirrelProfiler profiler_;
+	CUtlHashtable<void*, SavedFunctionProto*> savedProtos_;
 };
 
 SQUserPointer TYPETAG_VECTOR = "VectorTypeTag";
@@ -956,6 +1282,179 @@ bool getVariant(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& variant)
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Native calls
+//
+// Each bound function gets a stub when it's registered, holding a reader for
+// each of its parameter types and a pusher for its return type. Calls read
+// straight into a parameter array on the stack instead of switching on types
+// into a heap vector. Strings and vectors point into the VM's own objects
+// rather than being copied.
+//-----------------------------------------------------------------------------
+
+// vscript_templates.h generates bindings for up to 14 parameters
+#define SQ_STUB_MAX_PARAMS 14
+
+typedef bool (*SquirrelParamReader_t)(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param);
+typedef void (*SquirrelReturnPusher_t)(HSQUIRRELVM vm, ScriptVariant_t& retval);
+
+struct SquirrelFunctionStub_t
+{
+	ScriptFunctionBinding_t* pFunc;
+	const char* pszClassName; // For the profiler, nullptr for global functions
+	int nParams;
+	SquirrelParamReader_t readers[SQ_STUB_MAX_PARAMS];
+	const char* errors[SQ_STUB_MAX_PARAMS];
+	SquirrelReturnPusher_t pushReturn; // nullptr for void functions
+};
+
+bool readFloatParam(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param)
+{
+	SQFloat val = 0.0;
+	if (SQ_FAILED(sq_getfloat(vm, idx, &val)))
+		return false;
+	param = (float)val;
+	return true;
+}
+
+bool readStringParam(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param)
+{
+	// The string stays on the stack for the length of the call
+	const char* val;
+	if (SQ_FAILED(sq_getstring(vm, idx, &val)))
+		return false;
+	param = val;
+	return true;
+}
+
+bool readVectorParam(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param)
+{
+	Vector* val;
+	if (SQ_FAILED(sq_getinstanceup(vm, idx, (SQUserPointer*)&val, TYPETAG_VECTOR)))
+		return false;
+	param = *val;
+	return true;
+}
+
+bool readIntegerParam(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param)
+{
+	SQInteger val = 0;
+	if (SQ_FAILED(sq_getinteger(vm, idx, &val)))
+		return false;
+	param = (int)val;
+	return true;
+}
+
+bool readBoolParam(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param)
+{
+	SQBool val = 0;
+	if (SQ_FAILED(sq_getbool(vm, idx, &val)))
+		return false;
+	param = val ? true : false;
+	return true;
+}
+
+bool readCharParam(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param)
+{
+	const char* val;
+	if (SQ_FAILED(sq_getstring(vm, idx, &val)))
+		return false;
+	param = val[0];
+	return true;
+}
+
+bool readHandleParam(HSQUIRRELVM vm, SQInteger idx, ScriptVariant_t& param)
+{
+	HSQOBJECT val;
+	if (SQ_FAILED(sq_getstackobj(vm, idx, &val)))
+		return false;
+
+	if (sq_isnull(val))
+	{
+		param = (HSCRIPT)nullptr;
+	}
+	else
+	{
+		// Natives are free to hold on to handles, so these still get their own reference
+		HSQOBJECT* pObject = new HSQOBJECT;
+		*pObject = val;
+		sq_addref(vm, pObject);
+		param = (HSCRIPT)pObject;
+	}
+	return true;
+}
+
+void pushFloatReturn(HSQUIRRELVM vm, ScriptVariant_t& retval)
+{
+	sq_pushfloat(vm, retval.m_float);
+}
+
+void pushIntegerReturn(HSQUIRRELVM vm, ScriptVariant_t& retval)
+{
+	sq_pushinteger(vm, retval.m_int);
+}
+
+void pushBoolReturn(HSQUIRRELVM vm, ScriptVariant_t& retval)
+{
+	sq_pushbool(vm, retval.m_bool);
+}
+
+void pushVariantReturn(HSQUIRRELVM vm, ScriptVariant_t& retval)
+{
+	PushVariant(vm, retval);
+
+	// The bindings return vectors in a copy of their own
+	if (retval.m_type == FIELD_VECTOR)
+	{
+		delete retval.m_pVector;
+	}
+}
+
+SquirrelFunctionStub_t* SquirrelVM::CreateFunctionStub(ScriptFunctionBinding_t* pFunc, const char* pszClassName)
+{
+	int nParams = pFunc->m_desc.m_Parameters.Count();
+	if (nParams > SQ_STUB_MAX_PARAMS)
+	{
+		Warning("Too many parameters for %s\n", pFunc->m_desc.m_pszScriptName);
+		return nullptr;
+	}
+
+	SquirrelFunctionStub_t* pStub = new SquirrelFunctionStub_t;
+	pStub->pFunc = pFunc;
+	pStub->pszClassName = pszClassName;
+	pStub->nParams = nParams;
+
+	for (int i = 0; i < nParams; ++i)
+	{
+		switch (pFunc->m_desc.m_Parameters[i])
+		{
+		case FIELD_FLOAT:		pStub->readers[i] = readFloatParam;		pStub->errors[i] = "Expected float";	break;
+		case FIELD_CSTRING:		pStub->readers[i] = readStringParam;	pStub->errors[i] = "Expected string";	break;
+		case FIELD_VECTOR:		pStub->readers[i] = readVectorParam;	pStub->errors[i] = "Expected Vector";	break;
+		case FIELD_INTEGER:		pStub->readers[i] = readIntegerParam;	pStub->errors[i] = "Expected integer";	break;
+		case FIELD_BOOLEAN:		pStub->readers[i] = readBoolParam;		pStub->errors[i] = "Expected bool";		break;
+		case FIELD_CHARACTER:	pStub->readers[i] = readCharParam;		pStub->errors[i] = "Expected string";	break;
+		case FIELD_HSCRIPT:		pStub->readers[i] = readHandleParam;	pStub->errors[i] = "Expected handle";	break;
+		default:
+			Assert(!"Unsupported type");
+			delete pStub;
+			return nullptr;
+		}
+	}
+
+	switch (pFunc->m_desc.m_ReturnType)
+	{
+	case FIELD_VOID:	pStub->pushReturn = nullptr;				break;
+	case FIELD_FLOAT:	pStub->pushReturn = pushFloatReturn;		break;
+	case FIELD_INTEGER:	pStub->pushReturn = pushIntegerReturn;	break;
+	case FIELD_BOOLEAN:	pStub->pushReturn = pushBoolReturn;		break;
+	default:			pStub->pushReturn = pushVariantReturn;	break;
+	}
+
+	functionStubs_.AddToTail(pStub);
+	return pStub;
+}
+
 SQInteger function_stub(HSQUIRRELVM vm)
 {
 	SQInteger top = sq_gettop(vm);
@@ -965,9 +1464,10 @@ SQInteger function_stub(HSQUIRRELVM vm)
 
 	Assert(userptr);
 
-	ScriptFunctionBinding_t* pFunc = (ScriptFunctionBinding_t*)userptr;
+	SquirrelFunctionStub_t* pStub = (SquirrelFunctionStub_t*)userptr;
+	ScriptFunctionBinding_t* pFunc = pStub->pFunc;
 
-	auto nargs = pFunc->m_desc.m_Parameters.Count();
+	int nargs = pStub->nParams;
 
 	if (nargs > top)
 	{
@@ -975,84 +1475,12 @@ SQInteger function_stub(HSQUIRRELVM vm)
 		return sq_throwerror(vm, "Invalid number of parameters");
 	}
 
-	CUtlVector<ScriptVariant_t> params;
-	params.SetCount(nargs);
+	ScriptVariant_t params[SQ_STUB_MAX_PARAMS];
 
 	for (int i = 0; i < nargs; ++i)
 	{
-		switch (pFunc->m_desc.m_Parameters[i])
-		{
-		case FIELD_FLOAT:
-		{
-			float val = 0.0;
-			if (SQ_FAILED(sq_getfloat(vm, i + 2, &val)))
-				return sq_throwerror(vm, "Expected float");
-			params[i] = val;
-			break;
-		}
-		case FIELD_CSTRING:
-		{
-			const char* val;
-			if (SQ_FAILED(sq_getstring(vm, i + 2, &val)))
-				return sq_throwerror(vm, "Expected string");
-			params[i] = val;
-			break;
-		}
-		case FIELD_VECTOR:
-		{
-			Vector* val;
-			if (SQ_FAILED(sq_getinstanceup(vm, i + 2, (SQUserPointer*)&val, TYPETAG_VECTOR)))
-				return sq_throwerror(vm, "Expected Vector");
-			params[i] = *val;
-			break;
-		}
-		case FIELD_INTEGER:
-		{
-			SQInteger val = 0;
-			if (SQ_FAILED(sq_getinteger(vm, i + 2, &val)))
-				return sq_throwerror(vm, "Expected integer");
-			params[i] = (int)val;
-			break;
-		}
-		case FIELD_BOOLEAN:
-		{
-			SQBool val = 0;
-			if (SQ_FAILED(sq_getbool(vm, i + 2, &val)))
-				return sq_throwerror(vm, "Expected bool");
-			params[i] = val ? true : false;
-			break;
-		}
-		case FIELD_CHARACTER:
-		{
-			const char* val;
-			if (SQ_FAILED(sq_getstring(vm, i + 2, &val)))
-				return sq_throwerror(vm, "Expected string");
-			params[i] = val[i];
-			break;
-		}
-		case FIELD_HSCRIPT:
-		{
-			HSQOBJECT val;
-			if (SQ_FAILED(sq_getstackobj(vm, i + 2, &val)))
-				return sq_throwerror(vm, "Expected handle");
-
-			if (sq_isnull(val))
-			{
-				params[i] = (HSCRIPT)nullptr;
-			}
-			else
-			{
-				HSQOBJECT* pObject = new HSQOBJECT;
-				*pObject = val;
-				sq_addref(vm, pObject);
-				params[i] = (HSCRIPT)pObject;
-			}
-			break;
-		}
-		default:
-			Assert(!"Unsupported type");
-			return false;
-		}
+		if (!pStub->readers[i](vm, i + 2, params[i]))
+			return sq_throwerror(vm, pStub->errors[i]);
 	}
 
 	void* instance = nullptr;
@@ -1077,19 +1505,35 @@ SQInteger function_stub(HSQUIRRELVM vm)
 
 	sq_resetobject(&pSquirrelVM->lastError_);
 
-	(*pFunc->m_pfnBinding)(pFunc->m_pFunction, instance, params.Base(), nargs,
-		pFunc->m_desc.m_ReturnType == FIELD_VOID ? nullptr : &retval);
+	SquirrelProfiler& profiler = pSquirrelVM->profiler_;
+	if (profiler.enabled_)
+	{
+		profiler.enter(vm, profiler.findFunction(pFunc, pFunc->m_desc.m_pszScriptName, pStub->pszClassName, nullptr, 0, true));
+	}
+
+	(*pFunc->m_pfnBinding)(pFunc->m_pFunction, instance, params, nargs,
+		pStub->pushReturn ? &retval : nullptr);
+
+	if (profiler.enabled_)
+	{
+		profiler.leave(vm);
+	}
 
 	if (!sq_isnull(pSquirrelVM->lastError_))
 	{
+		if (retval.m_type == FIELD_VECTOR)
+			delete retval.m_pVector;
+
 		sq_pushobject(vm, pSquirrelVM->lastError_);
 		sq_resetobject(&pSquirrelVM->lastError_);
 		return sq_throwobject(vm);
 	}
 
-	PushVariant(vm, retval);
+	if (!pStub->pushReturn)
+		return 0;
 
-	return pFunc->m_desc.m_ReturnType != FIELD_VOID;
+	pStub->pushReturn(vm, retval);
+	return 1;
 }
 
 
@@ -1709,12 +2153,17 @@ void SquirrelVM::Shutdown()
 {
 	if (vm_)
 	{
+		profiler_.setEnabled(vm_, nullptr, false);
+		PurgeSavedProtos(true);
+
 		sq_release(vm_, &vectorClass_);
 		sq_release(vm_, &regexpClass_);
 
 		sq_close(vm_);
 		vm_ = nullptr;
 	}
+
+	functionStubs_.PurgeAndDeleteElements();
 }
 
 bool SquirrelVM::ConnectDebugger()
@@ -1758,7 +2207,11 @@ ScriptStatus_t SquirrelVM::Run(const char* pszScript, bool bWait)
 	}
 
 	sq_pushroottable(vm_);
-	if (SQ_FAILED(sq_call(vm_, 1, SQFalse, SQTrue)))
+	int profileDepth = profiler_.stack_.Count();
+	SQRESULT result = sq_call(vm_, 1, SQFalse, SQTrue);
+	profiler_.unwind(profileDepth);
+
+	if (SQ_FAILED(result))
 	{
 		sq_pop(vm_, 1);
 		return SCRIPT_ERROR;
@@ -1813,7 +2266,9 @@ ScriptStatus_t SquirrelVM::Run(HSCRIPT hScript, HSCRIPT hScope, bool bWait)
 		sq_pushroottable(vm_);
 	}
 
+	int profileDepth = profiler_.stack_.Count();
 	auto result = sq_call(vm_, 1, false, true);
+	profiler_.unwind(profileDepth);
 	sq_pop(vm_, 1);
 	if (SQ_FAILED(result))
 	{
@@ -1828,7 +2283,9 @@ ScriptStatus_t SquirrelVM::Run(HSCRIPT hScript, bool bWait)
 	HSQOBJECT* obj = (HSQOBJECT*)hScript;
 	sq_pushobject(vm_, *obj);
 	sq_pushroottable(vm_);
+	int profileDepth = profiler_.stack_.Count();
 	auto result = sq_call(vm_, 1, false, true);
+	profiler_.unwind(profileDepth);
 	sq_pop(vm_, 1);
 	if (SQ_FAILED(result))
 	{
@@ -1971,7 +2428,11 @@ ScriptStatus_t SquirrelVM::ExecuteFunction(HSCRIPT hFunction, ScriptVariant_t* p
 
 	bool hasReturn = pReturn != nullptr;
 
-	if (SQ_FAILED(sq_call(vm_, nArgs + 1, hasReturn, SQTrue)))
+	int profileDepth = profiler_.stack_.Count();
+	SQRESULT result = sq_call(vm_, nArgs + 1, hasReturn, SQTrue);
+	profiler_.unwind(profileDepth);
+
+	if (SQ_FAILED(result))
 	{
 		sq_pop(vm_, 1);
 		return SCRIPT_ERROR;
@@ -2006,11 +2467,17 @@ void SquirrelVM::RegisterFunction(ScriptFunctionBinding_t* pScriptFunction)
 		return;
 	}
 
+	SquirrelFunctionStub_t* pStub = CreateFunctionStub(pScriptFunction);
+	if (!pStub)
+	{
+		return;
+	}
+
 	sq_pushroottable(vm_);
 
 	sq_pushstring(vm_, pScriptFunction->m_desc.m_pszScriptName, -1);
 
-	sq_pushuserpointer(vm_, pScriptFunction);
+	sq_pushuserpointer(vm_, pStub);
 	sq_newclosure(vm_, function_stub, 1);
 
 	sq_setnativeclosurename(vm_, -1, pScriptFunction->m_desc.m_pszScriptName);
@@ -2119,9 +2586,17 @@ bool SquirrelVM::RegisterClass(ScriptClassDesc_t* pClassDesc)
 			break;
 		}
 
+		SquirrelFunctionStub_t* pStub = CreateFunctionStub(&scriptFunction, pClassDesc->m_pszScriptName);
+		if (!pStub)
+		{
+			Warning("Unable to create call stub for %s.%s\n",
+				pClassDesc->m_pszClassname, scriptFunction.m_desc.m_pszFunction);
+			break;
+		}
+
 		sq_pushstring(vm_, scriptFunction.m_desc.m_pszScriptName, -1);
 
-		sq_pushuserpointer(vm_, &scriptFunction);
+		sq_pushuserpointer(vm_, pStub);
 		sq_newclosure(vm_, function_stub, 1);
 
 		sq_setnativeclosurename(vm_, -1, scriptFunction.m_desc.m_pszScriptName);
@@ -2642,6 +3117,43 @@ SQInteger closure_write(SQUserPointer file, SQUserPointer p, SQInteger size)
 	return size;
 }
 
+void SquirrelVM::WriteFunctionProto(CUtlBuffer* pBuffer, SQFunctionProto* pProto)
+{
+	UtlHashHandle_t h = savedProtos_.Find(pProto);
+	if (h == savedProtos_.InvalidHandle())
+	{
+		SavedFunctionProto* pSaved = new SavedFunctionProto;
+		pSaved->proto = pProto;
+		if (!pProto->Save(vm_, &pSaved->bytes, closure_write))
+		{
+			Error("Failed to write closure\n");
+		}
+		h = savedProtos_.Insert(pProto, pSaved);
+	}
+
+	const CUtlBuffer& bytes = savedProtos_[h]->bytes;
+	pBuffer->Put(bytes.Base(), bytes.TellPut());
+}
+
+void SquirrelVM::PurgeSavedProtos(bool bAll)
+{
+	UtlHashHandle_t h = savedProtos_.FirstHandle();
+	while (h != savedProtos_.InvalidHandle())
+	{
+		// Our reference is the only one left once nothing can call the function
+		SavedFunctionProto* pSaved = savedProtos_[h];
+		if (bAll || _funcproto(pSaved->proto)->_uiRef <= 1)
+		{
+			delete pSaved;
+			h = savedProtos_.RemoveAndAdvance(h);
+		}
+		else
+		{
+			h = savedProtos_.NextHandle(h);
+		}
+	}
+}
+
 void SquirrelVM::WriteObject(CUtlBuffer* pBuffer, WriteStateMap& writeState, SQInteger idx)
 {
 	SquirrelSafeCheck safeCheck(vm_);
@@ -2678,6 +3190,11 @@ void SquirrelVM::WriteObject(CUtlBuffer* pBuffer, WriteStateMap& writeState, SQI
 	case OT_STRING:
 	{
 		pBuffer->PutInt(OT_STRING);
+		// Strings are interned, repeated table keys and values are only written once
+		if (writeState.CheckCache(pBuffer, obj._unVal.pString))
+		{
+			break;
+		}
 		const char* val = nullptr;
 		SQInteger size = 0;
 		sq_getstringandsize(vm_, idx, &val, &size);
@@ -2739,46 +3256,27 @@ void SquirrelVM::WriteObject(CUtlBuffer* pBuffer, WriteStateMap& writeState, SQI
 			break;
 		}
 
-		SQInteger nparams = 0, nfreevars = 0;
-		sq_getclosureinfo(vm_, idx, &nparams, &nfreevars);
-		if (nfreevars == 0 && _closure(obj)->_function->_defaultparams == 0)
+		// Closures made from the same function share its prototype
+		SQFunctionProto* pProto = _closure(obj)->_function;
+		if (!writeState.CheckCache(pBuffer, pProto))
 		{
-			pBuffer->PutChar(0);
-
-			sq_push(vm_, idx);
-			if (SQ_FAILED(sq_writeclosure(vm_, closure_write, pBuffer)))
-			{
-				Error("Failed to write closure");
-			}
-			sq_pop(vm_, 1);
+			WriteFunctionProto(pBuffer, pProto);
 		}
-		else
-		{
-			// Unfortunately we can't use sq_writeclosure because it doesn't work well with
-			// outer variables
 
-			pBuffer->PutChar(1);
-
-			if (!_closure(obj)->Save(vm_, pBuffer, closure_write))
-			{
-				Error("Failed to write closure\n");
-			}
-
-			int noutervalues = _closure(obj)->_function->_noutervalues;
-			for (int i = 0; i < noutervalues; ++i)
-			{
-				sq_pushobject(vm_, _closure(obj)->_outervalues[i]);
-				WriteObject(pBuffer, writeState, -1);
-				sq_poptop(vm_);
-			}
+		int noutervalues = pProto->_noutervalues;
+		for (int i = 0; i < noutervalues; ++i)
+		{
+			sq_pushobject(vm_, _closure(obj)->_outervalues[i]);
+			WriteObject(pBuffer, writeState, -1);
+			sq_poptop(vm_);
+		}
 
-			int ndefaultparams = _closure(obj)->_function->_ndefaultparams;
-			for (int i = 0; i < ndefaultparams; ++i)
-			{
-				sq_pushobject(vm_, _closure(obj)->_defaultparams[i]);
-				WriteObject(pBuffer, writeState, -1);
-				sq_poptop(vm_);
-			}
+		int ndefaultparams = pProto->_ndefaultparams;
+		for (int i = 0; i < ndefaultparams; ++i)
+		{
+			sq_pushobject(vm_, _closure(obj)->_defaultparams[i]);
+			WriteObject(pBuffer, writeState, -1);
+			sq_poptop(vm_);
 		}
 
 		if (_closure(obj)->_env)
@@ -2981,7 +3479,7 @@ void SquirrelVM::WriteObject(CUtlBuffer* pBuffer, WriteStateMap& writeState, SQI
 			break;
 		}
 
-		_funcproto(obj)->Save(vm_, pBuffer, closure_write);
+		WriteFunctionProto(pBuffer, _funcproto(obj));
 	}
 	case OT_OUTER: //internal usage only
 	{
@@ -3014,6 +3512,8 @@ void SquirrelVM::WriteState(CUtlBuffer* pBuffer)
 {
 	SquirrelSafeCheck safeCheck(vm_);
 
+	PurgeSavedProtos(false);
+
 	WriteStateMap writeState;
 
 	sq_pushroottable(vm_);
@@ -3075,12 +3575,27 @@ void SquirrelVM::ReadObject(CUtlBuffer* pBuffer, ReadStateMap& readState)
 	}
 	case OT_STRING:
 	{
+		HSQOBJECT* obj = nullptr;
+		if (readState.CheckCache(pBuffer, &obj))
+		{
+			sq_pushobject(vm_, *obj);
+			break;
+		}
+
+		// Read straight out of the save buffer
 		int size = pBuffer->GetInt();
-		char* buffer = new char[size + 1];
-		pBuffer->Get(buffer, size);
-		buffer[size] = 0;
-		sq_pushstring(vm_, buffer, size);
-		delete[] buffer;
+		const char* val = (size >= 0) ? (const char*)pBuffer->PeekGet(size, 0) : nullptr;
+		if (!val)
+		{
+			Error("SquirrelVM::ReadObject: Truncated string\n");
+			sq_pushnull(vm_);
+			break;
+		}
+		sq_pushstring(vm_, val, size);
+		pBuffer->SeekGet(CUtlBuffer::SEEK_CURRENT, size);
+
+		sq_getstackobj(vm_, -1, obj);
+		sq_addref(vm_, obj);
 		break;
 	}
 	case OT_TABLE:
@@ -3144,54 +3659,56 @@ void SquirrelVM::ReadObject(CUtlBuffer* pBuffer, ReadStateMap& readState)
 			break;
 		}
 
-		if (pBuffer->GetChar() == 0)
+		HSQOBJECT* proto = nullptr;
+		if (!readState.CheckCache(pBuffer, &proto))
 		{
-			if (SQ_FAILED(sq_readclosure(vm_, closure_read, pBuffer)))
+			SQObjectPtr func;
+			if (!SQFunctionProto::Load(vm_, pBuffer, closure_read, func))
 			{
 				Error("Failed to read closure\n");
 				sq_pushnull(vm_);
 				break;
 			}
-			sq_getstackobj(vm_, -1, obj);
-			sq_addref(vm_, obj);
+
+			*proto = func;
+			sq_addref(vm_, proto);
 		}
-		else
+
+		if (sq_type(*proto) != OT_FUNCPROTO)
 		{
-			SQObjectPtr ret;
-			if (!SQClosure::Load(vm_, pBuffer, closure_read, ret))
-			{
-				Error("Failed to read closure\n");
-				sq_pushnull(vm_);
-				break;
-			}
+			Error("Failed to read closure\n");
+			sq_pushnull(vm_);
+			break;
+		}
 
-			int noutervalues = _closure(ret)->_function->_noutervalues;
-			for (int i = 0; i < noutervalues; ++i)
-			{
-				ReadObject(pBuffer, readState);
-				HSQOBJECT obj;
-				sq_resetobject(&obj);
-				sq_getstackobj(vm_, -1, &obj);
-				_closure(ret)->_outervalues[i] = obj;
-				sq_poptop(vm_);
-			}
+		SQObjectPtr ret = SQClosure::Create(_ss(vm_), _funcproto(*proto), _table(vm_->_roottable)->GetWeakRef(OT_TABLE));
 
-			int ndefaultparams = _closure(ret)->_function->_ndefaultparams;
-			for (int i = 0; i < ndefaultparams; ++i)
-			{
-				ReadObject(pBuffer, readState);
-				HSQOBJECT obj;
-				sq_resetobject(&obj);
-				sq_getstackobj(vm_, -1, &obj);
-				_closure(ret)->_defaultparams[i] = obj;
-				sq_poptop(vm_);
-			}
+		int noutervalues = _closure(ret)->_function->_noutervalues;
+		for (int i = 0; i < noutervalues; ++i)
+		{
+			ReadObject(pBuffer, readState);
+			HSQOBJECT obj;
+			sq_resetobject(&obj);
+			sq_getstackobj(vm_, -1, &obj);
+			_closure(ret)->_outervalues[i] = obj;
+			sq_poptop(vm_);
+		}
 
-			*obj = ret;
-			sq_addref(vm_, obj);
-			sq_pushobject(vm_, *obj);
+		int ndefaultparams = _closure(ret)->_function->_ndefaultparams;
+		for (int i = 0; i < ndefaultparams; ++i)
+		{
+			ReadObject(pBuffer, readState);
+			HSQOBJECT obj;
+			sq_resetobject(&obj);
+			sq_getstackobj(vm_, -1, &obj);
+			_closure(ret)->_defaultparams[i] = obj;
+			sq_poptop(vm_);
 		}
 
+		*obj = ret;
+		sq_addref(vm_, obj);
+		sq_pushobject(vm_, *obj);
+
 		ReadObject(pBuffer, readState);
 		HSQOBJECT env;
 		sq_resetobject(&env);
@@ -3527,6 +4044,54 @@ void SquirrelVM::DumpState()
 	// TODO: Dump state
 }
 
+void profilerHook(HSQUIRRELVM vm, SQInteger type, const SQChar* src, SQInteger line, const SQChar* funcname)
+{
+	SquirrelVM* pSquirrelVM = (SquirrelVM*)sq_getforeignptr(vm);
+	if (!pSquirrelVM || !pSquirrelVM->profiler_.enabled_)
+		return;
+
+	SquirrelProfiler& profiler = pSquirrelVM->profiler_;
+	if (type == 'c')
+	{
+		// Keyed by prototype so closures of the same function share an entry, the
+		// line reported on call is the function's first
+		SQFunctionProto* pProto = _closure(vm->ci->_closure)->_function;
+		profiler.enter(vm, profiler.findFunction(pProto, funcname, nullptr, src, line, false));
+	}
+	else if (type == 'r')
+	{
+		profiler.leave(vm);
+	}
+}
+
+void SquirrelVM::SetProfilingEnabled(bool bEnabled)
+{
+	if (!vm_)
+		return;
+
+	profiler_.setEnabled(vm_, profilerHook, bEnabled);
+}
+
+bool SquirrelVM::IsProfilingEnabled()
+{
+	return profiler_.enabled_;
+}
+
+void SquirrelVM::ResetProfile()
+{
+	profiler_.reset();
+}
+
+void SquirrelVM::DumpProfile(int nMaxEntries)
+{
+	profiler_.dump(nMaxEntries);
+}
+
+void SquirrelVM::WriteProfileStacks(CUtlBuffer* pBuffer)
+{
+	profiler_.writeStacks(pBuffer);
+}
+
 void SquirrelVM::SetOutputCallback(ScriptOutputFunc_t pFunc)
 {
 	SquirrelSafeCheck safeCheck(vm_);